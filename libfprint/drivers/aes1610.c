@@ -576,11 +576,12 @@ capture_read_strip_cb (FpiUsbTransfer *transfer, FpDevice *device,
   if (sum > 0)
     {
       /* FIXME: would preallocating strip buffers be a decent optimization? */
-      struct fpi_frame *stripe = g_malloc (FRAME_WIDTH * (FRAME_HEIGHT / 2) + sizeof (struct fpi_frame));
+      struct fpi_frame *stripe = g_malloc (FRAME_SIZE + sizeof (struct fpi_frame));
       stripe->delta_x = 0;
       stripe->delta_y = 0;
       stripdata = stripe->data;
-      memcpy (stripdata, data + 1, FRAME_WIDTH * (FRAME_HEIGHT / 2));
+      fpi_unpack_4bpp_transposed (data + 1, FRAME_WIDTH, FRAME_HEIGHT, stripdata,
+                                  FPI_UNPACK_4BPP_NONE);
       self->strips = g_slist_prepend (self->strips, stripe);
       self->strips_len++;
       self->blanks_count = 0;
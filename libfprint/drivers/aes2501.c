@@ -297,7 +297,7 @@ finger_det_reqs_cb (FpImageDevice *dev, GError *error,
 
   transfer = fpi_usb_transfer_new (FP_DEVICE (dev));
   transfer->short_is_error = TRUE;
-  fpi_usb_transfer_fill_bulk (transfer, EP_IN, FINGER_DETECTION_LEN);
+  fpi_usb_transfer_fill_bulk_pooled (transfer, EP_IN, FINGER_DETECTION_LEN);
   fpi_usb_transfer_submit (transfer, BULK_TIMEOUT, NULL,
                            finger_det_data_cb, NULL);
 }
@@ -476,11 +476,12 @@ capture_read_strip_cb (FpiUsbTransfer *transfer, FpDevice *_dev,
     {
       /* obtain next strip */
       /* FIXME: would preallocating strip buffers be a decent optimization? */
-      struct fpi_frame *stripe = g_malloc (FRAME_WIDTH * FRAME_HEIGHT / 2 + sizeof (struct fpi_frame));
+      struct fpi_frame *stripe = g_malloc (FRAME_SIZE + sizeof (struct fpi_frame));
       stripe->delta_x = 0;
       stripe->delta_y = 0;
       stripdata = stripe->data;
-      memcpy (stripdata, data + 1, 192 * 8);
+      fpi_unpack_4bpp_transposed (data + 1, FRAME_WIDTH, FRAME_HEIGHT, stripdata,
+                                  FPI_UNPACK_4BPP_NONE);
       self->no_finger_cnt = 0;
       self->strips = g_slist_prepend (self->strips, stripe);
       self->strips_len++;
@@ -529,7 +530,7 @@ capture_run_state (FpiSsm *ssm, FpDevice *device)
         transfer = fpi_usb_transfer_new (device);
         transfer->ssm = ssm;
         transfer->short_is_error = TRUE;
-        fpi_usb_transfer_fill_bulk (transfer, EP_IN, STRIP_CAPTURE_LEN);
+        fpi_usb_transfer_fill_bulk_pooled (transfer, EP_IN, STRIP_CAPTURE_LEN);
         fpi_usb_transfer_submit (transfer, BULK_TIMEOUT, NULL,
                                  capture_read_strip_cb, NULL);
         break;
@@ -203,11 +203,13 @@ process_strip_data (FpiSsm *ssm, FpImageDevice *dev,
   len = data[1] * 256 + data[2];
   if (len != (AES2550_STRIP_SIZE - 3))
     fp_dbg ("Bogus frame len: %.4x", len);
-  stripe = g_malloc0 (FRAME_WIDTH * FRAME_HEIGHT / 2 + sizeof (struct fpi_frame));     /* 4 bits per pixel */
+  stripe = g_malloc (FRAME_SIZE + sizeof (struct fpi_frame));
   stripe->delta_x = (int8_t) data[6];
   stripe->delta_y = -(int8_t) data[7];
   stripdata = stripe->data;
-  memcpy (stripdata, data + 33, FRAME_WIDTH * FRAME_HEIGHT / 2);
+  /* 4 bits per pixel */
+  fpi_unpack_4bpp_transposed (data + 33, FRAME_WIDTH, FRAME_HEIGHT, stripdata,
+                              FPI_UNPACK_4BPP_NONE);
   self->strips = g_slist_prepend (self->strips, stripe);
   self->strips_len++;
 
@@ -56,23 +56,6 @@ static void do_capture (FpImageDevice *dev);
 
 G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE (FpiDeviceAes3k, fpi_device_aes3k, FP_TYPE_IMAGE_DEVICE);
 
-static void
-aes3k_assemble_image (unsigned char *input, size_t width, size_t height,
-                      unsigned char *output)
-{
-  size_t row, column;
-
-  for (column = 0; column < width; column++)
-    {
-      for (row = 0; row < height; row += 2)
-        {
-          output[width * row + column] = (*input & 0x0f) * 17;
-          output[width * (row + 1) + column] = ((*input & 0xf0) >> 4) * 17;
-          input++;
-        }
-    }
-}
-
 static void
 img_cb (FpiUsbTransfer *transfer, FpDevice *device,
         gpointer user_data, GError *error)
@@ -115,12 +98,16 @@ img_cb (FpiUsbTransfer *transfer, FpDevice *device,
     {
       fp_dbg ("frame header byte %02x", *ptr);
       ptr++;
-      aes3k_assemble_image (ptr, cls->frame_width, AES3K_FRAME_HEIGHT, tmp->data + (i * cls->frame_width * AES3K_FRAME_HEIGHT));
+      fpi_unpack_4bpp_transposed (ptr, cls->frame_width, AES3K_FRAME_HEIGHT,
+                                  tmp->data + (i * cls->frame_width * AES3K_FRAME_HEIGHT),
+                                  FPI_UNPACK_4BPP_NONE);
       ptr += cls->frame_size;
     }
 
-  /* FIXME: this is an ugly hack to make the image big enough for NBIS
-   * to process reliably */
+  /* NBIS is tuned for 500dpi images and finds far fewer minutiae at the
+   * native resolution of these sensors, even with scaled parameters.
+   * Enlarging also keeps the minutiae of new prints compatible with
+   * existing enrollments. */
   img = fpi_image_resize (tmp, cls->enlarge_factor, cls->enlarge_factor);
   g_object_unref (tmp);
   fpi_image_device_image_captured (dev, img);
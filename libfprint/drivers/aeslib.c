@@ -159,11 +159,5 @@ aes_get_pixel (struct fpi_frame_asmbl_ctx *ctx,
                unsigned int                x,
                unsigned int                y)
 {
-  unsigned char ret;
-
-  ret = frame->data[x * (ctx->frame_height >> 1) + (y >> 1)];
-  ret = y % 2 ? ret >> 4 : ret & 0xf;
-  ret *= 17;
-
-  return ret;
+  return frame->data[y * ctx->frame_width + x];
 }
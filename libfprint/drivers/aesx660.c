@@ -96,7 +96,7 @@ aesX660_read_response (FpiSsm                *ssm,
   if (cancellable)
     cancel = fpi_device_get_cancellable (_dev);
 
-  fpi_usb_transfer_fill_bulk (transfer, EP_IN, buf_len);
+  fpi_usb_transfer_fill_bulk_pooled (transfer, EP_IN, buf_len);
   transfer->ssm = ssm;
   transfer->short_is_error = short_is_error;
   fpi_usb_transfer_submit (transfer, BULK_TIMEOUT, cancel, callback, NULL);
@@ -294,7 +294,7 @@ process_stripe_data (FpiSsm *ssm, FpiDeviceAesX660 *self,
       return 0;
     }
 
-  stripe = g_malloc (cls->assembling_ctx->frame_width * FRAME_HEIGHT / 2 + sizeof (struct fpi_frame));     /* 4 bpp */
+  stripe = g_malloc (cls->assembling_ctx->frame_width * FRAME_HEIGHT + sizeof (struct fpi_frame));
   stripdata = stripe->data;
 
   fp_dbg ("Processing frame %.2x %.2x", data[AESX660_IMAGE_OK_OFFSET],
@@ -306,7 +306,10 @@ process_stripe_data (FpiSsm *ssm, FpiDeviceAesX660 *self,
 
   if (data[AESX660_IMAGE_OK_OFFSET] == AESX660_IMAGE_OK)
     {
-      memcpy (stripdata, data + AESX660_IMAGE_OFFSET, cls->assembling_ctx->frame_width * FRAME_HEIGHT / 2);
+      /* 4 bpp */
+      fpi_unpack_4bpp_transposed (data + AESX660_IMAGE_OFFSET,
+                                  cls->assembling_ctx->frame_width, FRAME_HEIGHT,
+                                  stripdata, FPI_UNPACK_4BPP_NONE);
 
       priv->strips = g_slist_prepend (priv->strips, stripe);
       priv->strips_len++;
@@ -107,17 +107,12 @@ postprocess_frames (FpDeviceEgis0570 *self, guint8 * img)
     {
       guint8 * frame = &img[(k * EGIS0570_IMGSIZE) + EGIS0570_RFMDIS * EGIS0570_IMGWIDTH];
 
-      for (size_t i = 0; i < EGIS0570_IMGWIDTH * EGIS0570_RFMGHEIGHT; i += 1)
-        {
-          if (frame[i] - EGIS0570_MARGIN  > self->background[i])
-            frame[i] -= self->background[i];
-          else
-            frame[i] = 0;
+      guint64 sum;
 
-          mean[k] += frame[i];
-        }
+      fpi_frame_subtract_background_u8 (frame, self->background, EGIS0570_MARGIN,
+                                        EGIS0570_IMGWIDTH * EGIS0570_RFMGHEIGHT, &sum);
 
-      mean[k] /= EGIS0570_IMGWIDTH * EGIS0570_RFMGHEIGHT;
+      mean[k] = sum / (EGIS0570_IMGWIDTH * EGIS0570_RFMGHEIGHT);
     }
 
   char result = 0;
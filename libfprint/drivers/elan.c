@@ -63,8 +63,9 @@ struct _FpiDeviceElan
   /* device config */
   unsigned short dev_type;
   unsigned short fw_ver;
-  void           (*process_frame) (unsigned short *raw_frame,
-                                   GSList       ** frames);
+  void           (*process_frame) (FpiDeviceElan  *self,
+                                   unsigned short *raw_frame,
+                                   GSList        **frames);
   /* end device config */
 
   /* commands */
@@ -79,6 +80,7 @@ struct _FpiDeviceElan
   unsigned char   calib_atts_left;
   unsigned char   calib_status;
   unsigned short *background;
+  FpiFrameNormalizeScratch *norm_scratch;
   unsigned char   frame_width;
   unsigned char   frame_height;
   unsigned char   raw_frame_height;
@@ -88,12 +90,6 @@ struct _FpiDeviceElan
 };
 G_DEFINE_TYPE (FpiDeviceElan, fpi_device_elan, FP_TYPE_IMAGE_DEVICE);
 
-static int
-cmp_short (const void *a, const void *b)
-{
-  return (int) (*(short *) a - *(short *) b);
-}
-
 static void
 elan_dev_reset_state (FpiDeviceElan *elandev)
 {
@@ -135,18 +131,30 @@ elan_save_frame (FpiDeviceElan *self, unsigned short *frame)
   unsigned char frame_height = self->frame_height;
   unsigned char raw_height = self->raw_frame_height;
   unsigned char frame_margin = (raw_height - self->frame_height) / 2;
-  int frame_idx, raw_idx;
+  const unsigned short *raw = (unsigned short *) self->last_read;
+
+  if (self->dev_type & ELAN_NOT_ROTATED)
+    {
+      /* rows are stored in order, only the margin needs to be skipped */
+      memcpy (frame, raw + frame_margin * frame_width,
+              frame_width * frame_height * sizeof (unsigned short));
+      return;
+    }
 
-  for (int y = 0; y < frame_height; y++)
-    for (int x = 0; x < frame_width; x++)
+  /* transpose in small blocks so that both sides stay in cache */
+  for (int y0 = 0; y0 < frame_height; y0 += ELAN_TRANSPOSE_BLOCK)
+    for (int x0 = 0; x0 < frame_width; x0 += ELAN_TRANSPOSE_BLOCK)
       {
-        if (self->dev_type & ELAN_NOT_ROTATED)
-          raw_idx = x + (y + frame_margin) * frame_width;
-        else
-          raw_idx = frame_margin + y + x * raw_height;
-        frame_idx = x + y * frame_width;
-        frame[frame_idx] =
-          ((unsigned short *) self->last_read)[raw_idx];
+        int y_end = MIN (y0 + ELAN_TRANSPOSE_BLOCK, frame_height);
+        int x_end = MIN (x0 + ELAN_TRANSPOSE_BLOCK, frame_width);
+
+        for (int x = x0; x < x_end; x++)
+          {
+            const unsigned short *col = raw + frame_margin + x * raw_height;
+
+            for (int y = y0; y < y_end; y++)
+              frame[x + y * frame_width] = col[y];
+          }
       }
 }
 
@@ -206,16 +214,9 @@ elan_save_img_frame (FpiDeviceElan *elandev)
   unsigned short *frame = g_malloc (frame_size * sizeof (short));
 
   elan_save_frame (elandev, frame);
-  unsigned int sum = 0;
+  guint64 sum;
 
-  for (int i = 0; i < frame_size; i++)
-    {
-      if (elandev->background[i] > frame[i])
-        frame[i] = 0;
-      else
-        frame[i] -= elandev->background[i];
-      sum += frame[i];
-    }
+  fpi_frame_subtract_background (frame, elandev->background, frame_size, &sum);
 
   if (sum == 0)
     {
@@ -231,44 +232,42 @@ elan_save_img_frame (FpiDeviceElan *elandev)
 }
 
 static void
-elan_process_frame_linear (unsigned short *raw_frame,
-                           GSList       ** frames)
+elan_process_frame_linear (FpiDeviceElan  *self,
+                           unsigned short *raw_frame,
+                           GSList        **frames)
 {
+  static const guint16 permille[] = { 0, 1000 };
+  static const guint8 values[] = { 0, 0xff };
   unsigned int frame_size =
     assembling_ctx.frame_width * assembling_ctx.frame_height;
   struct fpi_frame *frame =
     g_malloc (frame_size + sizeof (struct fpi_frame));
+  guint16 levels[G_N_ELEMENTS (permille)];
 
   G_DEBUG_HERE ();
 
-  unsigned short min = 0xffff, max = 0;
+  fpi_frame_normalize_get_levels (raw_frame, frame_size, permille,
+                                  G_N_ELEMENTS (permille), levels,
+                                  self->norm_scratch);
 
-  for (int i = 0; i < frame_size; i++)
-    {
-      if (raw_frame[i] < min)
-        min = raw_frame[i];
-      if (raw_frame[i] > max)
-        max = raw_frame[i];
-    }
-
-  g_assert (max != min);
-
-  unsigned short px;
+  g_assert (levels[0] != levels[1]);
 
-  for (int i = 0; i < frame_size; i++)
-    {
-      px = raw_frame[i];
-      px = (px - min) * 0xff / (max - min);
-      frame->data[i] = (unsigned char) px;
-    }
+  fpi_frame_normalize_build_lut (levels, values, G_N_ELEMENTS (levels),
+                                 self->norm_scratch);
+  fpi_frame_normalize_apply (raw_frame, frame_size, levels[0],
+                             self->norm_scratch, frame->data);
 
   *frames = g_slist_prepend (*frames, frame);
 }
 
 static void
-elan_process_frame_thirds (unsigned short *raw_frame,
-                           GSList       ** frames)
+elan_process_frame_thirds (FpiDeviceElan  *self,
+                           unsigned short *raw_frame,
+                           GSList        **frames)
 {
+  static const guint16 permille[] = { 0, 300, 650, 1000 };
+  static const guint8 values[] = { 0, 99, 155, 255 };
+
   G_DEBUG_HERE ();
 
   unsigned int frame_size =
@@ -276,30 +275,9 @@ elan_process_frame_thirds (unsigned short *raw_frame,
   struct fpi_frame *frame =
     g_malloc (frame_size + sizeof (struct fpi_frame));
 
-  unsigned short lvl0, lvl1, lvl2, lvl3;
-  unsigned short *sorted = g_malloc (frame_size * sizeof (short));
-
-  memcpy (sorted, raw_frame, frame_size * sizeof (short));
-  qsort (sorted, frame_size, sizeof (short), cmp_short);
-  lvl0 = sorted[0];
-  lvl1 = sorted[frame_size * 3 / 10];
-  lvl2 = sorted[frame_size * 65 / 100];
-  lvl3 = sorted[frame_size - 1];
-  g_free (sorted);
-
-  unsigned short px;
-
-  for (int i = 0; i < frame_size; i++)
-    {
-      px = raw_frame[i];
-      if (lvl0 <= px && px < lvl1)
-        px = (px - lvl0) * 99 / (lvl1 - lvl0);
-      else if (lvl1 <= px && px < lvl2)
-        px = 99 + ((px - lvl1) * 56 / (lvl2 - lvl1));
-      else                      // (lvl2 <= px && px <= lvl3)
-        px = 155 + ((px - lvl2) * 100 / (lvl3 - lvl2));
-      frame->data[i] = (unsigned char) px;
-    }
+  fpi_frame_normalize (raw_frame, frame_size, permille, values,
+                       G_N_ELEMENTS (permille), frame->data,
+                       self->norm_scratch);
 
   *frames = g_slist_prepend (*frames, frame);
 }
@@ -319,7 +297,8 @@ elan_submit_image (FpImageDevice *dev)
   assembling_ctx.frame_width = self->frame_width;
   assembling_ctx.frame_height = self->frame_height;
   assembling_ctx.image_width = self->frame_width * 3 / 2;
-  g_slist_foreach (raw_frames, (GFunc) self->process_frame, &frames);
+  for (GSList *l = raw_frames; l; l = l->next)
+    self->process_frame (self, l->data, &frames);
   fpi_do_movement_estimation (&assembling_ctx, frames);
   img = fpi_assemble_frames (&assembling_ctx, frames);
   img->flags |= FPI_IMAGE_PARTIAL;
@@ -403,9 +382,9 @@ elan_cmd_read (FpiSsm *ssm, FpDevice *dev)
   transfer->ssm = ssm;
   transfer->short_is_error = TRUE;
 
-  fpi_usb_transfer_fill_bulk (transfer,
-                              self->cmd->response_in,
-                              response_len);
+  fpi_usb_transfer_fill_bulk_pooled (transfer,
+                                     self->cmd->response_in,
+                                     response_len);
 
   if (!self->cmd->never_cancel)
     cancellable = fpi_device_get_cancellable (dev);
@@ -918,6 +897,7 @@ dev_init (FpImageDevice *dev)
   /* common params */
   self->dev_type = fpi_device_get_driver_data (FP_DEVICE (dev));
   self->background = NULL;
+  self->norm_scratch = g_new (FpiFrameNormalizeScratch, 1);
   self->process_frame = elan_process_frame_thirds;
 
   switch (self->dev_type)
@@ -940,6 +920,7 @@ dev_deinit (FpImageDevice *dev)
 
   elan_dev_reset_state (self);
   g_free (self->background);
+  g_clear_pointer (&self->norm_scratch, g_free);
   g_usb_device_release_interface (fpi_device_get_usb_device (FP_DEVICE (dev)),
                                   0, 0, &error);
   fpi_image_device_close_complete (dev, error);
@@ -53,6 +53,9 @@
 /* crop frames to this height to improve stitching */
 #define ELAN_MAX_FRAME_HEIGHT 50
 
+/* block size (in pixels) used when rotating raw frames */
+#define ELAN_TRANSPOSE_BLOCK 8
+
 /* number of frames to drop at the end of capture because frames captured
  * while the finger is being lifted can be bad */
 #define ELAN_SKIP_LAST_FRAMES 2
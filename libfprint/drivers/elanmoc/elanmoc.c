@@ -474,14 +474,18 @@ create_print_from_response (FpiDeviceElanmoc *self,
                             gsize             length_in,
                             GError          **error)
 {
+  FpiByteReader reader = FPI_BYTE_READER_INIT (buffer_in, length_in);
   FpPrint *print;
   GVariant *data;
   GVariant *uid;
-  g_autofree gchar *userid = NULL;
+  const guint8 *userid;
   g_autofree gchar *userid_safe = NULL;
-  int userid_len = 0;
+  guint8 magic = 0, status = 0;
+  guint8 uuid0 = 0, uuid1 = 0;
+  guint8 userid_len = 0;
 
-  if (buffer_in[0] != 0x43)
+  if (!fpi_byte_reader_get_uint8 (&reader, &magic) || magic != 0x43 ||
+      !fpi_byte_reader_get_uint8 (&reader, &status))
     {
       g_propagate_error (error,
                          fpi_device_error_new_msg (FP_DEVICE_ERROR_PROTO,
@@ -489,17 +493,18 @@ create_print_from_response (FpiDeviceElanmoc *self,
       return NULL;
     }
 
-  if (buffer_in[1] != ELAN_MSG_OK)
+  if (status != ELAN_MSG_OK)
     {
       g_propagate_error (error,
                          fpi_device_error_new_msg (FP_DEVICE_ERROR_PROTO,
-                                                   "Device returned error %d rather than print!", buffer_in[1]));
+                                                   "Device returned error %d rather than print!", status));
       return NULL;
     }
 
-  userid_len = buffer_in[4];
-
-  if (userid_len > length_in - 5)
+  if (!fpi_byte_reader_get_uint8 (&reader, &uuid0) ||
+      !fpi_byte_reader_get_uint8 (&reader, &uuid1) ||
+      !fpi_byte_reader_get_uint8 (&reader, &userid_len) ||
+      !fpi_byte_reader_get_data (&reader, userid_len, &userid))
     {
       g_propagate_error (error,
                          fpi_device_error_new_msg (FP_DEVICE_ERROR_PROTO,
@@ -507,8 +512,8 @@ create_print_from_response (FpiDeviceElanmoc *self,
       return NULL;
     }
 
-  userid = g_memdup (&buffer_in[5], userid_len);
-  userid_safe = g_strndup ((const char *) &buffer_in[5], userid_len);
+  /* The user ID is copied straight out of the transfer buffer */
+  userid_safe = g_strndup ((const char *) userid, userid_len);
   print = fp_print_new (FP_DEVICE (self));
   uid = g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE, userid, userid_len, 1);
 
@@ -516,8 +521,8 @@ create_print_from_response (FpiDeviceElanmoc *self,
    * but will always be zero for prints created by libfprint.
    */
   data = g_variant_new ("(yy@ay)",
-                        buffer_in[2],
-                        buffer_in[3],
+                        uuid0,
+                        uuid1,
                         uid);
 
   fpi_print_set_type (print, FPI_PRINT_RAW);
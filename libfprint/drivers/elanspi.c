@@ -74,6 +74,9 @@ struct _FpiDeviceElanSpi
   guint16 *bg_image;
   guint16 *last_image;
   guint16 *prev_frame_image;
+  FpiFrameNormalizeScratch *norm_scratch;
+  /* index into the raw image for each pixel of the (rotated) frame */
+  guint32  *rotation_map;
 
   gint     fp_empty_counter;
   GSList  *fp_frame_list;
@@ -216,7 +219,6 @@ enum elanspi_capture_hv_state {
 
 enum elanspi_write_regtable_state {
   ELANSPI_WRTABLE_WRITE,
-  ELANSPI_WRTABLE_ITERATE,
   ELANSPI_WRTABLE_NSTATES
 };
 
@@ -329,6 +331,39 @@ elanspi_write_register (FpiDeviceElanSpi *self, guint8 reg_id, guint8 data_in)
   return xfer;
 }
 
+static void
+elanspi_build_rotation_map (FpiDeviceElanSpi *self)
+{
+  int rotation = fpi_device_get_driver_data (FP_DEVICE (self)) & 3;
+  guint32 *map;
+
+  g_clear_pointer (&self->rotation_map, g_free);
+  map = self->rotation_map = g_new (guint32, self->frame_width * self->frame_height);
+
+  for (int y = 0; y < self->frame_height; y += 1)
+    for (int x = 0; x < self->frame_width; x += 1)
+      {
+        gint x1 = x, y1 = y;
+
+        if (rotation == ELANSPI_180_ROTATE)
+          {
+            x1 = (self->sensor_width - x - 1);
+            y1 = (self->sensor_height - y - 1);
+          }
+        else if (rotation == ELANSPI_90LEFT_ROTATE)
+          {
+            x1 = y;
+            y1 = (self->sensor_width - x - 1);
+          }
+        else if (rotation == ELANSPI_90RIGHT_ROTATE)
+          {
+            x1 = (self->sensor_height - y - 1);
+            y1 = x;
+          }
+        *map++ = y1 * self->sensor_width + x1;
+      }
+}
+
 static void
 elanspi_determine_sensor (FpiDeviceElanSpi *self, GError **err)
 {
@@ -408,6 +443,8 @@ elanspi_determine_sensor (FpiDeviceElanSpi *self, GError **err)
       self->frame_width = self->sensor_width;
       self->frame_height = self->sensor_height > ELANSPI_MAX_FRAME_HEIGHT ? ELANSPI_MAX_FRAME_HEIGHT : self->sensor_height;
     }
+
+  elanspi_build_rotation_map (self);
 }
 
 static void
@@ -516,20 +553,16 @@ elanspi_send_regtable_handler (FpiSsm *ssm, FpDevice *dev)
   switch (fpi_ssm_get_cur_state (ssm))
     {
     case ELANSPI_WRTABLE_WRITE:
-      xfer = elanspi_write_register (self, entry->addr, entry->value);
+      /* send the whole table at once, deselecting after each register */
+      xfer = fpi_spi_transfer_new (dev, self->spi_fd);
       xfer->ssm = ssm;
-      fpi_spi_transfer_submit (xfer, fpi_device_get_cancellable (dev), fpi_ssm_spi_transfer_cb, NULL);
-      return;
-
-    case ELANSPI_WRTABLE_ITERATE:
-      entry += 1;
-      if (entry->addr != 0xff)
+      for (; entry->addr != 0xff; entry += 1)
         {
-          fpi_ssm_set_data (ssm, (gpointer) entry, NULL);
-          fpi_ssm_jump_to_state (ssm, ELANSPI_WRTABLE_WRITE);
-          return;
+          guint8 cmd[2] = { entry->addr | 0x80, entry->value };
+
+          fpi_spi_transfer_add_write (xfer, cmd, sizeof (cmd), TRUE);
         }
-      fpi_ssm_mark_completed (ssm);
+      fpi_spi_transfer_submit (xfer, fpi_device_get_cancellable (dev), fpi_ssm_spi_transfer_cb, NULL);
       return;
     }
 }
@@ -997,6 +1030,8 @@ do_sw_reset:
       self->last_image = g_malloc0 (self->sensor_width * self->sensor_height * 2);
       self->bg_image = g_malloc0 (self->sensor_width * self->sensor_height * 2);
       self->prev_frame_image = g_malloc0 (self->sensor_width * self->sensor_height * 2);
+      if (!self->norm_scratch)
+        self->norm_scratch = g_new (FpiFrameNormalizeScratch, 1);
       /* reset again */
       goto do_sw_reset;
 
@@ -1153,46 +1188,9 @@ enum elanspi_guess_result {
 static gint
 elanspi_correct_with_bg (FpiDeviceElanSpi *self, guint16 *raw_image)
 {
-  gint count = 0;
-
-  for (int i = 0; i < self->sensor_width * self->sensor_height; i += 1)
-    {
-      if (raw_image[i] < self->bg_image[i])
-        {
-          count += 1;
-          raw_image[i] = 0;
-        }
-      else
-        {
-          raw_image[i] -= self->bg_image[i];
-        }
-    }
-
-  return count;
-}
-
-static guint16
-elanspi_lookup_pixel_with_rotation (FpiDeviceElanSpi *self, const guint16 *data_in, int y, int x)
-{
-  int rotation = fpi_device_get_driver_data (FP_DEVICE (self)) & 3;
-  gint x1 = x, y1 = y;
-
-  if (rotation == ELANSPI_180_ROTATE)
-    {
-      x1 = (self->sensor_width - x - 1);
-      y1 = (self->sensor_height - y - 1);
-    }
-  else if (rotation == ELANSPI_90LEFT_ROTATE)
-    {
-      x1 = y;
-      y1 = (self->sensor_width - x - 1);
-    }
-  else if (rotation == ELANSPI_90RIGHT_ROTATE)
-    {
-      x1 = (self->sensor_height - y - 1);
-      y1 = x;
-    }
-  return data_in[y1 * self->sensor_width + x1];
+  return fpi_frame_subtract_background (raw_image, self->bg_image,
+                                        self->sensor_width * self->sensor_height,
+                                        NULL);
 }
 
 static enum elanspi_guess_result
@@ -1214,18 +1212,16 @@ elanspi_guess_image (FpiDeviceElanSpi *self, guint16 *raw_image)
   gint64 mean = 0;
   gint64 sq_stddev = 0;
 
-  for (int j = 0; j < frame_height; j += 1)
-    for (int i = 0; i < frame_width; i += 1)
-      mean += (gint64) elanspi_lookup_pixel_with_rotation (self, image_copy, j, i);
+  for (int i = 0; i < frame_width * frame_height; i += 1)
+    mean += (gint64) image_copy[self->rotation_map[i]];
 
   mean /= (frame_width * frame_height);
 
-  for (int j = 0; j < frame_height; j += 1)
-    for (int i = 0; i < frame_width; i += 1)
-      {
-        gint64 k = (gint64) elanspi_lookup_pixel_with_rotation (self, image_copy, j, i) - mean;
-        sq_stddev += k * k;
-      }
+  for (int i = 0; i < frame_width * frame_height; i += 1)
+    {
+      gint64 k = (gint64) image_copy[self->rotation_map[i]] - mean;
+      sq_stddev += k * k;
+    }
 
   sq_stddev /= (frame_width * frame_height);
 
@@ -1269,58 +1265,31 @@ elanspi_check_waitupdown_done (FpiDeviceElanSpi *self, enum elanspi_guess_result
     }
 }
 
-static int
-cmp_u16 (const void *a, const void *b)
-{
-  return (int) (*(guint16 *) a - *(guint16 *) b);
-}
-
 static void
 elanspi_process_frame (FpiDeviceElanSpi *self, const guint16 *data_in, guint8 *data_out)
 {
+  static const guint16 permille[] = { 0, 300, 650, 1000 };
+  static const guint8 values[] = { 0, 99, 155, 255 };
   size_t frame_size = self->frame_width * self->frame_height;
-  guint16 data_in_sorted[frame_size];
+  guint16 data_in_rotated[frame_size];
+  guint16 levels[G_N_ELEMENTS (permille)];
 
-  for (int i = 0, offset = 0; i < self->frame_height; i += 1)
-    for (int j = 0; j < self->frame_width; j += 1)
-      data_in_sorted[offset++] = elanspi_lookup_pixel_with_rotation (self, data_in, i, j);
+  for (size_t i = 0; i < frame_size; i += 1)
+    data_in_rotated[i] = data_in[self->rotation_map[i]];
 
-  qsort (data_in_sorted, frame_size, 2, cmp_u16);
-  guint16 lvl0 = data_in_sorted[0];
-  guint16 lvl1 = data_in_sorted[frame_size * 3 / 10];
-  guint16 lvl2 = data_in_sorted[frame_size * 65 / 100];
-  guint16 lvl3 = data_in_sorted[frame_size - 1];
+  fpi_frame_normalize_get_levels (data_in_rotated, frame_size, permille,
+                                  G_N_ELEMENTS (permille), levels,
+                                  self->norm_scratch);
 
-  lvl1 = MAX (lvl1, lvl0 + 1);
-  lvl2 = MAX (lvl2, lvl1 + 1);
-  lvl3 = MAX (lvl3, lvl2 + 1);
+  /* every level needs to map at least one input value */
+  levels[1] = MAX (levels[1], levels[0] + 1);
+  levels[2] = MAX (levels[2], levels[1] + 1);
+  levels[3] = MAX (levels[3], levels[2] + 1);
 
-  for (int i = 0; i < self->frame_height; i += 1)
-    {
-      for (int j = 0; j < self->frame_width; j += 1)
-        {
-          guint16 px = elanspi_lookup_pixel_with_rotation (self, data_in, i, j);
-          if (px < lvl0)
-            {
-              px = 0;
-            }
-          else if (px > lvl3)
-            {
-              px = 255;
-            }
-          else
-            {
-              if (lvl0 <= px && px < lvl1)
-                px = (px - lvl0) * 99 / (lvl1 - lvl0);
-              else if (lvl1 <= px && px < lvl2)
-                px = 99 + ((px - lvl1) * 56 / (lvl2 - lvl1));
-              else /* (lvl2 <= px && px <= lvl3) */
-                px = 155 + ((px - lvl2) * 100 / (lvl3 - lvl2));
-            }
-          *data_out = px;
-          data_out += 1;
-        }
-    }
+  fpi_frame_normalize_build_lut (levels, values, G_N_ELEMENTS (levels),
+                                 self->norm_scratch);
+  fpi_frame_normalize_apply (data_in_rotated, frame_size, levels[0],
+                             self->norm_scratch, data_out);
 }
 
 static unsigned char
@@ -1683,6 +1652,8 @@ fpi_device_elanspi_finalize (GObject *this)
   g_clear_pointer (&self->bg_image, g_free);
   g_clear_pointer (&self->last_image, g_free);
   g_clear_pointer (&self->prev_frame_image, g_free);
+  g_clear_pointer (&self->norm_scratch, g_free);
+  g_clear_pointer (&self->rotation_map, g_free);
   g_slist_free_full (g_steal_pointer (&self->fp_frame_list), g_free);
 
   G_OBJECT_CLASS (fpi_device_elanspi_parent_class)->finalize (this);
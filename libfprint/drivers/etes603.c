@@ -553,21 +553,6 @@ process_frame_empty (guint8 *frame, size_t size)
   return 0;
 }
 
-/* Transform 4 bits image to 8 bits image */
-static void
-process_4to8_bpp (guint8 *input, unsigned int input_size,
-                  guint8 *output)
-{
-  unsigned int i, j = 0;
-
-  for (i = 0; i < input_size; i++, j += 2)
-    {
-      /* 16 gray levels transform to 256 levels using << 4 */
-      output[j] = input[i] & 0xF0;
-      output[j + 1] = input[i] << 4;
-    }
-}
-
 /*
  * Remove duplicated lines at the end of a fingerprint.
  */
@@ -872,7 +857,10 @@ m_capture_state (FpiSsm *ssm, FpDevice *dev)
               /* TODO detect sweep direction */
               img->flags = FPI_IMAGE_COLORS_INVERTED | FPI_IMAGE_V_FLIPPED;
               img->height = self->fp_height;
-              process_4to8_bpp (self->fp, img_size / 2, img->data);
+              /* 16 gray levels transform to 256 levels using << 4 */
+              fpi_unpack_4bpp (self->fp, img_size / 2, img->data,
+                               FPI_UNPACK_4BPP_HIGH_NIBBLE_FIRST |
+                               FPI_UNPACK_4BPP_SHIFT);
               fp_dbg ("Sending the raw fingerprint image (%dx%d)",
                       img->width, img->height);
               fpi_image_device_image_captured (idev, img);
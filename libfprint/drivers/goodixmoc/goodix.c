@@ -88,7 +88,7 @@ fp_print_from_template (FpiDeviceGoodixMoc *self, template_format_t *template)
   GVariant *uid;
   g_autofree gchar *userid = NULL;
 
-  userid = g_strndup ((gchar *) template->payload.data, template->payload.size);
+  userid = g_strndup ((const gchar *) template->payload.data, template->payload.size);
 
   print = fp_print_new (FP_DEVICE (self));
 
@@ -1262,6 +1262,7 @@ fp_template_list_cb (FpiDeviceGoodixMoc  *self,
                      GError              *error)
 {
   FpDevice *device = FP_DEVICE (self);
+  FpiByteReader finger_list;
 
   if (error)
     {
@@ -1290,11 +1291,17 @@ fp_template_list_cb (FpiDeviceGoodixMoc  *self,
       return;
     }
 
+  /* The list was already validated when parsing the response */
+  finger_list = resp->finger_list_resp.finger_list;
   for (int n = 0; n < resp->finger_list_resp.finger_num; n++)
     {
+      template_format_t template;
       FpPrint *print;
 
-      print = fp_print_from_template (self, &resp->finger_list_resp.finger_list[n]);
+      if (gx_proto_parse_next_finger (&finger_list, &template) != 0)
+        g_assert_not_reached ();
+
+      print = fp_print_from_template (self, &template);
 
       g_ptr_array_add (self->list_result, g_object_ref_sink (print));
     }
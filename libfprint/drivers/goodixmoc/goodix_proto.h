@@ -22,12 +22,17 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include "fpi-byte-reader.h"
+
 #define PACKAGE_CRC_SIZE (4)
 #define PACKAGE_HEADER_SIZE (8)
 
 #define FP_MAX_FINGERNUM (20)
 
 #define TEMPLATE_ID_SIZE (32)
+#define TEMPLATE_ACCOUNT_ID_SIZE (32)
+#define TEMPLATE_PAYLOAD_OFFSET (68)
+#define TEMPLATE_PAYLOAD_MAX_SIZE (56)
 
 #define GX_VERSION_LEN (8)
 
@@ -110,25 +115,21 @@ typedef struct _gxfp_enroll_init
   uint8_t tid[TEMPLATE_ID_SIZE];
 } gxfp_enroll_init_t, *pgxfp_enroll_init_t;
 
-#pragma pack(push, 1)
+/* Parsed template, the arrays point into the response buffer and are
+ * only valid while the command callback runs. */
 typedef struct _template_format
 {
-  uint8_t _0x43_byte;
-  uint8_t type;
-  uint8_t finger_index;
-  uint8_t pad0;
-  uint8_t accountid[32];
-  uint8_t tid[32];
+  uint8_t        type;
+  uint8_t        finger_index;
+  const uint8_t *accountid;
+  const uint8_t *tid;
   struct
   {
-    uint8_t size;
-    uint8_t data[56];
+    uint8_t        size;
+    const uint8_t *data;
   } payload;
-  uint8_t reserve[2];
 } template_format_t, *ptemplate_format_t;
 
-#pragma pack(pop)
-
 
 typedef struct _gxfp_verify
 {
@@ -158,10 +159,12 @@ typedef struct _gxfp_enroll_update
   uint8_t img_preoverlay;
 } gxfp_enroll_update_t, *Pgxfp_enroll_update_t;
 
+/* The list is validated while parsing, iterate it with
+ * gx_proto_parse_next_finger() */
 typedef struct _gxfp_enum_fingerlist
 {
-  uint8_t           finger_num;
-  template_format_t finger_list[FP_MAX_FINGERNUM];
+  uint8_t       finger_num;
+  FpiByteReader finger_list;
 } gxfp_enum_fingerlist_t, *pgxfp_enum_fingerlist_t;
 
 typedef struct _gxfp_enroll_commit
@@ -241,6 +244,9 @@ int gx_proto_parse_body (uint16_t             cmd,
                          uint16_t             buffer_len,
                          pgxfp_cmd_response_t presponse);
 
+int gx_proto_parse_next_finger (FpiByteReader     *finger_list,
+                                ptemplate_format_t template);
+
 int gx_proto_init_sensor_config (pgxfp_sensor_cfg_t pconfig);
 
 uint8_t gx_proto_crc8_calc (uint8_t *lubp_date,
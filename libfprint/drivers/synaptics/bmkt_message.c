@@ -20,225 +20,235 @@
 #include "bmkt_response.h"
 #include "bmkt_message.h"
 
-static uint8_t
-extract8 (const uint8_t *buf, int *offset)
-{
-  uint8_t ret = 0;
-  int off = 0;
-
-  if (offset)
-    off = *offset;
-
-  ret = *(buf + off);
-
-  if (offset)
-    *offset += 1;
-
-  return ret;
-}
-
-
 static int
-parse_error_response (bmkt_msg_resp_t *msg_resp, bmkt_response_t *resp)
+parse_error_response (FpiByteReader *payload, bmkt_response_t *resp)
 {
-  if (msg_resp->payload_len != 2)
+  guint16 result;
+
+  if (fpi_byte_reader_get_remaining (payload) != 2 ||
+      !fpi_byte_reader_get_uint16_be (payload, &result))
     return BMKT_UNRECOGNIZED_MESSAGE;
 
-  resp->result = (msg_resp->payload[0] << 8) | msg_resp->payload[1];
+  resp->result = result;
 
   return BMKT_SUCCESS;
 }
 
 static int
-parse_init_ok (bmkt_msg_resp_t *msg_resp, bmkt_response_t *resp)
+parse_init_ok (FpiByteReader *payload, bmkt_response_t *resp)
 {
   bmkt_init_resp_t *init_resp = &resp->response.init_resp;
 
-  if (msg_resp->payload_len != 1)
+  if (fpi_byte_reader_get_remaining (payload) != 1 ||
+      !fpi_byte_reader_get_uint8 (payload, &init_resp->finger_presence))
     return BMKT_UNRECOGNIZED_MESSAGE;
 
-  init_resp->finger_presence = extract8 (msg_resp->payload, NULL);
-
   return BMKT_SUCCESS;
 }
 
 
 static int
-parse_fps_mode_report (bmkt_msg_resp_t *msg_resp, bmkt_response_t *resp)
+parse_fps_mode_report (FpiByteReader *payload, bmkt_response_t *resp)
 {
-  int offset = 0;
   bmkt_fps_mode_resp_t *fps_mode_resp = &resp->response.fps_mode_resp;
 
-  if (msg_resp->payload_len != sizeof (bmkt_fps_mode_resp_t))
+  if (fpi_byte_reader_get_remaining (payload) != sizeof (bmkt_fps_mode_resp_t))
     return BMKT_UNRECOGNIZED_MESSAGE;
 
-  fps_mode_resp->mode = extract8 (msg_resp->payload, &offset);
-  fps_mode_resp->level2_mode = extract8 (msg_resp->payload, &offset);
-  fps_mode_resp->cmd_id = extract8 (msg_resp->payload, &offset);
-  fps_mode_resp->finger_presence = extract8 (msg_resp->payload, &offset);
+  fps_mode_resp->mode = fpi_byte_reader_get_uint8_unchecked (payload);
+  fps_mode_resp->level2_mode = fpi_byte_reader_get_uint8_unchecked (payload);
+  fps_mode_resp->cmd_id = fpi_byte_reader_get_uint8_unchecked (payload);
+  fps_mode_resp->finger_presence = fpi_byte_reader_get_uint8_unchecked (payload);
 
   return BMKT_SUCCESS;
 }
 
 static int
-parse_enroll_report (bmkt_msg_resp_t *msg_resp, bmkt_response_t *resp)
+parse_enroll_report (FpiByteReader *payload, bmkt_response_t *resp)
 {
   bmkt_enroll_resp_t *enroll_resp = &resp->response.enroll_resp;
 
-  if (msg_resp->payload_len != 1)
+  if (fpi_byte_reader_get_remaining (payload) != 1)
     return BMKT_UNRECOGNIZED_MESSAGE;
 
-  enroll_resp->progress = extract8 (msg_resp->payload, NULL);
+  enroll_resp->progress = fpi_byte_reader_get_uint8_unchecked (payload);
 
   return BMKT_SUCCESS;
 }
 
 static int
-parse_enroll_ok (bmkt_msg_resp_t *msg_resp, bmkt_response_t *resp)
+parse_enroll_ok (FpiByteReader *payload, bmkt_response_t *resp)
 {
   bmkt_enroll_resp_t *enroll_resp = &resp->response.enroll_resp;
+  guint len = fpi_byte_reader_get_remaining (payload);
 
-  if (msg_resp->payload_len < 1 || msg_resp->payload_len > (BMKT_MAX_USER_ID_LEN + 1))
+  if (len < 1 || len > (BMKT_MAX_USER_ID_LEN + 1))
     return BMKT_UNRECOGNIZED_MESSAGE;
 
-  enroll_resp->finger_id = msg_resp->payload[0];
-  memcpy (enroll_resp->user_id, &msg_resp->payload[1], msg_resp->payload_len - 1);
+  enroll_resp->finger_id = fpi_byte_reader_get_uint8_unchecked (payload);
+  enroll_resp->user_id_len = len - 1;
+  enroll_resp->user_id = fpi_byte_reader_get_data_unchecked (payload, len - 1);
 
   return BMKT_SUCCESS;
 }
 
 static int
-parse_auth_ok (bmkt_msg_resp_t *msg_resp, bmkt_response_t *resp)
+parse_auth_ok (FpiByteReader *payload, bmkt_response_t *resp)
 {
   bmkt_identify_resp_t *id_resp = &resp->response.id_resp;
+  guint len = fpi_byte_reader_get_remaining (payload);
+  guint8 score_int, score_frac;
 
-  if (msg_resp->payload_len < 3 || msg_resp->payload_len > (BMKT_MAX_USER_ID_LEN + 3))
+  if (len < 3 || len > (BMKT_MAX_USER_ID_LEN + 3))
     return BMKT_UNRECOGNIZED_MESSAGE;
 
-  id_resp->match_result = (double) msg_resp->payload[0] + 0.01 * (double) msg_resp->payload[1];
-  id_resp->finger_id = msg_resp->payload[2];
-  memcpy (id_resp->user_id, &msg_resp->payload[3], msg_resp->payload_len - 3);
+  score_int = fpi_byte_reader_get_uint8_unchecked (payload);
+  score_frac = fpi_byte_reader_get_uint8_unchecked (payload);
+  id_resp->match_result = (double) score_int + 0.01 * (double) score_frac;
+  id_resp->finger_id = fpi_byte_reader_get_uint8_unchecked (payload);
+  id_resp->user_id_len = len - 3;
+  id_resp->user_id = fpi_byte_reader_get_data_unchecked (payload, len - 3);
 
   return BMKT_SUCCESS;
 }
 
 static int
-parse_security_level_report (bmkt_msg_resp_t *msg_resp, bmkt_response_t *resp)
+parse_security_level_report (FpiByteReader *payload, bmkt_response_t *resp)
 {
   bmkt_set_sec_level_resp_t *sec_level_resp = &resp->response.sec_level_resp;
 
-  if (msg_resp->payload_len != 1)
+  if (fpi_byte_reader_get_remaining (payload) != 1)
     return BMKT_UNRECOGNIZED_MESSAGE;
 
-  sec_level_resp->sec_level = extract8 (msg_resp->payload, NULL);
+  sec_level_resp->sec_level = fpi_byte_reader_get_uint8_unchecked (payload);
 
   return BMKT_SUCCESS;
 }
 
 static int
-parse_del_all_users_progress_report (bmkt_msg_resp_t *msg_resp, bmkt_response_t *resp)
+parse_del_all_users_progress_report (FpiByteReader *payload, bmkt_response_t *resp)
 {
   bmkt_del_all_users_resp_t *del_all_users_resp = &resp->response.del_all_users_resp;
 
-  if (msg_resp->payload_len != 1)
+  if (fpi_byte_reader_get_remaining (payload) != 1)
     return BMKT_UNRECOGNIZED_MESSAGE;
 
-  del_all_users_resp->progress = extract8 (msg_resp->payload, NULL);
+  del_all_users_resp->progress = fpi_byte_reader_get_uint8_unchecked (payload);
 
   return BMKT_SUCCESS;
 }
 
 static int
-parse_db_cap_report (bmkt_msg_resp_t *msg_resp, bmkt_response_t *resp)
+parse_db_cap_report (FpiByteReader *payload, bmkt_response_t *resp)
 {
   bmkt_get_db_capacity_resp_t *db_cap_resp = &resp->response.db_cap_resp;
-  int offset = 0;
+  guint len = fpi_byte_reader_get_remaining (payload);
 
-  if (msg_resp->payload_len < 2 || msg_resp->payload_len > 4)
+  if (len < 2 || len > 4)
     return BMKT_UNRECOGNIZED_MESSAGE;
 
-  db_cap_resp->total = extract8 (msg_resp->payload, &offset);
-  db_cap_resp->empty = extract8 (msg_resp->payload, &offset);
+  db_cap_resp->total = fpi_byte_reader_get_uint8_unchecked (payload);
+  db_cap_resp->empty = fpi_byte_reader_get_uint8_unchecked (payload);
 
-  if (msg_resp->payload_len == 4)
+  if (len == 4)
     {
-      db_cap_resp->bad_slots = extract8 (msg_resp->payload, &offset);
-      db_cap_resp->corrupt_templates = extract8 (msg_resp->payload, &offset);
+      db_cap_resp->bad_slots = fpi_byte_reader_get_uint8_unchecked (payload);
+      db_cap_resp->corrupt_templates = fpi_byte_reader_get_uint8_unchecked (payload);
     }
 
   return BMKT_SUCCESS;
 }
 
 static int
-parse_get_enrolled_fingers_report (bmkt_msg_resp_t *msg_resp, bmkt_response_t *resp)
+parse_get_enrolled_fingers_report (FpiByteReader *payload, bmkt_response_t *resp)
 {
-  int offset = 0;
-  int i = 0;
+  bmkt_enrolled_fingers_resp_t *get_enrolled_fingers_resp = &resp->response.enrolled_fingers_resp;
+  guint num_fingers;
+  guint i;
 
-  if (msg_resp->payload_len < 2)
+  if (fpi_byte_reader_get_remaining (payload) < 2)
     return BMKT_UNRECOGNIZED_MESSAGE;
-  /* 2 bytes per finger so calculate the total number of fingers to process*/
-  int num_fingers = (msg_resp->payload_len) / 2;
 
-  bmkt_enrolled_fingers_resp_t *get_enrolled_fingers_resp = &resp->response.enrolled_fingers_resp;
+  /* 2 bytes per finger so calculate the total number of fingers to process*/
+  num_fingers = MIN (fpi_byte_reader_get_remaining (payload) / 2,
+                     G_N_ELEMENTS (get_enrolled_fingers_resp->fingers));
 
   for (i = 0; i < num_fingers; i++)
     {
-      get_enrolled_fingers_resp->fingers[i].finger_id = extract8 (msg_resp->payload, &offset);
-      get_enrolled_fingers_resp->fingers[i].template_status = extract8 (msg_resp->payload, &offset);
-
+      get_enrolled_fingers_resp->fingers[i].finger_id = fpi_byte_reader_get_uint8_unchecked (payload);
+      get_enrolled_fingers_resp->fingers[i].template_status = fpi_byte_reader_get_uint8_unchecked (payload);
     }
+
   return BMKT_SUCCESS;
 }
-static int
-parse_get_enrolled_users_report (bmkt_msg_resp_t *msg_resp, bmkt_response_t *resp)
+
+/* Reads one record of a template records report, the user id of the
+ * template points into the data of the reader. */
+gboolean
+bmkt_get_next_enroll_template (FpiByteReader          *templates,
+                               bmkt_enroll_template_t *template)
 {
-  int offset = 0;
-  int i = 0;
+  guint8 record_len;
 
-  /* the payload is 2 bytes + template data */
-  if (msg_resp->payload_len < 2)
-    return BMKT_UNRECOGNIZED_MESSAGE;
+  if (!fpi_byte_reader_get_uint8 (templates, &record_len))
+    return FALSE;
 
-  bmkt_enroll_templates_resp_t *get_enroll_templates_resp = &resp->response.enroll_templates_resp;
+  /* The record length includes the status and finger id */
+  template->user_id_len = record_len - 2;
+  if (template->user_id_len > BMKT_MAX_USER_ID_LEN)
+    return FALSE;
 
-  get_enroll_templates_resp->total_query_messages = extract8 (msg_resp->payload, &offset);
-  get_enroll_templates_resp->query_sequence = extract8 (msg_resp->payload, &offset);
+  return fpi_byte_reader_get_uint8 (templates, &template->template_status) &&
+         fpi_byte_reader_get_uint8 (templates, &template->finger_id) &&
+         fpi_byte_reader_get_data (templates, template->user_id_len, &template->user_id);
+}
 
-  int n = 0;
+static int
+parse_get_enrolled_users_report (FpiByteReader *payload, bmkt_response_t *resp)
+{
+  bmkt_enroll_templates_resp_t *get_enroll_templates_resp = &resp->response.enroll_templates_resp;
+  bmkt_enroll_template_t template;
+  guint start;
 
-  for (n = 0; n < BMKT_MAX_NUM_TEMPLATES_INTERNAL_FLASH; n++)
+  /* the payload is 2 bytes + template data */
+  if (!fpi_byte_reader_get_uint8 (payload, &get_enroll_templates_resp->total_query_messages) ||
+      !fpi_byte_reader_get_uint8 (payload, &get_enroll_templates_resp->query_sequence))
+    return BMKT_UNRECOGNIZED_MESSAGE;
+
+  /* Validate the records once, users iterate over them in place */
+  start = fpi_byte_reader_get_pos (payload);
+  while (fpi_byte_reader_get_remaining (payload) > 0 &&
+         get_enroll_templates_resp->num_templates < BMKT_MAX_NUM_TEMPLATES_INTERNAL_FLASH)
     {
-      if (offset >= msg_resp->payload_len)
-        break;
-      get_enroll_templates_resp->templates[n].user_id_len = extract8 (msg_resp->payload, &offset) - 2;
-      if(get_enroll_templates_resp->templates[n].user_id_len > BMKT_MAX_USER_ID_LEN)
+      if (!bmkt_get_next_enroll_template (payload, &template))
         return BMKT_UNRECOGNIZED_MESSAGE;
-      get_enroll_templates_resp->templates[n].template_status = extract8 (msg_resp->payload, &offset);
-      get_enroll_templates_resp->templates[n].finger_id = extract8 (msg_resp->payload, &offset);
-      for (i = 0; i < get_enroll_templates_resp->templates[n].user_id_len; i++)
-        get_enroll_templates_resp->templates[n].user_id[i] = extract8 (msg_resp->payload, &offset);
-      get_enroll_templates_resp->templates[n].user_id[i] = '\0';
+      get_enroll_templates_resp->num_templates++;
     }
 
+  fpi_byte_reader_init (&get_enroll_templates_resp->templates,
+                        payload->data + start,
+                        fpi_byte_reader_get_pos (payload) - start);
+
   return BMKT_SUCCESS;
 }
 
 static int
-parse_get_version_report (bmkt_msg_resp_t *msg_resp, bmkt_response_t *resp)
+parse_get_version_report (FpiByteReader *payload, bmkt_response_t *resp)
 {
   bmkt_get_version_resp_t *get_version_resp = &resp->response.get_version_resp;
-  int offset = 0;
 
-  if (msg_resp->payload_len != 15)
+  if (fpi_byte_reader_get_remaining (payload) != 15)
     return BMKT_UNRECOGNIZED_MESSAGE;
 
-  memcpy (get_version_resp->part, msg_resp->payload, BMKT_PART_NUM_LEN);
-  offset += BMKT_PART_NUM_LEN;
-  get_version_resp->year = extract8 (msg_resp->payload, &offset);
-  get_version_resp->week = extract8 (msg_resp->payload, &offset);
-  get_version_resp->patch = extract8 (msg_resp->payload, &offset);
-  memcpy (get_version_resp->supplier_id, msg_resp->payload + offset, BMKT_SUPPLIER_ID_LEN);
+  memcpy (get_version_resp->part,
+          fpi_byte_reader_get_data_unchecked (payload, BMKT_PART_NUM_LEN),
+          BMKT_PART_NUM_LEN);
+  get_version_resp->year = fpi_byte_reader_get_uint8_unchecked (payload);
+  get_version_resp->week = fpi_byte_reader_get_uint8_unchecked (payload);
+  get_version_resp->patch = fpi_byte_reader_get_uint8_unchecked (payload);
+  memcpy (get_version_resp->supplier_id,
+          fpi_byte_reader_get_data_unchecked (payload, BMKT_SUPPLIER_ID_LEN),
+          BMKT_SUPPLIER_ID_LEN);
 
   return BMKT_SUCCESS;
 }
@@ -266,16 +276,23 @@ bmkt_compose_message (uint8_t *cmd, int *cmd_len, uint8_t msg_id, uint8_t seq_nu
 int
 bmkt_parse_message_header (uint8_t *resp_buf, int resp_len, bmkt_msg_resp_t *msg_resp)
 {
-  if (resp_buf[BMKT_MESSAGE_HEADER_ID_FIELD] != BMKT_MESSAGE_HEADER_ID)
+  FpiByteReader reader = FPI_BYTE_READER_INIT (resp_buf, MAX (resp_len, 0));
+  guint8 header_id;
+
+  if (!fpi_byte_reader_get_uint8 (&reader, &header_id) ||
+      header_id != BMKT_MESSAGE_HEADER_ID)
+    return BMKT_CORRUPT_MESSAGE;
+
+  if (!fpi_byte_reader_get_uint8 (&reader, &msg_resp->seq_num) ||
+      !fpi_byte_reader_get_uint8 (&reader, &msg_resp->msg_id) ||
+      !fpi_byte_reader_get_uint8 (&reader, &msg_resp->payload_len))
     return BMKT_CORRUPT_MESSAGE;
 
-  msg_resp->seq_num = resp_buf[BMKT_MESSAGE_SEQ_NUM_FIELD];
-  msg_resp->msg_id = resp_buf[BMKT_MESSAGE_ID_FIELD];
-  msg_resp->payload_len = resp_buf[BMKT_MESSAGE_PAYLOAD_LEN_FIELD];
-  if (msg_resp->payload_len > 0)
-    msg_resp->payload = &resp_buf[BMKT_MESSAGE_PAYLOAD_FIELD];
-  else
-    msg_resp->payload = NULL;
+  /* The payload is parsed in place, make sure that it was received */
+  msg_resp->payload = NULL;
+  if (msg_resp->payload_len > 0 &&
+      !fpi_byte_reader_get_data (&reader, msg_resp->payload_len, &msg_resp->payload))
+    return BMKT_CORRUPT_MESSAGE;
 
   return BMKT_SUCCESS;
 }
@@ -283,6 +300,7 @@ bmkt_parse_message_header (uint8_t *resp_buf, int resp_len, bmkt_msg_resp_t *msg
 int
 bmkt_parse_message_payload (bmkt_msg_resp_t *msg_resp, bmkt_response_t *resp)
 {
+  FpiByteReader payload = FPI_BYTE_READER_INIT (msg_resp->payload, msg_resp->payload_len);
   int ret = BMKT_SUCCESS;
 
   memset (resp, 0, sizeof (bmkt_response_t));
@@ -311,12 +329,12 @@ bmkt_parse_message_payload (bmkt_msg_resp_t *msg_resp, bmkt_response_t *resp)
     case BMKT_RSP_QUERY_PAIRING_FAIL:
     case BMKT_RSP_SENSOR_STATUS_FAIL:
     case BMKT_RSP_RETRIEVE_FINAL_RESULT_FAIL:
-      ret = parse_error_response (msg_resp, resp);
+      ret = parse_error_response (&payload, resp);
       resp->complete = 1;
       break;
 
     case BMKT_RSP_FPS_INIT_OK:
-      ret = parse_init_ok (msg_resp, resp);
+      ret = parse_init_ok (&payload, resp);
       resp->complete = 1;
       break;
 
@@ -331,19 +349,19 @@ bmkt_parse_message_payload (bmkt_msg_resp_t *msg_resp, bmkt_response_t *resp)
 
     case BMKT_RSP_FPS_MODE_REPORT:
       // parse_fps_mode
-      ret = parse_fps_mode_report (msg_resp, resp);
+      ret = parse_fps_mode_report (&payload, resp);
       resp->complete = 1;
       break;
 
     case BMKT_RSP_GET_SECURITY_LEVEL_REPORT:
     case BMKT_RSP_SET_SECURITY_LEVEL_REPORT:
       /* parse security level result */
-      ret = parse_security_level_report (msg_resp, resp);
+      ret = parse_security_level_report (&payload, resp);
       resp->complete = 1;
       break;
 
     case BMKT_RSP_DELETE_PROGRESS:
-      ret = parse_del_all_users_progress_report (msg_resp, resp);
+      ret = parse_del_all_users_progress_report (&payload, resp);
       break;
 
     case BMKT_RSP_CAPTURE_COMPLETE:
@@ -355,32 +373,32 @@ bmkt_parse_message_payload (bmkt_msg_resp_t *msg_resp, bmkt_response_t *resp)
       break;
 
     case BMKT_RSP_ENROLL_REPORT:
-      ret = parse_enroll_report (msg_resp, resp);
+      ret = parse_enroll_report (&payload, resp);
       break;
 
     case BMKT_RSP_ENROLL_OK:
       resp->complete = 1;
-      ret = parse_enroll_ok (msg_resp, resp);
+      ret = parse_enroll_ok (&payload, resp);
       break;
 
     case BMKT_RSP_ID_OK:
     case BMKT_RSP_VERIFY_OK:
-      ret = parse_auth_ok (msg_resp, resp);
+      ret = parse_auth_ok (&payload, resp);
       resp->complete = 1;
       break;
 
     case BMKT_RSP_GET_ENROLLED_FINGERS_REPORT:
-      ret = parse_get_enrolled_fingers_report (msg_resp, resp);
+      ret = parse_get_enrolled_fingers_report (&payload, resp);
       resp->complete = 1;
       break;
 
     case BMKT_RSP_DATABASE_CAPACITY_REPORT:
       resp->complete = 1;
-      ret = parse_db_cap_report (msg_resp, resp);
+      ret = parse_db_cap_report (&payload, resp);
       break;
 
     case BMKT_RSP_TEMPLATE_RECORDS_REPORT:
-      ret = parse_get_enrolled_users_report (msg_resp, resp);
+      ret = parse_get_enrolled_users_report (&payload, resp);
       break;
 
     case BMKT_RSP_QUERY_RESPONSE_COMPLETE:
@@ -388,7 +406,7 @@ bmkt_parse_message_payload (bmkt_msg_resp_t *msg_resp, bmkt_response_t *resp)
       break;
 
     case BMKT_RSP_VERSION_INFO:
-      ret = parse_get_version_report (msg_resp, resp);
+      ret = parse_get_version_report (&payload, resp);
       resp->complete = 1;
       break;
 
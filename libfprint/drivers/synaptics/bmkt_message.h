@@ -68,11 +68,11 @@
 
 typedef struct bmkt_msg_resp
 {
-  uint8_t  msg_id;
-  uint8_t  seq_num;
-  uint8_t  payload_len;
-  uint8_t *payload;
-  int      result;
+  uint8_t        msg_id;
+  uint8_t        seq_num;
+  uint8_t        payload_len;
+  const uint8_t *payload;
+  int            result;
 } bmkt_msg_resp_t;
 
 int bmkt_compose_message (uint8_t       *cmd,
@@ -87,3 +87,5 @@ int bmkt_parse_message_header (uint8_t         *resp_buf,
                                bmkt_msg_resp_t *msg_resp);
 int bmkt_parse_message_payload (bmkt_msg_resp_t *msg_resp,
                                 bmkt_response_t *resp);
+gboolean bmkt_get_next_enroll_template (FpiByteReader          *templates,
+                                        bmkt_enroll_template_t *template);
@@ -20,6 +20,7 @@
 #pragma once
 
 #include "bmkt.h"
+#include "fpi-byte-reader.h"
 
 /** List of response message IDs */
 #define BMKT_RSP_CONTINUOUS_IMAGE_CAPTURE_FAIL 0x02
@@ -313,23 +314,27 @@ typedef struct bmkt_init_resp
 /**
  * bmkt_enroll_resp:
  * Response payload data structure returned by enrollment operation.
+ * The user_id points into the received message.
  */
 typedef struct bmkt_enroll_resp
 {
-  int     progress;                             /**< Shows current progress status [0-100] */
-  uint8_t finger_id;                            /**< User's finger id [1-10] */
-  uint8_t user_id[BMKT_MAX_USER_ID_LEN];        /**< User name to be enrolled */
+  int            progress;                      /**< Shows current progress status [0-100] */
+  uint8_t        finger_id;                     /**< User's finger id [1-10] */
+  uint8_t        user_id_len;                   /**< Length of user_id */
+  const uint8_t *user_id;                       /**< User name to be enrolled */
 } bmkt_enroll_resp_t;
 
 /**
  * bmkt_auth_resp:
  * Response payload data structure returned by identify and verify operations.
+ * The user_id points into the received message.
  */
 struct bmkt_auth_resp
 {
-  double  match_result;                         /**< match result returned by matcher */
-  uint8_t finger_id;                            /**< Matched templates's finger id */
-  uint8_t user_id[BMKT_MAX_USER_ID_LEN];        /**< Matched template's user id */
+  double         match_result;                  /**< match result returned by matcher */
+  uint8_t        finger_id;                     /**< Matched templates's finger id */
+  uint8_t        user_id_len;                   /**< Length of user_id */
+  const uint8_t *user_id;                       /**< Matched template's user id */
 };
 
 typedef struct bmkt_auth_resp bmkt_verify_resp_t;   /**< Returned by verify */
@@ -411,25 +416,30 @@ typedef struct bmkt_del_user_resp
 
 /**
  * bmkt_enroll_template:
- * Structure of enrolled users template record data.
+ * Structure of enrolled users template record data, see
+ * bmkt_get_next_enroll_template(). The user_id points into the received
+ * message.
  */
 typedef struct bmkt_enroll_template
 {
-  uint8_t user_id_len;                              /**< Length of user_id string */
-  uint8_t template_status;                          /**< Template record status  */
-  uint8_t finger_id;                                /**< ID of enrolled finger */
-  uint8_t user_id[BMKT_MAX_USER_ID_LEN + 1];        /**< Name of the enrolled user */
+  uint8_t        user_id_len;                       /**< Length of user_id string */
+  uint8_t        template_status;                   /**< Template record status  */
+  uint8_t        finger_id;                         /**< ID of enrolled finger */
+  const uint8_t *user_id;                           /**< Name of the enrolled user */
 } bmkt_enroll_template_t;
 
 /**
  * bmkt_enroll_templates_resp:
  * Response payload data structure returned by get enrolled user list operation.
+ * The template records are validated while parsing and are iterated in
+ * place using bmkt_get_next_enroll_template().
  */
 typedef struct bmkt_enroll_templates_resp
 {
-  uint8_t                total_query_messages;                                   /**< Total query response messages */
-  uint8_t                query_sequence;                                         /**< Query response sequence number */
-  bmkt_enroll_template_t templates[BMKT_MAX_NUM_TEMPLATES_INTERNAL_FLASH];       /**< Enrolled user template records list */
+  uint8_t       total_query_messages;                                   /**< Total query response messages */
+  uint8_t       query_sequence;                                         /**< Query response sequence number */
+  uint8_t       num_templates;                                          /**< Number of template records */
+  FpiByteReader templates;                                              /**< Enrolled user template records list */
 } bmkt_enroll_templates_resp_t;
 
 /**
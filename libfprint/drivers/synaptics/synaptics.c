@@ -483,7 +483,8 @@ parse_print_data (GVariant      *data,
 
 static FpPrint *
 create_print (FpiDeviceSynaptics *self,
-              guint8             *user_id,
+              const guint8       *user_id,
+              gsize               user_id_len,
               guint8              finger_id)
 {
   FpPrint *print;
@@ -491,7 +492,7 @@ create_print (FpiDeviceSynaptics *self,
   GVariant *data = NULL;
   GVariant *uid = NULL;
 
-  user_id_safe = g_strndup ((char *) user_id, BMKT_MAX_USER_ID_LEN);
+  user_id_safe = g_strndup ((const char *) user_id, user_id_len);
 
   print = fp_print_new (FP_DEVICE (self));
   uid = g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
@@ -602,8 +603,9 @@ verify_msg_cb (FpiDeviceSynaptics *self,
       break;
 
     case BMKT_RSP_VERIFY_OK:
-      fp_info ("Verify was successful! for user: %s finger: %d score: %f",
-               verify_resp->user_id, verify_resp->finger_id, verify_resp->match_result);
+      fp_info ("Verify was successful! for user: %.*s finger: %d score: %f",
+               verify_resp->user_id_len, verify_resp->user_id,
+               verify_resp->finger_id, verify_resp->match_result);
       fpi_device_verify_report (device, FPI_MATCH_SUCCESS, NULL, NULL);
       verify_complete_after_finger_removal (self);
       break;
@@ -735,6 +737,7 @@ identify_msg_cb (FpiDeviceSynaptics *self,
 
         print = create_print (self,
                               resp->response.id_resp.user_id,
+                              resp->response.id_resp.user_id_len,
                               resp->response.id_resp.finger_id);
 
         fpi_device_get_identify_data (device, &prints);
@@ -73,13 +73,9 @@ struct _FpiDeviceUpeksonly
 
   FpiSsm       *loopsm;
 
-  /* Do we really need multiple concurrent transfers? */
-  GCancellable                    *img_cancellable;
-  GPtrArray                       *img_transfers;
-  int                              num_flying;
+  FpiUsbStream                    *img_stream;
 
-  GSList                          *rows;
-  unsigned                         num_rows;
+  FpiLineBuffer                   *rows;
   unsigned char                   *rowbuf;
   int                              rowbuf_offset;
 
@@ -103,9 +99,11 @@ G_DEFINE_TYPE (FpiDeviceUpeksonly, fpi_device_upeksonly, FP_TYPE_IMAGE_DEVICE);
 /* Calculate squared standard deviation of sum of two lines */
 static int
 upeksonly_get_deviation2 (struct fpi_line_asmbl_ctx *ctx,
-                          GSList *line1, GSList *line2)
+                          const FpiLineBuffer *lines,
+                          guint line1, guint line2)
 {
-  unsigned char *buf1 = line1->data, *buf2 = line2->data;
+  unsigned char *buf1 = fpi_line_buffer_get_line (lines, line1);
+  unsigned char *buf2 = fpi_line_buffer_get_line (lines, line2);
   int res = 0, mean = 0, i;
 
   g_assert (ctx->line_width > 0);
@@ -127,7 +125,8 @@ upeksonly_get_deviation2 (struct fpi_line_asmbl_ctx *ctx,
 
 static unsigned char
 upeksonly_get_pixel (struct fpi_line_asmbl_ctx *ctx,
-                     GSList                    *row,
+                     const FpiLineBuffer       *lines,
+                     guint                      row,
                      unsigned                   x)
 {
   unsigned char *buf;
@@ -141,10 +140,10 @@ upeksonly_get_pixel (struct fpi_line_asmbl_ctx *ctx,
   else
     return 0;
   /* Each 2nd pixel is shifted 2 pixels down */
-  if ((!(x & 1)) && g_slist_next (row) && g_slist_next (g_slist_next (row)))
-    buf = g_slist_next (g_slist_next (row))->data;
+  if ((!(x & 1)) && row + 2 < lines->num_lines)
+    buf = fpi_line_buffer_get_line (lines, row + 2);
   else
-    buf = row->data;
+    buf = fpi_line_buffer_get_line (lines, row);
 
   return buf[offset];
 }
@@ -154,9 +153,7 @@ upeksonly_get_pixel (struct fpi_line_asmbl_ctx *ctx,
 static void
 free_img_transfers (FpiDeviceUpeksonly *sdev)
 {
-  g_cancellable_cancel (sdev->img_cancellable);
-  g_clear_object (&sdev->img_cancellable);
-  g_clear_pointer (&sdev->img_transfers, g_ptr_array_unref);
+  g_clear_pointer (&sdev->img_stream, fpi_usb_stream_unref);
 }
 
 static void
@@ -187,16 +184,16 @@ cancel_img_transfers (FpImageDevice *dev)
 {
   FpiDeviceUpeksonly *self = FPI_DEVICE_UPEKSONLY (dev);
 
-  g_cancellable_cancel (self->img_cancellable);
-
-  if (self->num_flying == 0)
+  if (fpi_usb_stream_is_active (self->img_stream))
+    fpi_usb_stream_stop (self->img_stream, NULL);
+  else
     last_transfer_killed (dev);
 }
 
 static gboolean
 is_capturing (FpiDeviceUpeksonly *sdev)
 {
-  return sdev->num_rows < MAX_ROWS && (sdev->finger_state != FINGER_REMOVED);
+  return sdev->rows->num_lines < MAX_ROWS && (sdev->finger_state != FINGER_REMOVED);
 }
 
 static void
@@ -205,21 +202,15 @@ handoff_img (FpImageDevice *dev)
   FpiDeviceUpeksonly *self = FPI_DEVICE_UPEKSONLY (dev);
   FpImage *img;
 
-  GSList *elem = self->rows;
-
-  if (!elem)
+  if (self->rows->num_lines == 0)
     {
       fp_err ("no rows?");
       return;
     }
 
-  self->rows = g_slist_reverse (self->rows);
-
-  fp_dbg ("%u rows", self->num_rows);
-  img = fpi_assemble_lines (&self->assembling_ctx, self->rows, self->num_rows);
-
-  g_slist_free_full (self->rows, g_free);
-  self->rows = NULL;
+  fp_dbg ("%u rows", self->rows->num_lines);
+  img = fpi_assemble_lines (&self->assembling_ctx, self->rows,
+                            self->rows->num_lines);
 
   fpi_image_device_image_captured (dev, img);
   fpi_image_device_report_finger_status (dev, FALSE);
@@ -236,14 +227,17 @@ row_complete (FpImageDevice *dev)
 
   self->rowbuf_offset = -1;
 
-  if (self->num_rows > 0)
+  if (self->rows->num_lines > 0)
     {
-      unsigned char *lastrow = self->rows->data;
+      unsigned char *lastrow;
+      FpiLineStats stats;
       int std_sq_dev, mean_sq_diff;
 
-      std_sq_dev = fpi_std_sq_dev (self->rowbuf, self->img_width);
-      mean_sq_diff = fpi_mean_sq_diff_norm (lastrow, self->rowbuf,
-                                            self->img_width);
+      lastrow = fpi_line_buffer_get_line (self->rows,
+                                          self->rows->num_lines - 1);
+      fpi_get_line_stats (self->rowbuf, lastrow, self->img_width, &stats);
+      std_sq_dev = stats.sq_dev;
+      mean_sq_diff = stats.sq_diff;
 
       switch (self->finger_state)
         {
@@ -296,7 +290,7 @@ row_complete (FpImageDevice *dev)
             {
               self->finger_state = FINGER_REMOVED;
               fp_dbg ("detected finger removal. Blank rows: %d, Full rows: %u",
-                      self->num_blank, self->num_rows);
+                      self->num_blank, self->rows->num_lines);
               handoff_img (dev);
               return;
             }
@@ -310,26 +304,20 @@ row_complete (FpImageDevice *dev)
   switch (self->finger_state)
     {
     case AWAIT_FINGER:
-      if (!self->num_rows)
-        {
-          self->rows = g_slist_prepend (self->rows, self->rowbuf);
-          self->num_rows++;
-        }
+      if (!self->rows->num_lines)
+        fpi_line_buffer_commit_line (self->rows);
       else
-        {
-          return;
-        }
+        return;
       break;
 
     case FINGER_DETECTED:
     case FINGER_REMOVED:
-      self->rows = g_slist_prepend (self->rows, self->rowbuf);
-      self->num_rows++;
+      fpi_line_buffer_commit_line (self->rows);
       break;
     }
   self->rowbuf = NULL;
 
-  if (self->num_rows >= MAX_ROWS)
+  if (self->rows->num_lines >= MAX_ROWS)
     {
       fp_dbg ("row limit met");
       handoff_img (dev);
@@ -353,8 +341,15 @@ static void
 start_new_row (FpiDeviceUpeksonly *self, unsigned char *data,
                int size)
 {
+  /* The row is assembled in place, and only kept if row_complete
+   * commits it. Once the buffer is full, further data is dropped. */
+  self->rowbuf = fpi_line_buffer_get_free_line (self->rows);
   if (!self->rowbuf)
-    self->rowbuf = g_malloc (self->img_width);
+    {
+      self->rowbuf_offset = -1;
+      return;
+    }
+
   memcpy (self->rowbuf, data, size);
   self->rowbuf_offset = size;
 }
@@ -405,11 +400,11 @@ handle_packet (FpImageDevice *dev, unsigned char *data)
               abs_base_addr = (self->last_seqnum + 1) * 62;
 
               /* If possible take the replacement data from last row */
-              if (self->num_rows > 1)
+              if (self->rows->num_lines > 1)
                 {
                   int row_left = self->img_width - self->rowbuf_offset;
-                  unsigned char *last_row = g_slist_nth_data (self->rows,
-                                                              0);
+                  unsigned char *last_row = fpi_line_buffer_get_line (self->rows,
+                                                                      self->rows->num_lines - 1);
 
                   if (row_left >= 62)
                     {
@@ -498,45 +493,44 @@ handle_packet (FpImageDevice *dev, unsigned char *data)
 }
 
 static void
-img_data_cb (FpiUsbTransfer *transfer, FpDevice *device,
-             gpointer user_data, GError *error)
+img_stream_done_cb (FpiUsbStream *stream, FpDevice *device,
+                    gpointer user_data, GError *error)
 {
   FpImageDevice *dev = FP_IMAGE_DEVICE (device);
   FpiDeviceUpeksonly *self = FPI_DEVICE_UPEKSONLY (dev);
-  int i;
 
-  self->num_flying--;
-
-  if (self->killing_transfers)
+  /* don't care about error or success if we're terminating */
+  if (error && !self->killing_transfers)
     {
-      if (self->num_flying == 0)
-        last_transfer_killed (dev);
+      fp_warn ("bad status %s, terminating session", error->message);
+      self->killing_transfers = IMG_SESSION_ERROR;
 
-      /* don't care about error or success if we're terminating */
-      g_clear_error (&error);
-      return;
+      /* This cannot really happen, but just in case. */
+      if (!self->kill_error)
+        self->kill_error = g_steal_pointer (&error);
     }
+  g_clear_error (&error);
+
+  last_transfer_killed (dev);
+}
+
+static void
+img_data_cb (FpiUsbStream *stream, FpiUsbTransfer *transfer,
+             FpDevice *device, gpointer user_data)
+{
+  FpImageDevice *dev = FP_IMAGE_DEVICE (device);
+  FpiDeviceUpeksonly *self = FPI_DEVICE_UPEKSONLY (dev);
+  int i;
 
   /* NOTE: The old code assume 4096 bytes are received each time
    * but there is no reason we need to enforce that. However, we
    * always need full lines. */
   if (transfer->actual_length % 64 != 0)
-    error = fpi_device_error_new_msg (FP_DEVICE_ERROR_PROTO,
-                                      "Data packets need to be multiple of 64 bytes, got %zi bytes",
-                                      transfer->actual_length);
-
-  if (error)
     {
-      fp_warn ("bad status %s, terminating session", error->message);
-      self->killing_transfers = IMG_SESSION_ERROR;
-
-      /* This cannot really happen, but just in case. */
-      if (!self->kill_error)
-        self->kill_error = error;
-      else
-        g_error_free (error);
-
-      cancel_img_transfers (dev);
+      fpi_usb_stream_stop (stream,
+                           fpi_device_error_new_msg (FP_DEVICE_ERROR_PROTO,
+                                                     "Data packets need to be multiple of 64 bytes, got %zi bytes",
+                                                     transfer->actual_length));
       return;
     }
 
@@ -545,22 +539,12 @@ img_data_cb (FpiUsbTransfer *transfer, FpDevice *device,
    * the first 2 bytes are a sequence number
    * then there are 62 bytes for image data
    */
-  for (i = 0; i + 64 <= transfer->actual_length; i += 64)
-    {
-      if (!is_capturing (self))
-        return;
-      handle_packet (dev, transfer->buffer + i);
-    }
+  for (i = 0; i + 64 <= transfer->actual_length && is_capturing (self); i += 64)
+    handle_packet (dev, transfer->buffer + i);
 
-  if (is_capturing (self))
-    {
-      fpi_usb_transfer_submit (fpi_usb_transfer_ref (transfer),
-                               0,
-                               self->img_cancellable,
-                               img_data_cb,
-                               user_data);
-      self->num_flying++;
-    }
+  /* Stop polling for more data, this is a no-op if the image was handed off */
+  if (!is_capturing (self))
+    fpi_usb_stream_stop (stream, NULL);
 }
 
 /***** STATE MACHINE HELPERS *****/
@@ -892,21 +876,11 @@ capsm_fire_bulk (FpiSsm   *ssm,
                  FpDevice *dev)
 {
   FpiDeviceUpeksonly *self = FPI_DEVICE_UPEKSONLY (dev);
-  int i;
 
   g_assert (self->capturing == FALSE);
 
-  g_clear_object (&self->img_cancellable);
-  self->img_cancellable = g_cancellable_new ();
-  for (i = 0; i < self->img_transfers->len; i++)
-    {
-      fpi_usb_transfer_submit (fpi_usb_transfer_ref (g_ptr_array_index (self->img_transfers, i)),
-                               0,
-                               self->img_cancellable,
-                               img_data_cb,
-                               NULL);
-      self->num_flying++;
-    }
+  fpi_usb_stream_start (self->img_stream, 0, NULL,
+                        img_data_cb, img_stream_done_cb, NULL);
   self->capturing = TRUE;
   fpi_ssm_next_state (ssm);
 }
@@ -921,7 +895,7 @@ capsm_2016_run_state (FpiSsm *ssm, FpDevice *_dev)
     {
     case CAPSM_2016_INIT:
       self->rowbuf_offset = -1;
-      self->num_rows = 0;
+      fpi_line_buffer_clear (self->rows);
       self->wraparounds = -1;
       self->num_blank = 0;
       self->num_nonblank = 0;
@@ -958,7 +932,7 @@ capsm_1000_run_state (FpiSsm *ssm, FpDevice *_dev)
     {
     case CAPSM_1000_INIT:
       self->rowbuf_offset = -1;
-      self->num_rows = 0;
+      fpi_line_buffer_clear (self->rows);
       self->wraparounds = -1;
       self->num_blank = 0;
       self->num_nonblank = 0;
@@ -987,7 +961,7 @@ capsm_1001_run_state (FpiSsm *ssm, FpDevice *_dev)
     {
     case CAPSM_1001_INIT:
       self->rowbuf_offset = -1;
-      self->num_rows = 0;
+      fpi_line_buffer_clear (self->rows);
       self->wraparounds = -1;
       self->num_blank = 0;
       self->num_nonblank = 0;
@@ -1326,11 +1300,8 @@ deactivate_done (FpImageDevice *dev, GError *error)
 
   G_DEBUG_HERE ();
   free_img_transfers (self);
-  g_free (self->rowbuf);
   self->rowbuf = NULL;
-
-  g_slist_free_full (self->rows, g_free);
-  self->rows = NULL;
+  fpi_line_buffer_clear (self->rows);
 
   fpi_image_device_deactivate_complete (dev, error);
 }
@@ -1392,26 +1363,15 @@ dev_activate (FpImageDevice *dev)
 {
   FpiDeviceUpeksonly *self = FPI_DEVICE_UPEKSONLY (dev);
   FpiSsm *ssm = NULL;
-  int i;
 
   self->deactivating = FALSE;
   self->capturing = FALSE;
 
-  self->num_flying = 0;
-  self->img_transfers = g_ptr_array_new_with_free_func ((GFreeFunc) fpi_usb_transfer_unref);
-
   /* This might seem odd, but we do need multiple in-flight URBs so that
    * we never stop polling the device for more data.
    */
-  for (i = 0; i < NUM_BULK_TRANSFERS; i++)
-    {
-      FpiUsbTransfer *transfer;
-
-      transfer = fpi_usb_transfer_new (FP_DEVICE (dev));
-      fpi_usb_transfer_fill_bulk (transfer, 0x81, 4096);
-
-      g_ptr_array_add (self->img_transfers, transfer);
-    }
+  self->img_stream = fpi_usb_stream_new (FP_DEVICE (dev), 0x81, 4096,
+                                         NUM_BULK_TRANSFERS);
 
   switch (self->dev_model)
     {
@@ -1442,6 +1402,9 @@ static void
 dev_deinit (FpImageDevice *dev)
 {
   GError *error = NULL;
+  FpiDeviceUpeksonly *self = FPI_DEVICE_UPEKSONLY (dev);
+
+  g_clear_pointer (&self->rows, fpi_line_buffer_free);
 
   g_usb_device_release_interface (fpi_device_get_usb_device (FP_DEVICE (dev)),
                                   0, 0, &error);
@@ -1551,5 +1514,6 @@ dev_init (FpImageDevice *dev)
     default:
       g_assert_not_reached ();
     }
+  self->rows = fpi_line_buffer_new (self->img_width, MAX_ROWS);
   fpi_image_device_open_complete (dev, NULL);
 }
@@ -29,7 +29,6 @@
 #define FP_COMPONENT "upekts"
 
 #include "drivers_api.h"
-#include "upek_proto.h"
 
 #define EP_IN (1 | FPI_USB_ENDPOINT_IN)
 #define EP_OUT (2 | FPI_USB_ENDPOINT_OUT)
@@ -125,7 +124,7 @@ alloc_send_cmd_transfer (FpDevice            *dev,
     memcpy (transfer->buffer + 7, data, len);
 
   /* Append CRC */
-  crc = udf_crc (transfer->buffer + 4, urblen - 6);
+  crc = fpi_crc16_ccitt (0, transfer->buffer + 4, urblen - 6);
   transfer->buffer[urblen - 2] = crc & 0xff;
   transfer->buffer[urblen - 1] = crc >> 8;
 
@@ -245,7 +244,7 @@ __handle_incoming_msg (FpDevice             *device,
   len = ((buf[5] & 0xf) << 8) | buf[6];
 
   g_assert (udata->buflen >= len + 9);
-  computed_crc = udf_crc (buf + 4, len + 3);
+  computed_crc = fpi_crc16_ccitt (0, buf + 4, len + 3);
   msg_crc = (buf[len + 8] << 8) | buf[len + 7];
 
   if (computed_crc != msg_crc)
@@ -579,23 +579,104 @@ update_key (uint32_t key)
   return (bit & 0x80000000) | (key >> 1);
 }
 
+static uint8_t
+key_xorbyte (uint32_t key)
+{
+  uint8_t xorbyte;
+
+  xorbyte  = ((key >>  4) & 1) << 0;
+  xorbyte |= ((key >>  8) & 1) << 1;
+  xorbyte |= ((key >> 11) & 1) << 2;
+  xorbyte |= ((key >> 14) & 1) << 3;
+  xorbyte |= ((key >> 18) & 1) << 4;
+  xorbyte |= ((key >> 21) & 1) << 5;
+  xorbyte |= ((key >> 24) & 1) << 6;
+  xorbyte |= ((key >> 29) & 1) << 7;
+
+  return xorbyte;
+}
+
+/* Both the key state after 8 LFSR steps and the 8 xor bytes produced on
+ * the way are linear in the key. They are therefore the XOR of the
+ * contributions of each key byte, which are precomputed in these tables
+ * (byte n of the keystream is in bits 8n..8n+7). */
+static uint64_t keystream_table[4][256];
+static uint32_t key_step8_table[4][256];
+
+static void
+init_keystream_tables (void)
+{
+  int b, v, n;
+
+  for (b = 0; b < 4; b++)
+    {
+      for (v = 0; v < 256; v++)
+        {
+          uint32_t key = (uint32_t) v << (b * 8);
+          uint64_t stream = 0;
+
+          for (n = 0; n < 8; n++)
+            {
+              stream |= (uint64_t) key_xorbyte (key) << (n * 8);
+              key = update_key (key);
+            }
+
+          keystream_table[b][v] = stream;
+          key_step8_table[b][v] = key;
+        }
+    }
+}
+
+static inline uint32_t
+key_step8 (uint32_t key, uint64_t *stream)
+{
+  *stream = keystream_table[0][key & 0xff] ^
+            keystream_table[1][(key >> 8) & 0xff] ^
+            keystream_table[2][(key >> 16) & 0xff] ^
+            keystream_table[3][key >> 24];
+
+  return key_step8_table[0][key & 0xff] ^
+         key_step8_table[1][(key >> 8) & 0xff] ^
+         key_step8_table[2][(key >> 16) & 0xff] ^
+         key_step8_table[3][key >> 24];
+}
+
+static uint32_t
+skip_key (uint32_t key, int num_bytes)
+{
+  uint64_t stream;
+  int i;
+
+  for (i = 0; i + 8 <= num_bytes; i += 8)
+    key = key_step8 (key, &stream);
+
+  for (; i < num_bytes; i++)
+    key = update_key (key);
+
+  return key;
+}
+
 static uint32_t
 do_decode (uint8_t *data, int num_bytes, uint32_t key)
 {
-  uint8_t xorbyte;
+  uint64_t block, stream;
   int i;
 
-  for (i = 0; i < num_bytes - 1; i++)
+  /* decrypt 8 bytes at a time, each byte is shifted down by one */
+  for (i = 0; i + 8 < num_bytes; i += 8)
+    {
+      key = key_step8 (key, &stream);
+
+      memcpy (&block, &data[i + 1], sizeof (block));
+      block = GUINT64_TO_LE (GUINT64_FROM_LE (block) ^ stream);
+      memcpy (&data[i], &block, sizeof (block));
+    }
+
+  for (; i < num_bytes - 1; i++)
     {
       /* calculate xor byte and update key */
-      xorbyte  = ((key >>  4) & 1) << 0;
-      xorbyte |= ((key >>  8) & 1) << 1;
-      xorbyte |= ((key >> 11) & 1) << 2;
-      xorbyte |= ((key >> 14) & 1) << 3;
-      xorbyte |= ((key >> 18) & 1) << 4;
-      xorbyte |= ((key >> 21) & 1) << 5;
-      xorbyte |= ((key >> 24) & 1) << 6;
-      xorbyte |= ((key >> 29) & 1) << 7;
+      uint8_t xorbyte = key_xorbyte (key);
+
       key = update_key (key);
 
       /* decrypt data */
@@ -738,8 +819,7 @@ imaging_run_state (FpiSsm *ssm, FpDevice *_dev)
 
             case 0:
               fp_dbg ("skipping %d lines", num_lines);
-              for (r = 0; r < IMAGE_WIDTH * num_lines; r++)
-                key = update_key (key);
+              key = skip_key (key, IMAGE_WIDTH * num_lines);
               break;
             }
           if ((flags & BLOCKF_NOT_PRESENT) == 0)
@@ -1470,4 +1550,6 @@ fpi_device_uru4000_class_init (FpiDeviceUru4000Class *klass)
 
   img_class->img_width = IMAGE_WIDTH;
   img_class->img_height = IMAGE_HEIGHT;
+
+  init_keystream_tables ();
 }
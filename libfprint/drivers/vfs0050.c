@@ -169,18 +169,18 @@ async_abort (FpDevice *dev, FpiSsm *ssm, int ep)
 /* Pixel getter for fpi_assemble_lines */
 static unsigned char
 vfs0050_get_pixel (struct fpi_line_asmbl_ctx *ctx,
-                   GSList * line, unsigned int x)
+                   const FpiLineBuffer *lines, guint line, unsigned int x)
 {
-  return ((struct vfs_line *) line->data)->data[x];
+  return ((struct vfs_line *) fpi_line_buffer_get_line (lines, line))->data[x];
 }
 
 /* Deviation getter for fpi_assemble_lines */
 static int
 vfs0050_get_difference (struct fpi_line_asmbl_ctx *ctx,
-                        GSList * line_list_1, GSList * line_list_2)
+                        const FpiLineBuffer *lines, guint line_1, guint line_2)
 {
-  struct vfs_line *line1 = line_list_1->data;
-  struct vfs_line *line2 = line_list_2->data;
+  struct vfs_line *line1 = (struct vfs_line *) fpi_line_buffer_get_line (lines, line_1);
+  struct vfs_line *line2 = (struct vfs_line *) fpi_line_buffer_get_line (lines, line_2);
   const int shift = (VFS_IMAGE_WIDTH - VFS_NEXT_LINE_WIDTH) / 2 - 1;
   int res = 0;
 
@@ -242,17 +242,16 @@ prepare_image (FpDeviceVfs0050 *vdev)
   if (height < VFS_IMAGE_WIDTH)
     return NULL;
 
-  /* Building GSList */
-  GSList *lines = NULL;
-
-  for (int i = height - 1; i >= 0; --i)
-    lines = g_slist_prepend (lines, vdev->lines_buffer + i);
+  /* The lines were received into one contiguous buffer already */
+  FpiLineBuffer lines = {
+    .data = (guint8 *) vdev->lines_buffer,
+    .line_size = sizeof (struct vfs_line),
+    .num_lines = height,
+    .max_lines = height,
+  };
 
   /* Perform line assembling */
-  FpImage *img = fpi_assemble_lines (&assembling_ctx, lines, height);
-
-  g_slist_free (lines);
-  return img;
+  return fpi_assemble_lines (&assembling_ctx, &lines, height);
 }
 
 /* Processes and submits image after fingerprint received */
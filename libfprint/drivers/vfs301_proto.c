@@ -35,6 +35,7 @@
 #include <glib.h>
 
 #include "fpi-usb-transfer.h"
+#include "fpi-image.h"
 #include "vfs301.h"
 #include "vfs301_proto_fragments.h"
 
@@ -310,8 +311,6 @@ scanline_diff (const guint8 *scanlines, int prev, int cur)
 {
   const guint8 *line1 = scanlines + prev * VFS301_FP_OUTPUT_WIDTH;
   const guint8 *line2 = scanlines + cur * VFS301_FP_OUTPUT_WIDTH;
-  int i;
-  int diff;
 
 #ifdef OUTPUT_RAW
   /* We only need the image, not the surrounding stuff. */
@@ -321,18 +320,8 @@ scanline_diff (const guint8 *scanlines, int prev, int cur)
 
   /* TODO: This doesn't work too well when there are parallel lines in the
    * fingerprint. */
-  for (diff = 0, i = 0; i < VFS301_FP_WIDTH; i++)
-    {
-      if (*line1 > *line2)
-        diff += *line1 - *line2;
-      else
-        diff += *line2 - *line1;
-
-      line1++;
-      line2++;
-    }
-
-  return (diff / VFS301_FP_WIDTH) > VFS301_FP_LINE_DIFF_THRESHOLD;
+  return (fpi_sum_abs_diff (line1, line2, VFS301_FP_WIDTH) / VFS301_FP_WIDTH) >
+         VFS301_FP_LINE_DIFF_THRESHOLD;
 }
 
 /** Transform the input data to a normalized fingerprint scan */
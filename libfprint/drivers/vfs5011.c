@@ -207,14 +207,17 @@ usb_exchange_async (FpiSsm                  *ssm,
 
 /* Calculade squared standand deviation of sum of two lines */
 static int
-vfs5011_get_deviation2 (struct fpi_line_asmbl_ctx *ctx, GSList *row1, GSList *row2)
+vfs5011_get_deviation2 (struct fpi_line_asmbl_ctx *ctx,
+                        const FpiLineBuffer       *lines,
+                        guint                      row1,
+                        guint                      row2)
 {
   unsigned char *buf1, *buf2;
   int res = 0, mean = 0, i;
   const int size = 64;
 
-  buf1 = (unsigned char *) row1->data + 56;
-  buf2 = (unsigned char *) row2->data + 168;
+  buf1 = fpi_line_buffer_get_line (lines, row1) + 56;
+  buf2 = fpi_line_buffer_get_line (lines, row2) + 168;
 
   for (i = 0; i < size; i++)
     mean += (int) buf1[i] + (int) buf2[i];
@@ -232,10 +235,11 @@ vfs5011_get_deviation2 (struct fpi_line_asmbl_ctx *ctx, GSList *row1, GSList *ro
 
 static unsigned char
 vfs5011_get_pixel (struct fpi_line_asmbl_ctx *ctx,
-                   GSList                    *row,
+                   const FpiLineBuffer       *lines,
+                   guint                      row,
                    unsigned                   x)
 {
-  unsigned char *data = (unsigned char *) row->data + 8;
+  unsigned char *data = fpi_line_buffer_get_line (lines, row) + 8;
 
   return data[x];
 }
@@ -244,6 +248,7 @@ vfs5011_get_pixel (struct fpi_line_asmbl_ctx *ctx,
 
 enum {
   CAPTURE_LINES = 256,
+  CAPTURE_TRANSFERS = 4,
   MAXLINES = 2000,
   MAX_CAPTURE_LINES = 100000,
 };
@@ -263,12 +268,12 @@ struct _FpDeviceVfs5011
   FpImageDevice           parent;
 
   unsigned char          *total_buffer;
-  unsigned char          *capture_buffer;
+  FpiUsbStream           *capture_stream;
   unsigned char          *row_buffer;
   unsigned char          *lastline;
-  GSList                 *rows;
-  int                     lines_captured, lines_recorded, empty_lines;
-  int                     max_lines_captured, max_lines_recorded;
+  FpiLineBuffer          *rows;
+  int                     lines_captured, empty_lines;
+  int                     max_lines_captured;
   int                     lines_total, lines_total_allocated;
   gboolean                loop_running;
   gboolean                deactivating;
@@ -294,23 +299,21 @@ enum {
 };
 
 static void
-capture_init (FpDeviceVfs5011 *self, int max_captured,
-              int max_recorded)
+capture_init (FpDeviceVfs5011 *self, int max_captured)
 {
   fp_dbg ("capture_init");
   self->lastline = NULL;
   self->lines_captured = 0;
-  self->lines_recorded = 0;
   self->empty_lines = 0;
   self->lines_total = 0;
   self->lines_total_allocated = 0;
   self->total_buffer = NULL;
   self->max_lines_captured = max_captured;
-  self->max_lines_recorded = max_recorded;
+  fpi_line_buffer_clear (self->rows);
 }
 
 static int
-process_chunk (FpDeviceVfs5011 *self, int transferred)
+process_chunk (FpDeviceVfs5011 *self, unsigned char *buffer, int transferred)
 {
   enum {
     DEVIATION_THRESHOLD = 15 * 15,
@@ -324,11 +327,14 @@ process_chunk (FpDeviceVfs5011 *self, int transferred)
 
   for (i = 0; i < lines_captured; i++)
     {
-      unsigned char *linebuf = self->capture_buffer
-                               + i * VFS5011_LINE_SIZE;
+      unsigned char *linebuf = buffer + i * VFS5011_LINE_SIZE;
+      FpiLineStats stats;
 
-      if (fpi_std_sq_dev (linebuf + 8, VFS5011_IMAGE_WIDTH)
-          < DEVIATION_THRESHOLD)
+      fpi_get_line_stats (linebuf + 8,
+                          self->lastline ? self->lastline + 8 : NULL,
+                          VFS5011_IMAGE_WIDTH, &stats);
+
+      if (stats.sq_dev < DEVIATION_THRESHOLD)
         {
           if (self->lines_captured == 0)
             continue;
@@ -355,19 +361,14 @@ process_chunk (FpDeviceVfs5011 *self, int transferred)
         }
 
       if ((self->lastline == NULL) ||
-          (fpi_mean_sq_diff_norm (self->lastline + 8,
-                                  linebuf + 8,
-                                  VFS5011_IMAGE_WIDTH) >= DIFFERENCE_THRESHOLD))
+          (stats.sq_diff >= DIFFERENCE_THRESHOLD))
         {
-          self->lastline = g_malloc (VFS5011_LINE_SIZE);
-          self->rows = g_slist_prepend (self->rows,
-                                        self->lastline);
-          memmove (self->lastline, linebuf, VFS5011_LINE_SIZE);
-          self->lines_recorded++;
-          if (self->lines_recorded >= self->max_lines_recorded)
+          self->lastline = fpi_line_buffer_get_free_line (self->rows);
+          fpi_line_buffer_append (self->rows, linebuf);
+          if (self->rows->num_lines >= self->rows->max_lines)
             {
-              fp_dbg ("process_chunk: recorded %d lines, finishing",
-                      self->lines_recorded);
+              fp_dbg ("process_chunk: recorded %u lines, finishing",
+                      self->rows->num_lines);
               return 1;
             }
         }
@@ -382,21 +383,14 @@ submit_image (FpiSsm          *ssm,
 {
   FpImage *img;
 
-  if (self->lines_recorded < VFS5011_IMAGE_WIDTH)
+  if (self->rows->num_lines < VFS5011_IMAGE_WIDTH)
     {
       fpi_image_device_retry_scan (dev, FP_DEVICE_RETRY_TOO_SHORT);
       return;
     }
 
-  g_assert (self->rows != NULL);
-
-  self->rows = g_slist_reverse (self->rows);
-
   img = fpi_assemble_lines (&assembling_ctx, self->rows,
-                            self->lines_recorded);
-
-  g_slist_free_full (self->rows, g_free);
-  self->rows = NULL;
+                            self->rows->num_lines);
 
   fp_dbg ("Image captured, committing");
 
@@ -404,68 +398,46 @@ submit_image (FpiSsm          *ssm,
 }
 
 static void
-chunk_capture_callback (FpiUsbTransfer *transfer, FpDevice *device,
-                        gpointer user_data, GError *error)
+chunk_capture_callback (FpiUsbStream *stream, FpiUsbTransfer *transfer,
+                        FpDevice *device, gpointer user_data)
 {
   FpImageDevice *dev = FP_IMAGE_DEVICE (device);
   FpDeviceVfs5011 *self;
 
   self = FPI_DEVICE_VFS5011 (dev);
 
-  if (!error ||
-      g_error_matches (error, G_USB_DEVICE_ERROR, G_USB_DEVICE_ERROR_TIMED_OUT))
-    {
-      if (error)
-        g_error_free (error);
+  fp_dbg ("chunk_capture_callback: got %zd bytes, already have %u lines",
+          transfer->actual_length, self->rows->num_lines);
 
-      if (transfer->actual_length > 0)
-        fpi_image_device_report_finger_status (dev, TRUE);
+  if (transfer->actual_length > 0)
+    fpi_image_device_report_finger_status (dev, TRUE);
 
-      if (process_chunk (self, transfer->actual_length))
-        fpi_ssm_jump_to_state (transfer->ssm,
-                               DEV_ACTIVATE_DATA_COMPLETE);
-      else
-        fpi_ssm_jump_to_state (transfer->ssm,
-                               DEV_ACTIVATE_READ_DATA);
-    }
-  else
-    {
-      if (!self->deactivating)
-        {
-          fp_err ("Failed to capture data");
-          fpi_ssm_mark_failed (transfer->ssm, error);
-        }
-      else
-        {
-          g_error_free (error);
-          fpi_ssm_mark_completed (transfer->ssm);
-        }
-    }
+  if (process_chunk (self, transfer->buffer, transfer->actual_length) ||
+      self->deactivating)
+    fpi_usb_stream_stop (stream, NULL);
 }
 
 static void
-capture_chunk_async (FpDeviceVfs5011 *self,
-                     GUsbDevice *handle, int nline,
-                     int timeout, FpiSsm *ssm)
+chunk_capture_done (FpiUsbStream *stream, FpDevice *device,
+                    gpointer user_data, GError *error)
 {
-  FpiUsbTransfer *transfer;
+  FpDeviceVfs5011 *self = FPI_DEVICE_VFS5011 (device);
+  FpiSsm *ssm = user_data;
 
-  fp_dbg ("capture_chunk_async: capture %d lines, already have %d",
-          nline, self->lines_recorded);
-  enum {
-    DEVIATION_THRESHOLD = 15 * 15,
-    DIFFERENCE_THRESHOLD = 600,
-    STOP_CHECK_LINES = 50
-  };
-
-  transfer = fpi_usb_transfer_new (FP_DEVICE (self));
-  fpi_usb_transfer_fill_bulk_full (transfer,
-                                   VFS5011_IN_ENDPOINT_DATA,
-                                   self->capture_buffer,
-                                   nline * VFS5011_LINE_SIZE, NULL);
-  transfer->ssm = ssm;
-  fpi_usb_transfer_submit (transfer, timeout, fpi_device_get_cancellable (FP_DEVICE (self)),
-                           chunk_capture_callback, NULL);
+  if (!error)
+    {
+      fpi_ssm_jump_to_state (ssm, DEV_ACTIVATE_DATA_COMPLETE);
+    }
+  else if (!self->deactivating)
+    {
+      fp_err ("Failed to capture data");
+      fpi_ssm_mark_failed (ssm, error);
+    }
+  else
+    {
+      g_error_free (error);
+      fpi_ssm_mark_completed (ssm);
+    }
 }
 
 /*
@@ -693,16 +665,17 @@ activate_loop (FpiSsm *ssm, FpDevice *_dev)
       if (self->init_sequence.receive_buf != NULL)
         g_free (self->init_sequence.receive_buf);
       self->init_sequence.receive_buf = NULL;
-      capture_init (self, MAX_CAPTURE_LINES, MAXLINES);
+      capture_init (self, MAX_CAPTURE_LINES);
       fpi_image_device_activate_complete (dev, NULL);
       fpi_ssm_next_state (ssm);
       break;
 
     case DEV_ACTIVATE_READ_DATA:
-      capture_chunk_async (self,
-                           fpi_device_get_usb_device (FP_DEVICE (dev)),
-                           CAPTURE_LINES,
-                           READ_TIMEOUT, ssm);
+      /* Keep multiple reads queued, so that no lines are lost while
+       * the previous chunk is being processed. */
+      fpi_usb_stream_start (self->capture_stream, READ_TIMEOUT,
+                            fpi_device_get_cancellable (FP_DEVICE (dev)),
+                            chunk_capture_callback, chunk_capture_done, ssm);
       break;
 
     case DEV_ACTIVATE_DATA_COMPLETE:
@@ -787,6 +760,13 @@ open_loop_complete (FpiSsm *ssm, FpDevice *_dev, GError *error)
   g_free (self->init_sequence.receive_buf);
   self->init_sequence.receive_buf = NULL;
 
+  /* dev_close() is not called if opening fails */
+  if (error)
+    {
+      g_clear_pointer (&self->capture_stream, fpi_usb_stream_unref);
+      g_clear_pointer (&self->rows, fpi_line_buffer_free);
+    }
+
   fpi_image_device_open_complete (dev, error);
 }
 
@@ -798,7 +778,6 @@ dev_open (FpImageDevice *dev)
   FpDeviceVfs5011 *self;
 
   self = FPI_DEVICE_VFS5011 (dev);
-  self->capture_buffer = g_new0 (unsigned char, CAPTURE_LINES * VFS5011_LINE_SIZE);
 
   if (!g_usb_device_claim_interface (fpi_device_get_usb_device (FP_DEVICE (dev)), 0, 0, &error))
     {
@@ -806,6 +785,12 @@ dev_open (FpImageDevice *dev)
       return;
     }
 
+  self->capture_stream = fpi_usb_stream_new (FP_DEVICE (dev),
+                                             VFS5011_IN_ENDPOINT_DATA,
+                                             CAPTURE_LINES * VFS5011_LINE_SIZE,
+                                             CAPTURE_TRANSFERS);
+  self->rows = fpi_line_buffer_new (VFS5011_LINE_SIZE, MAXLINES);
+
   ssm = fpi_ssm_new (FP_DEVICE (dev), open_loop, DEV_OPEN_NUM_STATES);
   fpi_ssm_start (ssm, open_loop_complete);
 }
@@ -819,8 +804,8 @@ dev_close (FpImageDevice *dev)
   g_usb_device_release_interface (fpi_device_get_usb_device (FP_DEVICE (dev)),
                                   0, 0, &error);
 
-  g_free (self->capture_buffer);
-  g_slist_free_full (g_steal_pointer (&self->rows), g_free);
+  g_clear_pointer (&self->capture_stream, fpi_usb_stream_unref);
+  g_clear_pointer (&self->rows, fpi_line_buffer_free);
 
   fpi_image_device_close_complete (dev, error);
 }
@@ -461,8 +461,8 @@ capture_chunk_async (FpiSsm *ssm, FpDevice *_dev, guint timeout)
 
   transfer = fpi_usb_transfer_new (_dev);
 
-  fpi_usb_transfer_fill_bulk (transfer, VFS7552_IN_ENDPOINT,
-                              VFS7552_RECEIVE_BUF_SIZE);
+  fpi_usb_transfer_fill_bulk_pooled (transfer, VFS7552_IN_ENDPOINT,
+                                     VFS7552_RECEIVE_BUF_SIZE);
 
   transfer->ssm = ssm;
   fpi_usb_transfer_submit (transfer, timeout, NULL,
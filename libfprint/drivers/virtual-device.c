@@ -55,10 +55,10 @@ maybe_continue_current_action (FpDeviceVirtualDevice *self)
 {
   FpDevice *dev = FP_DEVICE (self);
 
-  if (self->sleep_timeout_id)
+  if (self->sleep_timeout)
     return;
 
-  g_assert (self->wait_command_id == 0);
+  g_assert (self->wait_command_timeout == NULL);
 
   switch (fpi_device_get_current_action (dev))
     {
@@ -98,35 +98,47 @@ maybe_continue_current_action (FpDeviceVirtualDevice *self)
     case FPI_DEVICE_ACTION_NONE:
     case FPI_DEVICE_ACTION_PROBE:
     case FPI_DEVICE_ACTION_CAPTURE:
+    case FPI_DEVICE_ACTION_LAST:
     default:
       break;
     }
 }
 
-static gboolean
-sleep_timeout_cb (gpointer data)
+static void
+sleep_timeout_cb (FpDevice *dev,
+                  gpointer  user_data)
 {
-  FpDeviceVirtualDevice *self = data;
+  FpDeviceVirtualDevice *self = FP_DEVICE_VIRTUAL_DEVICE (dev);
 
-  self->sleep_timeout_id = 0;
+  self->sleep_timeout = NULL;
 
   if (g_cancellable_is_cancelled (self->cancellable))
-    return FALSE;
+    return;
 
   g_debug ("Sleeping completed");
   maybe_continue_current_action (self);
+}
 
-  return FALSE;
+/* Continue on the next main loop iteration, like g_idle_add() would, but on
+ * the context the driver runs on. */
+static void
+schedule_continue (FpDeviceVirtualDevice *self)
+{
+  self->sleep_timeout = fpi_device_add_timeout (FP_DEVICE (self), 0,
+                                                sleep_timeout_cb,
+                                                NULL, NULL);
+  g_source_set_priority (self->sleep_timeout, G_PRIORITY_DEFAULT_IDLE);
 }
 
-static gboolean
-wait_for_command_timeout (gpointer data)
+static void
+wait_for_command_timeout (FpDevice *dev,
+                          gpointer  user_data)
 {
-  FpDeviceVirtualDevice *self = FP_DEVICE_VIRTUAL_DEVICE (data);
+  FpDeviceVirtualDevice *self = FP_DEVICE_VIRTUAL_DEVICE (dev);
   FpiDeviceAction action;
   GError *error = NULL;
 
-  self->wait_command_id = 0;
+  self->wait_command_timeout = NULL;
 
   action = fpi_device_get_current_action (FP_DEVICE (self));
   if (action == FPI_DEVICE_ACTION_LIST || action == FPI_DEVICE_ACTION_DELETE)
@@ -135,13 +147,11 @@ wait_for_command_timeout (gpointer data)
       maybe_continue_current_action (self);
       self->ignore_wait = FALSE;
 
-      return FALSE;
+      return;
     }
 
   error = g_error_new (G_IO_ERROR, G_IO_ERROR_TIMED_OUT, "No commands arrived in time to run!");
   fpi_device_action_error (FP_DEVICE (self), error);
-
-  return FALSE;
 }
 
 gboolean
@@ -195,7 +205,9 @@ process_cmds (FpDeviceVirtualDevice * self,
           guint64 sleep_ms = g_ascii_strtoull (cmd + strlen (SLEEP_CMD_PREFIX), NULL, 10);
 
           g_debug ("Sleeping %" G_GUINT64_FORMAT "ms", sleep_ms);
-          self->sleep_timeout_id = g_timeout_add (sleep_ms, sleep_timeout_cb, self);
+          self->sleep_timeout = fpi_device_add_timeout (FP_DEVICE (self), sleep_ms,
+                                                        sleep_timeout_cb,
+                                                        NULL, NULL);
 
           return FALSE;
         }
@@ -254,9 +266,11 @@ process_cmds (FpDeviceVirtualDevice * self,
 
   g_object_get (self, "removed", &removed, NULL);
 
-  g_assert (self->wait_command_id == 0);
+  g_assert (self->wait_command_timeout == NULL);
   if (!scan || removed)
-    self->wait_command_id = g_timeout_add (500, wait_for_command_timeout, self);
+    self->wait_command_timeout = fpi_device_add_timeout (FP_DEVICE (self), 500,
+                                                         wait_for_command_timeout,
+                                                         NULL, NULL);
   return FALSE;
 }
 
@@ -347,7 +361,7 @@ recv_instruction_cb (GObject      *source_object,
       else
         {
           g_ptr_array_add (self->pending_commands, g_steal_pointer (&cmd));
-          g_clear_handle_id (&self->wait_command_id, g_source_remove);
+          g_clear_pointer (&self->wait_command_timeout, g_source_destroy);
 
           maybe_continue_current_action (self);
         }
@@ -440,7 +454,7 @@ start_scan_command (FpDeviceVirtualDevice *self,
   /* We report finger needed if we are waiting for instructions
    * (i.e. we did not get an explicit SLEEP command).
    */
-  if (!self->sleep_timeout_id)
+  if (!self->sleep_timeout)
     {
       fpi_device_report_finger_status_changes (FP_DEVICE (self),
                                                FP_FINGER_STATUS_NEEDED,
@@ -472,7 +486,7 @@ should_wait_to_sleep (FpDeviceVirtualDevice *self,
 {
   const gchar *cmd;
 
-  if (self->sleep_timeout_id)
+  if (self->sleep_timeout)
     return TRUE;
 
   if (!self->pending_commands->len)
@@ -489,7 +503,7 @@ should_wait_to_sleep (FpDeviceVirtualDevice *self,
         return FALSE;
 
       g_assert (!self->injected_synthetic_cmd);
-      g_assert (self->sleep_timeout_id != 0);
+      g_assert (self->sleep_timeout != NULL);
 
       if (!self->pending_commands->len)
         {
@@ -511,7 +525,7 @@ should_wait_to_sleep (FpDeviceVirtualDevice *self,
         }
     }
 
-  return self->sleep_timeout_id != 0;
+  return self->sleep_timeout != NULL;
 }
 
 static void
@@ -628,7 +642,7 @@ dev_enroll (FpDevice *dev)
                                           g_steal_pointer (&error));
 
               if (!should_wait_to_sleep (self, id, error))
-                self->sleep_timeout_id = g_idle_add (sleep_timeout_cb, self);
+                schedule_continue (self);
               return;
             }
         }
@@ -656,7 +670,7 @@ dev_enroll (FpDevice *dev)
         }
       else if (!should_wait_to_sleep (self, id, error))
         {
-          self->sleep_timeout_id = g_idle_add (sleep_timeout_cb, self);
+          schedule_continue (self);
         }
     }
   else
@@ -670,7 +684,7 @@ dev_enroll (FpDevice *dev)
           fpi_device_enroll_progress (dev, self->enroll_stages_passed, NULL, g_steal_pointer (&error));
 
           if (!should_wait_to_sleep (self, id, error))
-            self->sleep_timeout_id = g_idle_add (sleep_timeout_cb, self);
+            schedule_continue (self);
         }
       else
         {
@@ -698,8 +712,8 @@ dev_cancel (FpDevice *dev)
     return;
 
   g_debug ("Got cancellation!");
-  g_clear_handle_id (&self->sleep_timeout_id, g_source_remove);
-  g_clear_handle_id (&self->wait_command_id, g_source_remove);
+  g_clear_pointer (&self->sleep_timeout, g_source_destroy);
+  g_clear_pointer (&self->wait_command_timeout, g_source_destroy);
 
   maybe_continue_current_action (self);
 }
@@ -22,7 +22,9 @@
 #pragma once
 
 #include "fpi-compat.h"
+#include "fpi-crc.h"
 #include "fpi-assembling.h"
+#include "fpi-frame-normalize.h"
 #include "fpi-device.h"
 #include "fpi-image-device.h"
 #include "fpi-image.h"
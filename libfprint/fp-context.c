@@ -52,11 +52,15 @@ typedef struct
 
   gint          pending_devices;
   gboolean      enumerated;
+  guint         probe_timeout_ms;
 
   GArray       *drivers;
+  gboolean     *drivers_allowed;
   GPtrArray    *devices;
 } FpContextPrivate;
 
+#define USB_ID_KEY(vid, pid) GUINT_TO_POINTER (((vid) << 16) | (pid))
+
 G_DEFINE_TYPE_WITH_PRIVATE (FpContext, fp_context, G_TYPE_OBJECT)
 
 enum {
@@ -95,6 +99,41 @@ is_driver_allowed (const gchar *driver)
   return FALSE;
 }
 
+/* The ID tables reference drivers by index, this returns the driver type
+ * or G_TYPE_NONE if it was filtered by the whitelist. */
+static GType
+get_driver (FpContext *self, guint driver)
+{
+  FpContextPrivate *priv = fp_context_get_instance_private (self);
+
+  if (priv->drivers_allowed && !priv->drivers_allowed[driver])
+    return G_TYPE_NONE;
+
+  return g_array_index (priv->drivers, GType, driver);
+}
+
+/* Index of the first entry for VID/PID in the sorted USB ID table */
+static guint
+usb_ids_lower_bound (guint16 vid, guint16 pid)
+{
+  guint32 key = ((guint32) vid << 16) | pid;
+  guint lo = 0;
+  guint hi = fpi_driver_usb_ids_len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+      const FpiDriverIdEntry *entry = &fpi_driver_usb_ids[mid];
+
+      if ((((guint32) entry->vid << 16) | entry->pid) < key)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
 typedef struct
 {
   FpContext *context;
@@ -172,23 +211,65 @@ device_removed_cb (FpContext *context, FpDevice *device)
     }
 }
 
+typedef struct
+{
+  FpContext    *context;
+  GCancellable *cancellable;
+  GSource      *timeout_source;
+  GType         driver;
+  guint         timeout_ms;
+  gint64        start_time;
+  gboolean      timed_out;
+} ProbeData;
+
+static void
+probe_data_free (ProbeData *data)
+{
+  g_clear_object (&data->cancellable);
+  g_free (data);
+}
+
 static void
 async_device_init_done_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
   g_autoptr(GError) error = NULL;
+  ProbeData *data = user_data;
   FpDevice *device;
   FpContext *context;
   FpContextPrivate *priv;
 
   device = FP_DEVICE (g_async_initable_new_finish (G_ASYNC_INITABLE (source_object),
                                                    res, &error));
+
+  /* Already accounted for when the timeout triggered. */
+  if (data->timed_out)
+    {
+      g_clear_object (&device);
+      probe_data_free (data);
+      return;
+    }
+
+  /* The context is being destroyed */
   if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
-    return;
+    {
+      probe_data_free (data);
+      return;
+    }
 
-  context = FP_CONTEXT (user_data);
+  context = data->context;
   priv = fp_context_get_instance_private (context);
   priv->pending_devices--;
 
+  g_debug ("Probing %s took %.1f ms", g_type_name (data->driver),
+           (g_get_monotonic_time () - data->start_time) / 1000.0);
+
+  if (data->timeout_source)
+    {
+      priv->sources = g_slist_remove (priv->sources, data->timeout_source);
+      g_source_destroy (data->timeout_source);
+    }
+  probe_data_free (data);
+
   if (error)
     {
       g_message ("Ignoring device due to initialization error: %s", error->message);
@@ -205,47 +286,118 @@ async_device_init_done_cb (GObject *source_object, GAsyncResult *res, gpointer u
   g_signal_emit (context, signals[DEVICE_ADDED_SIGNAL], 0, device);
 }
 
+static gboolean
+probe_timeout_cb (gpointer user_data)
+{
+  ProbeData *data = user_data;
+  FpContextPrivate *priv = fp_context_get_instance_private (data->context);
+
+  g_message ("Ignoring device as probing %s did not finish within %u ms",
+             g_type_name (data->driver), data->timeout_ms);
+
+  priv->sources = g_slist_remove (priv->sources, data->timeout_source);
+  data->timeout_source = NULL;
+  data->timed_out = TRUE;
+  priv->pending_devices--;
+
+  g_cancellable_cancel (data->cancellable);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* All probes run concurrently on the main context, this only starts one. */
 static void
-usb_device_added_cb (FpContext *self, GUsbDevice *device, GUsbContext *usb_ctx)
+probe_device (FpContext   *self,
+              GType        driver,
+              const gchar *first_property_name,
+              ...)
 {
   FpContextPrivate *priv = fp_context_get_instance_private (self);
+  g_autoptr(FpDeviceClass) cls = g_type_class_ref (driver);
+  ProbeData *data;
+  va_list args;
+
+  data = g_new0 (ProbeData, 1);
+  data->context = self;
+  data->driver = driver;
+  data->start_time = g_get_monotonic_time ();
+
+  /* The driver's own timeout takes precedence over FP_PROBE_TIMEOUT */
+  data->timeout_ms = cls->probe_timeout_ms;
+  if (data->timeout_ms == 0)
+    data->timeout_ms = priv->probe_timeout_ms;
+
+  if (data->timeout_ms > 0)
+    {
+      data->cancellable = g_cancellable_new ();
+      g_signal_connect_object (priv->cancellable, "cancelled",
+                               G_CALLBACK (g_cancellable_cancel),
+                               data->cancellable,
+                               G_CONNECT_SWAPPED);
+
+      data->timeout_source = g_timeout_source_new (data->timeout_ms);
+      g_source_set_callback (data->timeout_source, probe_timeout_cb, data, NULL);
+      g_source_attach (data->timeout_source, g_main_context_get_thread_default ());
+      g_source_unref (data->timeout_source);
+      priv->sources = g_slist_prepend (priv->sources, data->timeout_source);
+    }
+  else
+    {
+      data->cancellable = g_object_ref (priv->cancellable);
+    }
+
+  priv->pending_devices++;
+
+  va_start (args, first_property_name);
+  g_async_initable_new_valist_async (driver,
+                                     first_property_name,
+                                     args,
+                                     G_PRIORITY_LOW,
+                                     data->cancellable,
+                                     async_device_init_done_cb,
+                                     data);
+  va_end (args);
+}
+
+static void
+usb_device_added_cb (FpContext *self, GUsbDevice *device, GUsbContext *usb_ctx)
+{
   GType found_driver = G_TYPE_NONE;
-  const FpIdEntry *found_entry = NULL;
+  const FpiDriverIdEntry *found_entry = NULL;
   gint found_score = 0;
-  gint i;
+  guint i;
   guint16 pid, vid;
 
   pid = g_usb_device_get_pid (device);
   vid = g_usb_device_get_vid (device);
 
-  /* Find the best driver to handle this USB device. */
-  for (i = 0; i < priv->drivers->len; i++)
+  /* Find the best driver to handle this USB device. Only the classes of
+   * drivers that list the device are initialized. */
+  for (i = usb_ids_lower_bound (vid, pid); i < fpi_driver_usb_ids_len; i++)
     {
-      GType driver = g_array_index (priv->drivers, GType, i);
-      g_autoptr(FpDeviceClass) cls = g_type_class_ref (driver);
-      const FpIdEntry *entry;
+      const FpiDriverIdEntry *entry = &fpi_driver_usb_ids[i];
+      g_autoptr(FpDeviceClass) cls = NULL;
+      GType driver;
+      gint driver_score = 50;
 
-      if (cls->type != FP_DEVICE_TYPE_USB)
-        continue;
+      if (entry->vid != vid || entry->pid != pid)
+        break;
 
-      for (entry = cls->id_table; entry->pid; entry++)
-        {
-          gint driver_score = 50;
-
-          if (entry->pid != pid || entry->vid != vid)
-            continue;
+      driver = get_driver (self, entry->driver);
+      if (driver == G_TYPE_NONE)
+        continue;
 
-          if (cls->usb_discover)
-            driver_score = cls->usb_discover (device);
+      cls = g_type_class_ref (driver);
+      if (cls->usb_discover)
+        driver_score = cls->usb_discover (device);
 
-          /* Is this driver better than the one we had? */
-          if (driver_score <= found_score)
-            continue;
+      /* Is this driver better than the one we had? */
+      if (driver_score <= found_score)
+        continue;
 
-          found_score = driver_score;
-          found_driver = driver;
-          found_entry = entry;
-        }
+      found_score = driver_score;
+      found_driver = driver;
+      found_entry = entry;
     }
 
   if (found_driver == G_TYPE_NONE)
@@ -254,15 +406,10 @@ usb_device_added_cb (FpContext *self, GUsbDevice *device, GUsbContext *usb_ctx)
       return;
     }
 
-  priv->pending_devices++;
-  g_async_initable_new_async (found_driver,
-                              G_PRIORITY_LOW,
-                              priv->cancellable,
-                              async_device_init_done_cb,
-                              self,
-                              "fpi-usb-device", device,
-                              "fpi-driver-data", found_entry->driver_data,
-                              NULL);
+  probe_device (self, found_driver,
+                "fpi-usb-device", device,
+                "fpi-driver-data", found_entry->driver_data,
+                NULL);
 }
 
 static void
@@ -296,6 +443,7 @@ fp_context_finalize (GObject *object)
   g_cancellable_cancel (priv->cancellable);
   g_clear_object (&priv->cancellable);
   g_clear_pointer (&priv->drivers, g_array_unref);
+  g_clear_pointer (&priv->drivers_allowed, g_free);
 
   g_slist_free_full (g_steal_pointer (&priv->sources), (GDestroyNotify) g_source_destroy);
 
@@ -363,22 +511,20 @@ fp_context_init (FpContext *self)
 
   g_debug ("Initializing FpContext (libfprint version " LIBFPRINT_VERSION ")");
 
+  /* Only the types are registered here, driver classes are initialized
+   * lazily once a device in their ID table is found. */
   priv->drivers = fpi_get_driver_types ();
 
   if (get_drivers_whitelist_env ())
     {
-      for (i = 0; i < priv->drivers->len;)
-        {
-          GType driver = g_array_index (priv->drivers, GType, i);
-          g_autoptr(FpDeviceClass) cls = g_type_class_ref (driver);
-
-          if (!is_driver_allowed (cls->id))
-            g_array_remove_index (priv->drivers, i);
-          else
-            ++i;
-        }
+      priv->drivers_allowed = g_new0 (gboolean, priv->drivers->len);
+      for (i = 0; i < priv->drivers->len; i++)
+        priv->drivers_allowed[i] = is_driver_allowed (fpi_driver_names[i]);
     }
 
+  if (g_getenv ("FP_PROBE_TIMEOUT"))
+    priv->probe_timeout_ms = g_ascii_strtoull (g_getenv ("FP_PROBE_TIMEOUT"), NULL, 10);
+
   priv->devices = g_ptr_array_new_with_free_func (g_object_unref);
 
   priv->cancellable = g_cancellable_new ();
@@ -403,6 +549,95 @@ fp_context_init (FpContext *self)
     }
 }
 
+#ifdef HAVE_UDEV
+/* Index spidev devices by the ACPI ID of their parent, which is part of
+ * the sysfs path, e.g. ".../spi-ELAN7001:00/spidev/spidev0.0". Driver IDs
+ * must match the complete ACPI ID, see fpi_context_get_spi_acpi_id().
+ */
+static GHashTable *
+udev_index_spidev (GUdevClient *udev_client)
+{
+  GHashTable *index;
+  GList *devices, *l;
+
+  index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                 (GDestroyNotify) g_ptr_array_unref);
+
+  devices = g_udev_client_query_by_subsystem (udev_client, "spidev");
+  for (l = devices; l; l = l->next)
+    {
+      g_autoptr(GUdevDevice) dev = l->data;
+      const gchar *sysfs = g_udev_device_get_sysfs_path (dev);
+      gchar *acpi_id;
+      GPtrArray *matches;
+
+      if (!sysfs)
+        continue;
+
+      acpi_id = fpi_context_get_spi_acpi_id (sysfs);
+      if (!acpi_id)
+        continue;
+
+      matches = g_hash_table_lookup (index, acpi_id);
+      if (!matches)
+        {
+          matches = g_ptr_array_new_with_free_func (g_object_unref);
+          g_hash_table_insert (index, acpi_id, matches);
+        }
+      else
+        {
+          g_free (acpi_id);
+        }
+      g_ptr_array_add (matches, g_object_ref (dev));
+    }
+  g_list_free (devices);
+
+  return index;
+}
+
+/* Index hidraw devices by the vid/pid from the HID_ID of the parent HID node */
+static GHashTable *
+udev_index_hidraw (GUdevClient *udev_client)
+{
+  GHashTable *index;
+  GList *devices, *l;
+
+  index = g_hash_table_new_full (NULL, NULL, NULL,
+                                 (GDestroyNotify) g_ptr_array_unref);
+
+  devices = g_udev_client_query_by_subsystem (udev_client, "hidraw");
+  for (l = devices; l; l = l->next)
+    {
+      g_autoptr(GUdevDevice) dev = l->data;
+      g_autoptr(GUdevDevice) parent = g_udev_device_get_parent_with_subsystem (dev, "hid", NULL);
+      const gchar *hid_id;
+      guint32 vendor, product;
+      GPtrArray *matches;
+
+      if (!parent)
+        continue;
+
+      hid_id = g_udev_device_get_property (parent, "HID_ID");
+      if (!hid_id)
+        continue;
+
+      if (sscanf (hid_id, "%*X:%X:%X", &vendor, &product) != 2)
+        continue;
+
+      matches = g_hash_table_lookup (index, USB_ID_KEY (vendor, product));
+      if (!matches)
+        {
+          matches = g_ptr_array_new_with_free_func (g_object_unref);
+          g_hash_table_insert (index, USB_ID_KEY (vendor, product), matches);
+        }
+      g_ptr_array_add (matches, g_object_ref (dev));
+    }
+  g_list_free (devices);
+
+  return index;
+}
+#endif
+
 /**
  * fp_context_new:
  *
@@ -423,13 +658,19 @@ fp_context_new (void)
  * Enumerate all devices. You should call this function exactly once
  * at startup. Please note that it iterates the mainloop until all
  * devices are enumerated.
+ *
+ * All devices are probed concurrently. A device whose driver does not finish
+ * probing within the driver's probe timeout is ignored. Drivers that do not
+ * set a timeout fall back to the FP_PROBE_TIMEOUT environment variable, a
+ * number of milliseconds.
  */
 void
 fp_context_enumerate (FpContext *context)
 {
   FpContextPrivate *priv = fp_context_get_instance_private (context);
   gboolean dispatched;
-  gint i;
+  gint64 start_time;
+  guint i;
 
   g_return_if_fail (FP_IS_CONTEXT (context));
 
@@ -439,131 +680,100 @@ fp_context_enumerate (FpContext *context)
   priv->enumerated = TRUE;
 
   /* USB devices are handled from callbacks */
+  start_time = g_get_monotonic_time ();
   if (priv->usb_ctx)
     g_usb_context_enumerate (priv->usb_ctx);
+  g_debug ("USB enumeration took %.1f ms",
+           (g_get_monotonic_time () - start_time) / 1000.0);
 
   /* Handle Virtual devices based on environment variables */
-  for (i = 0; i < priv->drivers->len; i++)
+  for (i = 0; i < fpi_driver_ids_len; i++)
     {
-      GType driver = g_array_index (priv->drivers, GType, i);
-      g_autoptr(FpDeviceClass) cls = g_type_class_ref (driver);
-      const FpIdEntry *entry;
+      const FpiDriverIdEntry *entry = &fpi_driver_ids[i];
+      GType driver;
+      const gchar *val;
 
-      if (cls->type != FP_DEVICE_TYPE_VIRTUAL)
+      if (entry->type != FP_DEVICE_TYPE_VIRTUAL)
         continue;
 
-      for (entry = cls->id_table; entry->pid; entry++)
-        {
-          const gchar *val;
-
-          val = g_getenv (entry->virtual_envvar);
-          if (!val || val[0] == '\0')
-            continue;
-
-          g_debug ("Found virtual environment device: %s, %s", entry->virtual_envvar, val);
-          priv->pending_devices++;
-          g_async_initable_new_async (driver,
-                                      G_PRIORITY_LOW,
-                                      priv->cancellable,
-                                      async_device_init_done_cb,
-                                      context,
-                                      "fpi-environ", val,
-                                      "fpi-driver-data", entry->driver_data,
-                                      NULL);
-          g_debug ("created");
-        }
+      val = g_getenv (entry->virtual_envvar);
+      if (!val || val[0] == '\0')
+        continue;
+
+      driver = get_driver (context, entry->driver);
+      if (driver == G_TYPE_NONE)
+        continue;
+
+      g_debug ("Found virtual environment device: %s, %s", entry->virtual_envvar, val);
+      probe_device (context, driver,
+                    "fpi-environ", val,
+                    "fpi-driver-data", entry->driver_data,
+                    NULL);
+      g_debug ("created");
     }
 
 
 #ifdef HAVE_UDEV
   {
     g_autoptr(GUdevClient) udev_client = g_udev_client_new (NULL);
+    g_autoptr(GHashTable) spidev_devices = NULL;
+    g_autoptr(GHashTable) hidraw_devices = NULL;
 
     /* This uses a very simple algorithm to allocate devices to drivers and assumes that no two drivers will want the same device. Future improvements
      * could add a usb_discover style udev_discover that returns a score, however for internal devices the potential overlap should be very low between
      * separate drivers.
      */
 
-    g_autoptr(GList) spidev_devices = g_udev_client_query_by_subsystem (udev_client, "spidev");
-    g_autoptr(GList) hidraw_devices = g_udev_client_query_by_subsystem (udev_client, "hidraw");
+    start_time = g_get_monotonic_time ();
+    spidev_devices = udev_index_spidev (udev_client);
+    hidraw_devices = udev_index_hidraw (udev_client);
 
     /* for each potential driver, try to match all requested resources. */
-    for (i = 0; i < priv->drivers->len; i++)
+    for (i = 0; i < fpi_driver_ids_len; i++)
       {
-        GType driver = g_array_index (priv->drivers, GType, i);
-        g_autoptr(FpDeviceClass) cls = g_type_class_ref (driver);
-        const FpIdEntry *entry;
+        const FpiDriverIdEntry *entry = &fpi_driver_ids[i];
+        GPtrArray *matched_spidev = NULL, *matched_hidraw = NULL;
+        const gchar *spidev_file = NULL, *hidraw_file = NULL;
+        GType driver;
 
-        if (cls->type != FP_DEVICE_TYPE_UDEV)
+        if (entry->type != FP_DEVICE_TYPE_UDEV)
           continue;
 
-        for (entry = cls->id_table; entry->udev_types; entry++)
+        driver = get_driver (context, entry->driver);
+        if (driver == G_TYPE_NONE)
+          continue;
+
+        if (entry->udev_types & FPI_DEVICE_UDEV_SUBTYPE_SPIDEV)
+          {
+            matched_spidev = g_hash_table_lookup (spidev_devices, entry->spi_acpi_id);
+            /* If match was not found exit */
+            if (matched_spidev == NULL || matched_spidev->len == 0)
+              continue;
+            spidev_file = g_udev_device_get_device_file (g_ptr_array_index (matched_spidev, 0));
+          }
+        if (entry->udev_types & FPI_DEVICE_UDEV_SUBTYPE_HIDRAW)
           {
-            GList *matched_spidev = NULL, *matched_hidraw = NULL;
-
-            if (entry->udev_types & FPI_DEVICE_UDEV_SUBTYPE_SPIDEV)
-              {
-                for (matched_spidev = spidev_devices; matched_spidev; matched_spidev = matched_spidev->next)
-                  {
-                    const gchar * sysfs = g_udev_device_get_sysfs_path (matched_spidev->data);
-                    if (!sysfs)
-                      continue;
-                    if (strstr (sysfs, entry->spi_acpi_id))
-                      break;
-                  }
-                /* If match was not found exit */
-                if (matched_spidev == NULL)
-                  continue;
-              }
-            if (entry->udev_types & FPI_DEVICE_UDEV_SUBTYPE_HIDRAW)
-              {
-                for (matched_hidraw = hidraw_devices; matched_hidraw; matched_hidraw = matched_hidraw->next)
-                  {
-                    /* Find the parent HID node, and check the vid/pid from its HID_ID property */
-                    g_autoptr(GUdevDevice) parent = g_udev_device_get_parent_with_subsystem (matched_hidraw->data, "hid", NULL);
-                    const gchar * hid_id = g_udev_device_get_property (parent, "HID_ID");
-                    guint32 vendor, product;
-
-                    if (!parent || !hid_id)
-                      continue;
-
-                    if (sscanf (hid_id, "%*X:%X:%X", &vendor, &product) != 2)
-                      continue;
-
-                    if (vendor == entry->hid_id.vid && product == entry->hid_id.pid)
-                      break;
-                  }
-                /* If match was not found exit */
-                if (matched_hidraw == NULL)
-                  continue;
-              }
-            priv->pending_devices++;
-            g_async_initable_new_async (driver,
-                                        G_PRIORITY_LOW,
-                                        priv->cancellable,
-                                        async_device_init_done_cb,
-                                        context,
-                                        "fpi-driver-data", entry->driver_data,
-                                        "fpi-udev-data-spidev", (matched_spidev ? g_udev_device_get_device_file (matched_spidev->data) : NULL),
-                                        "fpi-udev-data-hidraw", (matched_hidraw ? g_udev_device_get_device_file (matched_hidraw->data) : NULL),
-                                        NULL);
-            /* remove entries from list to avoid conflicts */
-            if (matched_spidev)
-              {
-                g_object_unref (matched_spidev->data);
-                spidev_devices = g_list_delete_link (spidev_devices, matched_spidev);
-              }
-            if (matched_hidraw)
-              {
-                g_object_unref (matched_hidraw->data);
-                hidraw_devices = g_list_delete_link (hidraw_devices, matched_hidraw);
-              }
+            matched_hidraw = g_hash_table_lookup (hidraw_devices,
+                                                  USB_ID_KEY (entry->vid, entry->pid));
+            /* If match was not found exit */
+            if (matched_hidraw == NULL || matched_hidraw->len == 0)
+              continue;
+            hidraw_file = g_udev_device_get_device_file (g_ptr_array_index (matched_hidraw, 0));
           }
+        probe_device (context, driver,
+                      "fpi-driver-data", entry->driver_data,
+                      "fpi-udev-data-spidev", spidev_file,
+                      "fpi-udev-data-hidraw", hidraw_file,
+                      NULL);
+        /* remove entries from the index to avoid conflicts */
+        if (matched_spidev)
+          g_ptr_array_remove_index (matched_spidev, 0);
+        if (matched_hidraw)
+          g_ptr_array_remove_index (matched_hidraw, 0);
       }
 
-    /* free all unused elemnts in both lists */
-    g_list_foreach (spidev_devices, (GFunc) g_object_unref, NULL);
-    g_list_foreach (hidraw_devices, (GFunc) g_object_unref, NULL);
+    g_debug ("udev enumeration took %.1f ms",
+             (g_get_monotonic_time () - start_time) / 1000.0);
   }
 #endif
 
@@ -577,9 +787,12 @@ fp_context_enumerate (FpContext *context)
    * As a hotplug event is seemingly emitted by the kernel immediately, we can
    * simply make sure to process all events before returning from enumerate.
    */
+  start_time = g_get_monotonic_time ();
   dispatched = TRUE;
   while (priv->pending_devices || dispatched)
     dispatched = g_main_context_iteration (NULL, !!priv->pending_devices);
+  g_debug ("Waiting for device probes took %.1f ms",
+           (g_get_monotonic_time () - start_time) / 1000.0);
 }
 
 /**
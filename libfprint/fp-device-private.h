@@ -39,6 +39,23 @@
 #define DEFAULT_TEMP_HOT_SECONDS (3 * 60)
 #define DEFAULT_TEMP_COLD_SECONDS (9 * 60)
 
+/* Log-linear latency histogram in microseconds, every power of two is split
+ * into four buckets, i.e. the resolution is better than 25%.
+ */
+#define FP_LATENCY_SUB_BUCKETS 4
+#define FP_LATENCY_N_BUCKETS ((32 - 1) * FP_LATENCY_SUB_BUCKETS)
+
+typedef struct
+{
+  guint64 count;
+  guint64 sum;
+  guint64 min;
+  guint64 max;
+  guint32 buckets[FP_LATENCY_N_BUCKETS];
+} FpLatencyHistogram;
+
+typedef struct _FpDeviceWorker FpDeviceWorker;
+
 typedef struct
 {
   FpDeviceType type;
@@ -63,10 +80,15 @@ typedef struct
   guint64         driver_data;
 
   gint            nr_enroll_stages;
+
+  /* Timeout sources, these may be added and destroyed from the worker
+   * thread as well as from the caller. */
+  GMutex          sources_lock;
   GSList         *sources;
 
   /* We always make sure that only one task is run at a time. */
   FpiDeviceAction     current_action;
+  gint64              current_action_start;
   GTask              *current_task;
   GError             *current_cancellation_reason;
   GAsyncReadyCallback current_user_cb;
@@ -79,6 +101,14 @@ typedef struct
   /* State for tasks */
   gboolean            wait_for_finger;
   FpFingerStatusFlags finger_status;
+  gint64              finger_needed_time;
+  gint64              finger_present_time;
+
+  /* Latency statistics, allocated on first use. Drivers may record
+   * samples from the worker thread, so they are protected by a lock. */
+  GMutex              timings_lock;
+  FpLatencyHistogram *timings[FPI_DEVICE_TIMING_LAST];
+  FpLatencyHistogram *action_timings[FPI_DEVICE_ACTION_LAST];
 
   /* Driver critical sections */
   guint    critical_section;
@@ -91,7 +121,9 @@ typedef struct
   GTask  *suspend_resume_task;
   GError *suspend_error;
 
-  /* Device temperature model information and state */
+  /* Device temperature model information and state, updated both when an
+   * action starts or ends and from a timeout on the driver context. */
+  GMutex        temp_lock;
   GSource      *temp_timeout;
   FpTemperature temp_current;
   gint32        temp_hot_seconds;
@@ -99,6 +131,9 @@ typedef struct
   gint64        temp_last_update;
   gboolean      temp_last_active;
   gdouble       temp_current_ratio;
+
+  /* Optional thread and main context that the driver runs on */
+  FpDeviceWorker *worker;
 } FpDevicePrivate;
 
 
@@ -130,6 +165,12 @@ typedef struct
 
 void match_data_free (FpMatchData *match_data);
 
+void fpi_device_start_worker (FpDevice *device);
+GMainContext *fpi_device_get_driver_context (FpDevice *device);
+void fpi_device_invoke_driver (FpDevice *device,
+                               void (*func) (FpDevice *device));
+GMainContext *fpi_device_stop_worker (FpDevice *device);
+
 void fpi_device_suspend (FpDevice *device);
 void fpi_device_resume (FpDevice *device);
 
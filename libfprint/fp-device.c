@@ -22,6 +22,7 @@
 #include "fpi-log.h"
 
 #include "fp-device-private.h"
+#include "fpi-trace.h"
 
 /**
  * SECTION: fp-device
@@ -29,6 +30,13 @@
  * @short_description: Fingerpint device routines
  *
  * These are the public #FpDevice routines.
+ *
+ * If the FP_DEVICE_WORKER_THREAD environment variable is set to 1, each
+ * device runs its driver (I/O, state machines and image processing) on a
+ * separate thread with its own #GMainContext. Operations still complete and
+ * call the progress and match callbacks in the thread-default main context
+ * of the caller. Property change notifications and the removed signal are
+ * emitted in the thread-default main context the device was created in.
  */
 
 static void fp_device_async_initable_iface_init (GAsyncInitableIface *iface);
@@ -118,7 +126,7 @@ fp_device_cancelled_cb (GCancellable *cancellable, FpDevice *self)
                          self,
                          NULL);
   g_source_attach (priv->current_idle_cancel_source,
-                   g_task_get_context (priv->current_task));
+                   fpi_device_get_driver_context (self));
   g_source_unref (priv->current_idle_cancel_source);
 }
 
@@ -158,6 +166,16 @@ setup_task_cancellable (FpDevice *device)
     }
 }
 
+static void
+fp_device_start_action (FpDevice *device, FpiDeviceAction action)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  priv->current_action = action;
+  priv->current_action_start = g_get_monotonic_time ();
+  FPI_TRACE (device_action_start, device, action);
+}
+
 static void
 fp_device_constructed (GObject *object)
 {
@@ -205,6 +223,9 @@ fp_device_constructed (GObject *object)
   priv->temp_last_update = g_get_monotonic_time ();
   priv->temp_last_active = FALSE;
 
+  if (g_strcmp0 (g_getenv ("FP_DEVICE_WORKER_THREAD"), "1") == 0)
+    fpi_device_start_worker (self);
+
   G_OBJECT_CLASS (fp_device_parent_class)->constructed (object);
 }
 
@@ -213,19 +234,25 @@ fp_device_finalize (GObject *object)
 {
   FpDevice *self = (FpDevice *) object;
   FpDevicePrivate *priv = fp_device_get_instance_private (self);
+  GMainContext *worker_context;
 
   g_assert (priv->current_action == FPI_DEVICE_ACTION_NONE);
   g_assert (priv->current_task == NULL);
   if (priv->is_open)
     g_warning ("User destroyed open device! Not cleaning up properly!");
 
-  g_clear_pointer (&priv->temp_timeout, g_source_destroy);
+  /* Nothing is dispatched on the worker anymore after this, but its context
+   * must outlive the sources that are destroyed below. */
+  worker_context = fpi_device_stop_worker (self);
 
-  g_slist_free_full (priv->sources, (GDestroyNotify) g_source_destroy);
+  priv->temp_timeout = NULL;
+  g_slist_free_full (g_steal_pointer (&priv->sources),
+                     (GDestroyNotify) g_source_destroy);
 
   g_clear_pointer (&priv->current_idle_cancel_source, g_source_destroy);
   g_clear_pointer (&priv->current_task_idle_return_source, g_source_destroy);
   g_clear_pointer (&priv->critical_section_flush_source, g_source_destroy);
+  g_clear_pointer (&worker_context, g_main_context_unref);
 
   g_clear_pointer (&priv->device_id, g_free);
   g_clear_pointer (&priv->device_name, g_free);
@@ -235,6 +262,11 @@ fp_device_finalize (GObject *object)
   g_clear_pointer (&priv->udev_data.spidev_path, g_free);
   g_clear_pointer (&priv->udev_data.hidraw_path, g_free);
 
+  fp_device_reset_statistics (self);
+  g_mutex_clear (&priv->sources_lock);
+  g_mutex_clear (&priv->temp_lock);
+  g_mutex_clear (&priv->timings_lock);
+
   G_OBJECT_CLASS (fp_device_parent_class)->finalize (object);
 }
 
@@ -377,6 +409,17 @@ device_idle_probe_cb (FpDevice *self, gpointer user_data)
   return;
 }
 
+static void
+device_start_probe (FpDevice *self)
+{
+  /* We push this into an idle handler for compatibility with libgusb
+   * 0.3.7 and before.
+   * See https://github.com/hughsie/libgusb/pull/50
+   */
+  g_source_set_name (fpi_device_add_timeout (self, 0, device_idle_probe_cb, NULL, NULL),
+                     "libusb probe in idle");
+}
+
 static void
 fp_device_async_initable_init_async (GAsyncInitable     *initable,
                                      int                 io_priority,
@@ -396,16 +439,11 @@ fp_device_async_initable_init_async (GAsyncInitable     *initable,
   if (g_task_return_error_if_cancelled (task))
     return;
 
-  priv->current_action = FPI_DEVICE_ACTION_PROBE;
+  fp_device_start_action (self, FPI_DEVICE_ACTION_PROBE);
   priv->current_task = g_steal_pointer (&task);
   setup_task_cancellable (self);
 
-  /* We push this into an idle handler for compatibility with libgusb
-   * 0.3.7 and before.
-   * See https://github.com/hughsie/libgusb/pull/50
-   */
-  g_source_set_name (fpi_device_add_timeout (self, 0, device_idle_probe_cb, NULL, NULL),
-                     "libusb probe in idle");
+  fpi_device_invoke_driver (self, device_start_probe);
 }
 
 static gboolean
@@ -600,6 +638,11 @@ fp_device_class_init (FpDeviceClass *klass)
 static void
 fp_device_init (FpDevice *self)
 {
+  FpDevicePrivate *priv = fp_device_get_instance_private (self);
+
+  g_mutex_init (&priv->sources_lock);
+  g_mutex_init (&priv->temp_lock);
+  g_mutex_init (&priv->timings_lock);
 }
 
 /**
@@ -739,6 +782,165 @@ fp_device_get_temperature (FpDevice *device)
   return priv->temp_current;
 }
 
+static const gchar *timing_names[FPI_DEVICE_TIMING_LAST] = {
+  [FPI_DEVICE_TIMING_FINGER_WAIT] = "finger-wait",
+  [FPI_DEVICE_TIMING_CAPTURE] = "capture",
+  [FPI_DEVICE_TIMING_DETECTION] = "detection",
+  [FPI_DEVICE_TIMING_MATCH] = "match",
+  [FPI_DEVICE_TIMING_RESULT] = "result",
+};
+
+static guint64
+latency_bucket_lower (guint bucket)
+{
+  guint msb, sub;
+
+  if (bucket < FP_LATENCY_SUB_BUCKETS)
+    return bucket;
+
+  msb = bucket / FP_LATENCY_SUB_BUCKETS + 1;
+  sub = bucket % FP_LATENCY_SUB_BUCKETS;
+
+  return ((guint64) FP_LATENCY_SUB_BUCKETS + sub) << (msb - 2);
+}
+
+static guint64
+latency_histogram_percentile (FpLatencyHistogram *h, guint percentile)
+{
+  guint64 rank = MAX (1, (h->count * percentile + 99) / 100);
+  guint64 seen = 0;
+  guint i;
+
+  for (i = 0; i < FP_LATENCY_N_BUCKETS; i++)
+    {
+      seen += h->buckets[i];
+      if (seen >= rank)
+        return CLAMP (latency_bucket_lower (i + 1) - 1, h->min, h->max);
+    }
+
+  return h->max;
+}
+
+static GVariant *
+latency_histogram_to_variant (FpLatencyHistogram *h)
+{
+  GVariantBuilder builder;
+  GVariantBuilder buckets;
+  guint i;
+
+  g_variant_builder_init (&buckets, G_VARIANT_TYPE ("a(tu)"));
+  for (i = 0; i < FP_LATENCY_N_BUCKETS; i++)
+    {
+      if (h->buckets[i] == 0)
+        continue;
+
+      g_variant_builder_add (&buckets, "(tu)", latency_bucket_lower (i), h->buckets[i]);
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "count", g_variant_new_uint64 (h->count));
+  g_variant_builder_add (&builder, "{sv}", "sum", g_variant_new_uint64 (h->sum));
+  g_variant_builder_add (&builder, "{sv}", "min", g_variant_new_uint64 (h->min));
+  g_variant_builder_add (&builder, "{sv}", "max", g_variant_new_uint64 (h->max));
+  g_variant_builder_add (&builder, "{sv}", "p50",
+                         g_variant_new_uint64 (latency_histogram_percentile (h, 50)));
+  g_variant_builder_add (&builder, "{sv}", "p90",
+                         g_variant_new_uint64 (latency_histogram_percentile (h, 90)));
+  g_variant_builder_add (&builder, "{sv}", "p99",
+                         g_variant_new_uint64 (latency_histogram_percentile (h, 99)));
+  g_variant_builder_add (&builder, "{sv}", "buckets", g_variant_builder_end (&buckets));
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * fp_device_get_statistics:
+ * @device: A #FpDevice
+ *
+ * Retrieves latency statistics that were collected since the device was
+ * created or fp_device_reset_statistics() was called.
+ *
+ * The result is a dictionary of type `a{sv}` that maps the name of a phase
+ * to a dictionary of type `a{sv}`. Phases only show up once a sample has
+ * been recorded. The phases are:
+ *  - `finger-wait`: waiting for the user to place the finger
+ *  - `capture`: from placing the finger until an image was captured
+ *  - `detection`: minutiae detection
+ *  - `match`: matching on the host
+ *  - `result`: from placing the finger until the match result was known
+ *  - `action-<name>`: the whole operation, e.g. `action-verify`
+ *
+ * Each phase contains the keys `count`, `sum`, `min`, `max`, `p50`, `p90`
+ * and `p99` (all `t`, times in microseconds) and `buckets` (`a(tu)`)
+ * containing the lower bound and the sample count of each non-empty
+ * histogram bucket. Percentiles are approximated from the histogram with a
+ * precision of about 25%.
+ *
+ * Returns: (transfer full): A #GVariant with the statistics
+ */
+GVariant *
+fp_device_get_statistics (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  g_autoptr(GEnumClass) action_class = NULL;
+  GVariantBuilder builder;
+  guint i;
+
+  g_return_val_if_fail (FP_IS_DEVICE (device), NULL);
+
+  action_class = g_type_class_ref (FPI_TYPE_DEVICE_ACTION);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_mutex_lock (&priv->timings_lock);
+  for (i = 0; i < G_N_ELEMENTS (priv->timings); i++)
+    {
+      if (!priv->timings[i])
+        continue;
+
+      g_variant_builder_add (&builder, "{sv}", timing_names[i],
+                             latency_histogram_to_variant (priv->timings[i]));
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (priv->action_timings); i++)
+    {
+      g_autofree gchar *name = NULL;
+
+      if (!priv->action_timings[i])
+        continue;
+
+      name = g_strdup_printf ("action-%s",
+                              g_enum_get_value (action_class, i)->value_nick);
+      g_variant_builder_add (&builder, "{sv}", name,
+                             latency_histogram_to_variant (priv->action_timings[i]));
+    }
+  g_mutex_unlock (&priv->timings_lock);
+
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+/**
+ * fp_device_reset_statistics:
+ * @device: A #FpDevice
+ *
+ * Discards all latency statistics collected so far, see
+ * fp_device_get_statistics().
+ */
+void
+fp_device_reset_statistics (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  guint i;
+
+  g_return_if_fail (FP_IS_DEVICE (device));
+
+  g_mutex_lock (&priv->timings_lock);
+  for (i = 0; i < G_N_ELEMENTS (priv->timings); i++)
+    g_clear_pointer (&priv->timings[i], g_free);
+  for (i = 0; i < G_N_ELEMENTS (priv->action_timings); i++)
+    g_clear_pointer (&priv->action_timings[i], g_free);
+  g_mutex_unlock (&priv->timings_lock);
+}
+
 /**
  * fp_device_supports_identify:
  * @device: A #FpDevice
@@ -858,12 +1060,12 @@ fp_device_open (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_OPEN;
+  fp_device_start_action (device, FPI_DEVICE_ACTION_OPEN);
   priv->current_task = g_steal_pointer (&task);
   setup_task_cancellable (device);
   fpi_device_report_finger_status (device, FP_FINGER_STATUS_NONE);
 
-  FP_DEVICE_GET_CLASS (device)->open (device);
+  fpi_device_invoke_driver (device, FP_DEVICE_GET_CLASS (device)->open);
 }
 
 /**
@@ -923,11 +1125,11 @@ fp_device_close (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_CLOSE;
+  fp_device_start_action (device, FPI_DEVICE_ACTION_CLOSE);
   priv->current_task = g_steal_pointer (&task);
   setup_task_cancellable (device);
 
-  FP_DEVICE_GET_CLASS (device)->close (device);
+  fpi_device_invoke_driver (device, FP_DEVICE_GET_CLASS (device)->close);
 }
 
 /**
@@ -999,7 +1201,7 @@ fp_device_suspend (FpDevice           *device,
 
   priv->suspend_resume_task = g_steal_pointer (&task);
 
-  fpi_device_suspend (device);
+  fpi_device_invoke_driver (device, fpi_device_suspend);
 }
 
 /**
@@ -1064,7 +1266,7 @@ fp_device_resume (FpDevice           *device,
 
   priv->suspend_resume_task = g_steal_pointer (&task);
 
-  fpi_device_resume (device);
+  fpi_device_invoke_driver (device, fpi_device_resume);
 }
 
 /**
@@ -1172,7 +1374,7 @@ fp_device_enroll (FpDevice           *device,
         }
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_ENROLL;
+  fp_device_start_action (device, FPI_DEVICE_ACTION_ENROLL);
   priv->current_task = g_steal_pointer (&task);
   setup_task_cancellable (device);
 
@@ -1193,7 +1395,7 @@ fp_device_enroll (FpDevice           *device,
   // Attach the progress data as task data so that it is destroyed
   g_task_set_task_data (priv->current_task, data, (GDestroyNotify) enroll_data_free);
 
-  FP_DEVICE_GET_CLASS (device)->enroll (device);
+  fpi_device_invoke_driver (device, FP_DEVICE_GET_CLASS (device)->enroll);
 }
 
 /**
@@ -1273,7 +1475,7 @@ fp_device_verify (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_VERIFY;
+  fp_device_start_action (device, FPI_DEVICE_ACTION_VERIFY);
   priv->current_task = g_steal_pointer (&task);
   setup_task_cancellable (device);
 
@@ -1294,7 +1496,7 @@ fp_device_verify (FpDevice           *device,
   // Attach the match data as task data so that it is destroyed
   g_task_set_task_data (priv->current_task, data, (GDestroyNotify) match_data_free);
 
-  cls->verify (device);
+  fpi_device_invoke_driver (device, cls->verify);
 }
 
 /**
@@ -1400,7 +1602,7 @@ fp_device_identify (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_IDENTIFY;
+  fp_device_start_action (device, FPI_DEVICE_ACTION_IDENTIFY);
   priv->current_task = g_steal_pointer (&task);
   setup_task_cancellable (device);
 
@@ -1427,7 +1629,7 @@ fp_device_identify (FpDevice           *device,
   // Attach the match data as task data so that it is destroyed
   g_task_set_task_data (priv->current_task, data, (GDestroyNotify) match_data_free);
 
-  cls->identify (device);
+  fpi_device_invoke_driver (device, cls->identify);
 }
 
 /**
@@ -1525,7 +1727,7 @@ fp_device_capture (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_CAPTURE;
+  fp_device_start_action (device, FPI_DEVICE_ACTION_CAPTURE);
   priv->current_task = g_steal_pointer (&task);
   setup_task_cancellable (device);
 
@@ -1539,7 +1741,7 @@ fp_device_capture (FpDevice           *device,
 
   priv->wait_for_finger = wait_for_finger;
 
-  cls->capture (device);
+  fpi_device_invoke_driver (device, cls->capture);
 }
 
 /**
@@ -1615,7 +1817,7 @@ fp_device_delete_print (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_DELETE;
+  fp_device_start_action (device, FPI_DEVICE_ACTION_DELETE);
   priv->current_task = g_steal_pointer (&task);
   setup_task_cancellable (device);
 
@@ -1623,7 +1825,7 @@ fp_device_delete_print (FpDevice           *device,
                         g_object_ref (enrolled_print),
                         g_object_unref);
 
-  cls->delete (device);
+  fpi_device_invoke_driver (device, cls->delete);
 }
 
 /**
@@ -1694,11 +1896,11 @@ fp_device_list_prints (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_LIST;
+  fp_device_start_action (device, FPI_DEVICE_ACTION_LIST);
   priv->current_task = g_steal_pointer (&task);
   setup_task_cancellable (device);
 
-  cls->list (device);
+  fpi_device_invoke_driver (device, cls->list);
 }
 
 /**
@@ -1779,11 +1981,11 @@ fp_device_clear_storage (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_CLEAR_STORAGE;
+  fp_device_start_action (device, FPI_DEVICE_ACTION_CLEAR_STORAGE);
   priv->current_task = g_steal_pointer (&task);
   setup_task_cancellable (device);
 
-  cls->clear_storage (device);
+  fpi_device_invoke_driver (device, cls->clear_storage);
 
   return;
 }
@@ -226,6 +226,9 @@ FpFingerStatusFlags fp_device_get_finger_status (FpDevice *device);
 gint         fp_device_get_nr_enroll_stages (FpDevice *device);
 FpTemperature fp_device_get_temperature (FpDevice *device);
 
+GVariant    *fp_device_get_statistics (FpDevice *device);
+void         fp_device_reset_statistics (FpDevice *device);
+
 FpDeviceFeature     fp_device_get_features (FpDevice *device);
 gboolean            fp_device_has_feature (FpDevice       *device,
                                            FpDeviceFeature feature);
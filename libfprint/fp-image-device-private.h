@@ -23,6 +23,10 @@
 
 #define IMG_ENROLL_STAGES 5
 
+/* Number of enroll images (including the one being scanned) that may be
+ * waiting for minutiae detection before we stop asking for the finger. */
+#define IMG_MAX_PENDING_DETECTIONS 2
+
 typedef struct
 {
   FpiImageDeviceState state;
@@ -33,10 +37,16 @@ typedef struct
   gint                enroll_stage;
 
   gboolean            minutiae_scan_active;
+  GQueue              pending_images;
+  gint64              capture_start;
+  gint64              detection_start;
   GError             *action_error;
   FpImage            *capture_image;
 
   gint                bz3_threshold;
+  gint                bz3_min_quality;
+  gint                max_minutiae;
+  FpiImageDeviceFusion enroll_fusion;
 } FpImageDevicePrivate;
 
 
@@ -22,7 +22,7 @@
 
 #include "fp-image-device-private.h"
 
-#define BOZORTH3_DEFAULT_THRESHOLD 40
+#include <nbis.h>
 
 /**
  * SECTION: fp-image-device
@@ -131,9 +131,10 @@ fp_image_device_start_capture_action (FpDevice *device)
     }
 
   priv->enroll_stage = 0;
-  /* The internal state machine guarantees both of these. */
+  /* The internal state machine guarantees all of these. */
   g_assert (!priv->finger_present);
   g_assert (!priv->minutiae_scan_active);
+  g_assert (g_queue_is_empty (&priv->pending_images));
 
   /* And activate the device; we rely on fpi_image_device_activate_complete()
    * to be called when done (or immediately). */
@@ -197,6 +198,15 @@ fp_image_device_constructed (GObject *obj)
   priv->bz3_threshold = BOZORTH3_DEFAULT_THRESHOLD;
   if (cls->bz3_threshold > 0)
     priv->bz3_threshold = cls->bz3_threshold;
+  priv->bz3_min_quality = cls->bz3_min_quality;
+
+  priv->max_minutiae = MAX_BOZORTH_MINUTIAE;
+  if (cls->max_minutiae > 0)
+    priv->max_minutiae = cls->max_minutiae;
+
+  priv->enroll_fusion = FPI_IMAGE_DEVICE_FUSION_NONE;
+  if (cls->enroll_fusion != FPI_IMAGE_DEVICE_FUSION_DEFAULT)
+    priv->enroll_fusion = cls->enroll_fusion;
 
   G_OBJECT_CLASS (fp_image_device_parent_class)->constructed (obj);
 }
@@ -268,4 +278,7 @@ fp_image_device_class_init (FpImageDeviceClass *klass)
 static void
 fp_image_device_init (FpImageDevice *self)
 {
+  FpImageDevicePrivate *priv = fp_image_device_get_instance_private (self);
+
+  g_queue_init (&priv->pending_images);
 }
@@ -633,6 +633,353 @@ fp_print_equal (FpPrint *self, FpPrint *other)
     }
 }
 
+typedef struct
+{
+  GPtrArray *gallery;
+  gint       threshold;
+
+  FpPrint   *match;
+  gint       score;
+} FpPrintMatchData;
+
+static void
+match_data_free (FpPrintMatchData *data)
+{
+  g_clear_pointer (&data->gallery, g_ptr_array_unref);
+  g_clear_object (&data->match);
+  g_free (data);
+}
+
+static gboolean
+print_check_nbis (FpPrint *print, GError **error)
+{
+  if (print->type == FPI_PRINT_NBIS)
+    return TRUE;
+
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+               "It is only possible to match NBIS type print data");
+  return FALSE;
+}
+
+static gboolean
+print_identify (FpPrint      *probe,
+                GPtrArray    *gallery,
+                gint          threshold,
+                GCancellable *cancellable,
+                FpPrint     **match,
+                gint         *score,
+                GError      **error)
+{
+  FpPrint *best_print = NULL;
+  gint best_score = 0;
+  guint i;
+
+  if (!print_check_nbis (probe, error))
+    return FALSE;
+
+  if (threshold <= 0)
+    threshold = BOZORTH3_DEFAULT_THRESHOLD;
+
+  for (i = 0; i < gallery->len; i++)
+    {
+      FpPrint *template = g_ptr_array_index (gallery, i);
+      gint template_score;
+
+      if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        return FALSE;
+
+      if (!print_check_nbis (template, error))
+        return FALSE;
+
+      template_score = fpi_print_bz3_score (template, probe, 0, 0);
+      if (template_score > best_score)
+        {
+          best_score = template_score;
+          best_print = template;
+        }
+    }
+
+  if (match)
+    *match = best_score >= threshold ? g_object_ref (best_print) : NULL;
+  if (score)
+    *score = best_score;
+
+  return TRUE;
+}
+
+static void
+fp_print_identify_thread_func (GTask        *task,
+                               gpointer      source_object,
+                               gpointer      task_data,
+                               GCancellable *cancellable)
+{
+  FpPrintMatchData *data = task_data;
+  GError *error = NULL;
+
+  if (!print_identify (FP_PRINT (source_object), data->gallery, data->threshold,
+                       cancellable, &data->match, &data->score, &error))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+print_identify_async (FpPrint            *probe,
+                      GPtrArray          *gallery,
+                      gint                threshold,
+                      GCancellable       *cancellable,
+                      gpointer            source_tag,
+                      GAsyncReadyCallback callback,
+                      gpointer            user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  FpPrintMatchData *data;
+  guint i;
+
+  task = g_task_new (probe, cancellable, callback, user_data);
+  g_task_set_source_tag (task, source_tag);
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  /* Hold a reference to each print, the caller may modify the array or
+   * drop its references while matching is running. */
+  data = g_new0 (FpPrintMatchData, 1);
+  data->gallery = g_ptr_array_new_full (gallery->len, g_object_unref);
+  for (i = 0; i < gallery->len; i++)
+    g_ptr_array_add (data->gallery, g_object_ref (g_ptr_array_index (gallery, i)));
+  data->threshold = threshold;
+
+  g_task_set_task_data (task, data, (GDestroyNotify) match_data_free);
+  g_task_run_in_thread (task, fp_print_identify_thread_func);
+}
+
+/**
+ * fp_print_match:
+ * @self: A #FpPrint
+ * @other: The #FpPrint to compare against
+ * @score: (out) (optional): Return location for the match score, or %NULL
+ * @error: Return location for errors, or %NULL to ignore
+ *
+ * Matches two prints against each other without requiring a device. This
+ * is only possible for prints that were created by image based devices,
+ * i.e. prints that are not stored on the device. If either print contains
+ * multiple enrollment samples, then the best scoring pair is used.
+ *
+ * Note that the score is only meaningful for prints that were captured
+ * with the same type of sensor.
+ *
+ * This function is thread safe and may block for a significant amount of
+ * time. Use fp_print_match_async() to avoid blocking the main loop.
+ *
+ * Returns: %TRUE if the prints match, %FALSE if not or on error
+ */
+gboolean
+fp_print_match (FpPrint *self,
+                FpPrint *other,
+                gint    *score,
+                GError **error)
+{
+  g_autoptr(FpPrint) match = NULL;
+  g_autoptr(GPtrArray) gallery = NULL;
+
+  g_return_val_if_fail (FP_IS_PRINT (self), FALSE);
+  g_return_val_if_fail (FP_IS_PRINT (other), FALSE);
+
+  gallery = g_ptr_array_new ();
+  g_ptr_array_add (gallery, other);
+
+  if (!print_identify (self, gallery, 0, NULL, &match, score, error))
+    return FALSE;
+
+  return match != NULL;
+}
+
+/**
+ * fp_print_match_async:
+ * @self: A #FpPrint
+ * @other: The #FpPrint to compare against
+ * @cancellable: (nullable): a #GCancellable, or %NULL
+ * @callback: the function to call on completion
+ * @user_data: the data to pass to @callback
+ *
+ * Start an asynchronous operation to match two prints on a worker thread.
+ * Retrieve the result with fp_print_match_finish().
+ *
+ * See fp_print_match().
+ */
+void
+fp_print_match_async (FpPrint            *self,
+                      FpPrint            *other,
+                      GCancellable       *cancellable,
+                      GAsyncReadyCallback callback,
+                      gpointer            user_data)
+{
+  g_autoptr(GPtrArray) gallery = NULL;
+
+  g_return_if_fail (FP_IS_PRINT (self));
+  g_return_if_fail (FP_IS_PRINT (other));
+
+  gallery = g_ptr_array_new ();
+  g_ptr_array_add (gallery, other);
+
+  print_identify_async (self, gallery, 0, cancellable,
+                        fp_print_match_async, callback, user_data);
+}
+
+/**
+ * fp_print_match_finish:
+ * @self: A #FpPrint
+ * @result: A #GAsyncResult
+ * @score: (out) (optional): Return location for the match score, or %NULL
+ * @error: Return location for errors, or %NULL to ignore
+ *
+ * Finish an asynchronous operation to match two prints.
+ * See fp_print_match_async().
+ *
+ * Returns: %TRUE if the prints match, %FALSE if not or on error
+ */
+gboolean
+fp_print_match_finish (FpPrint      *self,
+                       GAsyncResult *result,
+                       gint         *score,
+                       GError      **error)
+{
+  FpPrintMatchData *data;
+
+  g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
+  g_return_val_if_fail (g_task_get_source_tag (G_TASK (result)) == fp_print_match_async, FALSE);
+
+  if (!g_task_propagate_boolean (G_TASK (result), error))
+    return FALSE;
+
+  data = g_task_get_task_data (G_TASK (result));
+  if (score)
+    *score = data->score;
+
+  return data->match != NULL;
+}
+
+/**
+ * fp_print_identify:
+ * @self: The #FpPrint to identify
+ * @gallery: (element-type FpPrint) (transfer none): #GPtrArray of #FpPrint
+ * @threshold: The score required for a match, or 0 to use the default
+ * @match: (out) (transfer full) (nullable) (optional): Location for the matched #FpPrint, or %NULL
+ * @score: (out) (optional): Return location for the highest score, or %NULL
+ * @error: Return location for errors, or %NULL to ignore
+ *
+ * Identifies @self in @gallery without requiring a device. The print with
+ * the highest score is returned in @match if its score reaches @threshold.
+ * All prints need to be suitable for fp_print_match().
+ *
+ * This function is thread safe and may block for a significant amount of
+ * time. Use fp_print_identify_async() to avoid blocking the main loop.
+ *
+ * Returns: %FALSE on error, %TRUE otherwise
+ */
+gboolean
+fp_print_identify (FpPrint   *self,
+                   GPtrArray *gallery,
+                   gint       threshold,
+                   FpPrint  **match,
+                   gint      *score,
+                   GError   **error)
+{
+  g_return_val_if_fail (FP_IS_PRINT (self), FALSE);
+  g_return_val_if_fail (gallery != NULL, FALSE);
+
+  return print_identify (self, gallery, threshold, NULL, match, score, error);
+}
+
+/**
+ * fp_print_identify_async:
+ * @self: The #FpPrint to identify
+ * @gallery: (element-type FpPrint) (transfer none): #GPtrArray of #FpPrint
+ * @threshold: The score required for a match, or 0 to use the default
+ * @cancellable: (nullable): a #GCancellable, or %NULL
+ * @callback: the function to call on completion
+ * @user_data: the data to pass to @callback
+ *
+ * Start an asynchronous operation to identify a print on a worker thread.
+ * Retrieve the result with fp_print_identify_finish().
+ *
+ * See fp_print_identify().
+ */
+void
+fp_print_identify_async (FpPrint            *self,
+                         GPtrArray          *gallery,
+                         gint                threshold,
+                         GCancellable       *cancellable,
+                         GAsyncReadyCallback callback,
+                         gpointer            user_data)
+{
+  g_return_if_fail (FP_IS_PRINT (self));
+  g_return_if_fail (gallery != NULL);
+
+  print_identify_async (self, gallery, threshold, cancellable,
+                        fp_print_identify_async, callback, user_data);
+}
+
+/**
+ * fp_print_identify_finish:
+ * @self: The #FpPrint to identify
+ * @result: A #GAsyncResult
+ * @match: (out) (transfer full) (nullable) (optional): Location for the matched #FpPrint, or %NULL
+ * @score: (out) (optional): Return location for the highest score, or %NULL
+ * @error: Return location for errors, or %NULL to ignore
+ *
+ * Finish an asynchronous operation to identify a print.
+ * See fp_print_identify_async().
+ *
+ * Returns: %FALSE on error, %TRUE otherwise
+ */
+gboolean
+fp_print_identify_finish (FpPrint      *self,
+                          GAsyncResult *result,
+                          FpPrint     **match,
+                          gint         *score,
+                          GError      **error)
+{
+  FpPrintMatchData *data;
+
+  g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
+  g_return_val_if_fail (g_task_get_source_tag (G_TASK (result)) == fp_print_identify_async, FALSE);
+
+  if (!g_task_propagate_boolean (G_TASK (result), error))
+    return FALSE;
+
+  data = g_task_get_task_data (G_TASK (result));
+  if (match)
+    *match = data->match ? g_object_ref (data->match) : NULL;
+  if (score)
+    *score = data->score;
+
+  return TRUE;
+}
+
+/**
+ * fp_print_set_match_cache_size:
+ * @max_size: The maximum size of the cache in bytes, or 0 to disable it
+ *
+ * fp_print_match() and fp_print_identify() cache the state prepared from
+ * the enrolled prints, so that matching repeatedly against the same prints
+ * is faster. This sets the memory budget of that cache, which is shared by
+ * the whole process. The least recently used entries are dropped when the
+ * budget is exceeded.
+ *
+ * The default is 4 MiB, which is sufficient for a few dozen enrolled
+ * fingers. Services that match against a large gallery may want to raise
+ * it, memory constrained ones can pass 0.
+ */
+void
+fp_print_set_match_cache_size (gsize max_size)
+{
+  fpi_print_set_bz3_cache_size (max_size);
+}
+
 #define FPI_PRINT_VARIANT_TYPE G_VARIANT_TYPE ("(issbymsmsia{sv}v)")
 
 G_STATIC_ASSERT (sizeof (((struct xyt_struct *) NULL)->xcol[0]) == 4);
@@ -680,18 +1027,20 @@ fp_print_serialize (FpPrint *print,
   g_variant_builder_open (&builder, G_VARIANT_TYPE_VARDICT);
   g_variant_builder_close (&builder);
 
-  /* Insert NBIS print data for type NBIS, otherwise the GVariant directly */
+  /* Insert NBIS print data for type NBIS, otherwise the GVariant directly.
+   * The quality column was added later, readers that predate it simply
+   * ignore the fourth array. */
   if (print->type == FPI_PRINT_NBIS)
     {
-      GVariantBuilder nested = G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE ("(a(aiaiai))"));
+      GVariantBuilder nested = G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE ("(a(aiaiaiai))"));
       guint i;
 
-      g_variant_builder_open (&nested, G_VARIANT_TYPE ("a(aiaiai)"));
+      g_variant_builder_open (&nested, G_VARIANT_TYPE ("a(aiaiaiai)"));
       for (i = 0; i < print->prints->len; i++)
         {
           struct xyt_struct *xyt = g_ptr_array_index (print->prints, i);
 
-          g_variant_builder_open (&nested, G_VARIANT_TYPE ("(aiaiai)"));
+          g_variant_builder_open (&nested, G_VARIANT_TYPE ("(aiaiaiai)"));
 
           g_variant_builder_add_value (&nested,
                                        g_variant_new_fixed_array (G_VARIANT_TYPE_INT32,
@@ -708,6 +1057,11 @@ fp_print_serialize (FpPrint *print,
                                                                   xyt->thetacol,
                                                                   xyt->nrows,
                                                                   sizeof (xyt->thetacol[0])));
+          g_variant_builder_add_value (&nested,
+                                       g_variant_new_fixed_array (G_VARIANT_TYPE_INT32,
+                                                                  xyt->qualitycol,
+                                                                  xyt->nrows,
+                                                                  sizeof (xyt->qualitycol[0])));
           g_variant_builder_close (&nested);
         }
 
@@ -823,9 +1177,20 @@ fp_print_deserialize (const guchar *data,
   /* Assume data is valid at this point if the values are somewhat sane. */
   if (type == FPI_PRINT_NBIS)
     {
-      g_autoptr(GVariant) prints = g_variant_get_child_value (print_data, 0);
+      g_autoptr(GVariant) prints = NULL;
+      gboolean has_quality;
       guint i;
 
+      /* Prints stored before the quality column was added use (aiaiai) */
+      if (g_variant_is_of_type (print_data, G_VARIANT_TYPE ("(a(aiaiaiai))")))
+        has_quality = TRUE;
+      else if (g_variant_is_of_type (print_data, G_VARIANT_TYPE ("(a(aiaiai))")))
+        has_quality = FALSE;
+      else
+        goto invalid_format;
+
+      prints = g_variant_get_child_value (print_data, 0);
+
       result = g_object_new (FP_TYPE_PRINT,
                              "driver", driver,
                              "device-id", device_id,
@@ -836,8 +1201,8 @@ fp_print_deserialize (const guchar *data,
       for (i = 0; i < g_variant_n_children (prints); i++)
         {
           g_autofree struct xyt_struct *xyt = NULL;
-          const gint32 *xcol, *ycol, *thetacol;
-          gsize xlen, ylen, thetalen;
+          const gint32 *xcol, *ycol, *thetacol, *qualitycol = NULL;
+          gsize xlen, ylen, thetalen, qualitylen;
           g_autoptr(GVariant) xyt_data = NULL;
           GVariant *child;
 
@@ -855,7 +1220,18 @@ fp_print_deserialize (const guchar *data,
           thetacol = g_variant_get_fixed_array (child, &thetalen, sizeof (gint32));
           g_variant_unref (child);
 
-          if (xlen != ylen || xlen != thetalen)
+          if (has_quality)
+            {
+              child = g_variant_get_child_value (xyt_data, 3);
+              qualitycol = g_variant_get_fixed_array (child, &qualitylen, sizeof (gint32));
+              g_variant_unref (child);
+            }
+          else
+            {
+              qualitylen = xlen;
+            }
+
+          if (xlen != ylen || xlen != thetalen || xlen != qualitylen)
             goto invalid_format;
 
           if (xlen > G_N_ELEMENTS (xyt->xcol))
@@ -867,6 +1243,19 @@ fp_print_deserialize (const guchar *data,
           memcpy (xyt->ycol, ycol, sizeof (xcol[0]) * xlen);
           memcpy (xyt->thetacol, thetacol, sizeof (xcol[0]) * xlen);
 
+          /* Without stored quality, assume all minutiae are reliable */
+          if (qualitycol)
+            {
+              memcpy (xyt->qualitycol, qualitycol, sizeof (xcol[0]) * xlen);
+            }
+          else
+            {
+              gsize j;
+
+              for (j = 0; j < xlen; j++)
+                xyt->qualitycol[j] = 100;
+            }
+
           g_ptr_array_add (result->prints, g_steal_pointer (&xyt));
         }
     }
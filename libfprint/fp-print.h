@@ -104,6 +104,40 @@ gboolean fp_print_compatible (FpPrint  *self,
 gboolean fp_print_equal (FpPrint *self,
                          FpPrint *other);
 
+gboolean fp_print_match (FpPrint *self,
+                         FpPrint *other,
+                         gint    *score,
+                         GError **error);
+void     fp_print_match_async (FpPrint            *self,
+                               FpPrint            *other,
+                               GCancellable       *cancellable,
+                               GAsyncReadyCallback callback,
+                               gpointer            user_data);
+gboolean fp_print_match_finish (FpPrint      *self,
+                                GAsyncResult *result,
+                                gint         *score,
+                                GError      **error);
+
+gboolean fp_print_identify (FpPrint   *self,
+                            GPtrArray *gallery,
+                            gint       threshold,
+                            FpPrint  **match,
+                            gint      *score,
+                            GError   **error);
+void     fp_print_identify_async (FpPrint            *self,
+                                  GPtrArray          *gallery,
+                                  gint                threshold,
+                                  GCancellable       *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer            user_data);
+gboolean fp_print_identify_finish (FpPrint      *self,
+                                   GAsyncResult *result,
+                                   FpPrint     **match,
+                                   gint         *score,
+                                   GError      **error);
+
+void     fp_print_set_match_cache_size (gsize max_size);
+
 gboolean fp_print_serialize (FpPrint *print,
                              guchar **data,
                              gsize   *length,
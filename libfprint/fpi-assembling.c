@@ -312,6 +312,112 @@ fpi_assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
   return img;
 }
 
+/**
+ * fpi_line_buffer_new:
+ * @line_size: size of a single line in bytes
+ * @max_lines: maximum number of lines to store
+ *
+ * Creates a new #FpiLineBuffer with room for @max_lines lines.
+ *
+ * Returns: (transfer full): a new #FpiLineBuffer
+ */
+FpiLineBuffer *
+fpi_line_buffer_new (gsize line_size, guint max_lines)
+{
+  FpiLineBuffer *buffer = g_new0 (FpiLineBuffer, 1);
+
+  buffer->data = g_malloc (line_size * max_lines);
+  buffer->line_size = line_size;
+  buffer->max_lines = max_lines;
+
+  return buffer;
+}
+
+/**
+ * fpi_line_buffer_free:
+ * @buffer: (transfer full) (nullable): a #FpiLineBuffer
+ *
+ * Frees @buffer and its data.
+ */
+void
+fpi_line_buffer_free (FpiLineBuffer *buffer)
+{
+  if (!buffer)
+    return;
+
+  g_free (buffer->data);
+  g_free (buffer);
+}
+
+/**
+ * fpi_line_buffer_clear:
+ * @buffer: a #FpiLineBuffer
+ *
+ * Drops all lines from @buffer, the memory is kept for the next capture.
+ */
+void
+fpi_line_buffer_clear (FpiLineBuffer *buffer)
+{
+  buffer->num_lines = 0;
+}
+
+/**
+ * fpi_line_buffer_get_free_line:
+ * @buffer: a #FpiLineBuffer
+ *
+ * Returns the space for the line following the stored ones. Drivers can
+ * assemble a line there directly and then decide whether to keep it using
+ * fpi_line_buffer_commit_line(). Until then, the same space is returned
+ * again.
+ *
+ * Returns: (transfer none) (nullable): the next line, or %NULL if @buffer is full
+ */
+guint8 *
+fpi_line_buffer_get_free_line (FpiLineBuffer *buffer)
+{
+  if (buffer->num_lines >= buffer->max_lines)
+    return NULL;
+
+  return fpi_line_buffer_get_line (buffer, buffer->num_lines);
+}
+
+/**
+ * fpi_line_buffer_commit_line:
+ * @buffer: a #FpiLineBuffer
+ *
+ * Stores the line returned by fpi_line_buffer_get_free_line().
+ */
+void
+fpi_line_buffer_commit_line (FpiLineBuffer *buffer)
+{
+  g_return_if_fail (buffer->num_lines < buffer->max_lines);
+
+  buffer->num_lines++;
+}
+
+/**
+ * fpi_line_buffer_append:
+ * @buffer: a #FpiLineBuffer
+ * @line: the line to copy into @buffer
+ *
+ * Copies @line into @buffer.
+ *
+ * Returns: %FALSE if @buffer is full
+ */
+gboolean
+fpi_line_buffer_append (FpiLineBuffer *buffer, const guint8 *line)
+{
+  guint8 *dest = fpi_line_buffer_get_free_line (buffer);
+
+  if (!dest)
+    return FALSE;
+
+  memcpy (dest, line, buffer->line_size);
+  buffer->num_lines++;
+
+  return TRUE;
+}
+
 static int
 cmpint (const void *p1, const void *p2, gpointer data)
 {
@@ -352,22 +458,20 @@ median_filter (int *data, int size, int filtersize)
 
 static void
 interpolate_lines (struct fpi_line_asmbl_ctx *ctx,
-                   GSList *line1, gint32 y1_f,
-                   GSList *line2, gint32 y2_f,
+                   const FpiLineBuffer *lines,
+                   guint line1, gint32 y1_f,
+                   guint line2, gint32 y2_f,
                    unsigned char *output, gint32 yi_f,
                    int size)
 {
   int i;
   unsigned char p1, p2;
 
-  if (!line1 || !line2)
-    return;
-
   for (i = 0; i < size; i++)
     {
       gint unscaled;
-      p1 = ctx->get_pixel (ctx, line1, i);
-      p2 = ctx->get_pixel (ctx, line2, i);
+      p1 = ctx->get_pixel (ctx, lines, line1, i);
+      p2 = ctx->get_pixel (ctx, lines, line2, i);
 
       unscaled = (yi_f - y1_f) * p2 + (y2_f - yi_f) * p1;
       output[i] = (unscaled) / (y2_f - y1_f);
@@ -377,24 +481,23 @@ interpolate_lines (struct fpi_line_asmbl_ctx *ctx,
 /**
  * fpi_assemble_lines:
  * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
- * @lines: linked list of lines
- * @num_lines: number of items in @lines to process
+ * @lines: #FpiLineBuffer holding the lines
+ * @num_lines: number of lines in @lines to process
  *
  * #fpi_assemble_lines assembles individual lines into a single image.
  * It also rescales image to account variable swiping speed.
  *
- * Note that @num_lines might be shorter than the length of the list,
- * if some lines should be skipped.
+ * Note that @num_lines might be smaller than the number of lines in
+ * @lines, if some lines at the end should be skipped.
  *
  * Returns: a newly allocated #fp_img.
  */
 FpImage *
 fpi_assemble_lines (struct fpi_line_asmbl_ctx *ctx,
-                    GSList *lines, size_t num_lines)
+                    const FpiLineBuffer *lines, size_t num_lines)
 {
   /* Number of output lines per distance between two scanners */
   int i;
-  GSList *row1, *row2;
   /* The y coordinate is tracked as a 16.16 fixed point number. All
    * variables postfixed with _f follow this format here and in
    * interpolate_lines.
@@ -409,11 +512,11 @@ fpi_assemble_lines (struct fpi_line_asmbl_ctx *ctx,
 
   g_return_val_if_fail (lines != NULL, NULL);
   g_return_val_if_fail (num_lines >= 2, NULL);
+  g_return_val_if_fail (num_lines <= lines->num_lines, NULL);
 
   fp_dbg ("%"G_GINT64_FORMAT, g_get_real_time ());
 
-  row1 = lines;
-  for (i = 0; (i < num_lines - 1) && row1; i += 2)
+  for (i = 0; i < num_lines - 1; i += 2)
     {
       int bestmatch = i;
       int bestdiff = 0;
@@ -422,24 +525,17 @@ fpi_assemble_lines (struct fpi_line_asmbl_ctx *ctx,
       firstrow = i + 1;
       lastrow = MIN (i + ctx->max_search_offset, num_lines - 1);
 
-      row2 = g_slist_next (row1);
       for (j = firstrow; j <= lastrow; j++)
         {
-          int diff = ctx->get_deviation (ctx,
-                                         row1,
-                                         row2);
+          int diff = ctx->get_deviation (ctx, lines, i, j);
           if ((j == firstrow) || (diff < bestdiff))
             {
               bestdiff = diff;
               bestmatch = j;
             }
-          row2 = g_slist_next (row2);
         }
       offsets[i / 2] = bestmatch - i;
       fp_dbg ("%d", offsets[i / 2]);
-      row1 = g_slist_next (row1);
-      if (row1)
-        row1 = g_slist_next (row1);
     }
 
   median_filter (offsets, (num_lines / 2) - 1, ctx->median_filter_size);
@@ -447,8 +543,7 @@ fpi_assemble_lines (struct fpi_line_asmbl_ctx *ctx,
   fp_dbg ("offsets_filtered: %"G_GINT64_FORMAT, g_get_real_time ());
   for (i = 0; i <= (num_lines / 2) - 1; i++)
     fp_dbg ("%d", offsets[i]);
-  row1 = lines;
-  for (i = 0; i < num_lines - 1; i++, row1 = g_slist_next (row1))
+  for (i = 0; i < num_lines - 1; i++)
     {
       int offset = offsets[i / 2];
       if (offset > 0)
@@ -458,10 +553,9 @@ fpi_assemble_lines (struct fpi_line_asmbl_ctx *ctx,
             {
               if (line_ind > ctx->max_height - 1)
                 goto out;
-              interpolate_lines (ctx,
-                                 row1, y_f,
-                                 g_slist_next (row1),
-                                 ynext_f,
+              interpolate_lines (ctx, lines,
+                                 i, y_f,
+                                 i + 1, ynext_f,
                                  output + line_ind * ctx->line_width,
                                  line_ind << 16,
                                  ctx->line_width);
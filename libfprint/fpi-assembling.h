@@ -69,6 +69,50 @@ void fpi_do_movement_estimation (struct fpi_frame_asmbl_ctx *ctx,
 FpImage *fpi_assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
                               GSList                     *stripes);
 
+/**
+ * FpiLineBuffer:
+ * @data: the line data
+ * @line_size: size of a single line in bytes
+ * @num_lines: number of lines stored in @data
+ * @max_lines: number of lines that fit into @data
+ *
+ * #FpiLineBuffer stores the lines returned by swipe sensors contiguously.
+ * It is allocated for the maximum number of lines up front, so that no
+ * allocations are needed while capturing.
+ */
+typedef struct
+{
+  guint8 *data;
+  gsize   line_size;
+  guint   num_lines;
+  guint   max_lines;
+} FpiLineBuffer;
+
+FpiLineBuffer *fpi_line_buffer_new (gsize line_size,
+                                    guint max_lines);
+void fpi_line_buffer_free (FpiLineBuffer *buffer);
+void fpi_line_buffer_clear (FpiLineBuffer *buffer);
+guint8 *fpi_line_buffer_get_free_line (FpiLineBuffer *buffer);
+void fpi_line_buffer_commit_line (FpiLineBuffer *buffer);
+gboolean fpi_line_buffer_append (FpiLineBuffer *buffer,
+                                 const guint8  *line);
+
+/**
+ * fpi_line_buffer_get_line:
+ * @buffer: a #FpiLineBuffer
+ * @line: index of the line
+ *
+ * Returns: (transfer none): the data of @line
+ */
+static inline guint8 *
+fpi_line_buffer_get_line (const FpiLineBuffer *buffer,
+                          guint                line)
+{
+  return buffer->data + line * buffer->line_size;
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FpiLineBuffer, fpi_line_buffer_free)
+
 /**
  * fpi_line_asmbl_ctx:
  * @line_width: width of line
@@ -96,6 +140,10 @@ FpImage *fpi_assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
  * between two lines. Higher values means lines are more different. If the reader
  * returns two lines at a time, this function should be used to estimate the
  * difference between pairs of lines.
+ *
+ * Both callbacks are passed the #FpiLineBuffer holding the lines and the
+ * index of the line(s) in question, so that they may also look at the
+ * neighbouring lines.
  */
 struct fpi_line_asmbl_ctx
 {
@@ -105,13 +153,15 @@ struct fpi_line_asmbl_ctx
   unsigned int median_filter_size;
   unsigned int max_search_offset;
   int          (*get_deviation)(struct fpi_line_asmbl_ctx *ctx,
-                                GSList                    *line1,
-                                GSList                    *line2);
+                                const FpiLineBuffer       *lines,
+                                guint                      line1,
+                                guint                      line2);
   unsigned char (*get_pixel)(struct fpi_line_asmbl_ctx *ctx,
-                             GSList                    *line,
+                             const FpiLineBuffer       *lines,
+                             guint                      line,
                              unsigned int               x);
 };
 
 FpImage *fpi_assemble_lines (struct fpi_line_asmbl_ctx *ctx,
-                             GSList                    *lines,
+                             const FpiLineBuffer       *lines,
                              size_t                     num_lines);
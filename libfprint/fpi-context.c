@@ -0,0 +1,61 @@
+/*
+ * Device enumeration helpers
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "fpi-context.h"
+#include <string.h>
+
+/**
+ * fpi_context_get_spi_acpi_id:
+ * @sysfs_path: The sysfs path of a spidev device
+ *
+ * Extract the ACPI ID of the SPI device from a spidev sysfs path such as
+ * ".../spi-ELAN7001:00/spidev/spidev0.0". This is the ID that the
+ * spi_acpi_id field of an #FpIdEntry is compared against during
+ * enumeration; only the complete ID matches, a prefix of it does not.
+ *
+ * Returns: (transfer full) (nullable): The ACPI ID, or %NULL if the path
+ *   does not contain an "spi-" component
+ */
+gchar *
+fpi_context_get_spi_acpi_id (const gchar *sysfs_path)
+{
+  g_auto(GStrv) components = NULL;
+  gint i;
+
+  g_return_val_if_fail (sysfs_path, NULL);
+
+  components = g_strsplit (sysfs_path, "/", -1);
+  for (i = 0; components[i]; i++)
+    {
+      gchar *acpi_id;
+      gchar *sep;
+
+      if (!g_str_has_prefix (components[i], "spi-"))
+        continue;
+
+      acpi_id = g_strdup (components[i] + strlen ("spi-"));
+      sep = strrchr (acpi_id, ':');
+      if (sep)
+        *sep = '\0';
+
+      return acpi_id;
+    }
+
+  return NULL;
+}
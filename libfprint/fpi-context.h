@@ -21,6 +21,7 @@
 #include <gusb.h>
 #include "fp-context.h"
 #include "fpi-compat.h"
+#include "fpi-device.h"
 
 /**
  * fpi_get_driver_types:
@@ -33,3 +34,41 @@
  *   all driver types
  */
 GArray *fpi_get_driver_types (void);
+
+gchar *fpi_context_get_spi_acpi_id (const gchar *sysfs_path);
+
+/**
+ * FpiDriverIdEntry:
+ * @driver: Index of the driver in the array returned by fpi_get_driver_types()
+ * @type: The #FpDeviceType of the driver
+ * @vid: The USB vendor ID, or the HID vendor ID for hidraw udev devices
+ * @pid: The USB product ID, or the HID product ID for hidraw udev devices
+ * @udev_types: The #FpiDeviceUdevSubtypeFlags of a udev device
+ * @spi_acpi_id: The ACPI ID of a spidev udev device
+ * @virtual_envvar: The environment variable of a virtual device
+ * @driver_data: The driver data of the #FpIdEntry
+ *
+ * A flattened #FpIdEntry of an enabled driver. The tables of these are
+ * generated at build time so that devices can be matched without
+ * initializing all driver classes.
+ *
+ * Stability: private
+ */
+typedef struct
+{
+  guint                     driver;
+  FpDeviceType              type;
+  guint16                   vid;
+  guint16                   pid;
+  FpiDeviceUdevSubtypeFlags udev_types;
+  const gchar              *spi_acpi_id;
+  const gchar              *virtual_envvar;
+  guint64                   driver_data;
+} FpiDriverIdEntry;
+
+/* Generated at build time, see fprint-list-driver-ids.c */
+extern const gchar * const fpi_driver_names[];
+extern const FpiDriverIdEntry fpi_driver_ids[];
+extern const guint fpi_driver_ids_len;
+extern const FpiDriverIdEntry fpi_driver_usb_ids[];
+extern const guint fpi_driver_usb_ids_len;
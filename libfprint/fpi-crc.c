@@ -0,0 +1,203 @@
+/*
+ * Checksum helpers for device protocols
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "fpi-crc.h"
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+/**
+ * SECTION:fpi-crc
+ * @title: Checksums
+ * @short_description: CRC routines used by device protocols
+ *
+ * Table driven implementations of the CRC variants that are used to
+ * protect the packets of several device protocols. All functions take
+ * the value returned by a previous call as @crc, so that a checksum can
+ * be computed over several buffers; pass 0 for the first buffer.
+ *
+ * fpi_crc32() processes 8 bytes per step using the slicing-by-8 tables,
+ * or the CRC32 instructions when building for ARMv8 with the CRC
+ * extension.
+ */
+
+#define CRC32_POLY 0xedb88320
+#define CRC16_CCITT_POLY 0x1021
+#define CRC8_POLY 0x07
+
+typedef struct
+{
+  guint32 crc32[8][256];
+  guint16 crc16_ccitt[256];
+  guint8  crc8[256];
+} FpiCrcTables;
+
+static FpiCrcTables tables;
+
+static const FpiCrcTables *
+get_tables (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized))
+    {
+      guint i, j;
+
+      for (i = 0; i < 256; i++)
+        {
+          guint32 crc32 = i;
+          guint16 crc16 = i << 8;
+          guint8 crc8 = i;
+
+          for (j = 0; j < 8; j++)
+            {
+              crc32 = (crc32 >> 1) ^ (crc32 & 1 ? CRC32_POLY : 0);
+              crc16 = (crc16 << 1) ^ (crc16 & 0x8000 ? CRC16_CCITT_POLY : 0);
+              crc8 = (crc8 << 1) ^ (crc8 & 0x80 ? CRC8_POLY : 0);
+            }
+
+          tables.crc32[0][i] = crc32;
+          tables.crc16_ccitt[i] = crc16;
+          tables.crc8[i] = crc8;
+        }
+
+      /* crc32[k][i] is the CRC of byte i followed by k zero bytes */
+      for (j = 1; j < 8; j++)
+        for (i = 0; i < 256; i++)
+          tables.crc32[j][i] = (tables.crc32[j - 1][i] >> 8) ^
+                               tables.crc32[0][tables.crc32[j - 1][i] & 0xff];
+
+      g_once_init_leave (&initialized, 1);
+    }
+
+  return &tables;
+}
+
+/**
+ * fpi_crc32:
+ * @crc: the CRC of the preceding data, or 0
+ * @data: (array length=len): the data
+ * @len: length of @data
+ *
+ * Calculates the CRC-32 as used by ethernet and zlib (reflected polynomial
+ * 0x04c11db7, initial value and final XOR 0xffffffff).
+ *
+ * Returns: the CRC of @data
+ */
+guint32
+fpi_crc32 (guint32       crc,
+           const guint8 *data,
+           gsize         len)
+{
+#if defined(__ARM_FEATURE_CRC32)
+  crc = ~crc;
+
+  for (; len >= 8; len -= 8, data += 8)
+    {
+      guint64 word;
+
+      memcpy (&word, data, sizeof (word));
+      crc = __crc32d (crc, GUINT64_FROM_LE (word));
+    }
+
+  for (; len > 0; len--)
+    crc = __crc32b (crc, *data++);
+
+  return ~crc;
+#else
+  const FpiCrcTables *t = get_tables ();
+
+  crc = ~crc;
+
+  for (; len >= 8; len -= 8, data += 8)
+    {
+      guint32 lo, hi;
+
+      memcpy (&lo, data, sizeof (lo));
+      memcpy (&hi, data + 4, sizeof (hi));
+      lo = GUINT32_FROM_LE (lo) ^ crc;
+      hi = GUINT32_FROM_LE (hi);
+
+      crc = t->crc32[7][lo & 0xff] ^
+            t->crc32[6][(lo >> 8) & 0xff] ^
+            t->crc32[5][(lo >> 16) & 0xff] ^
+            t->crc32[4][lo >> 24] ^
+            t->crc32[3][hi & 0xff] ^
+            t->crc32[2][(hi >> 8) & 0xff] ^
+            t->crc32[1][(hi >> 16) & 0xff] ^
+            t->crc32[0][hi >> 24];
+    }
+
+  for (; len > 0; len--)
+    crc = t->crc32[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+
+  return ~crc;
+#endif
+}
+
+/**
+ * fpi_crc16_ccitt:
+ * @crc: the CRC of the preceding data, or 0
+ * @data: (array length=len): the data
+ * @len: length of @data
+ *
+ * Calculates the CRC-16 with the CCITT polynomial 0x1021, without
+ * reflection or final XOR (also known as CRC-16/XMODEM).
+ *
+ * Returns: the CRC of @data
+ */
+guint16
+fpi_crc16_ccitt (guint16       crc,
+                 const guint8 *data,
+                 gsize         len)
+{
+  const FpiCrcTables *t = get_tables ();
+
+  for (; len > 0; len--)
+    crc = (crc << 8) ^ t->crc16_ccitt[(crc >> 8) ^ *data++];
+
+  return crc;
+}
+
+/**
+ * fpi_crc8:
+ * @crc: the CRC of the preceding data, or 0
+ * @data: (array length=len): the data
+ * @len: length of @data
+ *
+ * Calculates the CRC-8 with the polynomial 0x07, without reflection or
+ * final XOR (also known as CRC-8/SMBUS).
+ *
+ * Returns: the CRC of @data
+ */
+guint8
+fpi_crc8 (guint8        crc,
+          const guint8 *data,
+          gsize         len)
+{
+  const FpiCrcTables *t = get_tables ();
+
+  for (; len > 0; len--)
+    crc = t->crc8[crc ^ *data++];
+
+  return crc;
+}
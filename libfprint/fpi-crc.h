@@ -0,0 +1,34 @@
+/*
+ * Checksum helpers for device protocols
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <glib.h>
+
+guint32 fpi_crc32 (guint32       crc,
+                   const guint8 *data,
+                   gsize         len);
+
+guint16 fpi_crc16_ccitt (guint16       crc,
+                         const guint8 *data,
+                         gsize         len);
+
+guint8 fpi_crc8 (guint8        crc,
+                 const guint8 *data,
+                 gsize         len);
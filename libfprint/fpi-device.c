@@ -26,6 +26,7 @@
 #include "fpi-log.h"
 
 #include "fp-device-private.h"
+#include "fpi-trace.h"
 
 /**
  * SECTION: fpi-device
@@ -50,6 +51,230 @@ fp_device_get_instance_private (FpDevice *self)
                             g_type_class_get_instance_private_offset (dev_class));
 }
 
+/* Optional per-device worker. When FP_DEVICE_WORKER_THREAD=1 is set, the
+ * driver of each device is run on its own thread with its own main context
+ * and only the results are passed back to the context of the caller. */
+struct _FpDeviceWorker
+{
+  GThread      *thread;
+  GMainContext *context;
+  GMainLoop    *loop;
+  GMainContext *caller_context;
+  gboolean      detached;
+};
+
+static void
+device_worker_free (FpDeviceWorker *worker)
+{
+  g_main_loop_unref (worker->loop);
+  g_main_context_unref (worker->context);
+  g_main_context_unref (worker->caller_context);
+  g_free (worker);
+}
+
+static gpointer
+device_worker_thread (gpointer user_data)
+{
+  FpDeviceWorker *worker = user_data;
+
+  g_main_context_push_thread_default (worker->context);
+  g_main_loop_run (worker->loop);
+  g_main_context_pop_thread_default (worker->context);
+
+  if (worker->detached)
+    device_worker_free (worker);
+
+  return NULL;
+}
+
+static gboolean
+device_worker_quit_cb (gpointer user_data)
+{
+  g_main_loop_quit (user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Started once from constructed(), priv->worker does not change until the
+ * device is finalized. Notifications are sent to the context the device
+ * was created in. */
+void
+fpi_device_start_worker (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  g_autofree char *name = g_strdup_printf ("fp-%s", fp_device_get_driver (device));
+  FpDeviceWorker *worker;
+
+  g_assert (priv->worker == NULL);
+
+  worker = g_new0 (FpDeviceWorker, 1);
+  worker->context = g_main_context_new ();
+  worker->loop = g_main_loop_new (worker->context, FALSE);
+  worker->caller_context = g_main_context_ref_thread_default ();
+  worker->thread = g_thread_new (name, device_worker_thread, worker);
+  priv->worker = worker;
+}
+
+/* Returns the context the driver runs on */
+GMainContext *
+fpi_device_get_driver_context (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  if (priv->worker)
+    return priv->worker->context;
+
+  if (priv->current_task)
+    return g_task_get_context (priv->current_task);
+
+  return g_main_context_get_thread_default ();
+}
+
+static gboolean
+device_in_worker (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  return priv->worker && g_thread_self () == priv->worker->thread;
+}
+
+typedef struct
+{
+  FpDevice *device;
+  void      (*func) (FpDevice *device);
+} FpDeviceInvokeData;
+
+static void
+invoke_data_free (FpDeviceInvokeData *data)
+{
+  g_object_unref (data->device);
+  g_free (data);
+}
+
+static gboolean
+invoke_driver_cb (gpointer user_data)
+{
+  FpDeviceInvokeData *data = user_data;
+
+  data->func (data->device);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Call a driver vfunc, on the worker thread if it is enabled */
+void
+fpi_device_invoke_driver (FpDevice *device,
+                          void (*func) (FpDevice *device))
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  FpDeviceInvokeData *data;
+
+  if (!priv->worker)
+    {
+      func (device);
+      return;
+    }
+
+  data = g_new (FpDeviceInvokeData, 1);
+  data->device = g_object_ref (device);
+  data->func = func;
+  g_main_context_invoke_full (priv->worker->context, G_PRIORITY_DEFAULT,
+                              invoke_driver_cb, data,
+                              (GDestroyNotify) invoke_data_free);
+}
+
+/* Stops the worker thread. A reference to its context is returned so that
+ * sources still attached to it can be destroyed before it goes away. */
+GMainContext *
+fpi_device_stop_worker (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  FpDeviceWorker *worker = g_steal_pointer (&priv->worker);
+  GMainContext *context;
+
+  if (!worker)
+    return NULL;
+
+  context = g_main_context_ref (worker->context);
+
+  /* The worker frees itself if the device is dropped from the driver */
+  if (g_thread_self () == worker->thread)
+    {
+      g_main_loop_quit (worker->loop);
+      worker->detached = TRUE;
+      g_thread_unref (worker->thread);
+      return context;
+    }
+
+  /* Quit from within the loop, it might not be running yet */
+  g_main_context_invoke (worker->context, device_worker_quit_cb, worker->loop);
+  g_thread_join (worker->thread);
+  device_worker_free (worker);
+
+  return context;
+}
+
+/* Property notifications and the removed signal are seen by the API user.
+ * With a worker thread they are emitted from the context the device was
+ * created in rather than from the worker. */
+typedef struct
+{
+  FpDevice    *device;
+  const gchar *property_name;
+  const gchar *signal_name;
+} FpDeviceNotifyData;
+
+static void
+notify_data_free (FpDeviceNotifyData *data)
+{
+  g_object_unref (data->device);
+  g_free (data);
+}
+
+static gboolean
+notify_in_caller_cb (gpointer user_data)
+{
+  FpDeviceNotifyData *data = user_data;
+
+  if (data->property_name)
+    g_object_notify (G_OBJECT (data->device), data->property_name);
+  else
+    g_signal_emit_by_name (data->device, data->signal_name);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+notify_in_caller (FpDevice    *device,
+                  const gchar *property_name,
+                  const gchar *signal_name)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  FpDeviceNotifyData *data;
+  GSource *source;
+
+  if (!device_in_worker (device))
+    {
+      if (property_name)
+        g_object_notify (G_OBJECT (device), property_name);
+      else
+        g_signal_emit_by_name (device, signal_name);
+      return;
+    }
+
+  data = g_new (FpDeviceNotifyData, 1);
+  data->device = g_object_ref (device);
+  data->property_name = property_name;
+  data->signal_name = signal_name;
+
+  source = g_idle_source_new ();
+  g_source_set_priority (source, G_PRIORITY_DEFAULT);
+  g_source_set_callback (source, notify_in_caller_cb, data,
+                         (GDestroyNotify) notify_data_free);
+  g_source_attach (source, priv->worker->caller_context);
+  g_source_unref (source);
+}
+
 /**
  * fpi_device_class_auto_initialize_features:
  *
@@ -264,7 +489,7 @@ fpi_device_set_nr_enroll_stages (FpDevice *device,
   g_return_if_fail (enroll_stages > 0);
 
   priv->nr_enroll_stages = enroll_stages;
-  g_object_notify (G_OBJECT (device), "nr-enroll-stages");
+  notify_in_caller (device, "nr-enroll-stages", NULL);
 }
 
 /**
@@ -285,7 +510,7 @@ fpi_device_set_scan_type (FpDevice  *device,
   g_return_if_fail (FP_IS_DEVICE (device));
 
   priv->scan_type = scan_type;
-  g_object_notify (G_OBJECT (device), "scan-type");
+  notify_in_caller (device, "scan-type", NULL);
 }
 
 /**
@@ -315,6 +540,7 @@ typedef struct
 {
   GSource   source;
   FpDevice *device;
+  gboolean  rearmable;
 } FpDeviceTimeoutSource;
 
 static void
@@ -324,7 +550,9 @@ timeout_finalize (GSource *source)
   FpDevicePrivate *priv;
 
   priv = fp_device_get_instance_private (timeout_source->device);
+  g_mutex_lock (&priv->sources_lock);
   priv->sources = g_slist_remove (priv->sources, source);
+  g_mutex_unlock (&priv->sources_lock);
 }
 
 static gboolean
@@ -333,9 +561,13 @@ timeout_dispatch (GSource *source, GSourceFunc gsource_func, gpointer user_data)
   FpDeviceTimeoutSource *timeout_source = (FpDeviceTimeoutSource *) source;
   FpTimeoutFunc callback = (FpTimeoutFunc) gsource_func;
 
+  /* Disarm before calling back, the callback may re-arm the source */
+  if (timeout_source->rearmable)
+    g_source_set_ready_time (source, -1);
+
   callback (timeout_source->device, user_data);
 
-  return G_SOURCE_REMOVE;
+  return timeout_source->rearmable ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
 }
 
 static GSourceFuncs timeout_funcs = {
@@ -346,6 +578,37 @@ static GSourceFuncs timeout_funcs = {
   NULL, NULL
 };
 
+static GSource *
+device_add_timeout (FpDevice      *device,
+                    gint64         ready_time,
+                    gboolean       rearmable,
+                    FpTimeoutFunc  func,
+                    gpointer       user_data,
+                    GDestroyNotify destroy_notify)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  FpDeviceTimeoutSource *source;
+
+  source = (FpDeviceTimeoutSource *) g_source_new (&timeout_funcs,
+                                                   sizeof (FpDeviceTimeoutSource));
+  source->device = device;
+  source->rearmable = rearmable;
+
+  g_source_set_callback (&source->source, (GSourceFunc) func, user_data, destroy_notify);
+  g_source_set_ready_time (&source->source, ready_time);
+
+  /* Track the source before attaching it, it may be dispatched (and
+   * finalized) on the worker thread right away. */
+  g_mutex_lock (&priv->sources_lock);
+  priv->sources = g_slist_prepend (priv->sources, source);
+  g_mutex_unlock (&priv->sources_lock);
+
+  g_source_attach (&source->source, fpi_device_get_driver_context (device));
+  g_source_unref (&source->source);
+
+  return &source->source;
+}
+
 /**
  * fpi_device_add_timeout:
  * @device: The #FpDevice
@@ -366,27 +629,58 @@ fpi_device_add_timeout (FpDevice      *device,
                         gpointer       user_data,
                         GDestroyNotify destroy_notify)
 {
-  FpDevicePrivate *priv = fp_device_get_instance_private (device);
-  FpDeviceTimeoutSource *source;
-  GMainContext *context;
+  return device_add_timeout (device,
+                             g_get_monotonic_time () + interval * (guint64) 1000,
+                             FALSE, func, user_data, destroy_notify);
+}
 
-  source = (FpDeviceTimeoutSource *) g_source_new (&timeout_funcs,
-                                                   sizeof (FpDeviceTimeoutSource));
-  source->device = device;
+/**
+ * fpi_device_add_rearmable_timeout:
+ * @device: The #FpDevice
+ * @func: The #FpTimeoutFunc to call on timeout
+ * @user_data: (nullable): User data to pass to the callback
+ * @destroy_notify: (nullable): #GDestroyNotify for @user_data
+ *
+ * Register a timeout that can be fired repeatedly. The source is created
+ * disarmed; arm it using g_source_set_ready_time(). It is disarmed again
+ * before @func is called and stays attached until it is destroyed using
+ * g_source_destroy() or the device is finalized.
+ *
+ * Like fpi_device_add_timeout(), the source is attached to the context the
+ * driver runs in.
+ *
+ * Returns: (transfer none): A newly created and attached #GSource
+ */
+GSource *
+fpi_device_add_rearmable_timeout (FpDevice      *device,
+                                  FpTimeoutFunc  func,
+                                  gpointer       user_data,
+                                  GDestroyNotify destroy_notify)
+{
+  return device_add_timeout (device, -1, TRUE, func, user_data, destroy_notify);
+}
 
-  if (priv->current_task)
-    context = g_task_get_context (priv->current_task);
-  else
-    context = g_main_context_get_thread_default ();
+/**
+ * fpi_device_timeout_is_current:
+ * @device: The #FpDevice
+ * @source: A #GSource returned by fpi_device_add_rearmable_timeout()
+ *
+ * Checks whether @source is attached to the context the driver currently
+ * runs in. A rearmable timeout that is kept across actions needs to be
+ * recreated if this is not the case.
+ *
+ * Returns: %TRUE if @source can be re-armed
+ */
+gboolean
+fpi_device_timeout_is_current (FpDevice *device,
+                               GSource  *source)
+{
+  GMainContext *context = fpi_device_get_driver_context (device);
 
-  g_source_attach (&source->source, context);
-  g_source_set_callback (&source->source, (GSourceFunc) func, user_data, destroy_notify);
-  g_source_set_ready_time (&source->source,
-                           g_source_get_time (&source->source) + interval * (guint64) 1000);
-  priv->sources = g_slist_prepend (priv->sources, source);
-  g_source_unref (&source->source);
+  if (!context)
+    context = g_main_context_default ();
 
-  return &source->source;
+  return g_source_get_context (source) == context;
 }
 
 /**
@@ -709,7 +1003,7 @@ fpi_device_remove (FpDevice *device)
 
   priv->is_removed = TRUE;
 
-  g_object_notify (G_OBJECT (device), "removed");
+  notify_in_caller (device, "removed", NULL);
 
   /* If there is a pending action, we wait for it to fail, otherwise we
    * immediately emit the "removed" signal. */
@@ -723,7 +1017,7 @@ fpi_device_remove (FpDevice *device)
     }
   else
     {
-      g_signal_emit_by_name (device, "removed");
+      notify_in_caller (device, NULL, "removed");
     }
 }
 
@@ -805,6 +1099,7 @@ fpi_device_action_error (FpDevice *device,
 
     default:
     case FPI_DEVICE_ACTION_NONE:
+    case FPI_DEVICE_ACTION_LAST:
       g_return_if_reached ();
       break;
     }
@@ -921,7 +1216,7 @@ fpi_device_critical_leave (FpDevice *device)
   g_source_set_name (priv->critical_section_flush_source,
                      "Flush libfprint driver critical section");
   g_source_attach (priv->critical_section_flush_source,
-                   g_task_get_context (priv->current_task));
+                   fpi_device_get_driver_context (device));
   g_source_unref (priv->critical_section_flush_source);
 }
 
@@ -930,8 +1225,8 @@ clear_device_cancel_action (FpDevice *device)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
-  g_clear_pointer (&priv->current_idle_cancel_source, g_source_destroy);
-
+  /* Disconnecting waits for a handler running in another thread, so the
+   * idle cancel source can only be cleared afterwards. */
   if (priv->current_cancellable_id)
     {
       g_cancellable_disconnect (priv->current_cancellable,
@@ -945,6 +1240,8 @@ clear_device_cancel_action (FpDevice *device)
                                 priv->current_task_cancellable_id);
       priv->current_task_cancellable_id = 0;
     }
+
+  g_clear_pointer (&priv->current_idle_cancel_source, g_source_destroy);
 }
 
 typedef enum _FpDeviceTaskReturnType {
@@ -955,6 +1252,40 @@ typedef enum _FpDeviceTaskReturnType {
   FP_DEVICE_TASK_RETURN_ERROR,
 } FpDeviceTaskReturnType;
 
+static void
+fp_latency_histogram_add (FpLatencyHistogram **histogram, gint64 duration_us)
+{
+  FpLatencyHistogram *h;
+  guint32 value;
+  guint bucket;
+
+  if (*histogram == NULL)
+    {
+      *histogram = g_new0 (FpLatencyHistogram, 1);
+      (*histogram)->min = G_MAXUINT64;
+    }
+  h = *histogram;
+
+  value = CLAMP (duration_us, 0, G_MAXUINT32);
+  if (value < FP_LATENCY_SUB_BUCKETS)
+    {
+      bucket = value;
+    }
+  else
+    {
+      gint msb = g_bit_nth_msf (value, -1);
+
+      bucket = (msb - 1) * FP_LATENCY_SUB_BUCKETS +
+               ((value >> (msb - 2)) & (FP_LATENCY_SUB_BUCKETS - 1));
+    }
+
+  h->count += 1;
+  h->sum += value;
+  h->min = MIN (h->min, value);
+  h->max = MAX (h->max, value);
+  h->buckets[bucket] += 1;
+}
+
 typedef struct _FpDeviceTaskReturnData
 {
   FpDevice              *device;
@@ -980,6 +1311,15 @@ fp_device_task_return_in_idle_cb (gpointer user_data)
   task = g_steal_pointer (&priv->current_task);
   action = priv->current_action;
   priv->current_action = FPI_DEVICE_ACTION_NONE;
+  FPI_TRACE (device_action_complete, data->device, action,
+             g_get_monotonic_time () - priv->current_action_start, data->type);
+  g_mutex_lock (&priv->timings_lock);
+  fp_latency_histogram_add (&priv->action_timings[action],
+                            g_get_monotonic_time () - priv->current_action_start);
+  g_mutex_unlock (&priv->timings_lock);
+  /* Finger timestamps of this action must not leak into the next one */
+  priv->finger_needed_time = 0;
+  priv->finger_present_time = 0;
   priv->current_task_idle_return_source = NULL;
   g_clear_object (&priv->current_cancellable);
   cancellation_reason = g_steal_pointer (&priv->current_cancellation_reason);
@@ -1147,13 +1487,13 @@ fpi_device_probe_complete (FpDevice    *device,
         {
           g_clear_pointer (&priv->device_id, g_free);
           priv->device_id = g_strdup (device_id);
-          g_object_notify (G_OBJECT (device), "device-id");
+          notify_in_caller (device, "device-id", NULL);
         }
       if (device_name)
         {
           g_clear_pointer (&priv->device_name, g_free);
           priv->device_name = g_strdup (device_name);
-          g_object_notify (G_OBJECT (device), "name");
+          notify_in_caller (device, "name", NULL);
         }
       fpi_device_return_task_in_idle (device, FP_DEVICE_TASK_RETURN_BOOL,
                                       GUINT_TO_POINTER (TRUE));
@@ -1642,6 +1982,7 @@ fpi_device_suspend (FpDevice *device)
     case FPI_DEVICE_ACTION_DELETE:
     case FPI_DEVICE_ACTION_LIST:
     case FPI_DEVICE_ACTION_CLEAR_STORAGE:
+    case FPI_DEVICE_ACTION_LAST:
       g_signal_connect_object (priv->current_task,
                                "notify::completed",
                                G_CALLBACK (complete_suspend_resume_task),
@@ -1687,6 +2028,7 @@ fpi_device_resume (FpDevice *device)
     case FPI_DEVICE_ACTION_DELETE:
     case FPI_DEVICE_ACTION_LIST:
     case FPI_DEVICE_ACTION_CLEAR_STORAGE:
+    case FPI_DEVICE_ACTION_LAST:
       /* cannot happen as we make sure these tasks complete before suspend */
       g_assert_not_reached ();
       complete_suspend_resume_task (device);
@@ -1876,6 +2218,81 @@ fpi_device_clear_storage_complete (FpDevice *device,
     fpi_device_return_task_in_idle (device, FP_DEVICE_TASK_RETURN_ERROR, error);
 }
 
+/* Progress and match callbacks are user code. With a worker thread they are
+ * passed to the context of the caller, together with copies of their
+ * arguments. */
+typedef struct
+{
+  FpDevice        *device;
+  FpEnrollProgress enroll_progress_cb;
+  FpMatchCb        match_cb;
+  gpointer         user_data;
+  gint             completed_stages;
+  FpPrint         *match;
+  FpPrint         *print;
+  GError          *error;
+} FpDeviceReportData;
+
+static void
+report_data_free (FpDeviceReportData *data)
+{
+  g_clear_object (&data->match);
+  g_clear_object (&data->print);
+  g_clear_error (&data->error);
+  g_object_unref (data->device);
+  g_free (data);
+}
+
+static gboolean
+report_in_caller_cb (gpointer user_data)
+{
+  FpDeviceReportData *data = user_data;
+
+  if (data->enroll_progress_cb)
+    data->enroll_progress_cb (data->device, data->completed_stages, data->print,
+                              data->user_data, data->error);
+  else
+    data->match_cb (data->device, data->match, data->print,
+                    data->user_data, data->error);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+report_in_caller (FpDevice           *device,
+                  FpDeviceReportData *report)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  FpDeviceReportData *data;
+  GSource *source;
+
+  report->device = device;
+
+  if (!priv->worker)
+    {
+      report_in_caller_cb (report);
+      return;
+    }
+
+  data = g_new (FpDeviceReportData, 1);
+  *data = *report;
+  g_object_ref (data->device);
+  if (data->match)
+    g_object_ref (data->match);
+  if (data->print)
+    g_object_ref (data->print);
+  if (data->error)
+    data->error = g_error_copy (data->error);
+
+  /* Not g_main_context_invoke(), which may run it on this thread */
+  source = g_idle_source_new ();
+  g_source_set_priority (source, g_task_get_priority (priv->current_task));
+  g_source_set_callback (source, report_in_caller_cb, data,
+                         (GDestroyNotify) report_data_free);
+  g_source_attach (source, g_task_get_context (priv->current_task));
+  g_source_unref (source);
+}
+
 /**
 
  * fpi_device_enroll_progress:
@@ -1915,11 +2332,15 @@ fpi_device_enroll_progress (FpDevice *device,
 
   if (data->enroll_progress_cb)
     {
-      data->enroll_progress_cb (device,
-                                completed_stages,
-                                print,
-                                data->enroll_progress_data,
-                                error);
+      FpDeviceReportData report = {
+        .enroll_progress_cb = data->enroll_progress_cb,
+        .user_data = data->enroll_progress_data,
+        .completed_stages = completed_stages,
+        .print = print,
+        .error = error,
+      };
+
+      report_in_caller (device, &report);
     }
 
   g_clear_error (&error);
@@ -1955,6 +2376,10 @@ fpi_device_verify_report (FpDevice      *device,
 
   g_debug ("Device reported verify result");
 
+  if (priv->finger_present_time)
+    fpi_device_record_timing (device, FPI_DEVICE_TIMING_RESULT,
+                              g_get_monotonic_time () - priv->finger_present_time);
+
   if (print)
     print = g_object_ref_sink (print);
 
@@ -1995,7 +2420,17 @@ fpi_device_verify_report (FpDevice      *device,
     }
 
   if (call_cb && data->match_cb)
-    data->match_cb (device, data->match, data->print, data->match_data, data->error);
+    {
+      FpDeviceReportData report = {
+        .match_cb = data->match_cb,
+        .user_data = data->match_data,
+        .match = data->match,
+        .print = data->print,
+        .error = data->error,
+      };
+
+      report_in_caller (device, &report);
+    }
 }
 
 /**
@@ -2025,6 +2460,10 @@ fpi_device_identify_report (FpDevice *device,
 
   data->result_reported = TRUE;
 
+  if (priv->finger_present_time)
+    fpi_device_record_timing (device, FPI_DEVICE_TIMING_RESULT,
+                              g_get_monotonic_time () - priv->finger_present_time);
+
   if (match)
     g_object_ref (match);
 
@@ -2071,7 +2510,17 @@ fpi_device_identify_report (FpDevice *device,
     }
 
   if (call_cb && data->match_cb)
-    data->match_cb (device, data->match, data->print, data->match_data, data->error);
+    {
+      FpDeviceReportData report = {
+        .match_cb = data->match_cb,
+        .user_data = data->match_data,
+        .match = data->match,
+        .print = data->print,
+        .error = data->error,
+      };
+
+      report_in_caller (device, &report);
+    }
 }
 
 /**
@@ -2090,6 +2539,7 @@ fpi_device_report_finger_status (FpDevice           *device,
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
   g_autofree char *status_string = NULL;
+  FpFingerStatusFlags added;
 
   if (priv->finger_status == finger_status)
     return FALSE;
@@ -2097,8 +2547,20 @@ fpi_device_report_finger_status (FpDevice           *device,
   status_string = g_flags_to_string (FP_TYPE_FINGER_STATUS_FLAGS, finger_status);
   fp_dbg ("Device reported finger status change: %s", status_string);
 
+  added = finger_status & ~priv->finger_status;
+  if (added & FP_FINGER_STATUS_NEEDED)
+    priv->finger_needed_time = g_get_monotonic_time ();
+  if (added & FP_FINGER_STATUS_PRESENT)
+    {
+      priv->finger_present_time = g_get_monotonic_time ();
+      if (priv->finger_needed_time)
+        fpi_device_record_timing (device, FPI_DEVICE_TIMING_FINGER_WAIT,
+                                  priv->finger_present_time - priv->finger_needed_time);
+      priv->finger_needed_time = 0;
+    }
+
   priv->finger_status = finger_status;
-  g_object_notify (G_OBJECT (device), "finger-status");
+  notify_in_caller (device, "finger-status", NULL);
 
   return TRUE;
 }
@@ -2134,8 +2596,13 @@ static void
 update_temp_timeout (FpDevice *device, gpointer user_data)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  gboolean is_active;
 
-  fpi_device_update_temp (device, priv->temp_last_active);
+  g_mutex_lock (&priv->temp_lock);
+  is_active = priv->temp_last_active;
+  g_mutex_unlock (&priv->temp_lock);
+
+  fpi_device_update_temp (device, is_active);
 }
 
 /**
@@ -2156,6 +2623,7 @@ fpi_device_update_temp (FpDevice *device, gboolean is_active)
   gdouble next_threshold;
   gdouble old_ratio;
   FpTemperature old_temp;
+  FpTemperature new_temp;
   g_autofree char *old_temp_str = NULL;
   g_autofree char *new_temp_str = NULL;
 
@@ -2165,6 +2633,10 @@ fpi_device_update_temp (FpDevice *device, gboolean is_active)
       return;
     }
 
+  /* Called when actions start and end, and from the timeout below which may
+   * run on the worker thread. */
+  g_mutex_lock (&priv->temp_lock);
+
   passed_seconds = (now - priv->temp_last_update) / 1e6;
   old_ratio = priv->temp_current_ratio;
 
@@ -2206,9 +2678,10 @@ fpi_device_update_temp (FpDevice *device, gboolean is_active)
       priv->temp_current = FP_TEMPERATURE_HOT;
       next_threshold = is_active ? -1.0 : TEMP_HOT_WARM_THRESH;
     }
+  new_temp = priv->temp_current;
 
   old_temp_str = g_enum_to_string (FP_TYPE_TEMPERATURE, old_temp);
-  new_temp_str = g_enum_to_string (FP_TYPE_TEMPERATURE, priv->temp_current);
+  new_temp_str = g_enum_to_string (FP_TYPE_TEMPERATURE, new_temp);
   g_debug ("Updated temperature model after %0.2f seconds, ratio %0.2f -> %0.2f, active %d -> %d, %s -> %s",
            passed_seconds,
            old_ratio,
@@ -2218,11 +2691,31 @@ fpi_device_update_temp (FpDevice *device, gboolean is_active)
            old_temp_str,
            new_temp_str);
 
-  if (priv->temp_current != old_temp)
-    g_object_notify (G_OBJECT (device), "temperature");
+  g_clear_pointer (&priv->temp_timeout, g_source_destroy);
+
+  if (next_threshold >= 0)
+    {
+      /* Set passed_seconds to the time until the next update is needed */
+      if (is_active)
+        passed_seconds = -priv->temp_hot_seconds * log ((next_threshold - 1.0) / (priv->temp_current_ratio - 1.0));
+      else
+        passed_seconds = -priv->temp_cold_seconds * log (next_threshold / priv->temp_current_ratio);
+
+      passed_seconds += TEMP_DELAY_SECONDS;
+
+      priv->temp_timeout = fpi_device_add_timeout (device,
+                                                   passed_seconds * 1000,
+                                                   update_temp_timeout,
+                                                   NULL, NULL);
+    }
+
+  g_mutex_unlock (&priv->temp_lock);
+
+  if (new_temp != old_temp)
+    notify_in_caller (device, "temperature", NULL);
 
   /* If the device is HOT, then do an internal cancellation of long running tasks. */
-  if (priv->temp_current == FP_TEMPERATURE_HOT)
+  if (new_temp == FP_TEMPERATURE_HOT)
     {
       if (priv->current_action == FPI_DEVICE_ACTION_ENROLL ||
           priv->current_action == FPI_DEVICE_ACTION_VERIFY ||
@@ -2235,22 +2728,30 @@ fpi_device_update_temp (FpDevice *device, gboolean is_active)
           g_cancellable_cancel (priv->current_cancellable);
         }
     }
+}
 
-  g_clear_pointer (&priv->temp_timeout, g_source_destroy);
-
-  if (next_threshold < 0)
-    return;
-
-  /* Set passed_seconds to the time until the next update is needed */
-  if (is_active)
-    passed_seconds = -priv->temp_hot_seconds * log ((next_threshold - 1.0) / (priv->temp_current_ratio - 1.0));
-  else
-    passed_seconds = -priv->temp_cold_seconds * log (next_threshold / priv->temp_current_ratio);
+/**
+ * fpi_device_record_timing:
+ * @device: The #FpDevice
+ * @timing: The #FpiDeviceTiming phase
+ * @duration_us: The duration in microseconds
+ *
+ * Add a sample to the latency statistics of @device, see
+ * fp_device_get_statistics(). The generic phases are recorded by libfprint
+ * itself, drivers only need to call this if they e.g. do matching on the
+ * host without using #FpImageDevice.
+ */
+void
+fpi_device_record_timing (FpDevice       *device,
+                          FpiDeviceTiming timing,
+                          gint64          duration_us)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
-  passed_seconds += TEMP_DELAY_SECONDS;
+  g_return_if_fail (FP_IS_DEVICE (device));
+  g_return_if_fail (timing < FPI_DEVICE_TIMING_LAST);
 
-  priv->temp_timeout = fpi_device_add_timeout (device,
-                                               passed_seconds * 1000,
-                                               update_temp_timeout,
-                                               NULL, NULL);
+  g_mutex_lock (&priv->timings_lock);
+  fp_latency_histogram_add (&priv->timings[timing], duration_us);
+  g_mutex_unlock (&priv->timings_lock);
 }
@@ -58,6 +58,7 @@ struct _FpIdEntry
     struct
     {
       FpiDeviceUdevSubtypeFlags udev_types;
+      /* Matched exactly against the "spi-<ID>:nn" sysfs path component */
       const gchar              *spi_acpi_id;
       struct
       {
@@ -86,6 +87,9 @@ struct _FpIdEntry
  *   after being mostly cold. Set to -1 if the device can be always-on.
  * @temp_cold_seconds: Assumed time in seconds for the device to be mostly cold
  *   after having been too hot to operate.
+ * @probe_timeout_ms: Time in milliseconds after which the device is ignored if
+ *   @probe has not finished. Leave at 0 to use the FP_PROBE_TIMEOUT
+ *   environment variable, which by default means no timeout.
  * @usb_discover: Class method to check whether a USB device is supported by
  *  the driver. Should return 0 if the device is unsupported and a positive
  *  score otherwise. The default score is 50 and the driver with the highest
@@ -157,6 +161,9 @@ struct _FpDeviceClass
   gint32 temp_hot_seconds;
   gint32 temp_cold_seconds;
 
+  /* Enumeration */
+  guint probe_timeout_ms;
+
   /* Callbacks */
   gint (*usb_discover) (GUsbDevice *usb_device);
   void (*probe)    (FpDevice *device);
@@ -200,6 +207,7 @@ typedef void (*FpTimeoutFunc) (FpDevice *device,
  * @FPI_DEVICE_ACTION_LIST: Device stored prints are being queried.
  * @FPI_DEVICE_ACTION_DELETE: Device stored print is being deleted.
  * @FPI_DEVICE_ACTION_CLEAR_STORAGE: Device stored prints are being deleted.
+ * @FPI_DEVICE_ACTION_LAST: Number of actions, not a valid action.
  *
  * Current active action of the device. A driver can retrieve the action.
  */
@@ -215,8 +223,34 @@ typedef enum {
   FPI_DEVICE_ACTION_LIST,
   FPI_DEVICE_ACTION_DELETE,
   FPI_DEVICE_ACTION_CLEAR_STORAGE,
+  FPI_DEVICE_ACTION_LAST,
 } FpiDeviceAction;
 
+/**
+ * FpiDeviceTiming:
+ * @FPI_DEVICE_TIMING_FINGER_WAIT: Time from requesting a finger until it
+ *   was reported as present.
+ * @FPI_DEVICE_TIMING_CAPTURE: Time from the finger being placed until the
+ *   image was captured (including e.g. frame assembly).
+ * @FPI_DEVICE_TIMING_DETECTION: Minutiae detection on a captured image.
+ * @FPI_DEVICE_TIMING_MATCH: Matching the scanned print against the
+ *   template(s) on the host.
+ * @FPI_DEVICE_TIMING_RESULT: Time from the finger being placed until the
+ *   verify or identify result was reported.
+ * @FPI_DEVICE_TIMING_LAST: Number of timings, not a valid timing.
+ *
+ * Phases of an operation for which latency statistics are kept, see
+ * fpi_device_record_timing() and fp_device_get_statistics().
+ */
+typedef enum {
+  FPI_DEVICE_TIMING_FINGER_WAIT,
+  FPI_DEVICE_TIMING_CAPTURE,
+  FPI_DEVICE_TIMING_DETECTION,
+  FPI_DEVICE_TIMING_MATCH,
+  FPI_DEVICE_TIMING_RESULT,
+  FPI_DEVICE_TIMING_LAST,
+} FpiDeviceTiming;
+
 GUsbDevice  *fpi_device_get_usb_device (FpDevice *device);
 const gchar *fpi_device_get_virtual_env (FpDevice *device);
 gpointer     fpi_device_get_udev_data (FpDevice                 *device,
@@ -260,6 +294,13 @@ GSource * fpi_device_add_timeout (FpDevice      *device,
                                   gpointer       user_data,
                                   GDestroyNotify destroy_notify);
 
+GSource * fpi_device_add_rearmable_timeout (FpDevice      *device,
+                                            FpTimeoutFunc  func,
+                                            gpointer       user_data,
+                                            GDestroyNotify destroy_notify);
+gboolean fpi_device_timeout_is_current (FpDevice *device,
+                                        GSource  *source);
+
 void fpi_device_set_nr_enroll_stages (FpDevice *device,
                                       gint      enroll_stages);
 
@@ -325,4 +366,8 @@ gboolean fpi_device_report_finger_status_changes (FpDevice           *device,
                                                   FpFingerStatusFlags added_status,
                                                   FpFingerStatusFlags removed_status);
 
+void fpi_device_record_timing (FpDevice       *device,
+                               FpiDeviceTiming timing,
+                               gint64          duration_us);
+
 G_END_DECLS
@@ -0,0 +1,306 @@
+/*
+ * Sensor frame normalization helpers
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define FP_COMPONENT "frame-normalize"
+
+#include "fpi-log.h"
+
+#include <string.h>
+
+#include "fpi-frame-normalize.h"
+
+/**
+ * SECTION:fpi-frame-normalize
+ * @title: Sensor frame normalization
+ * @short_description: Background subtraction and contrast stretching
+ *
+ * Many sensors return raw ADC readings with a fixed pattern offset and
+ * a narrow, device dependent range. These helpers subtract a previously
+ * captured background and map the result onto 8 bit greyscale using a
+ * piecewise linear curve through the pixel values found at given
+ * percentiles of the frame.
+ *
+ * The percentiles are found using a two pass radix histogram, so the cost
+ * is linear in the frame size. The mapping is done through a lookup table
+ * held in a #FpiFrameNormalizeScratch, which the caller allocates once.
+ */
+
+/**
+ * fpi_frame_subtract_background:
+ * @frame: 16 bit frame to correct in place
+ * @background: background frame of the same size
+ * @len: number of pixels in @frame
+ * @sum: (out) (optional): the sum of the corrected pixels
+ *
+ * Subtracts @background from @frame, clamping negative results to zero.
+ *
+ * Returns: the number of pixels that were darker than the background
+ */
+guint
+fpi_frame_subtract_background (guint16       *frame,
+                               const guint16 *background,
+                               gsize          len,
+                               guint64       *sum)
+{
+  guint64 total = 0;
+  guint clipped = 0;
+  gsize i;
+
+  /* Branch free so that the compiler can vectorize it */
+  for (i = 0; i < len; i++)
+    {
+      guint16 keep = frame[i] >= background[i];
+      guint16 px = (frame[i] - background[i]) * keep;
+
+      clipped += !keep;
+      frame[i] = px;
+      total += px;
+    }
+
+  if (sum)
+    *sum = total;
+
+  return clipped;
+}
+
+/**
+ * fpi_frame_subtract_background_u8:
+ * @frame: 8 bit frame to correct in place
+ * @background: background frame of the same size
+ * @margin: noise margin
+ * @len: number of pixels in @frame
+ * @sum: (out) (optional): the sum of the corrected pixels
+ *
+ * Subtracts @background from @frame. Pixels which are not brighter than
+ * the background by more than @margin are set to zero.
+ *
+ * Returns: the number of pixels that were set to zero
+ */
+guint
+fpi_frame_subtract_background_u8 (guint8       *frame,
+                                  const guint8 *background,
+                                  guint8        margin,
+                                  gsize         len,
+                                  guint64      *sum)
+{
+  guint64 total = 0;
+  guint clipped = 0;
+  gsize i;
+
+  for (i = 0; i < len; i++)
+    {
+      guint8 keep = frame[i] > background[i] + margin;
+      guint8 px = (frame[i] - background[i]) * keep;
+
+      clipped += !keep;
+      frame[i] = px;
+      total += px;
+    }
+
+  if (sum)
+    *sum = total;
+
+  return clipped;
+}
+
+/**
+ * fpi_frame_normalize_get_levels:
+ * @frame: 16 bit frame
+ * @len: number of pixels in @frame, must not be zero
+ * @permille: (array length=n_levels): the requested ranks in 1/1000
+ * @n_levels: number of levels to find
+ * @levels: (out caller-allocates) (array length=n_levels): the found levels
+ * @scratch: scratch memory
+ *
+ * Finds the pixel values at the given ranks. The pixel at rank
+ * `len * permille / 1000` of the sorted frame is returned, a permille value
+ * of 1000 (or more) returns the maximum.
+ */
+void
+fpi_frame_normalize_get_levels (const guint16            *frame,
+                                gsize                     len,
+                                const guint16            *permille,
+                                guint                     n_levels,
+                                guint16                  *levels,
+                                FpiFrameNormalizeScratch *scratch)
+{
+  guint16 min = G_MAXUINT16, max = 0;
+  guint cached_bucket = G_MAXUINT;
+  gsize i;
+  guint l;
+
+  g_return_if_fail (len > 0);
+  g_return_if_fail (n_levels <= FPI_FRAME_NORMALIZE_MAX_LEVELS);
+
+  memset (scratch->coarse, 0, sizeof (scratch->coarse));
+  for (i = 0; i < len; i++)
+    {
+      scratch->coarse[frame[i] >> 8]++;
+      min = MIN (min, frame[i]);
+      max = MAX (max, frame[i]);
+    }
+
+  for (l = 0; l < n_levels; l++)
+    {
+      gsize rank = MIN (len * permille[l] / 1000, len - 1);
+      gsize seen = 0;
+      guint bucket, j;
+
+      if (rank == 0)
+        {
+          levels[l] = min;
+          continue;
+        }
+      if (rank == len - 1)
+        {
+          levels[l] = max;
+          continue;
+        }
+
+      for (bucket = 0; seen + scratch->coarse[bucket] <= rank; bucket++)
+        seen += scratch->coarse[bucket];
+      rank -= seen;
+
+      /* Neighbouring levels often end up in the same bucket */
+      if (bucket != cached_bucket)
+        {
+          memset (scratch->fine, 0, sizeof (scratch->fine));
+          for (i = 0; i < len; i++)
+            if ((frame[i] >> 8) == bucket)
+              scratch->fine[frame[i] & 0xff]++;
+          cached_bucket = bucket;
+        }
+
+      for (j = 0; rank >= scratch->fine[j]; j++)
+        rank -= scratch->fine[j];
+
+      levels[l] = bucket << 8 | j;
+    }
+}
+
+/**
+ * fpi_frame_normalize_build_lut:
+ * @levels: (array length=n_levels): ascending input levels
+ * @values: (array length=n_levels): ascending output values
+ * @n_levels: number of levels, must not be zero
+ * @scratch: scratch memory to store the table in
+ *
+ * Fills the lookup table of @scratch for the piecewise linear curve
+ * through the (@levels, @values) points. Input values from `levels[i]`
+ * up to (but excluding) `levels[i + 1]` are mapped to
+ * |[<!-- -->
+ *    values[i] + (px - levels[i]) * (values[i + 1] - values[i]) / (levels[i + 1] - levels[i])
+ * ]|
+ * and the last level is mapped to the last value. The table is indexed by
+ * `px - levels[0]`, see fpi_frame_normalize_apply().
+ */
+void
+fpi_frame_normalize_build_lut (const guint16            *levels,
+                               const guint8             *values,
+                               guint                     n_levels,
+                               FpiFrameNormalizeScratch *scratch)
+{
+  guint l;
+
+  g_return_if_fail (n_levels > 0);
+
+  for (l = 0; l + 1 < n_levels; l++)
+    {
+      guint lo = levels[l] - levels[0];
+      guint hi = levels[l + 1] - levels[0];
+      guint delta = values[l + 1] - values[l];
+      guint q = 0, r = 0;
+      guint x;
+
+      g_return_if_fail (levels[l] <= levels[l + 1]);
+      g_return_if_fail (values[l] <= values[l + 1]);
+
+      /* Step through the division instead of doing one per entry */
+      for (x = lo; x < hi; x++)
+        {
+          scratch->lut[x] = values[l] + q;
+
+          r += delta;
+          while (r >= hi - lo)
+            {
+              r -= hi - lo;
+              q++;
+            }
+        }
+    }
+
+  scratch->lut[levels[n_levels - 1] - levels[0]] = values[n_levels - 1];
+}
+
+/**
+ * fpi_frame_normalize_apply:
+ * @frame: 16 bit frame
+ * @len: number of pixels in @frame
+ * @base: the lowest level passed to fpi_frame_normalize_build_lut()
+ * @scratch: scratch memory holding the lookup table
+ * @out: (out caller-allocates): 8 bit output frame
+ *
+ * Maps @frame through the lookup table. All pixels must be within the
+ * range of levels that the table was built for.
+ */
+void
+fpi_frame_normalize_apply (const guint16                  *frame,
+                           gsize                           len,
+                           guint16                         base,
+                           const FpiFrameNormalizeScratch *scratch,
+                           guint8                         *out)
+{
+  gsize i;
+
+  for (i = 0; i < len; i++)
+    out[i] = scratch->lut[(guint16) (frame[i] - base)];
+}
+
+/**
+ * fpi_frame_normalize:
+ * @frame: 16 bit frame
+ * @len: number of pixels in @frame, must not be zero
+ * @permille: (array length=n_levels): the ranks of the levels in 1/1000
+ * @values: (array length=n_levels): the output value for each level
+ * @n_levels: number of levels
+ * @out: (out caller-allocates): 8 bit output frame
+ * @scratch: scratch memory
+ *
+ * Convenience function to stretch the contrast of @frame, see
+ * fpi_frame_normalize_get_levels() and fpi_frame_normalize_build_lut().
+ * The first and last entry of @permille should be 0 and 1000, so that
+ * all pixels are covered by the curve.
+ */
+void
+fpi_frame_normalize (const guint16            *frame,
+                     gsize                     len,
+                     const guint16            *permille,
+                     const guint8             *values,
+                     guint                     n_levels,
+                     guint8                   *out,
+                     FpiFrameNormalizeScratch *scratch)
+{
+  guint16 levels[FPI_FRAME_NORMALIZE_MAX_LEVELS];
+
+  g_return_if_fail (n_levels > 0 && n_levels <= FPI_FRAME_NORMALIZE_MAX_LEVELS);
+
+  fpi_frame_normalize_get_levels (frame, len, permille, n_levels, levels, scratch);
+  fpi_frame_normalize_build_lut (levels, values, n_levels, scratch);
+  fpi_frame_normalize_apply (frame, len, levels[0], scratch, out);
+}
@@ -0,0 +1,85 @@
+/*
+ * Sensor frame normalization helpers
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/**
+ * FPI_FRAME_NORMALIZE_MAX_LEVELS:
+ *
+ * The maximum number of levels that can be passed to
+ * fpi_frame_normalize_get_levels() and fpi_frame_normalize_build_lut().
+ */
+#define FPI_FRAME_NORMALIZE_MAX_LEVELS 8
+
+/**
+ * FpiFrameNormalizeScratch:
+ * @coarse: histogram of the upper byte of the pixel values
+ * @fine: histogram of the lower byte within one @coarse bucket
+ * @lut: lookup table mapping (pixel - lowest level) to the output value
+ *
+ * Scratch memory used by the frame normalization routines. It is
+ * provided by the caller so that it can be allocated once and reused
+ * for every frame; its content has no meaning between calls, except
+ * for @lut which is filled by fpi_frame_normalize_build_lut().
+ */
+typedef struct
+{
+  guint32 coarse[256];
+  guint32 fine[256];
+  guint8  lut[G_MAXUINT16 + 1];
+} FpiFrameNormalizeScratch;
+
+guint fpi_frame_subtract_background (guint16       *frame,
+                                     const guint16 *background,
+                                     gsize          len,
+                                     guint64       *sum);
+
+guint fpi_frame_subtract_background_u8 (guint8       *frame,
+                                        const guint8 *background,
+                                        guint8        margin,
+                                        gsize         len,
+                                        guint64      *sum);
+
+void fpi_frame_normalize_get_levels (const guint16            *frame,
+                                     gsize                     len,
+                                     const guint16            *permille,
+                                     guint                     n_levels,
+                                     guint16                  *levels,
+                                     FpiFrameNormalizeScratch *scratch);
+
+void fpi_frame_normalize_build_lut (const guint16            *levels,
+                                    const guint8             *values,
+                                    guint                     n_levels,
+                                    FpiFrameNormalizeScratch *scratch);
+
+void fpi_frame_normalize_apply (const guint16                  *frame,
+                                gsize                           len,
+                                guint16                         base,
+                                const FpiFrameNormalizeScratch *scratch,
+                                guint8                         *out);
+
+void fpi_frame_normalize (const guint16            *frame,
+                          gsize                     len,
+                          const guint16            *permille,
+                          const guint8             *values,
+                          guint                     n_levels,
+                          guint8                   *out,
+                          FpiFrameNormalizeScratch *scratch);
@@ -23,6 +23,8 @@
 #include "fp-image-device-private.h"
 #include "fp-image-device.h"
 
+#include <nbis.h>
+
 /**
  * SECTION: fpi-image-device
  * @title: Internal FpImageDevice
@@ -43,6 +45,9 @@ fp_image_device_get_instance_private (FpImageDevice *self)
 
 static void fp_image_device_change_state (FpImageDevice      *self,
                                           FpiImageDeviceState state);
+static void fpi_image_device_minutiae_detected (GObject      *source_object,
+                                                GAsyncResult *res,
+                                                gpointer      user_data);
 
 /* Private shared functions */
 
@@ -65,6 +70,12 @@ fpi_image_device_deactivate (FpImageDevice *self, gboolean cancelling)
   FpDevice *device = FP_DEVICE (self);
   FpImageDevicePrivate *priv = fp_image_device_get_instance_private (self);
   FpImageDeviceClass *cls = FP_IMAGE_DEVICE_GET_CLASS (device);
+  FpImage *image;
+
+  /* Drop images that are still waiting for minutiae detection, a scan
+   * that is already running will finish (or be cancelled) as usual. */
+  while ((image = g_queue_pop_head (&priv->pending_images)))
+    g_object_unref (image);
 
   if (!priv->active || priv->state == FPI_IMAGE_DEVICE_STATE_DEACTIVATING)
     {
@@ -138,6 +149,8 @@ fp_image_device_change_state (FpImageDevice *self, FpiImageDeviceState state)
                prev_state_str, state_str);
 
   priv->state = state;
+  if (state == FPI_IMAGE_DEVICE_STATE_CAPTURE)
+    priv->capture_start = g_get_monotonic_time ();
   g_object_notify (G_OBJECT (self), "fpi-image-device-state");
   g_signal_emit_by_name (self, "fpi-image-device-state-changed", priv->state);
 
@@ -155,14 +168,42 @@ fp_image_device_change_state (FpImageDevice *self, FpiImageDeviceState state)
     }
 }
 
+static void
+fp_image_device_start_minutiae_scan (FpImageDevice *self, FpImage *image)
+{
+  FpImageDevicePrivate *priv = fp_image_device_get_instance_private (self);
+
+  g_assert (!priv->minutiae_scan_active);
+
+  priv->detection_start = g_get_monotonic_time ();
+  priv->minutiae_scan_active = TRUE;
+
+  /* XXX: We also detect minutiae in capture mode, we solely do this
+   *      to normalize the image which will happen as a by-product. */
+  fp_image_detect_minutiae (image,
+                            fpi_device_get_cancellable (FP_DEVICE (self)),
+                            fpi_image_device_minutiae_detected,
+                            self);
+}
+
 static void
 fp_image_device_enroll_maybe_await_finger_on (FpImageDevice *self)
 {
   FpImageDevicePrivate *priv = fp_image_device_get_instance_private (self);
+  guint pending;
 
-  /* We wait for both the minutiae scan to complete and the finger to
-   * be removed before we switch to AWAIT_FINGER_ON. */
-  if (priv->minutiae_scan_active || priv->finger_present)
+  /* The finger needs to be removed before we switch to AWAIT_FINGER_ON. */
+  if (priv->state != FPI_IMAGE_DEVICE_STATE_IDLE || priv->finger_present)
+    return;
+
+  /* Minutiae detection of earlier stages may still be running while the
+   * next image is captured. Only ask for another finger if the pending
+   * images cannot complete the enrollment on their own (they may still
+   * fail, in which case we get here again once they are done) and if
+   * not too many images are queued up already. */
+  pending = priv->minutiae_scan_active + g_queue_get_length (&priv->pending_images);
+  if (pending >= IMG_MAX_PENDING_DETECTIONS ||
+      priv->enroll_stage + pending >= fp_device_get_nr_enroll_stages (FP_DEVICE (self)))
     return;
 
   fp_image_device_change_state (self, FPI_IMAGE_DEVICE_STATE_AWAIT_FINGER_ON);
@@ -212,6 +253,12 @@ fp_image_device_maybe_complete_action (FpImageDevice *self, GError *error)
       FpPrint *enroll_print;
       fpi_device_get_enroll_data (device, &enroll_print);
 
+      /* Only the prints of this enrollment are merged, the template may
+       * already contain prints from an earlier one. */
+      if (priv->enroll_fusion != FPI_IMAGE_DEVICE_FUSION_NONE)
+        fpi_print_fuse (enroll_print, priv->enroll_stage, priv->bz3_threshold,
+                        priv->enroll_fusion == FPI_IMAGE_DEVICE_FUSION_KEEP_STAGES);
+
       fpi_device_enroll_complete (device, g_object_ref (enroll_print), NULL);
     }
   else if (action == FPI_DEVICE_ACTION_VERIFY)
@@ -246,6 +293,8 @@ fpi_image_device_minutiae_detected (GObject *source_object, GAsyncResult *res, g
   /* Note: We rely on the device to not disappear during an operation. */
   priv = fp_image_device_get_instance_private (FP_IMAGE_DEVICE (device));
   priv->minutiae_scan_active = FALSE;
+  fpi_device_record_timing (device, FPI_DEVICE_TIMING_DETECTION,
+                            g_get_monotonic_time () - priv->detection_start);
 
   if (!fp_image_detect_minutiae_finish (image, res, &error))
     {
@@ -277,7 +326,7 @@ fpi_image_device_minutiae_detected (GObject *source_object, GAsyncResult *res, g
     {
       print = fp_print_new (device);
       fpi_print_set_type (print, FPI_PRINT_NBIS);
-      if (!fpi_print_add_from_image (print, image, &error))
+      if (!fpi_print_add_from_image_full (print, image, priv->max_minutiae, &error))
         {
           g_clear_object (&print);
 
@@ -294,6 +343,17 @@ fpi_image_device_minutiae_detected (GObject *source_object, GAsyncResult *res, g
   if (action == FPI_DEVICE_ACTION_ENROLL)
     {
       FpPrint *enroll_print;
+
+      /* The session may have failed while capturing the next stage, in
+       * that case we were only waiting for this scan to finish. */
+      if (priv->state == FPI_IMAGE_DEVICE_STATE_DEACTIVATING ||
+          priv->state == FPI_IMAGE_DEVICE_STATE_INACTIVE)
+        {
+          g_clear_error (&error);
+          fp_image_device_maybe_complete_action (self, NULL);
+          return;
+        }
+
       fpi_device_get_enroll_data (device, &enroll_print);
 
       if (print)
@@ -313,6 +373,12 @@ fpi_image_device_minutiae_detected (GObject *source_object, GAsyncResult *res, g
         }
       else
         {
+          /* The reference is passed on to the scan. */
+          FpImage *next_image = g_queue_pop_head (&priv->pending_images);
+
+          if (next_image)
+            fp_image_device_start_minutiae_scan (self, next_image);
+
           fp_image_device_enroll_maybe_await_finger_on (FP_IMAGE_DEVICE (device));
         }
     }
@@ -320,12 +386,17 @@ fpi_image_device_minutiae_detected (GObject *source_object, GAsyncResult *res, g
     {
       FpPrint *template;
       FpiMatchResult result;
+      gint64 match_start = g_get_monotonic_time ();
 
       fpi_device_get_verify_data (device, &template);
       if (print)
-        result = fpi_print_bz3_match (template, print, priv->bz3_threshold, &error);
+        result = fpi_print_bz3_match (template, print,
+                                      priv->bz3_threshold, priv->bz3_min_quality,
+                                      &error);
       else
         result = FPI_MATCH_ERROR;
+      fpi_device_record_timing (device, FPI_DEVICE_TIMING_MATCH,
+                                g_get_monotonic_time () - match_start);
 
       if (!error || error->domain == FP_DEVICE_RETRY)
         fpi_device_verify_report (device, result, g_steal_pointer (&print), g_steal_pointer (&error));
@@ -337,18 +408,23 @@ fpi_image_device_minutiae_detected (GObject *source_object, GAsyncResult *res, g
       gint i;
       GPtrArray *templates;
       FpPrint *result = NULL;
+      gint64 match_start = g_get_monotonic_time ();
 
       fpi_device_get_identify_data (device, &templates);
       for (i = 0; !error && i < templates->len; i++)
         {
           FpPrint *template = g_ptr_array_index (templates, i);
 
-          if (fpi_print_bz3_match (template, print, priv->bz3_threshold, &error) == FPI_MATCH_SUCCESS)
+          if (fpi_print_bz3_match (template, print,
+                                   priv->bz3_threshold, priv->bz3_min_quality,
+                                   &error) == FPI_MATCH_SUCCESS)
             {
               result = template;
               break;
             }
         }
+      fpi_device_record_timing (device, FPI_DEVICE_TIMING_MATCH,
+                                g_get_monotonic_time () - match_start);
 
       if (!error || error->domain == FP_DEVICE_RETRY)
         fpi_device_identify_report (device, result, g_steal_pointer (&print), g_steal_pointer (&error));
@@ -357,12 +433,7 @@ fpi_image_device_minutiae_detected (GObject *source_object, GAsyncResult *res, g
     }
   else
     {
-      /* XXX: This can be hit currently due to a race condition in the enroll code!
-       *      In that case we scan a further image even though the minutiae for the previous
-       *      one have not yet been detected.
-       *      We need to keep track on the pending minutiae detection and the fact that
-       *      it will finish eventually (or we may need to retry on error and activate the
-       *      device again). */
+      /* The action cannot complete while a minutiae scan is pending. */
       g_assert_not_reached ();
     }
 }
@@ -392,6 +463,29 @@ fpi_image_device_set_bz3_threshold (FpImageDevice *self,
   priv->bz3_threshold = bz3_threshold;
 }
 
+/**
+ * fpi_image_device_set_max_minutiae:
+ * @self: a #FpImageDevice imaging fingerprint device
+ * @max_minutiae: Maximum number of minutiae to store per print
+ *
+ * Dynamically adjust the number of minutiae that are stored for each
+ * print. See #FpImageDeviceClass for details. Like
+ * fpi_image_device_set_bz3_threshold() it should generally be called
+ * from the probe callback.
+ */
+void
+fpi_image_device_set_max_minutiae (FpImageDevice *self,
+                                   gint           max_minutiae)
+{
+  FpImageDevicePrivate *priv = fp_image_device_get_instance_private (self);
+
+  g_return_if_fail (FP_IS_IMAGE_DEVICE (self));
+  g_return_if_fail (max_minutiae >= MIN_COMPUTABLE_BOZORTH_MINUTIAE &&
+                    max_minutiae <= MAX_BOZORTH_MINUTIAE);
+
+  priv->max_minutiae = max_minutiae;
+}
+
 /**
  * fpi_image_device_report_finger_status:
  * @self: a #FpImageDevice imaging fingerprint device
@@ -492,14 +586,21 @@ fpi_image_device_image_captured (FpImageDevice *self, FpImage *image)
 
   g_debug ("Image device captured an image");
 
-  priv->minutiae_scan_active = TRUE;
+  fpi_device_record_timing (FP_DEVICE (self), FPI_DEVICE_TIMING_CAPTURE,
+                            g_get_monotonic_time () - priv->capture_start);
 
-  /* XXX: We also detect minutiae in capture mode, we solely do this
-   *      to normalize the image which will happen as a by-product. */
-  fp_image_detect_minutiae (image,
-                            fpi_device_get_cancellable (FP_DEVICE (self)),
-                            fpi_image_device_minutiae_detected,
-                            self);
+  /* During enroll the next image may arrive before the previous one was
+   * processed. Queue it, so that the stages are reported in order and
+   * only one detection thread is busy at a time. */
+  if (priv->minutiae_scan_active)
+    {
+      g_debug ("Queueing image until the pending minutiae scan has finished");
+      g_queue_push_tail (&priv->pending_images, image);
+    }
+  else
+    {
+      fp_image_device_start_minutiae_scan (self, image);
+    }
 
   /* XXX: This is wrong if we add support for raw capture mode. */
   fp_image_device_change_state (self, FPI_IMAGE_DEVICE_STATE_AWAIT_FINGER_OFF);
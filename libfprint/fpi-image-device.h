@@ -70,9 +70,42 @@ typedef enum {
   FPI_IMAGE_DEVICE_STATE_AWAIT_FINGER_OFF,
 } FpiImageDeviceState;
 
+/**
+ * FpiImageDeviceFusion:
+ * @FPI_IMAGE_DEVICE_FUSION_DEFAULT: Use the default, currently
+ *   #FPI_IMAGE_DEVICE_FUSION_NONE
+ * @FPI_IMAGE_DEVICE_FUSION_NONE: Store every enroll stage as a separate print
+ * @FPI_IMAGE_DEVICE_FUSION_KEEP_STAGES: Store a print fused from all enroll
+ *   stages, followed by the stage prints as fallback
+ * @FPI_IMAGE_DEVICE_FUSION_ONLY: Only store the fused print, enroll stages
+ *   that could not be merged are still kept
+ *
+ * How the prints captured during the enroll stages are stored in the
+ * template, see fpi_print_fuse().
+ *
+ * A fused print has more minutiae than a single capture, and bozorth3
+ * scores are not normalized for the template size. Drivers should only
+ * enable fusion after checking the false accept rate with their threshold.
+ * No driver has been evaluated this way yet, so none enables it.
+ */
+typedef enum {
+  FPI_IMAGE_DEVICE_FUSION_DEFAULT = 0,
+  FPI_IMAGE_DEVICE_FUSION_NONE,
+  FPI_IMAGE_DEVICE_FUSION_KEEP_STAGES,
+  FPI_IMAGE_DEVICE_FUSION_ONLY,
+} FpiImageDeviceFusion;
+
 /**
  * FpImageDeviceClass:
  * @bz3_threshold: Threshold to consider bozorth3 score a match, default: 40
+ * @bz3_min_quality: Minimum quality (0-100) of both minutiae for an edge to
+ *   be used during matching. Skipping edges between unreliable minutiae
+ *   speeds up matching, default: 0 (use all edges)
+ * @max_minutiae: Maximum number of minutiae to store per print, the most
+ *   reliable ones are kept. Small sensors may want to use 40 to 80 to speed
+ *   up matching, default: 200
+ * @enroll_fusion: How to merge the enroll stages into the template,
+ *   default: #FPI_IMAGE_DEVICE_FUSION_NONE
  * @img_width: Width of the image, only provide if constant
  * @img_height: Height of the image, only provide if constant
  * @img_open: Open the device and do basic initialization
@@ -105,6 +138,9 @@ struct _FpImageDeviceClass
   FpDeviceClass parent_class;
 
   gint          bz3_threshold;
+  gint          bz3_min_quality;
+  gint          max_minutiae;
+  FpiImageDeviceFusion enroll_fusion;
   gint          img_width;
   gint          img_height;
 
@@ -118,6 +154,8 @@ struct _FpImageDeviceClass
 
 void fpi_image_device_set_bz3_threshold (FpImageDevice *self,
                                          gint           bz3_threshold);
+void fpi_image_device_set_max_minutiae (FpImageDevice *self,
+                                        gint           max_minutiae);
 
 void fpi_image_device_session_error (FpImageDevice *self,
                                      GError        *error);
@@ -24,10 +24,7 @@
 #include "fpi-log.h"
 
 #include <nbis.h>
-
-#if HAVE_PIXMAN
-#include <pixman.h>
-#endif
+#include <string.h>
 
 /**
  * SECTION: fpi-image
@@ -107,43 +104,353 @@ fpi_mean_sq_diff_norm (const guint8 *buf1,
   return res / size;
 }
 
-#if HAVE_PIXMAN
+/* Block size for the line helpers below, matches a 128 bit vector register.
+ * The fixed size inner loops get vectorized even with the cheap
+ * vectorizations enabled at -O2. */
+#define LINE_BLOCK 16
+
+/**
+ * fpi_sum_abs_diff:
+ * @buf1: buffer (usually bitmap, one byte per pixel)
+ * @buf2: buffer (usually bitmap, one byte per pixel)
+ * @size: buffer size of smallest buffer
+ *
+ * This function calculates the sum of absolute differences of two
+ * buffers, usually two lines, as per the following formula:
+ * |[<!-- -->
+ *    sad = sum (abs (buf1[0..size] - buf2[0..size]))
+ * ]|
+ *
+ * Unlike fpi_mean_sq_diff_norm(), this is cheap enough to be done for
+ * every line a sensor returns.
+ *
+ * Returns: the sum of absolute differences between @buf1 and @buf2
+ */
+guint
+fpi_sum_abs_diff (const guint8 *buf1,
+                  const guint8 *buf2,
+                  gsize         size)
+{
+  guint res = 0;
+  gsize i = 0;
+
+  /* Becomes a single psadbw (or similar) instruction per block */
+  for (; i + LINE_BLOCK <= size; i += LINE_BLOCK)
+    {
+      guint block = 0;
+      gint j;
+
+      for (j = 0; j < LINE_BLOCK; j++)
+        block += ABS ((gint) buf1[i + j] - (gint) buf2[i + j]);
+
+      res += block;
+    }
+
+  for (; i < size; i++)
+    res += ABS ((gint) buf1[i] - (gint) buf2[i]);
+
+  return res;
+}
+
+/**
+ * fpi_get_line_stats:
+ * @line: line (usually bitmap, one byte per pixel)
+ * @prev: (nullable): the previous line, or %NULL
+ * @size: number of pixels in @line and @prev
+ * @stats: (out caller-allocates): the statistics of @line
+ *
+ * Calculates the statistics that swipe sensor drivers usually need for
+ * every line in a single pass. The results are identical to calling
+ * fpi_std_sq_dev() on @line and fpi_mean_sq_diff_norm() on @prev and
+ * @line, the latter is 0 if @prev is %NULL.
+ */
+void
+fpi_get_line_stats (const guint8 *line,
+                    const guint8 *prev,
+                    gint          size,
+                    FpiLineStats *stats)
+{
+  guint64 sum = 0, sq_sum = 0, sq_diff = 0;
+  guint64 mean;
+  gint i = 0;
+
+  if (!prev)
+    prev = line;
+
+  for (; i + LINE_BLOCK <= size; i += LINE_BLOCK)
+    {
+      guint32 block_sum = 0, block_sq_sum = 0, block_sq_diff = 0;
+      gint j;
+
+      for (j = 0; j < LINE_BLOCK; j++)
+        {
+          guint32 px = line[i + j];
+          gint diff = (gint) line[i + j] - (gint) prev[i + j];
+
+          block_sum += px;
+          block_sq_sum += px * px;
+          block_sq_diff += diff * diff;
+        }
+
+      sum += block_sum;
+      sq_sum += block_sq_sum;
+      sq_diff += block_sq_diff;
+    }
+
+  for (; i < size; i++)
+    {
+      guint32 px = line[i];
+      gint diff = (gint) line[i] - (gint) prev[i];
+
+      sum += px;
+      sq_sum += px * px;
+      sq_diff += diff * diff;
+    }
+
+  /* Same rounding as fpi_std_sq_dev(), the mean is truncated first and
+   * sum ((px - mean) ^ 2) is expanded so that no second pass is needed. */
+  mean = sum / size;
+  stats->mean = mean;
+  stats->sq_dev = (sq_sum - 2 * mean * sum + size * mean * mean) / size;
+  stats->sq_diff = sq_diff / size;
+}
+
+#define NIBBLES_8 G_GUINT64_CONSTANT (0x0f0f0f0f0f0f0f0f)
+#define NIBBLES_16 G_GUINT64_CONSTANT (0x000f000f000f000f)
+
+/* Every byte of @nibbles holds a 4 bit value, so no carries can occur */
+static inline guint64
+unpack_4bpp_scale (guint64            nibbles,
+                   FpiUnpack4bppFlags flags)
+{
+  if (flags & FPI_UNPACK_4BPP_SHIFT)
+    return nibbles << 4;
+
+  return nibbles | nibbles << 4;
+}
+
+static inline guint64
+unpack_4bpp_word (guint32            packed,
+                  FpiUnpack4bppFlags flags)
+{
+  guint64 x = packed;
+  guint64 nibbles;
+
+  /* Move each byte into the low half of its own 16 bit lane */
+  x = (x | x << 16) & G_GUINT64_CONSTANT (0x0000ffff0000ffff);
+  x = (x | x << 8) & G_GUINT64_CONSTANT (0x00ff00ff00ff00ff);
+
+  if (flags & FPI_UNPACK_4BPP_HIGH_NIBBLE_FIRST)
+    nibbles = ((x >> 4) & NIBBLES_16) | (x & NIBBLES_16) << 8;
+  else
+    nibbles = (x & NIBBLES_16) | (x & NIBBLES_16 << 4) << 4;
+
+  return unpack_4bpp_scale (nibbles, flags);
+}
+
+/**
+ * fpi_unpack_4bpp:
+ * @input: 4 bit per pixel data
+ * @input_size: size of @input in bytes
+ * @output: (out caller-allocates): buffer of `2 * input_size` bytes
+ * @flags: #FpiUnpack4bppFlags describing the packing
+ *
+ * Expands a 4 bit per pixel image into one byte per pixel, keeping the
+ * pixel order. Four input bytes are expanded at a time within a 64 bit
+ * word.
+ */
+void
+fpi_unpack_4bpp (const guint8      *input,
+                 gsize              input_size,
+                 guint8            *output,
+                 FpiUnpack4bppFlags flags)
+{
+  gsize i = 0;
+
+  for (; i + 4 <= input_size; i += 4)
+    {
+      guint32 packed;
+      guint64 px;
+
+      memcpy (&packed, input + i, sizeof (packed));
+      px = GUINT64_TO_LE (unpack_4bpp_word (GUINT32_FROM_LE (packed), flags));
+      memcpy (output + 2 * i, &px, sizeof (px));
+    }
+
+  for (; i < input_size; i++)
+    {
+      guint first = input[i] & 0x0f;
+      guint second = input[i] >> 4;
+
+      if (flags & FPI_UNPACK_4BPP_HIGH_NIBBLE_FIRST)
+        {
+          second = first;
+          first = input[i] >> 4;
+        }
+
+      output[2 * i] = unpack_4bpp_scale (first, flags);
+      output[2 * i + 1] = unpack_4bpp_scale (second, flags);
+    }
+}
+
+/**
+ * fpi_unpack_4bpp_transposed:
+ * @input: 4 bit per pixel data, stored column by column
+ * @width: number of columns
+ * @height: number of rows, must be even
+ * @output: (out caller-allocates): buffer of `width * height` bytes
+ * @flags: #FpiUnpack4bppFlags describing the packing
+ *
+ * Expands a 4 bit per pixel image which the sensor sends column by column
+ * (`height / 2` bytes per column, each byte holding two vertically adjacent
+ * pixels) into a row major image with one byte per pixel.
+ *
+ * Eight columns are handled at a time, so that both rows of a byte can be
+ * written with a single 64 bit store each.
+ */
+void
+fpi_unpack_4bpp_transposed (const guint8      *input,
+                            guint              width,
+                            guint              height,
+                            guint8            *output,
+                            FpiUnpack4bppFlags flags)
+{
+  guint col_bytes = height / 2;
+  guint x = 0, k, c;
+
+  g_return_if_fail (height % 2 == 0);
+
+  for (; x + 8 <= width; x += 8)
+    {
+      for (k = 0; k < col_bytes; k++)
+        {
+          guint64 packed = 0;
+          guint64 first, second;
+
+          for (c = 0; c < 8; c++)
+            packed |= (guint64) input[(x + c) * col_bytes + k] << (8 * c);
+
+          first = packed & NIBBLES_8;
+          second = (packed >> 4) & NIBBLES_8;
+          if (flags & FPI_UNPACK_4BPP_HIGH_NIBBLE_FIRST)
+            {
+              guint64 tmp = first;
+
+              first = second;
+              second = tmp;
+            }
+
+          first = GUINT64_TO_LE (unpack_4bpp_scale (first, flags));
+          second = GUINT64_TO_LE (unpack_4bpp_scale (second, flags));
+          memcpy (output + 2 * k * width + x, &first, sizeof (first));
+          memcpy (output + (2 * k + 1) * width + x, &second, sizeof (second));
+        }
+    }
+
+  for (; x < width; x++)
+    {
+      for (k = 0; k < col_bytes; k++)
+        {
+          guint8 b = input[x * col_bytes + k];
+          guint first = b & 0x0f;
+          guint second = b >> 4;
+
+          if (flags & FPI_UNPACK_4BPP_HIGH_NIBBLE_FIRST)
+            {
+              second = first;
+              first = b >> 4;
+            }
+
+          output[2 * k * width + x] = unpack_4bpp_scale (first, flags);
+          output[(2 * k + 1) * width + x] = unpack_4bpp_scale (second, flags);
+        }
+    }
+}
+
+/* Bilinear interpolation uses 7 bit weights, scaled up to 8 bit */
+#define RESIZE_WEIGHT_BITS 7
+
+static void
+resize_coord (guint  factor,
+              guint  i,
+              gint  *idx,
+              guint *weight)
+{
+  /* The source position (in 16.16 fixed point) of the center of output
+   * pixel i, moved back by half a pixel to get the top/left sample. */
+  gint64 step = (G_GINT64_CONSTANT (1) << 32) / (factor << 16);
+  gint64 pos = ((step * 0x8000 + 0x8000) >> 16) - 0x8000 + step * i;
+
+  *idx = pos >> 16;
+  *weight = ((pos >> (16 - RESIZE_WEIGHT_BITS)) & ((1 << RESIZE_WEIGHT_BITS) - 1)) << (8 - RESIZE_WEIGHT_BITS);
+}
+
+static inline guint
+resize_get_pixel (FpImage *img,
+                  gint     x,
+                  gint     y)
+{
+  /* Everything outside of the image is black */
+  if (x < 0 || y < 0 || x >= (gint) img->width || y >= (gint) img->height)
+    return 0;
+
+  return img->data[x + y * img->width];
+}
+
+/**
+ * fpi_image_resize:
+ * @orig: The image to enlarge
+ * @w_factor: The horizontal scaling factor
+ * @h_factor: The vertical scaling factor
+ *
+ * Enlarges @orig by integer factors using bilinear interpolation. The
+ * result is identical to what pixman produces for the same operation,
+ * which was used for this before.
+ *
+ * Returns: (transfer full): A new #FpImage
+ */
 FpImage *
-fpi_image_resize (FpImage *orig_img,
+fpi_image_resize (FpImage *orig,
                   guint    w_factor,
                   guint    h_factor)
 {
-  int new_width = orig_img->width * w_factor;
-  int new_height = orig_img->height * h_factor;
-  pixman_image_t *orig, *resized;
-  pixman_transform_t transform;
+  guint new_width = orig->width * w_factor;
+  guint new_height = orig->height * h_factor;
+  g_autofree gint *x_idx = g_new (gint, new_width);
+  g_autofree guint *x_weight = g_new (guint, new_width);
   FpImage *newimg;
+  guint x, y;
 
-  orig = pixman_image_create_bits (PIXMAN_a8, orig_img->width, orig_img->height, (uint32_t *) orig_img->data, orig_img->width);
-  resized = pixman_image_create_bits (PIXMAN_a8, new_width, new_height, NULL, new_width);
-
-  pixman_transform_init_identity (&transform);
-  pixman_transform_scale (NULL, &transform, pixman_int_to_fixed (w_factor), pixman_int_to_fixed (h_factor));
-  pixman_image_set_transform (orig, &transform);
-  pixman_image_set_filter (orig, PIXMAN_FILTER_BILINEAR, NULL, 0);
-  pixman_image_composite32 (PIXMAN_OP_SRC,
-                            orig, /* src */
-                            NULL, /* mask */
-                            resized, /* dst */
-                            0, 0, /* src x y */
-                            0, 0, /* mask x y */
-                            0, 0, /* dst x y */
-                            new_width, new_height /* width height */
-                           );
+  g_return_val_if_fail (w_factor > 0 && h_factor > 0, NULL);
+
+  for (x = 0; x < new_width; x++)
+    resize_coord (w_factor, x, &x_idx[x], &x_weight[x]);
 
   newimg = fp_image_new (new_width, new_height);
-  newimg->flags = orig_img->flags;
+  newimg->flags = orig->flags;
+
+  for (y = 0; y < new_height; y++)
+    {
+      guint8 *out = newimg->data + y * new_width;
+      guint wy;
+      gint sy;
 
-  memcpy (newimg->data, pixman_image_get_data (resized), new_width * new_height);
+      resize_coord (h_factor, y, &sy, &wy);
 
-  pixman_image_unref (orig);
-  pixman_image_unref (resized);
+      for (x = 0; x < new_width; x++)
+        {
+          gint sx = x_idx[x];
+          guint wx = x_weight[x];
+          guint32 v;
+
+          v = resize_get_pixel (orig, sx, sy) * (256 - wx) * (256 - wy) +
+              resize_get_pixel (orig, sx + 1, sy) * wx * (256 - wy) +
+              resize_get_pixel (orig, sx, sy + 1) * (256 - wx) * wy +
+              resize_get_pixel (orig, sx + 1, sy + 1) * wx * wy;
+
+          out[x] = v >> 16;
+        }
+    }
 
   return newimg;
 }
-#endif
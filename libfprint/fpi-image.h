@@ -40,6 +40,22 @@ typedef enum {
   FPI_IMAGE_PARTIAL         = 1 << 3,
 } FpiImageFlags;
 
+/**
+ * FpiUnpack4bppFlags:
+ * @FPI_UNPACK_4BPP_NONE: the low nibble holds the first pixel, values are
+ *   scaled to the full 8 bit range
+ * @FPI_UNPACK_4BPP_HIGH_NIBBLE_FIRST: the high nibble holds the first pixel
+ * @FPI_UNPACK_4BPP_SHIFT: values are shifted up by 4 bits rather than scaled,
+ *   i.e. white is 0xf0 instead of 0xff
+ *
+ * Flags describing the layout of 4 bit per pixel data, see fpi_unpack_4bpp().
+ */
+typedef enum {
+  FPI_UNPACK_4BPP_NONE              = 0,
+  FPI_UNPACK_4BPP_HIGH_NIBBLE_FIRST = 1 << 0,
+  FPI_UNPACK_4BPP_SHIFT             = 1 << 1,
+} FpiUnpack4bppFlags;
+
 /**
  * FpImage:
  * @width: Width of the image
@@ -71,14 +87,44 @@ struct _FpImage
   guint      ref_count;
 };
 
+/**
+ * FpiLineStats:
+ * @mean: the mean pixel value
+ * @sq_dev: the squared standard deviation, see fpi_std_sq_dev()
+ * @sq_diff: the normalized mean squared difference to the previous line,
+ *   see fpi_mean_sq_diff_norm()
+ *
+ * Per line statistics as returned by fpi_get_line_stats().
+ */
+typedef struct
+{
+  gint mean;
+  gint sq_dev;
+  gint sq_diff;
+} FpiLineStats;
+
 gint fpi_std_sq_dev (const guint8 *buf,
                      gint          size);
 gint fpi_mean_sq_diff_norm (const guint8 *buf1,
                             const guint8 *buf2,
                             gint          size);
+guint fpi_sum_abs_diff (const guint8 *buf1,
+                        const guint8 *buf2,
+                        gsize         size);
+void fpi_get_line_stats (const guint8 *line,
+                         const guint8 *prev,
+                         gint          size,
+                         FpiLineStats *stats);
+void fpi_unpack_4bpp (const guint8      *input,
+                      gsize              input_size,
+                      guint8            *output,
+                      FpiUnpack4bppFlags flags);
+void fpi_unpack_4bpp_transposed (const guint8      *input,
+                                 guint              width,
+                                 guint              height,
+                                 guint8            *output,
+                                 FpiUnpack4bppFlags flags);
 
-#if HAVE_PIXMAN
 FpImage *fpi_image_resize (FpImage *orig,
                            guint    w_factor,
                            guint    h_factor);
-#endif
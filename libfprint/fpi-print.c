@@ -25,6 +25,8 @@
 #include "fpi-device.h"
 #include "fpi-compat.h"
 
+#include <math.h>
+
 /**
  * SECTION: fpi-print
  * @title: Internal FpPrint
@@ -97,21 +99,34 @@ fpi_print_set_device_stored (FpPrint *print,
   g_object_notify (G_OBJECT (print), "device-stored");
 }
 
-/* XXX: This is the old version, but wouldn't it be smarter to instead
- * use the highest quality mintutiae? Possibly just using bz_prune from
- * upstream? */
+static int
+minutiae_sort_quality_decreasing (const void *a, const void *b)
+{
+  const struct minutiae_struct *af = a;
+  const struct minutiae_struct *bf = b;
+
+  if (af->col[3] != bf->col[3])
+    return bf->col[3] - af->col[3];
+
+  /* Keep the selection stable for minutiae of equal quality */
+  return sort_x_y (a, b);
+}
+
+/* Equivalent of bz_prune from upstream NBIS, only the max_minutiae most
+ * reliable minutiae are kept. */
 static void
 minutiae_to_xyt (struct fp_minutiae *minutiae,
                  int                 bwidth,
                  int                 bheight,
+                 int                 max_minutiae,
                  struct xyt_struct  *xyt)
 {
   int i;
   struct fp_minutia *minutia;
-  struct minutiae_struct c[MAX_FILE_MINUTIAE];
+  g_autofree struct minutiae_struct *c = NULL;
+  int nmin = minutiae->num;
 
-  /* struct xyt_struct uses arrays of MAX_BOZORTH_MINUTIAE (200) */
-  int nmin = min (minutiae->num, MAX_BOZORTH_MINUTIAE);
+  c = g_new (struct minutiae_struct, nmin);
 
   for (i = 0; i < nmin; i++)
     {
@@ -125,7 +140,15 @@ minutiae_to_xyt (struct fp_minutiae *minutiae,
         c[i].col[2] -= 360;
     }
 
-  qsort ((void *) &c, (size_t) nmin, sizeof (struct minutiae_struct),
+  /* struct xyt_struct uses arrays of MAX_BOZORTH_MINUTIAE (200) */
+  if (nmin > max_minutiae)
+    {
+      qsort ((void *) c, (size_t) nmin, sizeof (struct minutiae_struct),
+             minutiae_sort_quality_decreasing);
+      nmin = max_minutiae;
+    }
+
+  qsort ((void *) c, (size_t) nmin, sizeof (struct minutiae_struct),
          sort_x_y);
 
   for (i = 0; i < nmin; i++)
@@ -133,6 +156,7 @@ minutiae_to_xyt (struct fp_minutiae *minutiae,
       xyt->xcol[i]     = c[i].col[0];
       xyt->ycol[i]     = c[i].col[1];
       xyt->thetacol[i] = c[i].col[2];
+      xyt->qualitycol[i] = c[i].col[3];
     }
   xyt->nrows = nmin;
 }
@@ -149,17 +173,49 @@ minutiae_to_xyt (struct fp_minutiae *minutiae,
  * The @image will be kept so that API users can get retrieve it e.g.
  * for debugging purposes.
  *
+ * See fpi_print_add_from_image_full().
+ *
  * Returns: %TRUE on success
  */
 gboolean
 fpi_print_add_from_image (FpPrint *print,
                           FpImage *image,
                           GError **error)
+{
+  return fpi_print_add_from_image_full (print, image, MAX_BOZORTH_MINUTIAE, error);
+}
+
+/**
+ * fpi_print_add_from_image_full:
+ * @print: A #FpPrint
+ * @image: A #FpImage
+ * @max_minutiae: The maximum number of minutiae to store
+ * @error: Return location for error
+ *
+ * Extracts the minutiae from the given image and adds it to @print of
+ * type #FPI_PRINT_NBIS. If more than @max_minutiae minutiae were detected,
+ * then only the most reliable ones are stored. As the cost of matching
+ * grows quadratically with the number of minutiae, drivers for small
+ * sensors may want to use a lower limit.
+ *
+ * The @image will be kept so that API users can get retrieve it e.g.
+ * for debugging purposes.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+fpi_print_add_from_image_full (FpPrint *print,
+                               FpImage *image,
+                               gint     max_minutiae,
+                               GError **error)
 {
   GPtrArray *minutiae;
   struct fp_minutiae _minutiae;
   struct xyt_struct *xyt;
 
+  g_return_val_if_fail (max_minutiae >= MIN_COMPUTABLE_BOZORTH_MINUTIAE &&
+                        max_minutiae <= MAX_BOZORTH_MINUTIAE, FALSE);
+
   if (print->type != FPI_PRINT_NBIS || !image)
     {
       g_set_error (error,
@@ -184,7 +240,7 @@ fpi_print_add_from_image (FpPrint *print,
   _minutiae.alloc = minutiae->len;
 
   xyt = g_new0 (struct xyt_struct, 1);
-  minutiae_to_xyt (&_minutiae, image->width, image->height, xyt);
+  minutiae_to_xyt (&_minutiae, image->width, image->height, max_minutiae, xyt);
   g_ptr_array_add (print->prints, xyt);
 
   g_clear_object (&print->image);
@@ -194,11 +250,218 @@ fpi_print_add_from_image (FpPrint *print,
   return TRUE;
 }
 
+/* The bozorth3 matcher keeps all of its working state in global arrays,
+ * so only one match may be running at any given time. */
+static GMutex bz3_lock;
+
+/* Cache of prepared gallery edge tables. Entries are keyed by the minutiae
+ * they were built from, so that verifying repeatedly against the same
+ * template (even if it was deserialized again) skips bz_comp(). All of the
+ * cache state is protected by the bz3_lock. */
+#define BZ3_CACHE_DEFAULT_SIZE (4 * 1024 * 1024)
+
+typedef struct
+{
+  GBytes *key;
+  GList   link;
+  gsize   size;
+  gint    len;
+  gint   *cols;
+} Bz3CacheEntry;
+
+static GHashTable *bz3_cache;
+static GQueue bz3_cache_lru = G_QUEUE_INIT;
+static gsize bz3_cache_size;
+static gsize bz3_cache_max_size = BZ3_CACHE_DEFAULT_SIZE;
+
+static void
+bz3_cache_entry_free (Bz3CacheEntry *entry)
+{
+  g_bytes_unref (entry->key);
+  g_free (entry->cols);
+  g_free (entry);
+}
+
+static void
+bz3_cache_trim (gsize max_size)
+{
+  while (bz3_cache_size > max_size)
+    {
+      Bz3CacheEntry *entry = g_queue_peek_tail (&bz3_cache_lru);
+
+      g_queue_unlink (&bz3_cache_lru, &entry->link);
+      bz3_cache_size -= entry->size;
+      g_hash_table_remove (bz3_cache, entry->key);
+    }
+}
+
+static GBytes *
+bz3_cache_key (struct xyt_struct *xyt, gint min_quality)
+{
+  gsize len = 2 + 4 * xyt->nrows;
+  gint *key = g_new (gint, len);
+
+  key[0] = xyt->nrows;
+  key[1] = min_quality;
+  memcpy (&key[2], xyt->xcol, xyt->nrows * sizeof (gint));
+  memcpy (&key[2 + xyt->nrows], xyt->ycol, xyt->nrows * sizeof (gint));
+  memcpy (&key[2 + 2 * xyt->nrows], xyt->thetacol, xyt->nrows * sizeof (gint));
+  memcpy (&key[2 + 3 * xyt->nrows], xyt->qualitycol, xyt->nrows * sizeof (gint));
+
+  return g_bytes_new_take (key, len * sizeof (gint));
+}
+
+/* Equivalent of bozorth_gallery_init(), restoring the edge table from the
+ * cache if possible. Only the rows referenced by fcolpt are stored, in
+ * sorted order, which is all that bz_match() looks at. */
+static gint
+bz3_gallery_init (struct xyt_struct *gstruct, gint min_quality)
+{
+  g_autoptr(GBytes) key = NULL;
+  Bz3CacheEntry *entry;
+  gint len, i;
+
+  if (bz3_cache_max_size == 0)
+    return bozorth_gallery_init (gstruct, min_quality);
+
+  if (!bz3_cache)
+    bz3_cache = g_hash_table_new_full (g_bytes_hash, g_bytes_equal, NULL,
+                                       (GDestroyNotify) bz3_cache_entry_free);
+
+  key = bz3_cache_key (gstruct, min_quality);
+  entry = g_hash_table_lookup (bz3_cache, key);
+  if (entry)
+    {
+      for (i = 0; i < entry->len; i++)
+        {
+          memcpy (fcols[i], &entry->cols[i * COLS_SIZE_2], sizeof (fcols[i]));
+          fcolpt[i] = fcols[i];
+        }
+
+      g_queue_unlink (&bz3_cache_lru, &entry->link);
+      g_queue_push_head_link (&bz3_cache_lru, &entry->link);
+
+      return entry->len;
+    }
+
+  len = bozorth_gallery_init (gstruct, min_quality);
+
+  entry = g_new0 (Bz3CacheEntry, 1);
+  entry->len = len;
+  entry->size = sizeof (Bz3CacheEntry) + g_bytes_get_size (key) + len * sizeof (fcols[0]);
+  if (entry->size > bz3_cache_max_size)
+    {
+      g_free (entry);
+      return len;
+    }
+
+  entry->cols = g_new (gint, len * COLS_SIZE_2);
+  for (i = 0; i < len; i++)
+    memcpy (&entry->cols[i * COLS_SIZE_2], fcolpt[i], sizeof (fcols[0]));
+
+  entry->key = g_steal_pointer (&key);
+  entry->link.data = entry;
+  g_hash_table_insert (bz3_cache, entry->key, entry);
+  g_queue_push_head_link (&bz3_cache_lru, &entry->link);
+  bz3_cache_size += entry->size;
+
+  bz3_cache_trim (bz3_cache_max_size);
+
+  return len;
+}
+
+/**
+ * fpi_print_set_bz3_cache_size:
+ * @max_size: The maximum size of the cache in bytes, or 0 to disable it
+ *
+ * Sets the memory budget for caching the prepared match state of NBIS
+ * templates. The least recently used entries are dropped when the budget
+ * is exceeded. The default is 4 MiB. This is exposed to API users as
+ * fp_print_set_match_cache_size().
+ */
+void
+fpi_print_set_bz3_cache_size (gsize max_size)
+{
+  g_mutex_lock (&bz3_lock);
+  bz3_cache_max_size = max_size;
+  if (bz3_cache)
+    bz3_cache_trim (max_size);
+  g_mutex_unlock (&bz3_lock);
+}
+
+/**
+ * fpi_print_bz3_score:
+ * @template: A #FpPrint containing one or more prints
+ * @print: A #FpPrint containing one or more prints
+ * @min_quality: Minimum quality (0-100) of minutiae to consider
+ * @stop_score: Score at which to stop matching early, or 0 to never stop
+ *
+ * Runs the BZ3 matcher for every print in @print against every print in
+ * @template and returns the highest score. If @stop_score is larger than
+ * zero, then matching stops as soon as a score of at least @stop_score
+ * has been found.
+ *
+ * Edges between minutiae are only considered if both minutiae have a
+ * quality of at least @min_quality. Pass 0 to consider all minutiae.
+ *
+ * The prepared state of the @template prints is cached, see
+ * fpi_print_set_bz3_cache_size().
+ *
+ * Both @template and @print need to be of type #FPI_PRINT_NBIS. This
+ * function is thread safe.
+ *
+ * Returns: The highest BZ3 score that was found
+ */
+gint
+fpi_print_bz3_score (FpPrint *template,
+                     FpPrint *print,
+                     gint     min_quality,
+                     gint     stop_score)
+{
+  gint best_score = 0;
+  gint i, j;
+
+  g_return_val_if_fail (template->type == FPI_PRINT_NBIS, 0);
+  g_return_val_if_fail (print->type == FPI_PRINT_NBIS, 0);
+
+  g_mutex_lock (&bz3_lock);
+
+  for (i = 0; i < print->prints->len; i++)
+    {
+      struct xyt_struct *pstruct;
+      gint probe_len;
+
+      pstruct = g_ptr_array_index (print->prints, i);
+      probe_len = bozorth_probe_init (pstruct, min_quality);
+
+      for (j = 0; j < template->prints->len; j++)
+        {
+          struct xyt_struct *gstruct;
+          gint np, score;
+
+          gstruct = g_ptr_array_index (template->prints, j);
+          np = bz_match (probe_len, bz3_gallery_init (gstruct, min_quality));
+          score = bz_match_score (np, pstruct, gstruct);
+          fp_dbg ("score %d/%d", score, stop_score);
+
+          best_score = MAX (best_score, score);
+          if (stop_score > 0 && best_score >= stop_score)
+            goto out;
+        }
+    }
+
+out:
+  g_mutex_unlock (&bz3_lock);
+
+  return best_score;
+}
+
 /**
  * fpi_print_bz3_match:
  * @template: A #FpPrint containing one or more prints
  * @print: A newly scanned #FpPrint to test
  * @bz3_threshold: The BZ3 match threshold
+ * @bz3_min_quality: Minimum minutia quality, see fpi_print_bz3_score()
  * @error: Return location for error
  *
  * Match the newly scanned @print (containing exactly one print) against the
@@ -210,12 +473,12 @@ fpi_print_add_from_image (FpPrint *print,
  * Returns: Whether the prints match, @error will be set if #FPI_MATCH_ERROR is returned
  */
 FpiMatchResult
-fpi_print_bz3_match (FpPrint *template, FpPrint *print, gint bz3_threshold, GError **error)
+fpi_print_bz3_match (FpPrint *template,
+                     FpPrint *print,
+                     gint     bz3_threshold,
+                     gint     bz3_min_quality,
+                     GError **error)
 {
-  struct xyt_struct *pstruct;
-  gint probe_len;
-  gint i;
-
   /* XXX: Use a different error type? */
   if (template->type != FPI_PRINT_NBIS || print->type != FPI_PRINT_NBIS)
     {
@@ -231,22 +494,446 @@ fpi_print_bz3_match (FpPrint *template, FpPrint *print, gint bz3_threshold, GErr
       return FPI_MATCH_ERROR;
     }
 
-  pstruct = g_ptr_array_index (print->prints, 0);
-  probe_len = bozorth_probe_init (pstruct);
+  if (fpi_print_bz3_score (template, print, bz3_min_quality, bz3_threshold) >= bz3_threshold)
+    return FPI_MATCH_SUCCESS;
+
+  return FPI_MATCH_FAIL;
+}
+
+/* Minutiae from different stages closer than this (in pixels and degrees)
+ * are considered to be the same minutia. */
+#define FUSE_MAX_DISTANCE 8
+#define FUSE_MAX_ANGLE 30
+/* Edge pairs are only used for alignment if their rotation is within this
+ * many degrees of the dominant rotation. */
+#define FUSE_ROTATION_TOLERANCE 10
+
+typedef struct
+{
+  gdouble cos_phi;
+  gdouble sin_phi;
+  gdouble tx;
+  gdouble ty;
+  gint    phi;
+} FuseTransform;
+
+typedef struct
+{
+  gdouble sum_x;
+  gdouble sum_y;
+  gdouble sum_dx;
+  gdouble sum_dy;
+  gint    quality;
+  guint   support;
+  guint   last_stage;
+} FuseCluster;
+
+static gint
+fuse_angle_diff (gint a, gint b)
+{
+  gint d = (a - b) % 360;
+
+  if (d < 0)
+    d += 360;
+  if (d > 180)
+    d = 360 - d;
+
+  return d;
+}
 
-  for (i = 0; i < template->prints->len; i++)
+static void
+fuse_transform_apply (const FuseTransform *t,
+                      gint x, gint y, gint theta,
+                      gdouble *ox, gdouble *oy, gint *otheta)
+{
+  *ox = t->cos_phi * x - t->sin_phi * y + t->tx;
+  *oy = t->sin_phi * x + t->cos_phi * y + t->ty;
+  *otheta = IANGLE180 (theta + t->phi);
+}
+
+/* Least squares rigid transform mapping the stage points onto the
+ * reference points of all pairs which are flagged in @use. */
+static gboolean
+fuse_estimate_transform (struct xyt_struct *ref,
+                         struct xyt_struct *stage,
+                         const gint        *pairs,
+                         const gboolean    *use,
+                         gint               n_pairs,
+                         FuseTransform     *t)
+{
+  gdouble rcx = 0, rcy = 0, scx = 0, scy = 0;
+  gdouble dot = 0, cross = 0, phi;
+  gint i, n = 0;
+
+  for (i = 0; i < n_pairs; i++)
     {
-      struct xyt_struct *gstruct;
-      gint score;
-      gstruct = g_ptr_array_index (template->prints, i);
-      score = bozorth_to_gallery (probe_len, pstruct, gstruct);
-      fp_dbg ("score %d/%d", score, bz3_threshold);
-
-      if (score >= bz3_threshold)
-        return FPI_MATCH_SUCCESS;
+      if (!use[i])
+        continue;
+
+      rcx += ref->xcol[pairs[2 * i]];
+      rcy += ref->ycol[pairs[2 * i]];
+      scx += stage->xcol[pairs[2 * i + 1]];
+      scy += stage->ycol[pairs[2 * i + 1]];
+      n++;
     }
 
-  return FPI_MATCH_FAIL;
+  if (n < 3)
+    return FALSE;
+
+  rcx /= n;
+  rcy /= n;
+  scx /= n;
+  scy /= n;
+
+  for (i = 0; i < n_pairs; i++)
+    {
+      gdouble ax, ay, bx, by;
+
+      if (!use[i])
+        continue;
+
+      ax = ref->xcol[pairs[2 * i]] - rcx;
+      ay = ref->ycol[pairs[2 * i]] - rcy;
+      bx = stage->xcol[pairs[2 * i + 1]] - scx;
+      by = stage->ycol[pairs[2 * i + 1]] - scy;
+
+      dot += ax * bx + ay * by;
+      cross += bx * ay - by * ax;
+    }
+
+  phi = atan2 (cross, dot);
+  t->cos_phi = cos (phi);
+  t->sin_phi = sin (phi);
+  t->phi = (gint) round (phi * 180.0 / G_PI);
+  t->tx = rcx - (t->cos_phi * scx - t->sin_phi * scy);
+  t->ty = rcy - (t->sin_phi * scx + t->cos_phi * scy);
+
+  return TRUE;
+}
+
+/* Aligns @stage to @ref using the compatible edge pairs found by bz_match().
+ * The probe needs to have been initialized from @ref already and the
+ * bz3_lock must be held. */
+static gboolean
+fuse_align (struct xyt_struct *ref,
+            gint               ref_len,
+            struct xyt_struct *stage,
+            gint               bz3_threshold,
+            FuseTransform     *t)
+{
+  g_autofree gint *votes = NULL;
+  g_autofree gint *pairs = NULL;
+  g_autofree gboolean *use = NULL;
+  gint hist[360] = { 0 };
+  gint best = 0, rotation = 0;
+  gint np, score, n_pairs = 0;
+  gint i, j, k;
+
+  np = bz_match (ref_len, bozorth_gallery_init (stage, 0));
+  if (np <= 0)
+    return FALSE;
+
+  /* Find the dominant rotation between the two prints */
+  for (i = 0; i < np; i++)
+    hist[colp[i][0] + 179] += 1;
+
+  for (i = 0; i < 360; i++)
+    {
+      gint sum = 0;
+
+      for (j = -FUSE_ROTATION_TOLERANCE; j <= FUSE_ROTATION_TOLERANCE; j++)
+        sum += hist[(i + j + 360) % 360];
+
+      if (sum > best)
+        {
+          best = sum;
+          rotation = i - 179;
+        }
+    }
+
+  /* Each consistent edge pair votes for two minutia correspondences */
+  votes = g_new0 (gint, ref->nrows * stage->nrows);
+  for (i = 0; i < np; i++)
+    {
+      if (fuse_angle_diff (colp[i][0], rotation) > FUSE_ROTATION_TOLERANCE)
+        continue;
+
+      votes[(colp[i][1] - 1) * stage->nrows + colp[i][3] - 1] += 1;
+      votes[(colp[i][2] - 1) * stage->nrows + colp[i][4] - 1] += 1;
+    }
+
+  score = bz_match_score (np, ref, stage);
+  if (score < bz3_threshold)
+    return FALSE;
+
+  /* Only keep correspondences where both minutiae agree on each other */
+  pairs = g_new (gint, 2 * MIN (ref->nrows, stage->nrows));
+  for (i = 0; i < ref->nrows; i++)
+    {
+      gint best_j = -1;
+
+      for (j = 0; j < stage->nrows; j++)
+        if (votes[i * stage->nrows + j] >= 2 &&
+            (best_j < 0 || votes[i * stage->nrows + j] > votes[i * stage->nrows + best_j]))
+          best_j = j;
+
+      if (best_j < 0)
+        continue;
+
+      for (k = 0; k < ref->nrows; k++)
+        if (votes[k * stage->nrows + best_j] > votes[i * stage->nrows + best_j])
+          break;
+
+      if (k < ref->nrows)
+        continue;
+
+      pairs[2 * n_pairs] = i;
+      pairs[2 * n_pairs + 1] = best_j;
+      n_pairs++;
+    }
+
+  use = g_new (gboolean, MAX (n_pairs, 1));
+  for (i = 0; i < n_pairs; i++)
+    use[i] = TRUE;
+
+  if (!fuse_estimate_transform (ref, stage, pairs, use, n_pairs, t))
+    return FALSE;
+
+  /* Drop correspondences that do not fit and refine once */
+  for (i = 0; i < n_pairs; i++)
+    {
+      gdouble x, y;
+      gint theta;
+
+      fuse_transform_apply (t,
+                            stage->xcol[pairs[2 * i + 1]],
+                            stage->ycol[pairs[2 * i + 1]],
+                            stage->thetacol[pairs[2 * i + 1]],
+                            &x, &y, &theta);
+
+      use[i] = hypot (x - ref->xcol[pairs[2 * i]], y - ref->ycol[pairs[2 * i]]) <= 2 * FUSE_MAX_DISTANCE;
+    }
+
+  return fuse_estimate_transform (ref, stage, pairs, use, n_pairs, t);
+}
+
+static void
+fuse_add_minutiae (FuseCluster         *clusters,
+                   guint               *n_clusters,
+                   struct xyt_struct   *xyt,
+                   const FuseTransform *t,
+                   guint                stage)
+{
+  gint i;
+
+  for (i = 0; i < xyt->nrows; i++)
+    {
+      FuseCluster *cluster = NULL;
+      gdouble best_dist = FUSE_MAX_DISTANCE;
+      gdouble x, y;
+      gint theta;
+      guint c;
+
+      fuse_transform_apply (t, xyt->xcol[i], xyt->ycol[i], xyt->thetacol[i],
+                            &x, &y, &theta);
+
+      for (c = 0; c < *n_clusters; c++)
+        {
+          FuseCluster *cur = &clusters[c];
+          gdouble dist;
+          gint ctheta;
+
+          if (cur->last_stage == stage)
+            continue;
+
+          dist = hypot (cur->sum_x / cur->support - x, cur->sum_y / cur->support - y);
+          if (dist > best_dist)
+            continue;
+
+          ctheta = (gint) round (atan2 (cur->sum_dy, cur->sum_dx) * 180.0 / G_PI);
+          if (fuse_angle_diff (ctheta, theta) > FUSE_MAX_ANGLE)
+            continue;
+
+          best_dist = dist;
+          cluster = cur;
+        }
+
+      if (!cluster)
+        {
+          cluster = &clusters[*n_clusters];
+          *n_clusters += 1;
+        }
+
+      cluster->sum_x += x;
+      cluster->sum_y += y;
+      cluster->sum_dx += cos (theta * G_PI / 180.0);
+      cluster->sum_dy += sin (theta * G_PI / 180.0);
+      cluster->quality = MAX (cluster->quality, xyt->qualitycol[i]);
+      cluster->support += 1;
+      cluster->last_stage = stage;
+    }
+}
+
+static int
+fuse_cluster_sort (const void *a, const void *b)
+{
+  const FuseCluster *ac = a;
+  const FuseCluster *bc = b;
+
+  if (ac->support != bc->support)
+    return (gint) bc->support - (gint) ac->support;
+
+  return bc->quality - ac->quality;
+}
+
+/* Must be called with the bz3_lock held. Returns the number of stages
+ * that were merged into @fused, these are flagged in @merged. */
+static guint
+fuse_stages (struct xyt_struct **stages,
+             guint               n_stages,
+             gint                bz3_threshold,
+             struct xyt_struct  *fused,
+             gboolean           *merged)
+{
+  g_autofree FuseCluster *clusters = NULL;
+  g_autofree struct minutiae_struct *c = NULL;
+  g_autofree gint *scores = NULL;
+  FuseTransform identity = { 1.0, 0.0, 0.0, 0.0, 0 };
+  guint n_clusters = 0, n_merged = 1;
+  guint ref = 0, i, j;
+  gint best = -1;
+  gint ref_len;
+
+  /* Use the stage which matches best against all others as reference */
+  scores = g_new0 (gint, n_stages);
+  for (i = 0; i < n_stages; i++)
+    {
+      gint probe_len = bozorth_probe_init (stages[i], 0);
+
+      for (j = 0; j < n_stages; j++)
+        if (i != j)
+          scores[i] += bozorth_to_gallery (probe_len, stages[i], stages[j], 0);
+
+      if (scores[i] > best)
+        {
+          best = scores[i];
+          ref = i;
+        }
+    }
+
+  clusters = g_new0 (FuseCluster, n_stages * MAX_BOZORTH_MINUTIAE);
+  for (i = 0; i < n_stages * MAX_BOZORTH_MINUTIAE; i++)
+    clusters[i].last_stage = G_MAXUINT;
+
+  fuse_add_minutiae (clusters, &n_clusters, stages[ref], &identity, ref);
+  merged[ref] = TRUE;
+
+  ref_len = bozorth_probe_init (stages[ref], 0);
+  for (i = 0; i < n_stages; i++)
+    {
+      FuseTransform t;
+
+      if (i == ref)
+        continue;
+
+      if (!fuse_align (stages[ref], ref_len, stages[i], bz3_threshold, &t))
+        continue;
+
+      fuse_add_minutiae (clusters, &n_clusters, stages[i], &t, i);
+      merged[i] = TRUE;
+      n_merged += 1;
+    }
+
+  /* Prefer minutiae that were seen in many stages */
+  qsort (clusters, n_clusters, sizeof (FuseCluster), fuse_cluster_sort);
+  n_clusters = MIN (n_clusters, MAX_BOZORTH_MINUTIAE);
+
+  c = g_new (struct minutiae_struct, n_clusters);
+  for (i = 0; i < n_clusters; i++)
+    {
+      FuseCluster *cluster = &clusters[i];
+
+      c[i].col[0] = (gint) round (cluster->sum_x / cluster->support);
+      c[i].col[1] = (gint) round (cluster->sum_y / cluster->support);
+      c[i].col[2] = IANGLE180 ((gint) round (atan2 (cluster->sum_dy, cluster->sum_dx) * 180.0 / G_PI));
+      c[i].col[3] = cluster->quality;
+    }
+
+  /* bz_comp() relies on the minutiae being sorted */
+  qsort (c, n_clusters, sizeof (struct minutiae_struct), sort_x_y);
+
+  for (i = 0; i < n_clusters; i++)
+    {
+      fused->xcol[i] = c[i].col[0];
+      fused->ycol[i] = c[i].col[1];
+      fused->thetacol[i] = c[i].col[2];
+      fused->qualitycol[i] = c[i].col[3];
+    }
+  fused->nrows = n_clusters;
+
+  return n_merged;
+}
+
+/**
+ * fpi_print_fuse:
+ * @print: A #FpPrint of type #FPI_PRINT_NBIS
+ * @n_stages: Number of prints at the end of @print to fuse
+ * @bz3_threshold: The BZ3 score a stage needs to reach for being merged
+ * @keep_stages: Whether to keep the merged stage prints as fallback
+ *
+ * Merges the last @n_stages prints of @print (usually the enroll stages)
+ * into one consolidated print. The stages are aligned against the stage
+ * which matches best with all others, corresponding minutiae are merged
+ * and the fused print is inserted in front of the stages. As it covers
+ * a larger area than any single stage, a successful verification will
+ * usually only need one match.
+ *
+ * Stages that could not be aligned are always kept. If @keep_stages is
+ * %FALSE, then the stages that were merged are removed.
+ *
+ * Returns: %TRUE if a fused print was added to @print
+ */
+gboolean
+fpi_print_fuse (FpPrint *print,
+                guint    n_stages,
+                gint     bz3_threshold,
+                gboolean keep_stages)
+{
+  g_autofree struct xyt_struct *fused = NULL;
+  g_autofree gboolean *merged = NULL;
+  guint first, n_merged, i;
+
+  g_return_val_if_fail (print->type == FPI_PRINT_NBIS, FALSE);
+  g_return_val_if_fail (n_stages <= print->prints->len, FALSE);
+
+  if (n_stages < 2)
+    return FALSE;
+
+  first = print->prints->len - n_stages;
+  fused = g_new0 (struct xyt_struct, 1);
+  merged = g_new0 (gboolean, n_stages);
+
+  g_mutex_lock (&bz3_lock);
+  n_merged = fuse_stages ((struct xyt_struct **) &print->prints->pdata[first],
+                          n_stages, bz3_threshold, fused, merged);
+  g_mutex_unlock (&bz3_lock);
+
+  fp_dbg ("Fused %u of %u prints into one with %d minutiae",
+          n_merged, n_stages, fused->nrows);
+
+  if (n_merged < 2)
+    return FALSE;
+
+  if (!keep_stages)
+    {
+      for (i = n_stages; i > 0; i--)
+        if (merged[i - 1])
+          g_ptr_array_remove_index (print->prints, first + i - 1);
+    }
+
+  g_ptr_array_insert (print->prints, first, g_steal_pointer (&fused));
+
+  return TRUE;
 }
 
 /**
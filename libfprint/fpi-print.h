@@ -30,6 +30,9 @@ typedef enum {
   FPI_MATCH_SUCCESS,
 } FpiMatchResult;
 
+/* Default BZ3 score at which two NBIS prints are considered to match */
+#define BOZORTH3_DEFAULT_THRESHOLD 40
+
 void     fpi_print_add_print (FpPrint *print,
                               FpPrint *add);
 
@@ -41,12 +44,29 @@ void     fpi_print_set_device_stored (FpPrint *print,
 gboolean fpi_print_add_from_image (FpPrint *print,
                                    FpImage *image,
                                    GError **error);
+gboolean fpi_print_add_from_image_full (FpPrint *print,
+                                        FpImage *image,
+                                        gint     max_minutiae,
+                                        GError **error);
+
+void           fpi_print_set_bz3_cache_size (gsize max_size);
+
+gint           fpi_print_bz3_score (FpPrint *temp,
+                                    FpPrint *print,
+                                    gint     min_quality,
+                                    gint     stop_score);
 
 FpiMatchResult fpi_print_bz3_match (FpPrint *temp,
                                     FpPrint *print,
                                     gint     bz3_threshold,
+                                    gint     bz3_min_quality,
                                     GError **error);
 
+gboolean       fpi_print_fuse (FpPrint *print,
+                               guint    n_stages,
+                               gint     bz3_threshold,
+                               gboolean keep_stages);
+
 /* Helpers to encode metadata into user ID strings. */
 gchar *  fpi_print_generate_user_id (FpPrint *print);
 gboolean fpi_print_fill_from_user_id (FpPrint    *print,
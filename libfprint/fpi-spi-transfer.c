@@ -18,15 +18,37 @@
  */
 
 #include "fpi-spi-transfer.h"
+#include "fpi-trace.h"
 #include <sys/ioctl.h>
 #include <linux/spi/spidev.h>
 #include <errno.h>
+#include <string.h>
 
 /* spidev can only handle the specified block size, which defaults to 4096. */
 #define SPIDEV_BLOCK_SIZE_PARAM "/sys/module/spidev/parameters/bufsiz"
 #define SPIDEV_BLOCK_SIZE_FALLBACK 4096
 static gsize block_size = 0;
 
+/* Upper bound on the number of segments passed to a single ioctl. The size
+ * field of SPI_IOC_MESSAGE only allows for 511 transfers. */
+#define SPI_MESSAGE_MAX_SEGMENTS 256
+
+typedef struct
+{
+  gsize    offset;
+  gsize    length;
+  gboolean read;
+  gboolean cs_change;
+} FpiSpiSegment;
+
+static int
+spi_ioctl_default (int fd, guint n_transfers, struct spi_ioc_transfer *xfer)
+{
+  return ioctl (fd, SPI_IOC_MESSAGE (n_transfers), xfer);
+}
+
+static FpiSpiIoctlFunc spi_ioctl = spi_ioctl_default;
+
 /**
  * SECTION:fpi-spi-transfer
  * @title: SPI transfer helpers
@@ -37,6 +59,8 @@ static gsize block_size = 0;
  * and provide a usable asynchronous API to libfprint drivers.
  *
  * Currently only transfers with a write and subsequent read are supported.
+ * Asynchronous transfers are executed by a per-device I/O thread which
+ * combines transfers that are queued at the same time into one ioctl.
  *
  * Drivers should always use this API rather than calling read/write/ioctl on
  * the spidev device.
@@ -48,31 +72,10 @@ static gsize block_size = 0;
 
 G_DEFINE_BOXED_TYPE (FpiSpiTransfer, fpi_spi_transfer, fpi_spi_transfer_ref, fpi_spi_transfer_unref)
 
-static void
-dump_buffer (guchar *buf, gssize dump_len)
-{
-  g_autoptr(GString) line = NULL;
-
-  line = g_string_new ("");
-  /* Dump the buffer. */
-  for (gssize i = 0; i < dump_len; i++)
-    {
-      g_string_append_printf (line, "%02x ", buf[i]);
-      if ((i + 1) % 16 == 0)
-        {
-          g_debug ("%s", line->str);
-          g_string_set_size (line, 0);
-        }
-    }
-
-  if (line->len)
-    g_debug ("%s", line->str);
-}
-
 static void
 log_transfer (FpiSpiTransfer *transfer, gboolean submit, GError *error)
 {
-  if (g_getenv ("FP_DEBUG_TRANSFER"))
+  if (fpi_trace_dump_transfers ())
     {
       if (submit)
         {
@@ -82,7 +85,7 @@ log_transfer (FpiSpiTransfer *transfer, gboolean submit, GError *error)
                    transfer->length_rd);
 
           if (transfer->buffer_wr)
-            dump_buffer (transfer->buffer_wr, transfer->length_wr);
+            fpi_trace_hexdump (transfer->buffer_wr, transfer->length_wr);
         }
       else
         {
@@ -98,9 +101,22 @@ log_transfer (FpiSpiTransfer *transfer, gboolean submit, GError *error)
                    transfer->length_wr,
                    transfer->length_rd);
           if (transfer->buffer_rd)
-            dump_buffer (transfer->buffer_rd, transfer->length_rd);
+            fpi_trace_hexdump (transfer->buffer_rd, transfer->length_rd);
         }
     }
+
+  if (submit)
+    {
+      transfer->submit_time = g_get_monotonic_time ();
+      FPI_TRACE (spi_transfer_submit, transfer, transfer->length_wr, transfer->length_rd);
+    }
+  else
+    {
+      FPI_TRACE (spi_transfer_complete, transfer,
+                 transfer->length_wr, transfer->length_rd,
+                 g_get_monotonic_time () - transfer->submit_time,
+                 FPI_TRACE_ERROR_CODE (error));
+    }
 }
 
 /**
@@ -166,6 +182,7 @@ fpi_spi_transfer_free (FpiSpiTransfer *self)
     self->free_buffer_rd (self->buffer_rd);
   self->buffer_wr = NULL;
   self->buffer_rd = NULL;
+  g_clear_pointer (&self->segments, g_array_unref);
 
   g_slice_free (FpiSpiTransfer, self);
 }
@@ -286,6 +303,7 @@ fpi_spi_transfer_read_full (FpiSpiTransfer *transfer,
 {
   g_assert (buffer != NULL);
   g_return_if_fail (transfer);
+  g_return_if_fail (transfer->segments == NULL);
   g_return_if_fail (transfer->buffer_rd == NULL);
 
   transfer->buffer_rd = buffer;
@@ -293,6 +311,104 @@ fpi_spi_transfer_read_full (FpiSpiTransfer *transfer,
   transfer->free_buffer_rd = free_func;
 }
 
+static void
+transfer_ensure_segments (FpiSpiTransfer *transfer)
+{
+  if (transfer->segments)
+    return;
+
+  transfer->segments = g_array_new (FALSE, FALSE, sizeof (FpiSpiSegment));
+  transfer->length_wr = 0;
+  transfer->length_rd = 0;
+  transfer->free_buffer_wr = g_free;
+  transfer->free_buffer_rd = g_free;
+}
+
+/**
+ * fpi_spi_transfer_add_write:
+ * @transfer: The #FpiSpiTransfer
+ * @data: The data to write
+ * @length: The size of @data
+ * @cs_change: Whether to deselect the chip after this segment
+ *
+ * Append a write segment to a segmented transfer. @data is copied into
+ * the @buffer_wr of the transfer.
+ *
+ * A segmented transfer is executed like a series of individual transfers
+ * where the chip is only deselected after segments that have @cs_change
+ * set (and at the end of the transfer). It is submitted with as few ioctls
+ * as possible. This cannot be mixed with fpi_spi_transfer_write() and
+ * fpi_spi_transfer_read() on the same transfer.
+ *
+ * The segments of a chip select group are always submitted with a single
+ * ioctl, so a group must not be larger than the spidev block size (4096
+ * bytes by default) and must not consist of more than 256 segments.
+ * Otherwise the transfer fails with #G_IO_ERROR_MESSAGE_TOO_LARGE before
+ * anything is sent to the device.
+ */
+void
+fpi_spi_transfer_add_write (FpiSpiTransfer *transfer,
+                            const guint8   *data,
+                            gsize           length,
+                            gboolean        cs_change)
+{
+  FpiSpiSegment segment = { 0 };
+
+  g_return_if_fail (transfer);
+  g_return_if_fail (data != NULL && length > 0);
+  g_return_if_fail (transfer->segments ||
+                    (transfer->buffer_wr == NULL && transfer->buffer_rd == NULL));
+
+  transfer_ensure_segments (transfer);
+
+  segment.offset = transfer->length_wr;
+  segment.length = length;
+  segment.cs_change = cs_change;
+  g_array_append_val (transfer->segments, segment);
+
+  transfer->buffer_wr = g_realloc (transfer->buffer_wr, transfer->length_wr + length);
+  memcpy (transfer->buffer_wr + transfer->length_wr, data, length);
+  transfer->length_wr += length;
+}
+
+/**
+ * fpi_spi_transfer_add_read:
+ * @transfer: The #FpiSpiTransfer
+ * @length: The number of bytes to read
+ * @cs_change: Whether to deselect the chip after this segment
+ *
+ * Append a read segment to a segmented transfer, see
+ * fpi_spi_transfer_add_write().
+ *
+ * Returns: The offset into @buffer_rd at which the data will be stored
+ */
+gsize
+fpi_spi_transfer_add_read (FpiSpiTransfer *transfer,
+                           gsize           length,
+                           gboolean        cs_change)
+{
+  FpiSpiSegment segment = { 0 };
+
+  g_return_val_if_fail (transfer, 0);
+  g_return_val_if_fail (length > 0, 0);
+  g_return_val_if_fail (transfer->segments ||
+                        (transfer->buffer_wr == NULL && transfer->buffer_rd == NULL), 0);
+
+  transfer_ensure_segments (transfer);
+
+  segment.offset = transfer->length_rd;
+  segment.length = length;
+  segment.read = TRUE;
+  segment.cs_change = cs_change;
+  g_array_append_val (transfer->segments, segment);
+
+  transfer->buffer_rd = g_realloc (transfer->buffer_rd, transfer->length_rd + length);
+  memset (transfer->buffer_rd + transfer->length_rd, 0, length);
+  transfer->length_rd += length;
+
+  return segment.offset;
+}
+
 static void
 transfer_finish_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
@@ -340,8 +456,9 @@ transfer_chunk (FpiSpiTransfer *transfer, gsize full_length, gsize *transferred)
     {
       if (skip < transfer->length_rd && len < block_size)
         {
+          /* spidev rejects ioctls exceeding the block size in total. */
           xfer[transfers].rx_buf = (gsize) transfer->buffer_rd + skip;
-          xfer[transfers].len = MIN (block_size, transfer->length_rd - skip);
+          xfer[transfers].len = MIN (block_size - len, transfer->length_rd - skip);
 
           len += xfer[transfers].len;
           /* skip += xfer[transfers].len; */
@@ -374,7 +491,7 @@ transfer_chunk (FpiSpiTransfer *transfer, gsize full_length, gsize *transferred)
     }
 
   /* This ioctl cannot be interrupted. */
-  status = ioctl (transfer->spidev_fd, SPI_IOC_MESSAGE (transfers), xfer);
+  status = spi_ioctl (transfer->spidev_fd, transfers, xfer);
 
   if (status >= 0)
     *transferred += len;
@@ -382,47 +499,437 @@ transfer_chunk (FpiSpiTransfer *transfer, gsize full_length, gsize *transferred)
   return status;
 }
 
-static void
-transfer_thread_func (GTask        *task,
-                      gpointer      source_object,
-                      gpointer      task_data,
-                      GCancellable *cancellable)
+static gsize
+transfer_full_length (FpiSpiTransfer *transfer)
+{
+  gsize full_length = 0;
+
+  if (transfer->buffer_wr)
+    full_length += transfer->length_wr;
+  if (transfer->buffer_rd)
+    full_length += transfer->length_rd;
+
+  return full_length;
+}
+
+/* Whether the transfer may be combined with others into one ioctl. Segmented
+ * transfers and transfers that need to be split are always run on their own.
+ */
+static gboolean
+transfer_can_batch (FpiSpiTransfer *transfer)
+{
+  if (transfer->segments)
+    return FALSE;
+
+  if (transfer->buffer_wr == NULL && transfer->buffer_rd == NULL)
+    return FALSE;
+
+  return transfer_full_length (transfer) <= block_size;
+}
+
+/**
+ * fpi_spi_transfer_plan_segments:
+ * @transfer: A #FpiSpiTransfer built using fpi_spi_transfer_add_write() and
+ *   fpi_spi_transfer_add_read()
+ * @max_length: The maximum number of bytes per ioctl
+ * @max_segments: The maximum number of segments per ioctl
+ * @group_per_ioctl: Whether every chip select group gets its own ioctl
+ * @error: Return location for errors
+ *
+ * Work out how the segments of @transfer are split up into ioctls. As many
+ * chip select groups as the limits permit are combined, but a group is never
+ * split as the chip would be deselected in between. If a group does not fit
+ * into a single ioctl, %G_IO_ERROR_MESSAGE_TOO_LARGE is returned.
+ *
+ * This is used internally when running the transfer.
+ *
+ * Returns: (transfer full): An array with the index after the last segment of
+ *   each ioctl, or %NULL on error
+ */
+GArray *
+fpi_spi_transfer_plan_segments (FpiSpiTransfer *transfer,
+                                gsize           max_length,
+                                guint           max_segments,
+                                gboolean        group_per_ioctl,
+                                GError        **error)
+{
+  g_autoptr(GArray) ends = NULL;
+  FpiSpiSegment *segments;
+  gsize length = 0;
+  gsize group_length = 0;
+  guint group_start = 0;
+  guint start = 0;
+  guint i;
+
+  g_return_val_if_fail (transfer, NULL);
+  g_return_val_if_fail (transfer->segments && transfer->segments->len > 0, NULL);
+
+  segments = (FpiSpiSegment *) transfer->segments->data;
+  ends = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  for (i = 0; i < transfer->segments->len; i++)
+    {
+      guint end = i + 1;
+
+      /* The chip is always deselected at the end of the transfer. */
+      group_length += segments[i].length;
+      if (!segments[i].cs_change && end < transfer->segments->len)
+        continue;
+
+      if (group_length > max_length || end - group_start > max_segments)
+        {
+          g_set_error (error,
+                       G_IO_ERROR,
+                       G_IO_ERROR_MESSAGE_TOO_LARGE,
+                       "SPI chip select group with %" G_GSIZE_FORMAT " bytes in %u segments "
+                       "exceeds the limit of %" G_GSIZE_FORMAT " bytes in %u segments",
+                       group_length, end - group_start, max_length, max_segments);
+          return NULL;
+        }
+
+      if (group_start > start &&
+          (group_per_ioctl ||
+           length + group_length > max_length ||
+           end - start > max_segments))
+        {
+          g_array_append_val (ends, group_start);
+          start = group_start;
+          length = 0;
+        }
+
+      length += group_length;
+      group_length = 0;
+      group_start = end;
+    }
+
+  g_array_append_val (ends, group_start);
+
+  return g_steal_pointer (&ends);
+}
+
+static gboolean
+transfer_run_segments (FpiSpiTransfer *transfer,
+                       GCancellable   *cancellable,
+                       GError        **error)
+{
+  g_autofree struct spi_ioc_transfer *xfer = NULL;
+  g_autoptr(GArray) ends = NULL;
+  FpiSpiSegment *segments = (FpiSpiSegment *) transfer->segments->data;
+  guint n_segments = transfer->segments->len;
+  gboolean emulation;
+  guint start = 0;
+  guint i;
+
+  /* Under emulation each group is submitted separately so that the
+   * recorded ioctl stream is reproduced. */
+  emulation = g_strcmp0 (g_getenv ("FP_DEVICE_EMULATION"), "1") == 0;
+
+  /* Check all groups before anything is sent to the device. */
+  ends = fpi_spi_transfer_plan_segments (transfer, block_size,
+                                         SPI_MESSAGE_MAX_SEGMENTS,
+                                         emulation, error);
+  if (!ends)
+    return FALSE;
+
+  xfer = g_new0 (struct spi_ioc_transfer, n_segments);
+  for (i = 0; i < n_segments; i++)
+    {
+      if (segments[i].read)
+        xfer[i].rx_buf = (gsize) transfer->buffer_rd + segments[i].offset;
+      else
+        xfer[i].tx_buf = (gsize) transfer->buffer_wr + segments[i].offset;
+      xfer[i].len = segments[i].length;
+      xfer[i].cs_change = segments[i].cs_change;
+    }
+
+  /* The chip is deselected between ioctls, so this is also where
+   * cancellation is possible. */
+  for (i = 0; i < ends->len; i++)
+    {
+      guint end = g_array_index (ends, guint, i);
+      int status;
+
+      if (start > 0 && g_cancellable_set_error_if_cancelled (cancellable, error))
+        return FALSE;
+
+      /* Release the chip at the end of the ioctl. */
+      xfer[end - 1].cs_change = FALSE;
+
+      status = spi_ioctl (transfer->spidev_fd, end - start, xfer + start);
+      if (status < 0)
+        {
+          g_set_error (error,
+                       G_IO_ERROR,
+                       g_io_error_from_errno (errno),
+                       "Error invoking ioctl for SPI transfer (%d)",
+                       errno);
+          return FALSE;
+        }
+
+      start = end;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+transfer_run (FpiSpiTransfer *transfer,
+              GCancellable   *cancellable,
+              GError        **error)
 {
-  FpiSpiTransfer *transfer = (FpiSpiTransfer *) task_data;
   gsize full_length;
   gsize transferred = 0;
   int status = 0;
 
   if (transfer->buffer_wr == NULL && transfer->buffer_rd == NULL)
     {
-      g_task_return_new_error (task,
-                               G_IO_ERROR,
-                               G_IO_ERROR_INVALID_ARGUMENT,
-                               "Transfer with neither write or read!");
-      return;
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_ARGUMENT,
+                   "Transfer with neither write or read!");
+      return FALSE;
     }
 
-  full_length = 0;
-  if (transfer->buffer_wr)
-    full_length += transfer->length_wr;
-  if (transfer->buffer_rd)
-    full_length += transfer->length_rd;
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    return FALSE;
+
+  if (transfer->segments)
+    return transfer_run_segments (transfer, cancellable, error);
 
+  full_length = transfer_full_length (transfer);
+
+  /* Once the first chunk went out the chip may still be selected, so a
+   * split transfer is always completed rather than being cancelled.
+   */
   while (transferred < full_length && status >= 0)
     status = transfer_chunk (transfer, full_length, &transferred);
 
   if (status < 0)
     {
-      g_task_return_new_error (task,
-                               G_IO_ERROR,
-                               g_io_error_from_errno (errno),
-                               "Error invoking ioctl for SPI transfer (%d)",
-                               errno);
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errno),
+                   "Error invoking ioctl for SPI transfer (%d)",
+                   errno);
+      return FALSE;
     }
+
+  return TRUE;
+}
+
+static void
+transfer_thread_func (GTask        *task,
+                      gpointer      source_object,
+                      gpointer      task_data,
+                      GCancellable *cancellable)
+{
+  FpiSpiTransfer *transfer = (FpiSpiTransfer *) task_data;
+  GError *error = NULL;
+
+  if (!transfer_run (transfer, NULL, &error))
+    g_task_return_error (task, error);
   else
+    g_task_return_boolean (task, TRUE);
+}
+
+/* Per-device SPI worker.
+ *
+ * Asynchronous transfers are queued to a thread that is owned by the device.
+ * Whenever several transfers are queued at the same time, they are combined
+ * into one SPI_IOC_MESSAGE ioctl with the chip being deselected in between
+ * (i.e. the same bus semantics as submitting them one by one). Only transfers
+ * that fit into a single spidev block are combined.
+ *
+ * Completion is reported through the GTask, i.e. on the main context that
+ * was the thread default when the transfer was submitted.
+ */
+#define SPI_BATCH_MAX_TRANSFERS 8
+
+typedef struct
+{
+  GThread     *thread;
+  GAsyncQueue *queue;
+  guint        max_batch;
+} FpiSpiWorker;
+
+static GQuark spi_worker_quark;
+
+static gboolean
+spi_worker_run_batch (GTask **batch, guint n, GError **error)
+{
+  struct spi_ioc_transfer xfer[SPI_BATCH_MAX_TRANSFERS * 2] = { 0 };
+  FpiSpiTransfer *transfer = NULL;
+  int segments = 0;
+  int status;
+  guint i;
+
+  for (i = 0; i < n; i++)
     {
-      g_task_return_boolean (task, TRUE);
+      transfer = g_task_get_task_data (batch[i]);
+
+      if (transfer->buffer_wr)
+        {
+          xfer[segments].tx_buf = (gsize) transfer->buffer_wr;
+          xfer[segments].len = transfer->length_wr;
+          segments += 1;
+        }
+
+      if (transfer->buffer_rd)
+        {
+          xfer[segments].rx_buf = (gsize) transfer->buffer_rd;
+          xfer[segments].len = transfer->length_rd;
+          segments += 1;
+        }
+
+      /* Deselect the chip between transfers, but not after the last one. */
+      if (i + 1 < n)
+        xfer[segments - 1].cs_change = TRUE;
     }
+
+  status = spi_ioctl (transfer->spidev_fd, segments, xfer);
+  if (status < 0)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errno),
+                   "Error invoking ioctl for SPI transfer (%d)",
+                   errno);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gpointer
+spi_worker_thread (gpointer user_data)
+{
+  FpiSpiWorker *worker = user_data;
+  GTask *batch[SPI_BATCH_MAX_TRANSFERS];
+  GTask *next = NULL;
+
+  while (TRUE)
+    {
+      g_autoptr(GError) error = NULL;
+      FpiSpiTransfer *transfer;
+      gsize length = 0;
+      gboolean res;
+      guint n = 0;
+      guint i;
+
+      if (!next)
+        next = g_async_queue_pop (worker->queue);
+
+      if (next == (gpointer) worker)
+        break;
+
+      /* Collect everything that has been queued up in the meantime. */
+      while (next && next != (gpointer) worker)
+        {
+          gsize full_length;
+
+          if (g_task_return_error_if_cancelled (next))
+            {
+              g_object_unref (next);
+              next = g_async_queue_try_pop (worker->queue);
+              continue;
+            }
+
+          transfer = g_task_get_task_data (next);
+          full_length = transfer_full_length (transfer);
+
+          if (n > 0)
+            {
+              FpiSpiTransfer *first = g_task_get_task_data (batch[0]);
+
+              if (n >= worker->max_batch ||
+                  transfer->spidev_fd != first->spidev_fd ||
+                  !transfer_can_batch (transfer) ||
+                  length + full_length > block_size)
+                break;
+            }
+
+          batch[n++] = next;
+          length += full_length;
+          next = NULL;
+
+          if (n >= worker->max_batch || !transfer_can_batch (transfer))
+            break;
+
+          next = g_async_queue_try_pop (worker->queue);
+        }
+
+      if (n == 0)
+        continue;
+
+      if (n == 1)
+        res = transfer_run (g_task_get_task_data (batch[0]),
+                            g_task_get_cancellable (batch[0]),
+                            &error);
+      else
+        res = spi_worker_run_batch (batch, n, &error);
+
+      for (i = 0; i < n; i++)
+        {
+          if (res)
+            g_task_return_boolean (batch[i], TRUE);
+          else if (i == 0 && n == 1)
+            g_task_return_error (batch[i], g_steal_pointer (&error));
+          else
+            g_task_return_error (batch[i], g_error_copy (error));
+
+          g_object_unref (batch[i]);
+        }
+    }
+
+  g_async_queue_unref (worker->queue);
+  g_free (worker);
+
+  return NULL;
+}
+
+static void
+spi_worker_destroy (gpointer data)
+{
+  FpiSpiWorker *worker = data;
+  GThread *thread = worker->thread;
+
+  /* Every queued transfer holds a reference to the device, so the queue is
+   * empty at this point and the thread only needs to be told to quit. It
+   * frees the worker on exit. The last device reference may be dropped from
+   * the worker thread itself though, so do not join in that case.
+   */
+  g_async_queue_push (worker->queue, worker);
+  if (g_thread_self () != thread)
+    g_thread_join (thread);
+  else
+    g_thread_unref (thread);
+}
+
+static FpiSpiWorker *
+spi_worker_get (FpDevice *device)
+{
+  FpiSpiWorker *worker;
+
+  if (G_UNLIKELY (spi_worker_quark == 0))
+    spi_worker_quark = g_quark_from_static_string ("fpi-spi-worker");
+
+  worker = g_object_get_qdata (G_OBJECT (device), spi_worker_quark);
+  if (worker)
+    return worker;
+
+  worker = g_new0 (FpiSpiWorker, 1);
+  worker->queue = g_async_queue_new ();
+  /* The recorded ioctl stream needs to be replayed one by one. */
+  if (g_strcmp0 (g_getenv ("FP_DEVICE_EMULATION"), "1") == 0)
+    worker->max_batch = 1;
+  else
+    worker->max_batch = SPI_BATCH_MAX_TRANSFERS;
+  worker->thread = g_thread_new ("fpi-spi-worker", spi_worker_thread, worker);
+
+  g_object_set_qdata_full (G_OBJECT (device), spi_worker_quark, worker,
+                           spi_worker_destroy);
+
+  return worker;
 }
 
 /**
@@ -434,8 +941,15 @@ transfer_thread_func (GTask        *task,
  *
  * Submit an SPI transfer with a specific timeout and callback functions.
  *
- * The underlying transfer cannot be cancelled. The current implementation
- * will only call @callback after the transfer has been completed.
+ * Transfers are queued to an I/O thread that is owned by the device and are
+ * executed in submission order. Transfers that are queued at the same time
+ * may be combined into a single ioctl, the chip is deselected between them
+ * as if they had been submitted individually.
+ *
+ * Cancelling @cancellable aborts the transfer if it has not been started yet.
+ * A transfer that is already running will always be completed, but @callback
+ * is called with a #G_IO_ERROR_CANCELLED error in that case. @callback is
+ * invoked on the thread default main context at the time of submission.
  *
  * Note that #FpiSpiTransfer will be stolen when this function is called.
  * So that all associated data will be free'ed automatically, after the
@@ -465,10 +979,11 @@ fpi_spi_transfer_submit (FpiSpiTransfer        *transfer,
                      transfer_finish_cb,
                      NULL);
   g_task_set_task_data (task,
-                        g_steal_pointer (&transfer),
+                        transfer,
                         (GDestroyNotify) fpi_spi_transfer_unref);
 
-  g_task_run_in_thread (task, transfer_thread_func);
+  g_async_queue_push (spi_worker_get (transfer->device),
+                      g_steal_pointer (&task));
 }
 
 /**
@@ -517,3 +1032,18 @@ fpi_spi_transfer_submit_sync (FpiSpiTransfer *transfer,
 
   return res;
 }
+
+/**
+ * fpi_spi_transfer_set_ioctl_func:
+ * @ioctl_func: (nullable): The function to replace the SPI_IOC_MESSAGE
+ *   ioctl with, or %NULL to restore the default
+ *
+ * Replaces the ioctl that all SPI transfers are submitted with. This is
+ * only meant to be used by unit tests, which run without a spidev device,
+ * and must be called before any transfer is submitted.
+ */
+void
+fpi_spi_transfer_set_ioctl_func (FpiSpiIoctlFunc ioctl_func)
+{
+  spi_ioctl = ioctl_func ? ioctl_func : spi_ioctl_default;
+}
@@ -34,6 +34,12 @@ typedef void (*FpiSpiTransferCallback)(FpiSpiTransfer *transfer,
                                        gpointer        user_data,
                                        GError         *error);
 
+struct spi_ioc_transfer;
+
+typedef int (*FpiSpiIoctlFunc)(int                      spidev_fd,
+                               guint                    n_transfers,
+                               struct spi_ioc_transfer *xfer);
+
 /**
  * FpiSpiTransfer:
  * @device: The #FpDevice that the transfer belongs to.
@@ -47,6 +53,11 @@ typedef void (*FpiSpiTransferCallback)(FpiSpiTransfer *transfer,
  * Helper for handling SPI transfers. Currently transfers can either be pure
  * write/read transfers or a write followed by a read (full duplex support
  * can easily be added if desired).
+ *
+ * Alternatively, a transfer can be built from a list of segments using
+ * fpi_spi_transfer_add_write() and fpi_spi_transfer_add_read(). In that case
+ * @buffer_wr and @buffer_rd contain the concatenated data of all write and
+ * read segments respectively.
  */
 struct _FpiSpiTransfer
 {
@@ -66,6 +77,12 @@ struct _FpiSpiTransfer
 
   int   spidev_fd;
 
+  /* Submission time for tracing */
+  gint64 submit_time;
+
+  /* Segments if the transfer was built using add_write/add_read */
+  GArray *segments;
+
   /* Callbacks */
   gpointer               user_data;
   FpiSpiTransferCallback callback;
@@ -99,6 +116,21 @@ void               fpi_spi_transfer_read_full (FpiSpiTransfer *transfer,
                                                gsize           length,
                                                GDestroyNotify  free_func);
 
+void               fpi_spi_transfer_add_write (FpiSpiTransfer *transfer,
+                                               const guint8   *data,
+                                               gsize           length,
+                                               gboolean        cs_change);
+
+gsize              fpi_spi_transfer_add_read (FpiSpiTransfer *transfer,
+                                              gsize           length,
+                                              gboolean        cs_change);
+
+GArray            *fpi_spi_transfer_plan_segments (FpiSpiTransfer *transfer,
+                                                   gsize           max_length,
+                                                   guint           max_segments,
+                                                   gboolean        group_per_ioctl,
+                                                   GError        **error);
+
 void               fpi_spi_transfer_submit (FpiSpiTransfer        *transfer,
                                             GCancellable          *cancellable,
                                             FpiSpiTransferCallback callback,
@@ -107,6 +139,7 @@ void               fpi_spi_transfer_submit (FpiSpiTransfer        *transfer,
 gboolean           fpi_spi_transfer_submit_sync (FpiSpiTransfer *transfer,
                                                  GError        **error);
 
+void               fpi_spi_transfer_set_ioctl_func (FpiSpiIoctlFunc ioctl_func);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (FpiSpiTransfer, fpi_spi_transfer_unref)
 
@@ -23,6 +23,7 @@
 
 #include "drivers_api.h"
 #include "fpi-ssm.h"
+#include "fpi-trace.h"
 
 
 /**
@@ -68,12 +69,26 @@
  * communication with the device (such as a USB transfer), and the
  * callback function iterates the machine to the next state
  * upon success (or fails).
+ *
+ * Freed state machines are kept in a small per-device free-list and each
+ * machine keeps its timeout source for delayed transitions, so drivers that
+ * run state machines at frame rate do not allocate for every iteration.
  */
 
+#define SSM_POOL_MAX_FREE 8
+#define SSM_NAME_LEN 48
+
+typedef enum {
+  SSM_DELAYED_NONE,
+  SSM_DELAYED_NEXT_STATE,
+  SSM_DELAYED_JUMP_TO_STATE,
+  SSM_DELAYED_COMPLETE,
+} FpiSsmDelayedAction;
+
 struct _FpiSsm
 {
   FpDevice               *dev;
-  const char             *name;
+  char                   *name;
   FpiSsm                 *parentsm;
   gpointer                ssm_data;
   GDestroyNotify          ssm_data_destroy;
@@ -83,11 +98,122 @@ struct _FpiSsm
   gboolean                completed;
   gboolean                silence;
   GSource                *timeout;
+  FpiSsmDelayedAction     timeout_action;
+  int                     timeout_state;
   GError                 *error;
   FpiSsmCompletedCallback callback;
   FpiSsmHandlerCallback   handler;
+  FpiSsm                 *next_free;
+  char                    name_buf[SSM_NAME_LEN];
 };
 
+typedef struct
+{
+  FpiSsm *free_machines;
+  guint   n_free;
+#ifndef NDEBUG
+  guint   hits;
+  guint   misses;
+#endif
+} FpiSsmPool;
+
+static GQuark ssm_pool_quark;
+
+static void
+fpi_ssm_destroy (FpiSsm *machine)
+{
+  g_clear_pointer (&machine->timeout, g_source_destroy);
+  g_free (machine);
+}
+
+/* Called when the device is finalized */
+static void
+ssm_pool_destroy (FpiSsmPool *pool)
+{
+#ifndef NDEBUG
+  g_debug ("SSM pool destroyed, %u hits and %u misses", pool->hits, pool->misses);
+#endif
+
+  while (pool->free_machines)
+    {
+      FpiSsm *machine = pool->free_machines;
+
+      pool->free_machines = machine->next_free;
+      fpi_ssm_destroy (machine);
+    }
+  g_free (pool);
+}
+
+static FpiSsmPool *
+ssm_pool_get (FpDevice *dev)
+{
+  FpiSsmPool *pool;
+
+  if (G_UNLIKELY (ssm_pool_quark == 0))
+    ssm_pool_quark = g_quark_from_static_string ("fpi-ssm-pool");
+
+  pool = g_object_get_qdata (G_OBJECT (dev), ssm_pool_quark);
+  if (!pool)
+    {
+      pool = g_new0 (FpiSsmPool, 1);
+      g_object_set_qdata_full (G_OBJECT (dev), ssm_pool_quark, pool,
+                               (GDestroyNotify) ssm_pool_destroy);
+    }
+
+  return pool;
+}
+
+static FpiSsm *
+ssm_pool_take (FpDevice *dev)
+{
+  FpiSsmPool *pool;
+  FpiSsm *machine;
+
+  if (!dev)
+    return g_new0 (FpiSsm, 1);
+
+  pool = ssm_pool_get (dev);
+  machine = pool->free_machines;
+
+  if (!machine)
+    {
+#ifndef NDEBUG
+      pool->misses += 1;
+#endif
+      return g_new0 (FpiSsm, 1);
+    }
+
+#ifndef NDEBUG
+  pool->hits += 1;
+#endif
+  pool->free_machines = machine->next_free;
+  pool->n_free -= 1;
+  machine->next_free = NULL;
+
+  return machine;
+}
+
+/* Returns a cleared machine to the free-list, keeping its disarmed timeout
+ * source. The device destroys the source when it is finalized. */
+static void
+ssm_pool_release (FpiSsm *machine)
+{
+  FpiSsmPool *pool = machine->dev ? ssm_pool_get (machine->dev) : NULL;
+  GSource *timeout = machine->timeout;
+
+  if (!pool || pool->n_free >= SSM_POOL_MAX_FREE)
+    {
+      fpi_ssm_destroy (machine);
+      return;
+    }
+
+  memset (machine, 0, sizeof (FpiSsm));
+  machine->timeout = timeout;
+  machine->next_free = pool->free_machines;
+  pool->free_machines = machine;
+  pool->n_free += 1;
+}
+
 /**
  * fpi_ssm_new:
  * @dev: a #fp_dev fingerprint device
@@ -131,13 +257,19 @@ fpi_ssm_new_full (FpDevice             *dev,
   BUG_ON (start_cleanup > nr_states);
   BUG_ON (handler == NULL);
 
-  machine = g_new0 (FpiSsm, 1);
+  machine = ssm_pool_take (dev);
   machine->handler = handler;
   machine->nr_states = nr_states;
   machine->start_cleanup = start_cleanup;
   machine->dev = dev;
-  machine->name = g_strdup (machine_name);
   machine->completed = TRUE;
+
+  /* Names are usually the stringified state enum and fit inline */
+  if (machine_name && strlen (machine_name) < SSM_NAME_LEN)
+    machine->name = strcpy (machine->name_buf, machine_name);
+  else
+    machine->name = g_strdup (machine_name);
+
   return machine;
 }
 
@@ -200,25 +332,81 @@ fpi_ssm_clear_delayed_action (FpiSsm *machine)
 {
   g_return_if_fail (machine);
 
-  g_clear_pointer (&machine->timeout, g_source_destroy);
+  machine->timeout_action = SSM_DELAYED_NONE;
+  if (machine->timeout)
+    g_source_set_ready_time (machine->timeout, -1);
+}
+
+static void
+on_ssm_timeout (FpDevice *dev, gpointer user_data)
+{
+  FpiSsm *machine = user_data;
+  FpiSsmDelayedAction action = machine->timeout_action;
+
+  machine->timeout_action = SSM_DELAYED_NONE;
+
+  switch (action)
+    {
+    case SSM_DELAYED_NEXT_STATE:
+      fpi_ssm_next_state (machine);
+      break;
+
+    case SSM_DELAYED_JUMP_TO_STATE:
+      fpi_ssm_jump_to_state (machine, machine->timeout_state);
+      break;
+
+    case SSM_DELAYED_COMPLETE:
+      fpi_ssm_mark_completed (machine);
+      break;
+
+    case SSM_DELAYED_NONE:
+      break;
+    }
+}
+
+/* The source is owned by its context, this is called when it is destroyed
+ * by the device or together with its context. */
+static void
+on_ssm_timeout_destroyed (gpointer user_data)
+{
+  FpiSsm *machine = user_data;
+
+  machine->timeout = NULL;
 }
 
 static void
-fpi_ssm_set_delayed_action_timeout (FpiSsm        *machine,
-                                    int            delay,
-                                    FpTimeoutFunc  callback,
-                                    gpointer       user_data,
-                                    GDestroyNotify destroy_func)
+fpi_ssm_set_delayed_action_timeout (FpiSsm             *machine,
+                                    int                 delay,
+                                    FpiSsmDelayedAction action,
+                                    int                 state)
 {
   g_return_if_fail (machine);
 
   BUG_ON (machine->completed);
-  BUG_ON (machine->timeout != NULL);
+  BUG_ON (machine->timeout_action != SSM_DELAYED_NONE);
 
-  fpi_ssm_clear_delayed_action (machine);
+  /* A pooled machine may have been used from another context before */
+  if (machine->timeout && !fpi_device_timeout_is_current (machine->dev, machine->timeout))
+    g_clear_pointer (&machine->timeout, g_source_destroy);
+
+  if (!machine->timeout)
+    {
+      g_autofree char *source_name = NULL;
 
-  machine->timeout = fpi_device_add_timeout (machine->dev, delay, callback,
-                                             user_data, destroy_func);
+      machine->timeout = fpi_device_add_rearmable_timeout (machine->dev,
+                                                           on_ssm_timeout,
+                                                           machine,
+                                                           on_ssm_timeout_destroyed);
+
+      source_name = g_strdup_printf ("[%s] ssm delayed transition",
+                                     fp_device_get_device_id (machine->dev));
+      g_source_set_name (machine->timeout, source_name);
+    }
+
+  machine->timeout_action = action;
+  machine->timeout_state = state;
+  g_source_set_ready_time (machine->timeout,
+                           g_source_get_time (machine->timeout) + delay * (gint64) 1000);
 }
 
 /**
@@ -234,14 +422,15 @@ fpi_ssm_free (FpiSsm *machine)
   if (!machine)
     return;
 
-  BUG_ON (machine->timeout != NULL);
+  BUG_ON (machine->timeout_action != SSM_DELAYED_NONE);
 
   if (machine->ssm_data_destroy)
     g_clear_pointer (&machine->ssm_data, machine->ssm_data_destroy);
   g_clear_pointer (&machine->error, g_error_free);
-  g_clear_pointer (&machine->name, g_free);
+  if (machine->name != machine->name_buf)
+    g_free (machine->name);
   fpi_ssm_clear_delayed_action (machine);
-  g_free (machine);
+  ssm_pool_release (machine);
 }
 
 /* Invoke the state handler */
@@ -251,6 +440,7 @@ __ssm_call_handler (FpiSsm *machine, gboolean force_msg)
   if (force_msg || !machine->silence)
     fp_dbg ("[%s] %s entering state %d", fp_device_get_driver (machine->dev),
             machine->name, machine->cur_state);
+  FPI_TRACE (ssm_state, machine, machine->name, machine->cur_state);
   machine->handler (machine, machine->dev);
 }
 
@@ -309,7 +499,7 @@ fpi_ssm_start_subsm (FpiSsm *parent, FpiSsm *child)
   g_return_if_fail (parent != NULL);
   g_return_if_fail (child != NULL);
 
-  BUG_ON (parent->timeout);
+  BUG_ON (parent->timeout_action != SSM_DELAYED_NONE);
   child->parentsm = parent;
 
   fpi_ssm_clear_delayed_action (parent);
@@ -335,7 +525,7 @@ fpi_ssm_mark_completed (FpiSsm *machine)
   g_return_if_fail (machine != NULL);
 
   BUG_ON (machine->completed);
-  BUG_ON (machine->timeout != NULL);
+  BUG_ON (machine->timeout_action != SSM_DELAYED_NONE);
 
   fpi_ssm_clear_delayed_action (machine);
 
@@ -353,6 +543,8 @@ fpi_ssm_mark_completed (FpiSsm *machine)
     }
 
   machine->completed = TRUE;
+  FPI_TRACE (ssm_complete, machine, machine->name, machine->cur_state,
+             FPI_TRACE_ERROR_CODE (machine->error));
 
   if (machine->error)
     fp_dbg ("[%s] %s completed with error: %s", fp_device_get_driver (machine->dev),
@@ -369,16 +561,6 @@ fpi_ssm_mark_completed (FpiSsm *machine)
   fpi_ssm_free (machine);
 }
 
-static void
-on_device_timeout_complete (FpDevice *dev,
-                            gpointer  user_data)
-{
-  FpiSsm *machine = user_data;
-
-  machine->timeout = NULL;
-  fpi_ssm_mark_completed (machine);
-}
-
 /**
  * fpi_ssm_mark_completed_delayed:
  * @machine: an #FpiSsm state machine
@@ -392,18 +574,9 @@ void
 fpi_ssm_mark_completed_delayed (FpiSsm *machine,
                                 int     delay)
 {
-  g_autofree char *source_name = NULL;
-
   g_return_if_fail (machine != NULL);
 
-  fpi_ssm_set_delayed_action_timeout (machine, delay,
-                                      on_device_timeout_complete,
-                                      machine, NULL);
-
-  source_name = g_strdup_printf ("[%s] ssm %s complete %d",
-                                 fp_device_get_device_id (machine->dev),
-                                 machine->name, machine->cur_state + 1);
-  g_source_set_name (machine->timeout, source_name);
+  fpi_ssm_set_delayed_action_timeout (machine, delay, SSM_DELAYED_COMPLETE, 0);
 }
 
 /**
@@ -454,7 +627,7 @@ fpi_ssm_next_state (FpiSsm *machine)
   g_return_if_fail (machine != NULL);
 
   BUG_ON (machine->completed);
-  BUG_ON (machine->timeout != NULL);
+  BUG_ON (machine->timeout_action != SSM_DELAYED_NONE);
 
   fpi_ssm_clear_delayed_action (machine);
 
@@ -470,7 +643,7 @@ fpi_ssm_cancel_delayed_state_change (FpiSsm *machine)
 {
   g_return_if_fail (machine);
   BUG_ON (machine->completed);
-  BUG_ON (machine->timeout == NULL);
+  BUG_ON (machine->timeout_action == SSM_DELAYED_NONE);
 
   fp_dbg ("[%s] %s cancelled delayed state change",
           fp_device_get_driver (machine->dev), machine->name);
@@ -478,16 +651,6 @@ fpi_ssm_cancel_delayed_state_change (FpiSsm *machine)
   fpi_ssm_clear_delayed_action (machine);
 }
 
-static void
-on_device_timeout_next_state (FpDevice *dev,
-                              gpointer  user_data)
-{
-  FpiSsm *machine = user_data;
-
-  machine->timeout = NULL;
-  fpi_ssm_next_state (machine);
-}
-
 /**
  * fpi_ssm_next_state_delayed:
  * @machine: an #FpiSsm state machine
@@ -501,18 +664,9 @@ void
 fpi_ssm_next_state_delayed (FpiSsm *machine,
                             int     delay)
 {
-  g_autofree char *source_name = NULL;
-
   g_return_if_fail (machine != NULL);
 
-  fpi_ssm_set_delayed_action_timeout (machine, delay,
-                                      on_device_timeout_next_state,
-                                      machine, NULL);
-
-  source_name = g_strdup_printf ("[%s] ssm %s jump to next state %d",
-                                 fp_device_get_device_id (machine->dev),
-                                 machine->name, machine->cur_state + 1);
-  g_source_set_name (machine->timeout, source_name);
+  fpi_ssm_set_delayed_action_timeout (machine, delay, SSM_DELAYED_NEXT_STATE, 0);
 }
 
 /**
@@ -531,7 +685,7 @@ fpi_ssm_jump_to_state (FpiSsm *machine, int state)
 
   BUG_ON (machine->completed);
   BUG_ON (state < 0 || state > machine->nr_states);
-  BUG_ON (machine->timeout != NULL);
+  BUG_ON (machine->timeout_action != SSM_DELAYED_NONE);
 
   fpi_ssm_clear_delayed_action (machine);
 
@@ -542,22 +696,6 @@ fpi_ssm_jump_to_state (FpiSsm *machine, int state)
     __ssm_call_handler (machine, FALSE);
 }
 
-typedef struct
-{
-  FpiSsm *machine;
-  int     next_state;
-} FpiSsmJumpToStateDelayedData;
-
-static void
-on_device_timeout_jump_to_state (FpDevice *dev,
-                                 gpointer  user_data)
-{
-  FpiSsmJumpToStateDelayedData *data = user_data;
-
-  data->machine->timeout = NULL;
-  fpi_ssm_jump_to_state (data->machine, data->next_state);
-}
-
 /**
  * fpi_ssm_jump_to_state_delayed:
  * @machine: an #FpiSsm state machine
@@ -572,24 +710,10 @@ fpi_ssm_jump_to_state_delayed (FpiSsm *machine,
                                int     state,
                                int     delay)
 {
-  FpiSsmJumpToStateDelayedData *data;
-  g_autofree char *source_name = NULL;
-
   g_return_if_fail (machine != NULL);
   BUG_ON (state < 0 || state > machine->nr_states);
 
-  data = g_new0 (FpiSsmJumpToStateDelayedData, 1);
-  data->machine = machine;
-  data->next_state = state;
-
-  fpi_ssm_set_delayed_action_timeout (machine, delay,
-                                      on_device_timeout_jump_to_state,
-                                      data, g_free);
-
-  source_name = g_strdup_printf ("[%s] ssm %s jump to state %d",
-                                 fp_device_get_device_id (machine->dev),
-                                 machine->name, state);
-  g_source_set_name (machine->timeout, source_name);
+  fpi_ssm_set_delayed_action_timeout (machine, delay, SSM_DELAYED_JUMP_TO_STATE, state);
 }
 
 /**
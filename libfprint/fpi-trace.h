@@ -0,0 +1,101 @@
+/*
+ * Internal tracing helpers for libfprint
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <config.h>
+#include <glib.h>
+
+/*
+ * Static tracepoints.
+ *
+ * When configured with -Dtracing=enabled, FPI_TRACE() emits a USDT probe in
+ * the "libfprint" provider that can be attached to using e.g. bpftrace,
+ * perf or SystemTap. A disabled probe is a single nop and the arguments are
+ * only copied into registers, i.e. no formatting happens at all. Without the
+ * option the macro expands to nothing and the arguments are not evaluated.
+ *
+ * The following probes exist (all durations are in microseconds):
+ *  - usb_transfer_submit (transfer, endpoint, length)
+ *  - usb_transfer_complete (transfer, endpoint, actual_length, duration, error code)
+ *  - spi_transfer_submit (transfer, write length, read length)
+ *  - spi_transfer_complete (transfer, write length, read length, duration, error code)
+ *  - ssm_state (ssm, ssm name, state)
+ *  - ssm_complete (ssm, ssm name, state, error code)
+ *  - device_action_start (device, action)
+ *  - device_action_complete (device, action, duration, return type)
+ *
+ * Error codes are 0 on success and the GError code otherwise.
+ */
+#ifdef HAVE_SDT
+#include <sys/sdt.h>
+
+#define FPI_TRACE(name, ...) STAP_PROBEV (libfprint, name, ## __VA_ARGS__)
+#else
+#define FPI_TRACE(name, ...) G_STMT_START { } G_STMT_END
+#endif
+
+#define FPI_TRACE_ERROR_CODE(error) ((error) ? (error)->code : 0)
+
+/*
+ * fpi_trace_dump_transfers:
+ *
+ * Whether FP_DEBUG_TRANSFER is set and the transfer content should be
+ * logged. The environment is only queried once.
+ */
+static inline gboolean
+fpi_trace_dump_transfers (void)
+{
+  static gsize dump_transfers = 0;
+
+  if (g_once_init_enter (&dump_transfers))
+    g_once_init_leave (&dump_transfers, g_getenv ("FP_DEBUG_TRANSFER") ? 2 : 1);
+
+  return dump_transfers == 2;
+}
+
+/*
+ * fpi_trace_hexdump:
+ * @buf: The data to dump
+ * @len: The length of @buf
+ *
+ * Log @buf at debug level, 16 bytes per line.
+ */
+static inline void
+fpi_trace_hexdump (const guint8 *buf, gssize len)
+{
+  static const char hex[] = "0123456789abcdef";
+  char line[16 * 3 + 1];
+  gssize i;
+
+  for (i = 0; i < len; i += 16)
+    {
+      gssize j, n = MIN (16, len - i);
+
+      for (j = 0; j < n; j++)
+        {
+          line[j * 3] = hex[buf[i + j] >> 4];
+          line[j * 3 + 1] = hex[buf[i + j] & 0xf];
+          line[j * 3 + 2] = ' ';
+        }
+      line[n * 3] = '\0';
+
+      g_debug ("%s", line);
+    }
+}
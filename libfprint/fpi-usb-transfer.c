@@ -18,6 +18,7 @@
  */
 
 #include "fpi-usb-transfer.h"
+#include "fpi-trace.h"
 
 /**
  * SECTION:fpi-usb-transfer
@@ -38,7 +39,7 @@ G_DEFINE_BOXED_TYPE (FpiUsbTransfer, fpi_usb_transfer, fpi_usb_transfer_ref, fpi
 static void
 log_transfer (FpiUsbTransfer *transfer, gboolean submit, GError *error)
 {
-  if (g_getenv ("FP_DEBUG_TRANSFER"))
+  if (fpi_trace_dump_transfers ())
     {
       if (!submit)
         {
@@ -65,27 +66,25 @@ log_transfer (FpiUsbTransfer *transfer, gboolean submit, GError *error)
 
       if (!submit == !!(transfer->endpoint & FPI_USB_ENDPOINT_IN))
         {
-          g_autoptr(GString) line = NULL;
           gssize dump_len;
 
           dump_len = (transfer->endpoint & FPI_USB_ENDPOINT_IN) ? transfer->actual_length : transfer->length;
-
-          line = g_string_new ("");
-          /* Dump the buffer. */
-          for (gint i = 0; i < dump_len; i++)
-            {
-              g_string_append_printf (line, "%02x ", transfer->buffer[i]);
-              if ((i + 1) % 16 == 0)
-                {
-                  g_debug ("%s", line->str);
-                  g_string_set_size (line, 0);
-                }
-            }
-
-          if (line->len)
-            g_debug ("%s", line->str);
+          fpi_trace_hexdump (transfer->buffer, dump_len);
         }
     }
+
+  if (submit)
+    {
+      transfer->submit_time = g_get_monotonic_time ();
+      FPI_TRACE (usb_transfer_submit, transfer, transfer->endpoint, transfer->length);
+    }
+  else
+    {
+      FPI_TRACE (usb_transfer_complete, transfer, transfer->endpoint,
+                 transfer->actual_length,
+                 g_get_monotonic_time () - transfer->submit_time,
+                 FPI_TRACE_ERROR_CODE (error));
+    }
 }
 
 /**
@@ -211,6 +210,169 @@ fpi_usb_transfer_fill_bulk_full (FpiUsbTransfer *transfer,
   transfer->free_buffer = free_func;
 }
 
+/* Buffers used by fpi_usb_transfer_fill_bulk_pooled() are recycled through a
+ * small per-device pool. Each buffer is preceded by a header pointing back
+ * to the pool, so that it can be returned from a plain GDestroyNotify. */
+#define USB_BUFFER_POOL_MAX_FREE 8
+#define USB_BUFFER_HEADER_SIZE 16
+
+typedef struct
+{
+  guint    ref_count;
+  gboolean closed;
+  GSList  *free_buffers;
+  guint    n_free;
+#ifndef NDEBUG
+  guint    hits;
+  guint    misses;
+#endif
+} FpiUsbBufferPool;
+
+typedef struct
+{
+  FpiUsbBufferPool *pool;
+  gsize             length;
+} FpiUsbPooledBuffer;
+
+G_STATIC_ASSERT (sizeof (FpiUsbPooledBuffer) <= USB_BUFFER_HEADER_SIZE);
+
+static GQuark usb_buffer_pool_quark;
+
+static void
+usb_buffer_pool_unref (FpiUsbBufferPool *pool)
+{
+  if (--pool->ref_count > 0)
+    return;
+
+  g_assert (pool->free_buffers == NULL);
+  g_free (pool);
+}
+
+/* Called when the device is finalized, buffers that are still in use are
+ * freed once they are returned. */
+static void
+usb_buffer_pool_destroy (FpiUsbBufferPool *pool)
+{
+#ifndef NDEBUG
+  g_debug ("USB buffer pool destroyed, %u hits and %u misses", pool->hits, pool->misses);
+#endif
+
+  pool->closed = TRUE;
+  g_slist_free_full (g_steal_pointer (&pool->free_buffers), g_free);
+  pool->n_free = 0;
+  usb_buffer_pool_unref (pool);
+}
+
+static void
+usb_buffer_pool_release (guint8 *buffer)
+{
+  FpiUsbPooledBuffer *header = (FpiUsbPooledBuffer *) (buffer - USB_BUFFER_HEADER_SIZE);
+  FpiUsbBufferPool *pool = header->pool;
+
+  if (!pool->closed && pool->n_free < USB_BUFFER_POOL_MAX_FREE)
+    {
+      pool->free_buffers = g_slist_prepend (pool->free_buffers, header);
+      pool->n_free += 1;
+    }
+  else
+    {
+      g_free (header);
+    }
+
+  usb_buffer_pool_unref (pool);
+}
+
+static guint8 *
+usb_buffer_pool_acquire (FpDevice *device, gsize length, gboolean zero)
+{
+  FpiUsbBufferPool *pool;
+  FpiUsbPooledBuffer *header = NULL;
+  GSList *l;
+
+  if (G_UNLIKELY (usb_buffer_pool_quark == 0))
+    usb_buffer_pool_quark = g_quark_from_static_string ("fpi-usb-buffer-pool");
+
+  pool = g_object_get_qdata (G_OBJECT (device), usb_buffer_pool_quark);
+  if (!pool)
+    {
+      pool = g_new0 (FpiUsbBufferPool, 1);
+      pool->ref_count = 1;
+      g_object_set_qdata_full (G_OBJECT (device), usb_buffer_pool_quark, pool,
+                               (GDestroyNotify) usb_buffer_pool_destroy);
+    }
+
+  for (l = pool->free_buffers; l; l = l->next)
+    {
+      FpiUsbPooledBuffer *free_header = l->data;
+
+      if (free_header->length == length)
+        {
+          header = free_header;
+          pool->free_buffers = g_slist_delete_link (pool->free_buffers, l);
+          pool->n_free -= 1;
+          break;
+        }
+    }
+
+  if (header)
+    {
+#ifndef NDEBUG
+      pool->hits += 1;
+#endif
+      if (zero)
+        memset ((guint8 *) header + USB_BUFFER_HEADER_SIZE, 0, length);
+    }
+  else
+    {
+#ifndef NDEBUG
+      pool->misses += 1;
+#endif
+      if (zero)
+        header = g_malloc0 (USB_BUFFER_HEADER_SIZE + length);
+      else
+        header = g_malloc (USB_BUFFER_HEADER_SIZE + length);
+      header->length = length;
+    }
+
+  header->pool = pool;
+  pool->ref_count += 1;
+
+  return (guint8 *) header + USB_BUFFER_HEADER_SIZE;
+}
+
+/**
+ * fpi_usb_transfer_fill_bulk_pooled:
+ * @transfer: The #FpiUsbTransfer
+ * @endpoint: The endpoint to send the transfer to
+ * @length: The buffer size to use
+ *
+ * Prepare a bulk transfer just like fpi_usb_transfer_fill_bulk(), but use
+ * a buffer from a pool that is kept per device. The buffer is returned to
+ * the pool when the transfer is freed, so drivers that repeatedly read
+ * the same amount of data (e.g. when polling for a finger) do not need to
+ * allocate a new buffer every time.
+ *
+ * Buffers for IN endpoints are not cleared and may contain data from an
+ * earlier transfer beyond @actual_length. Buffers for OUT endpoints are
+ * zeroed.
+ */
+void
+fpi_usb_transfer_fill_bulk_pooled (FpiUsbTransfer *transfer,
+                                   guint8          endpoint,
+                                   gsize           length)
+{
+  guint8 *buffer;
+
+  buffer = usb_buffer_pool_acquire (transfer->device, length,
+                                    !(endpoint & FPI_USB_ENDPOINT_IN));
+
+  fpi_usb_transfer_fill_bulk_full (transfer,
+                                   endpoint,
+                                   buffer,
+                                   length,
+                                   (GDestroyNotify) usb_buffer_pool_release);
+}
+
 /**
  * fpi_usb_transfer_fill_control:
  * @transfer: The #FpiUsbTransfer
@@ -548,3 +710,371 @@ fpi_usb_transfer_submit_sync (FpiUsbTransfer *transfer,
 
   return res;
 }
+
+typedef struct
+{
+  FpiUsbStream   *stream;
+  FpiUsbTransfer *transfer;
+  GList           link;
+  GError         *error;
+  gboolean        completed;
+} FpiUsbStreamSlot;
+
+struct _FpiUsbStream
+{
+  FpDevice                *device;
+  guint                    ref_count;
+
+  FpiUsbStreamSlot        *slots;
+  guint                    n_slots;
+
+  /* Submitted slots, in the order they were submitted in */
+  GQueue                   pending;
+  guint                    n_flying;
+
+  guint                    timeout_ms;
+  GCancellable            *cancellable;
+  GCancellable            *external_cancellable;
+  gulong                   external_cancellable_id;
+
+  gboolean                 active;
+  gboolean                 stopping;
+  gboolean                 dispatching;
+  GError                  *error;
+
+  FpiUsbStreamDataCallback data_callback;
+  FpiUsbStreamDoneCallback done_callback;
+  gpointer                 user_data;
+
+  FpiUsbStreamSubmitFunc   submit_func;
+};
+
+/**
+ * fpi_usb_stream_new:
+ * @device: The #FpDevice the stream is for
+ * @endpoint: The bulk IN endpoint to read from
+ * @length: The length of each transfer
+ * @n_transfers: The number of transfers to keep in flight
+ *
+ * Creates a new #FpiUsbStream. Once started, the stream keeps @n_transfers
+ * bulk transfers queued on @endpoint, so that the device can continue to
+ * send data while earlier transfers are being processed. This is important
+ * for sensors that stream data at a high rate, e.g. swipe sensors, as they
+ * would otherwise drop data if the main loop is busy for a short while.
+ *
+ * The buffers of the transfers are allocated once and recycled for the
+ * lifetime of the stream.
+ *
+ * When running under emulation (i.e. FP_DEVICE_EMULATION is set), only one
+ * transfer is kept in flight, as recorded USB traffic cannot be replayed
+ * otherwise.
+ *
+ * Returns: (transfer full): A newly created #FpiUsbStream
+ */
+FpiUsbStream *
+fpi_usb_stream_new (FpDevice *device,
+                    guint8    endpoint,
+                    gsize     length,
+                    guint     n_transfers)
+{
+  FpiUsbStream *stream;
+  guint i;
+
+  g_return_val_if_fail (device != NULL, NULL);
+  g_return_val_if_fail (endpoint & FPI_USB_ENDPOINT_IN, NULL);
+  g_return_val_if_fail (n_transfers > 0, NULL);
+
+  if (g_strcmp0 (g_getenv ("FP_DEVICE_EMULATION"), "1") == 0)
+    n_transfers = 1;
+
+  stream = g_new0 (FpiUsbStream, 1);
+  stream->ref_count = 1;
+  stream->device = device;
+  stream->n_slots = n_transfers;
+  stream->slots = g_new0 (FpiUsbStreamSlot, n_transfers);
+  stream->submit_func = fpi_usb_transfer_submit;
+  g_queue_init (&stream->pending);
+
+  for (i = 0; i < n_transfers; i++)
+    {
+      FpiUsbStreamSlot *slot = &stream->slots[i];
+
+      slot->stream = stream;
+      slot->link.data = slot;
+      slot->transfer = fpi_usb_transfer_new (device);
+      fpi_usb_transfer_fill_bulk (slot->transfer, endpoint, length);
+    }
+
+  return stream;
+}
+
+/**
+ * fpi_usb_stream_ref:
+ * @stream: A #FpiUsbStream
+ *
+ * Increments the reference count of @stream by one.
+ *
+ * Returns: (transfer full): @stream
+ */
+FpiUsbStream *
+fpi_usb_stream_ref (FpiUsbStream *stream)
+{
+  g_return_val_if_fail (stream, NULL);
+  g_return_val_if_fail (stream->ref_count, NULL);
+
+  g_atomic_int_inc (&stream->ref_count);
+
+  return stream;
+}
+
+/**
+ * fpi_usb_stream_unref:
+ * @stream: A #FpiUsbStream
+ *
+ * Decrements the reference count of @stream by one, freeing the structure
+ * when the reference count reaches zero. Transfers that are in flight keep
+ * a reference, drivers should stop the stream and wait for it to finish
+ * before dropping their reference.
+ */
+void
+fpi_usb_stream_unref (FpiUsbStream *stream)
+{
+  guint i;
+
+  g_return_if_fail (stream);
+  g_return_if_fail (stream->ref_count);
+
+  if (!g_atomic_int_dec_and_test (&stream->ref_count))
+    return;
+
+  g_assert (!stream->active);
+
+  for (i = 0; i < stream->n_slots; i++)
+    fpi_usb_transfer_unref (stream->slots[i].transfer);
+  g_free (stream->slots);
+  g_free (stream);
+}
+
+static void usb_stream_transfer_cb (FpiUsbTransfer *transfer,
+                                    FpDevice       *device,
+                                    gpointer        user_data,
+                                    GError         *error);
+
+static void
+usb_stream_submit (FpiUsbStream *stream, FpiUsbStreamSlot *slot)
+{
+  slot->completed = FALSE;
+  g_queue_push_tail_link (&stream->pending, &slot->link);
+  stream->n_flying += 1;
+
+  /* Every transfer in flight holds a reference on the stream */
+  fpi_usb_stream_ref (stream);
+  stream->submit_func (fpi_usb_transfer_ref (slot->transfer),
+                       stream->timeout_ms,
+                       stream->cancellable,
+                       usb_stream_transfer_cb,
+                       slot);
+}
+
+static void
+usb_stream_maybe_done (FpiUsbStream *stream)
+{
+  FpiUsbStreamDoneCallback done_callback;
+
+  if (!stream->stopping || stream->n_flying > 0 || stream->dispatching)
+    return;
+
+  g_assert (g_queue_is_empty (&stream->pending));
+
+  stream->active = FALSE;
+  stream->stopping = FALSE;
+
+  if (stream->external_cancellable)
+    g_cancellable_disconnect (stream->external_cancellable,
+                              stream->external_cancellable_id);
+  stream->external_cancellable_id = 0;
+  g_clear_object (&stream->external_cancellable);
+  g_clear_object (&stream->cancellable);
+
+  done_callback = stream->done_callback;
+  stream->done_callback = NULL;
+  stream->data_callback = NULL;
+
+  if (done_callback)
+    done_callback (stream, stream->device, stream->user_data,
+                   g_steal_pointer (&stream->error));
+  else
+    g_clear_error (&stream->error);
+}
+
+static void
+usb_stream_transfer_cb (FpiUsbTransfer *transfer,
+                        FpDevice       *device,
+                        gpointer        user_data,
+                        GError         *error)
+{
+  FpiUsbStreamSlot *slot = user_data;
+  g_autoptr(FpiUsbStream) stream = slot->stream;
+
+  stream->n_flying -= 1;
+  slot->completed = TRUE;
+  slot->error = error;
+
+  /* Deliver completed transfers in the order they were submitted in */
+  stream->dispatching = TRUE;
+  while ((slot = g_queue_peek_head (&stream->pending)) && slot->completed)
+    {
+      g_autoptr(GError) slot_error = g_steal_pointer (&slot->error);
+
+      g_queue_unlink (&stream->pending, &slot->link);
+
+      /* Errors of the remaining transfers are irrelevant when stopping */
+      if (stream->stopping)
+        continue;
+
+      if (slot_error)
+        {
+          fpi_usb_stream_stop (stream, g_steal_pointer (&slot_error));
+          continue;
+        }
+
+      stream->data_callback (stream, slot->transfer, device, stream->user_data);
+
+      if (!stream->stopping)
+        usb_stream_submit (stream, slot);
+    }
+  stream->dispatching = FALSE;
+
+  usb_stream_maybe_done (stream);
+}
+
+static void
+usb_stream_cancelled_cb (GCancellable *cancellable, FpiUsbStream *stream)
+{
+  g_cancellable_cancel (stream->cancellable);
+}
+
+/**
+ * fpi_usb_stream_start:
+ * @stream: A #FpiUsbStream
+ * @timeout_ms: Timeout for each transfer in ms
+ * @cancellable: (nullable): Cancellable to stop the stream with, e.g.
+ *   fpi_device_get_cancellable()
+ * @data_callback: Callback for each transfer that completed successfully
+ * @done_callback: Callback once the stream has stopped
+ * @user_data: Data to pass to the callbacks
+ *
+ * Submits all transfers of @stream. The @data_callback is invoked for every
+ * successfully completed transfer, in the order the transfers were submitted
+ * in. The transfer is resubmitted after the callback returns unless the
+ * stream was stopped from within the callback.
+ *
+ * The stream stops if fpi_usb_stream_stop() is called, if a transfer fails
+ * or if @cancellable is cancelled. The @done_callback is invoked once all
+ * transfers have returned, with the error that caused the stream to stop.
+ */
+void
+fpi_usb_stream_start (FpiUsbStream            *stream,
+                      guint                    timeout_ms,
+                      GCancellable            *cancellable,
+                      FpiUsbStreamDataCallback data_callback,
+                      FpiUsbStreamDoneCallback done_callback,
+                      gpointer                 user_data)
+{
+  guint i;
+
+  g_return_if_fail (stream);
+  g_return_if_fail (data_callback);
+  g_return_if_fail (done_callback);
+  g_return_if_fail (!stream->active);
+
+  stream->active = TRUE;
+  stream->timeout_ms = timeout_ms;
+  stream->data_callback = data_callback;
+  stream->done_callback = done_callback;
+  stream->user_data = user_data;
+  stream->cancellable = g_cancellable_new ();
+
+  if (cancellable)
+    {
+      stream->external_cancellable = g_object_ref (cancellable);
+      stream->external_cancellable_id =
+        g_cancellable_connect (cancellable,
+                               G_CALLBACK (usb_stream_cancelled_cb),
+                               stream, NULL);
+    }
+
+  for (i = 0; i < stream->n_slots; i++)
+    usb_stream_submit (stream, &stream->slots[i]);
+}
+
+/**
+ * fpi_usb_stream_stop:
+ * @stream: A #FpiUsbStream
+ * @error: (transfer full) (nullable): The error to report, or %NULL
+ *
+ * Stops @stream by cancelling all transfers that are in flight. No further
+ * data is delivered and the done callback is invoked with @error once all
+ * transfers have returned.
+ *
+ * Does nothing if the stream is not running or already stopping.
+ */
+void
+fpi_usb_stream_stop (FpiUsbStream *stream,
+                     GError       *error)
+{
+  g_autoptr(FpiUsbStream) ref = NULL;
+
+  g_return_if_fail (stream);
+
+  if (!stream->active || stream->stopping)
+    {
+      g_clear_error (&error);
+      return;
+    }
+
+  stream->stopping = TRUE;
+  stream->error = error;
+  g_cancellable_cancel (stream->cancellable);
+
+  ref = fpi_usb_stream_ref (stream);
+  usb_stream_maybe_done (stream);
+}
+
+/**
+ * fpi_usb_stream_is_active:
+ * @stream: A #FpiUsbStream
+ *
+ * Whether @stream is running, this includes the time until the done
+ * callback is invoked after it was stopped.
+ *
+ * Returns: %TRUE if @stream is running
+ */
+gboolean
+fpi_usb_stream_is_active (FpiUsbStream *stream)
+{
+  g_return_val_if_fail (stream, FALSE);
+
+  return stream->active;
+}
+
+/**
+ * fpi_usb_stream_set_submit_func:
+ * @stream: A #FpiUsbStream
+ * @submit_func: The function to submit transfers with
+ *
+ * Replaces fpi_usb_transfer_submit() as the function used to submit the
+ * transfers of @stream. @submit_func takes ownership of the transfer and
+ * must invoke the callback exactly once. This is only meant to be used by
+ * unit tests, which run without a USB device.
+ */
+void
+fpi_usb_stream_set_submit_func (FpiUsbStream          *stream,
+                                FpiUsbStreamSubmitFunc submit_func)
+{
+  g_return_if_fail (stream);
+  g_return_if_fail (submit_func);
+  g_return_if_fail (!stream->active);
+
+  stream->submit_func = submit_func;
+}
@@ -81,6 +81,9 @@ struct _FpiUsbTransfer
   /*< private >*/
   guint ref_count;
 
+  /* Submission time for tracing */
+  gint64 submit_time;
+
   /* USB Transfer information */
   FpiTransferType type;
   guint8          endpoint;
@@ -116,6 +119,10 @@ void               fpi_usb_transfer_fill_bulk (FpiUsbTransfer *transfer,
                                                guint8          endpoint,
                                                gsize           length);
 
+void               fpi_usb_transfer_fill_bulk_pooled (FpiUsbTransfer *transfer,
+                                                      guint8          endpoint,
+                                                      gsize           length);
+
 FP_GNUC_ACCESS (read_only, 3, 4)
 void               fpi_usb_transfer_fill_bulk_full (FpiUsbTransfer *transfer,
                                                     guint8          endpoint,
@@ -153,7 +160,51 @@ gboolean           fpi_usb_transfer_submit_sync (FpiUsbTransfer *transfer,
                                                  guint           timeout_ms,
                                                  GError        **error);
 
+/**
+ * FpiUsbStream:
+ *
+ * Helper to continuously read from a bulk IN endpoint using multiple
+ * transfers that are in flight at the same time.
+ * See fpi_usb_stream_new().
+ */
+typedef struct _FpiUsbStream FpiUsbStream;
+
+typedef void (*FpiUsbStreamDataCallback)(FpiUsbStream   *stream,
+                                         FpiUsbTransfer *transfer,
+                                         FpDevice       *dev,
+                                         gpointer        user_data);
+
+typedef void (*FpiUsbStreamDoneCallback)(FpiUsbStream *stream,
+                                         FpDevice     *dev,
+                                         gpointer      user_data,
+                                         GError       *error);
+
+typedef void (*FpiUsbStreamSubmitFunc)(FpiUsbTransfer        *transfer,
+                                       guint                  timeout_ms,
+                                       GCancellable          *cancellable,
+                                       FpiUsbTransferCallback callback,
+                                       gpointer               user_data);
+
+FpiUsbStream       *fpi_usb_stream_new (FpDevice *device,
+                                        guint8    endpoint,
+                                        gsize     length,
+                                        guint     n_transfers);
+FpiUsbStream       *fpi_usb_stream_ref (FpiUsbStream *stream);
+void               fpi_usb_stream_unref (FpiUsbStream *stream);
+
+void               fpi_usb_stream_start (FpiUsbStream            *stream,
+                                         guint                    timeout_ms,
+                                         GCancellable            *cancellable,
+                                         FpiUsbStreamDataCallback data_callback,
+                                         FpiUsbStreamDoneCallback done_callback,
+                                         gpointer                 user_data);
+void               fpi_usb_stream_stop (FpiUsbStream *stream,
+                                        GError       *error);
+gboolean           fpi_usb_stream_is_active (FpiUsbStream *stream);
+void               fpi_usb_stream_set_submit_func (FpiUsbStream          *stream,
+                                                   FpiUsbStreamSubmitFunc submit_func);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (FpiUsbTransfer, fpi_usb_transfer_unref)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FpiUsbStream, fpi_usb_stream_unref)
 
 G_END_DECLS
@@ -0,0 +1,162 @@
+/*
+ * Generate the static driver ID lookup table used by FpContext
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <config.h>
+
+#include "fpi-context.h"
+#include "fpi-device.h"
+
+/* This tool runs at build time and is linked against the drivers and the
+ * device classes (but not FpContext). It writes out the ID tables of all
+ * enabled drivers so that FpContext can match hardware against them without
+ * initializing every driver class.
+ *
+ * Drivers are referenced by their index in fpi_get_driver_types(), which
+ * is generated from the same driver list.
+ */
+
+typedef struct
+{
+  guint            driver;
+  guint            position;
+  const FpIdEntry *entry;
+} UsbId;
+
+static int
+usb_id_compare (gconstpointer p1, gconstpointer p2)
+{
+  const UsbId *a = p1;
+  const UsbId *b = p2;
+
+  if (a->entry->vid != b->entry->vid)
+    return a->entry->vid < b->entry->vid ? -1 : 1;
+  if (a->entry->pid != b->entry->pid)
+    return a->entry->pid < b->entry->pid ? -1 : 1;
+  /* Keep the driver order for devices supported by multiple drivers */
+  if (a->driver != b->driver)
+    return a->driver < b->driver ? -1 : 1;
+
+  return (gint) a->position - (gint) b->position;
+}
+
+static void
+print_string (const gchar *str)
+{
+  g_autofree gchar *escaped = NULL;
+
+  if (!str)
+    {
+      g_print ("NULL");
+      return;
+    }
+
+  escaped = g_strescape (str, NULL);
+  g_print ("\"%s\"", escaped);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_autoptr(GArray) drivers = fpi_get_driver_types ();
+  g_autoptr(GArray) usb_ids = g_array_new (FALSE, FALSE, sizeof (UsbId));
+  g_autofree char *program_name = NULL;
+  guint n_ids = 0;
+  guint i;
+
+  program_name = g_path_get_basename (argv[0]);
+
+  g_print ("/* This file has been generated using %s, do not edit */\n\n", program_name);
+  g_print ("#include \"fpi-context.h\"\n\n");
+
+  g_print ("const gchar * const fpi_driver_names[] = {\n");
+  for (i = 0; i < drivers->len; i++)
+    {
+      g_autoptr(FpDeviceClass) cls = g_type_class_ref (g_array_index (drivers, GType, i));
+
+      g_print ("  ");
+      print_string (cls->id);
+      g_print (",\n");
+    }
+  g_print ("  NULL,\n};\n\n");
+
+  g_print ("const FpiDriverIdEntry fpi_driver_ids[] = {\n");
+  for (i = 0; i < drivers->len; i++)
+    {
+      g_autoptr(FpDeviceClass) cls = g_type_class_ref (g_array_index (drivers, GType, i));
+      const FpIdEntry *entry;
+      guint position = 0;
+
+      switch (cls->type)
+        {
+        case FP_DEVICE_TYPE_USB:
+          for (entry = cls->id_table; entry->pid; entry++)
+            {
+              UsbId id = { i, position++, entry };
+
+              g_array_append_val (usb_ids, id);
+            }
+          break;
+
+        case FP_DEVICE_TYPE_VIRTUAL:
+          for (entry = cls->id_table; entry->pid; entry++)
+            {
+              g_print ("  { .driver = %u, .type = FP_DEVICE_TYPE_VIRTUAL, .virtual_envvar = ", i);
+              print_string (entry->virtual_envvar);
+              g_print (", .driver_data = G_GUINT64_CONSTANT (0x%" G_GINT64_MODIFIER "x) },\n",
+                       entry->driver_data);
+              n_ids++;
+            }
+          break;
+
+        case FP_DEVICE_TYPE_UDEV:
+          for (entry = cls->id_table; entry->udev_types; entry++)
+            {
+              g_print ("  { .driver = %u, .type = FP_DEVICE_TYPE_UDEV, .udev_types = 0x%x, .spi_acpi_id = ",
+                       i, entry->udev_types);
+              print_string (entry->udev_types & FPI_DEVICE_UDEV_SUBTYPE_SPIDEV ? entry->spi_acpi_id : NULL);
+              if (entry->udev_types & FPI_DEVICE_UDEV_SUBTYPE_HIDRAW)
+                g_print (", .vid = 0x%04x, .pid = 0x%04x", entry->hid_id.vid, entry->hid_id.pid);
+              g_print (", .driver_data = G_GUINT64_CONSTANT (0x%" G_GINT64_MODIFIER "x) },\n",
+                       entry->driver_data);
+              n_ids++;
+            }
+          break;
+        }
+    }
+  /* Terminator, this also avoids emitting an empty array */
+  g_print ("  { 0 },\n};\n\n");
+  g_print ("const guint fpi_driver_ids_len = %u;\n\n", n_ids);
+
+  /* Sorted by VID/PID so that FpContext can do a binary search */
+  g_array_sort (usb_ids, usb_id_compare);
+
+  g_print ("const FpiDriverIdEntry fpi_driver_usb_ids[] = {\n");
+  for (i = 0; i < usb_ids->len; i++)
+    {
+      UsbId *id = &g_array_index (usb_ids, UsbId, i);
+
+      g_print ("  { .driver = %u, .type = FP_DEVICE_TYPE_USB, .vid = 0x%04x, .pid = 0x%04x, "
+               ".driver_data = G_GUINT64_CONSTANT (0x%" G_GINT64_MODIFIER "x) },\n",
+               id->driver, id->entry->vid, id->entry->pid, id->entry->driver_data);
+    }
+  g_print ("  { 0 },\n};\n\n");
+  g_print ("const guint fpi_driver_usb_ids_len = %u;\n", usb_ids->len);
+
+  return 0;
+}
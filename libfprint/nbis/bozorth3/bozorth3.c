@@ -87,6 +87,8 @@ void bz_comp(
 	int xcol[     MAX_BOZORTH_MINUTIAE ],	/* INPUT: x cordinates */
 	int ycol[     MAX_BOZORTH_MINUTIAE ],	/* INPUT: y cordinates */
 	int thetacol[ MAX_BOZORTH_MINUTIAE ],	/* INPUT: theta values */
+	int qualitycol[ MAX_BOZORTH_MINUTIAE ],	/* INPUT: quality values */
+	int min_quality,			/* INPUT: minimum quality of both points of an edge */
 
 	int * ncomparisons,			/* OUTPUT: number of pointwise comparisons */
 	int cols[][ COLS_SIZE_2 ],		/* OUTPUT: pointwise comparison table */
@@ -118,8 +120,13 @@ c = &cols[0][0];
 
 table_index = 0;
 for ( k = 0; k < npoints - 1; k++ ) {
+	if ( qualitycol[k] < min_quality )
+		continue;
+
 	for ( j = k + 1; j < npoints; j++ ) {
 
+		if ( qualitycol[j] < min_quality )
+			continue;
 
 		if ( thetacol[j] > 0 ) {
 
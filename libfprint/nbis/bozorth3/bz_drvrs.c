@@ -78,7 +78,7 @@ of the software.
 
 /**************************************************************************/
 
-int bozorth_probe_init( struct xyt_struct * pstruct )
+int bozorth_probe_init( struct xyt_struct * pstruct, int min_quality )
 {
 int sim;	/* number of pointwise comparisons for Subject's record*/
 int msim;	/* Pruned length of Subject's comparison pointer list */
@@ -92,6 +92,8 @@ bz_comp(
 	pstruct->xcol,
 	pstruct->ycol,
 	pstruct->thetacol,
+	pstruct->qualitycol,
+	min_quality,
 	&sim,
 	scols,
 	scolpt );
@@ -116,7 +118,7 @@ return msim;
 
 /**************************************************************************/
 
-int bozorth_gallery_init( struct xyt_struct * gstruct )
+int bozorth_gallery_init( struct xyt_struct * gstruct, int min_quality )
 {
 int fim;	/* number of pointwise comparisons for On-File record*/
 int mfim;	/* Pruned length of On-File Record's pointer list */
@@ -129,6 +131,8 @@ bz_comp(
 	gstruct->xcol,
 	gstruct->ycol,
 	gstruct->thetacol,
+	gstruct->qualitycol,
+	min_quality,
 	&fim,
 	fcols,
 	fcolpt );
@@ -156,13 +160,14 @@ return mfim;
 int bozorth_to_gallery(
 		int probe_len,
 		struct xyt_struct * pstruct,
-		struct xyt_struct * gstruct
+		struct xyt_struct * gstruct,
+		int min_quality
 		)
 {
 int np;
 int gallery_len;
 
-gallery_len = bozorth_gallery_init( gstruct );
+gallery_len = bozorth_gallery_init( gstruct, min_quality );
 np = bz_match( probe_len, gallery_len );
 return bz_match_score( np, pstruct, gstruct );
 }
@@ -192,6 +192,7 @@ struct xyt_struct {
 	int xcol[     MAX_BOZORTH_MINUTIAE ];
 	int ycol[     MAX_BOZORTH_MINUTIAE ];
 	int thetacol[ MAX_BOZORTH_MINUTIAE ];
+	int qualitycol[ MAX_BOZORTH_MINUTIAE ];
 };
 
 struct xytq_struct {
@@ -252,13 +253,13 @@ extern int bz_y[20000];
 /* ROUTINE PROTOTYPES */
 /**************************************************************************/
 /* In: BZ_DRVRS.C */
-extern int bozorth_probe_init( struct xyt_struct *);
-extern int bozorth_gallery_init( struct xyt_struct *);
-extern int bozorth_to_gallery(int, struct xyt_struct *, struct xyt_struct *);
+extern int bozorth_probe_init( struct xyt_struct *, int);
+extern int bozorth_gallery_init( struct xyt_struct *, int);
+extern int bozorth_to_gallery(int, struct xyt_struct *, struct xyt_struct *, int);
 extern int bozorth_main(struct xyt_struct *, struct xyt_struct *);
 /* In: BOZORTH3.C */
-extern void bz_comp(int, int [], int [], int [], int *, int [][COLS_SIZE_2],
-                    int *[]);
+extern void bz_comp(int, int [], int [], int [], int [], int, int *,
+                    int [][COLS_SIZE_2], int *[]);
 extern void bz_find(int *, int *[]);
 extern int bz_match(int, int);
 extern int bz_match_score(int, struct xyt_struct *, struct xyt_struct *);
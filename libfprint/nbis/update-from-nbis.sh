@@ -198,3 +198,7 @@ patch -p0 < fix-scan-build-reports.patch
 
 # Add pass to remove perimeter points
 patch -p0 < remove-perimeter-pts.patch
+
+# Add a quality column to struct xyt_struct that allows skipping edges
+# between low quality minutiae while matching
+patch -p0 < minutia-quality.patch
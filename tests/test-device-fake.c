@@ -56,6 +56,7 @@ fpi_device_fake_open (FpDevice *device)
   FpiDeviceFake *fake_dev = FPI_DEVICE_FAKE (device);
 
   fake_dev->last_called_function = fpi_device_fake_open;
+  fake_dev->last_called_context = g_main_context_get_thread_default ();
   g_assert_cmpuint (fpi_device_get_current_action (device), ==, FPI_DEVICE_ACTION_OPEN);
 
   if (fake_dev->return_action_error)
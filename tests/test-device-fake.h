@@ -30,6 +30,7 @@ struct _FpiDeviceFake
   FpDevice        parent;
 
   gpointer        last_called_function;
+  GMainContext   *last_called_context;
   gboolean        return_action_error;
 
   GCancellable   *ext_cancellable;
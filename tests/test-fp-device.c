@@ -232,6 +232,44 @@ test_device_has_storage (void)
   G_GNUC_END_IGNORE_DEPRECATIONS
 }
 
+static void
+test_device_statistics (void)
+{
+  g_autoptr(FptContext) tctx = fpt_context_new_with_virtual_device (FPT_VIRTUAL_DEVICE_IMAGE);
+  g_autoptr(GVariant) stats = NULL;
+  g_autoptr(GVariant) open_stats = NULL;
+  g_autoptr(GVariant) close_stats = NULL;
+  guint64 count, min, max, p50;
+
+  stats = fp_device_get_statistics (tctx->device);
+  g_assert_cmpuint (g_variant_n_children (stats), ==, 0);
+  g_clear_pointer (&stats, g_variant_unref);
+
+  fp_device_open_sync (tctx->device, NULL, NULL);
+  fp_device_close_sync (tctx->device, NULL, NULL);
+  fp_device_open_sync (tctx->device, NULL, NULL);
+
+  stats = fp_device_get_statistics (tctx->device);
+  g_assert_true (g_variant_is_of_type (stats, G_VARIANT_TYPE_VARDICT));
+
+  open_stats = g_variant_lookup_value (stats, "action-open", G_VARIANT_TYPE_VARDICT);
+  g_assert_nonnull (open_stats);
+  g_assert_true (g_variant_lookup (open_stats, "count", "t", &count));
+  g_assert_true (g_variant_lookup (open_stats, "min", "t", &min));
+  g_assert_true (g_variant_lookup (open_stats, "max", "t", &max));
+  g_assert_true (g_variant_lookup (open_stats, "p50", "t", &p50));
+  g_assert_cmpuint (count, ==, 2);
+  g_assert_cmpuint (min, <=, p50);
+  g_assert_cmpuint (p50, <=, max);
+  close_stats = g_variant_lookup_value (stats, "action-close", G_VARIANT_TYPE_VARDICT);
+  g_assert_nonnull (close_stats);
+  g_clear_pointer (&stats, g_variant_unref);
+
+  fp_device_reset_statistics (tctx->device);
+  stats = fp_device_get_statistics (tctx->device);
+  g_assert_cmpuint (g_variant_n_children (stats), ==, 0);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -252,6 +290,7 @@ main (int argc, char *argv[])
   g_test_add_func ("/device/sync/supports_identify", test_device_supports_identify);
   g_test_add_func ("/device/sync/supports_capture", test_device_supports_capture);
   g_test_add_func ("/device/sync/has_storage", test_device_has_storage);
+  g_test_add_func ("/device/sync/statistics", test_device_statistics);
 
   return g_test_run ();
 }
@@ -0,0 +1,447 @@
+/*
+ * Unit tests for libfprint
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <libfprint/fprint.h>
+
+#include "fp-print-private.h"
+
+#include <math.h>
+
+#define TEST_MINUTIAE 40
+
+/* Simple LCG so that the generated minutiae are stable between runs */
+static guint
+test_random (guint *state)
+{
+  *state = *state * 1103515245u + 12345u;
+  return (*state >> 16) & 0x7fff;
+}
+
+static FpPrint *
+test_print_new_nbis (guint seed, gint dx, gint dy)
+{
+  FpPrint *print;
+  struct xyt_struct *xyt;
+  guint state = seed;
+  gint i;
+
+  print = g_object_new (FP_TYPE_PRINT,
+                        "driver", "test",
+                        "device-id", "0",
+                        NULL);
+  g_object_ref_sink (print);
+  fpi_print_set_type (print, FPI_PRINT_NBIS);
+
+  xyt = g_new0 (struct xyt_struct, 1);
+  xyt->nrows = TEST_MINUTIAE;
+  for (i = 0; i < TEST_MINUTIAE; i++)
+    {
+      xyt->xcol[i] = test_random (&state) % 256 + dx;
+      xyt->ycol[i] = test_random (&state) % 360 + dy;
+      xyt->thetacol[i] = (gint) (test_random (&state) % 360) - 179;
+      xyt->qualitycol[i] = 10 + test_random (&state) % 90;
+    }
+  g_ptr_array_add (print->prints, xyt);
+
+  return print;
+}
+
+static void
+test_print_match (void)
+{
+  g_autoptr(FpPrint) print = test_print_new_nbis (1, 0, 0);
+  g_autoptr(FpPrint) shifted = test_print_new_nbis (1, 7, -4);
+  g_autoptr(FpPrint) other = test_print_new_nbis (101, 0, 0);
+  g_autoptr(GError) error = NULL;
+  gint score = -1;
+
+  g_assert_true (fp_print_match (print, shifted, &score, &error));
+  g_assert_no_error (error);
+  g_assert_cmpint (score, >=, BOZORTH3_DEFAULT_THRESHOLD);
+
+  g_assert_false (fp_print_match (print, other, &score, &error));
+  g_assert_no_error (error);
+  g_assert_cmpint (score, <, BOZORTH3_DEFAULT_THRESHOLD);
+}
+
+static void
+test_print_match_min_quality (void)
+{
+  g_autoptr(FpPrint) print = test_print_new_nbis (1, 0, 0);
+  struct xyt_struct *xyt = g_ptr_array_index (print->prints, 0);
+  gint i;
+
+  g_assert_cmpint (fpi_print_bz3_score (print, print, 0, 0), >=, BOZORTH3_DEFAULT_THRESHOLD);
+
+  /* No edges remain if every minutia is below the minimum quality */
+  for (i = 0; i < xyt->nrows; i++)
+    xyt->qualitycol[i] = 10;
+  g_assert_cmpint (fpi_print_bz3_score (print, print, 50, 0), ==, 0);
+}
+
+static void
+test_print_match_cache (void)
+{
+  g_autoptr(FpPrint) print = test_print_new_nbis (1, 0, 0);
+  g_autoptr(FpPrint) shifted = test_print_new_nbis (1, 7, -4);
+  g_autoptr(FpPrint) other = test_print_new_nbis (101, 0, 0);
+  gint score, impostor_score;
+
+  fpi_print_set_bz3_cache_size (0);
+  score = fpi_print_bz3_score (print, shifted, 0, 0);
+  impostor_score = fpi_print_bz3_score (other, shifted, 0, 0);
+
+  /* Cached edge tables give the same result, also after being evicted */
+  fpi_print_set_bz3_cache_size (1024 * 1024);
+  g_assert_cmpint (fpi_print_bz3_score (print, shifted, 0, 0), ==, score);
+  g_assert_cmpint (fpi_print_bz3_score (other, shifted, 0, 0), ==, impostor_score);
+  g_assert_cmpint (fpi_print_bz3_score (print, shifted, 0, 0), ==, score);
+  g_assert_cmpint (fpi_print_bz3_score (other, shifted, 0, 0), ==, impostor_score);
+
+  fp_print_set_match_cache_size (1);
+  g_assert_cmpint (fpi_print_bz3_score (print, shifted, 0, 0), ==, score);
+  g_assert_cmpint (fpi_print_bz3_score (other, shifted, 0, 0), ==, impostor_score);
+
+  /* Back to the default budget */
+  fp_print_set_match_cache_size (4 * 1024 * 1024);
+}
+
+static void
+test_print_match_raw (void)
+{
+  g_autoptr(FpPrint) print = test_print_new_nbis (1, 0, 0);
+  g_autoptr(FpPrint) raw = NULL;
+  g_autoptr(GError) error = NULL;
+
+  raw = g_object_new (FP_TYPE_PRINT,
+                      "fpi-type", FPI_PRINT_RAW,
+                      "driver", "test",
+                      "device-id", "0",
+                      "fpi-data", g_variant_new_int32 (0),
+                      NULL);
+  g_object_ref_sink (raw);
+
+  g_assert_false (fp_print_match (print, raw, NULL, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED);
+}
+
+static void
+test_print_add_from_image_pruned (void)
+{
+  g_autoptr(FpPrint) print = NULL;
+  g_autoptr(FpImage) image = fp_image_new (256, 256);
+  g_autoptr(GError) error = NULL;
+  struct xyt_struct *xyt;
+  gint i;
+
+  print = g_object_new (FP_TYPE_PRINT,
+                        "driver", "test",
+                        "device-id", "0",
+                        NULL);
+  g_object_ref_sink (print);
+  fpi_print_set_type (print, FPI_PRINT_NBIS);
+
+  /* Reliability increases with the x coordinate, and the minutiae are
+   * added in reverse order of their reliability. */
+  image->minutiae = g_ptr_array_new_with_free_func ((GDestroyNotify) free_minutia);
+  for (i = 59; i >= 0; i--)
+    {
+      struct fp_minutia *minutia = g_new0 (struct fp_minutia, 1);
+
+      minutia->x = i * 4;
+      minutia->y = 128;
+      minutia->reliability = i / 60.0;
+      g_ptr_array_add (image->minutiae, minutia);
+    }
+
+  g_assert_true (fpi_print_add_from_image_full (print, image, 20, &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (print->prints->len, ==, 1);
+
+  /* Only the most reliable minutiae are kept, sorted by position */
+  xyt = g_ptr_array_index (print->prints, 0);
+  g_assert_cmpint (xyt->nrows, ==, 20);
+  for (i = 0; i < xyt->nrows; i++)
+    g_assert_cmpint (xyt->xcol[i], ==, (40 + i) * 4);
+}
+
+static void
+test_print_fuse (void)
+{
+  g_autoptr(FpPrint) print = test_print_new_nbis (1, 0, 0);
+  g_autoptr(FpPrint) shifted = test_print_new_nbis (1, 7, -4);
+  g_autoptr(FpPrint) rotated = test_print_new_nbis (1, 0, 0);
+  g_autoptr(FpPrint) other = test_print_new_nbis (101, 0, 0);
+  struct xyt_struct *xyt;
+  gint i;
+
+  /* Rotate by 10 degrees around the origin */
+  xyt = g_ptr_array_index (rotated->prints, 0);
+  for (i = 0; i < xyt->nrows; i++)
+    {
+      gint x = xyt->xcol[i];
+      gint y = xyt->ycol[i];
+
+      xyt->xcol[i] = round (x * cos (G_PI / 18) - y * sin (G_PI / 18));
+      xyt->ycol[i] = round (x * sin (G_PI / 18) + y * cos (G_PI / 18));
+      xyt->thetacol[i] = xyt->thetacol[i] + 10 > 180 ? xyt->thetacol[i] - 350 : xyt->thetacol[i] + 10;
+    }
+
+  fpi_print_add_print (print, shifted);
+  fpi_print_add_print (print, other);
+  fpi_print_add_print (print, rotated);
+  g_assert_cmpuint (print->prints->len, ==, 4);
+
+  /* The impostor print cannot be aligned and is kept */
+  g_assert_true (fpi_print_fuse (print, 4, BOZORTH3_DEFAULT_THRESHOLD, FALSE));
+  g_assert_cmpuint (print->prints->len, ==, 2);
+
+  /* All minutiae of the aligned stages correspond to each other */
+  xyt = g_ptr_array_index (print->prints, 0);
+  g_assert_cmpint (xyt->nrows, ==, TEST_MINUTIAE);
+  for (i = 1; i < xyt->nrows; i++)
+    g_assert_cmpint (xyt->xcol[i - 1], <=, xyt->xcol[i]);
+
+  /* The fused print on its own still matches */
+  g_ptr_array_remove_index (print->prints, 1);
+  g_assert_cmpint (fpi_print_bz3_score (print, shifted, 0, 0), >=, BOZORTH3_DEFAULT_THRESHOLD);
+  g_assert_cmpint (fpi_print_bz3_score (print, other, 0, 0), <, BOZORTH3_DEFAULT_THRESHOLD);
+}
+
+static void
+test_print_fuse_keep_stages (void)
+{
+  g_autoptr(FpPrint) print = test_print_new_nbis (1, 0, 0);
+  g_autoptr(FpPrint) template = test_print_new_nbis (1, 0, 0);
+  g_autoptr(FpPrint) shifted = test_print_new_nbis (1, 7, -4);
+
+  /* Only the given number of prints at the end is fused */
+  fpi_print_add_print (template, print);
+  fpi_print_add_print (template, shifted);
+  g_assert_true (fpi_print_fuse (template, 2, BOZORTH3_DEFAULT_THRESHOLD, TRUE));
+  g_assert_cmpuint (template->prints->len, ==, 4);
+
+  /* A single stage is never fused */
+  g_assert_false (fpi_print_fuse (print, 1, BOZORTH3_DEFAULT_THRESHOLD, TRUE));
+  g_assert_cmpuint (print->prints->len, ==, 1);
+}
+
+static void
+test_print_serialize_nbis (void)
+{
+  g_autoptr(FpPrint) print = test_print_new_nbis (1, 0, 0);
+  g_autoptr(FpPrint) result = NULL;
+  g_autoptr(GDate) date = g_date_new_dmy (1, G_DATE_JANUARY, 2020);
+  g_autoptr(GError) error = NULL;
+  g_autofree guchar *data = NULL;
+  gsize length;
+
+  fp_print_set_enroll_date (print, date);
+
+  g_assert_true (fp_print_serialize (print, &data, &length, &error));
+  g_assert_no_error (error);
+
+  result = fp_print_deserialize (data, length, &error);
+  g_assert_no_error (error);
+  g_assert_true (fp_print_equal (print, result));
+}
+
+static void
+test_print_deserialize_nbis_without_quality (void)
+{
+  g_autoptr(FpPrint) print = test_print_new_nbis (1, 0, 0);
+  g_autoptr(FpPrint) result = NULL;
+  g_autoptr(GVariant) value = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree guchar *data = NULL;
+  struct xyt_struct *xyt = g_ptr_array_index (print->prints, 0);
+  struct xyt_struct *result_xyt;
+  GVariantBuilder nested = G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE ("(a(aiaiai))"));
+  gsize length;
+  gint i;
+
+  /* Serialize the print in the format used before qualities were stored */
+  g_variant_builder_open (&nested, G_VARIANT_TYPE ("a(aiaiai)"));
+  g_variant_builder_add_value (&nested,
+                               g_variant_new ("(@ai@ai@ai)",
+                                              g_variant_new_fixed_array (G_VARIANT_TYPE_INT32,
+                                                                         xyt->xcol, xyt->nrows,
+                                                                         sizeof (gint32)),
+                                              g_variant_new_fixed_array (G_VARIANT_TYPE_INT32,
+                                                                         xyt->ycol, xyt->nrows,
+                                                                         sizeof (gint32)),
+                                              g_variant_new_fixed_array (G_VARIANT_TYPE_INT32,
+                                                                         xyt->thetacol, xyt->nrows,
+                                                                         sizeof (gint32))));
+  g_variant_builder_close (&nested);
+
+  value = g_variant_new ("(issbymsmsi@a{sv}v)",
+                         FPI_PRINT_NBIS, "test", "0", FALSE,
+                         FP_FINGER_LEFT_THUMB, NULL, NULL, 737425,
+                         g_variant_new_array (G_VARIANT_TYPE ("{sv}"), NULL, 0),
+                         g_variant_builder_end (&nested));
+  g_variant_ref_sink (value);
+
+  if (G_BYTE_ORDER == G_BIG_ENDIAN)
+    {
+      GVariant *tmp = g_variant_byteswap (value);
+      g_variant_unref (value);
+      value = tmp;
+    }
+
+  length = g_variant_get_size (value) + 3;
+  data = g_malloc (length);
+  memcpy (data, "FP3", 3);
+  g_variant_store (value, data + 3);
+
+  result = fp_print_deserialize (data, length, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (result->prints->len, ==, 1);
+
+  result_xyt = g_ptr_array_index (result->prints, 0);
+  g_assert_cmpint (result_xyt->nrows, ==, xyt->nrows);
+  for (i = 0; i < xyt->nrows; i++)
+    {
+      g_assert_cmpint (result_xyt->xcol[i], ==, xyt->xcol[i]);
+      g_assert_cmpint (result_xyt->ycol[i], ==, xyt->ycol[i]);
+      g_assert_cmpint (result_xyt->thetacol[i], ==, xyt->thetacol[i]);
+      g_assert_cmpint (result_xyt->qualitycol[i], ==, 100);
+    }
+}
+
+static GPtrArray *
+test_gallery_new (void)
+{
+  GPtrArray *gallery = g_ptr_array_new_with_free_func (g_object_unref);
+
+  g_ptr_array_add (gallery, test_print_new_nbis (101, 0, 0));
+  g_ptr_array_add (gallery, test_print_new_nbis (1, 0, 0));
+  g_ptr_array_add (gallery, test_print_new_nbis (102, 0, 0));
+
+  return gallery;
+}
+
+static void
+test_print_identify (void)
+{
+  g_autoptr(GPtrArray) gallery = test_gallery_new ();
+  g_autoptr(FpPrint) probe = test_print_new_nbis (1, 7, -4);
+  g_autoptr(FpPrint) unknown = test_print_new_nbis (103, 0, 0);
+  g_autoptr(FpPrint) match = NULL;
+  g_autoptr(GError) error = NULL;
+  gint score = -1;
+
+  g_assert_true (fp_print_identify (probe, gallery, 0, &match, &score, &error));
+  g_assert_no_error (error);
+  g_assert_true (match == g_ptr_array_index (gallery, 1));
+  g_assert_cmpint (score, >=, BOZORTH3_DEFAULT_THRESHOLD);
+
+  g_clear_object (&match);
+  g_assert_true (fp_print_identify (unknown, gallery, 0, &match, &score, &error));
+  g_assert_no_error (error);
+  g_assert_null (match);
+
+  /* An impossible threshold never matches */
+  g_assert_true (fp_print_identify (probe, gallery, G_MAXINT, &match, NULL, &error));
+  g_assert_no_error (error);
+  g_assert_null (match);
+}
+
+static void
+test_print_identify_async_cb (GObject      *source_object,
+                              GAsyncResult *res,
+                              gpointer      user_data)
+{
+  FpPrint **match = user_data;
+  g_autoptr(GError) error = NULL;
+
+  g_assert_true (fp_print_identify_finish (FP_PRINT (source_object), res,
+                                           match, NULL, &error));
+  g_assert_no_error (error);
+  g_assert_nonnull (*match);
+}
+
+static void
+test_print_identify_async (void)
+{
+  g_autoptr(GPtrArray) gallery = test_gallery_new ();
+  g_autoptr(FpPrint) probe = test_print_new_nbis (1, 7, -4);
+  g_autoptr(FpPrint) match = NULL;
+
+  fp_print_identify_async (probe, gallery, 0, NULL,
+                           test_print_identify_async_cb, &match);
+
+  /* The gallery is copied, so it may be modified while matching */
+  g_ptr_array_set_size (gallery, 0);
+
+  while (!match)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_true (fp_print_match (probe, match, NULL, NULL));
+}
+
+static void
+test_print_identify_cancelled_cb (GObject      *source_object,
+                                  GAsyncResult *res,
+                                  gpointer      user_data)
+{
+  gboolean *done = user_data;
+  g_autoptr(GError) error = NULL;
+
+  g_assert_false (fp_print_identify_finish (FP_PRINT (source_object), res,
+                                            NULL, NULL, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  *done = TRUE;
+}
+
+static void
+test_print_identify_async_cancelled (void)
+{
+  g_autoptr(GPtrArray) gallery = test_gallery_new ();
+  g_autoptr(FpPrint) probe = test_print_new_nbis (1, 7, -4);
+  g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+  gboolean done = FALSE;
+
+  g_cancellable_cancel (cancellable);
+  fp_print_identify_async (probe, gallery, 0, cancellable,
+                           test_print_identify_cancelled_cb, &done);
+
+  while (!done)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/print/match", test_print_match);
+  g_test_add_func ("/print/match/min-quality", test_print_match_min_quality);
+  g_test_add_func ("/print/match/cache", test_print_match_cache);
+  g_test_add_func ("/print/match/raw", test_print_match_raw);
+  g_test_add_func ("/print/add-from-image/pruned", test_print_add_from_image_pruned);
+  g_test_add_func ("/print/fuse", test_print_fuse);
+  g_test_add_func ("/print/fuse/keep-stages", test_print_fuse_keep_stages);
+  g_test_add_func ("/print/serialize/nbis", test_print_serialize_nbis);
+  g_test_add_func ("/print/deserialize/nbis-without-quality", test_print_deserialize_nbis_without_quality);
+  g_test_add_func ("/print/identify", test_print_identify);
+  g_test_add_func ("/print/identify/async", test_print_identify_async);
+  g_test_add_func ("/print/identify/async/cancelled", test_print_identify_async_cancelled);
+
+  return g_test_run ();
+}
@@ -127,12 +127,43 @@ test_frame_assembling (void)
   g_assert (1);
 }
 
+static void
+test_line_buffer (void)
+{
+  g_autoptr(FpiLineBuffer) buffer = fpi_line_buffer_new (3, 2);
+  const guint8 line[3] = { 1, 2, 3 };
+  guint8 *free_line;
+
+  g_assert_cmpuint (buffer->num_lines, ==, 0);
+  g_assert_true (fpi_line_buffer_append (buffer, line));
+  g_assert_cmpmem (fpi_line_buffer_get_line (buffer, 0), 3, line, 3);
+
+  /* The free line is only stored once committed */
+  free_line = fpi_line_buffer_get_free_line (buffer);
+  g_assert_true (free_line == fpi_line_buffer_get_line (buffer, 1));
+  memset (free_line, 7, 3);
+  g_assert_cmpuint (buffer->num_lines, ==, 1);
+  g_assert_true (fpi_line_buffer_get_free_line (buffer) == free_line);
+  fpi_line_buffer_commit_line (buffer);
+  g_assert_cmpuint (buffer->num_lines, ==, 2);
+  g_assert_cmpuint (fpi_line_buffer_get_line (buffer, 1)[2], ==, 7);
+
+  /* Full */
+  g_assert_null (fpi_line_buffer_get_free_line (buffer));
+  g_assert_false (fpi_line_buffer_append (buffer, line));
+
+  fpi_line_buffer_clear (buffer);
+  g_assert_cmpuint (buffer->num_lines, ==, 0);
+  g_assert_nonnull (fpi_line_buffer_get_free_line (buffer));
+}
+
 int
 main (int argc, char *argv[])
 {
   g_test_init (&argc, &argv, NULL);
 
   g_test_add_func ("/assembling/frames", test_frame_assembling);
+  g_test_add_func ("/assembling/line_buffer", test_line_buffer);
 
   return g_test_run ();
 }
@@ -0,0 +1,61 @@
+/*
+ * Unit tests for the device enumeration helpers
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include "fpi-context.h"
+
+static void
+test_context_spi_acpi_id (void)
+{
+  g_autofree gchar *id = NULL;
+  g_autofree gchar *id_no_instance = NULL;
+  g_autofree gchar *id_first = NULL;
+  g_autofree gchar *id_none = NULL;
+
+  id = fpi_context_get_spi_acpi_id (
+    "/sys/devices/pci0000:00/0000:00:1e.3/pxa2xx-spi.3/spi_master/spi1/"
+    "spi-ELAN7001:00/spidev/spidev1.0");
+  /* The complete ID is returned and compared, a driver ID of "ELAN700"
+   * does not match this device (it used to be a substring match). */
+  g_assert_cmpstr (id, ==, "ELAN7001");
+
+  id_no_instance = fpi_context_get_spi_acpi_id (
+    "/sys/devices/platform/spi-ELAN70A1/spidev/spidev0.0");
+  g_assert_cmpstr (id_no_instance, ==, "ELAN70A1");
+
+  /* Only the first spi- component is used */
+  id_first = fpi_context_get_spi_acpi_id (
+    "/sys/devices/spi-FPC1020:01/spi-ELAN7001:00/spidev/spidev0.0");
+  g_assert_cmpstr (id_first, ==, "FPC1020");
+
+  /* spi_master and spidev components are not ACPI devices */
+  id_none = fpi_context_get_spi_acpi_id (
+    "/sys/devices/platform/spi_master/spi0/spidev/spidev0.0");
+  g_assert_null (id_none);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/context/spi-acpi-id", test_context_spi_acpi_id);
+
+  return g_test_run ();
+}
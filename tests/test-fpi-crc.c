@@ -0,0 +1,112 @@
+/*
+ * Unit tests for the protocol checksum helpers
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include "fpi-crc.h"
+
+#define CHECK_INPUT ((const guint8 *) "123456789")
+#define CHECK_LEN 9
+
+/* Bit by bit reference, as the goodixmoc driver used to do it */
+static guint32
+crc32_reference (const guint8 *data, gsize len)
+{
+  guint32 crc = 0xffffffff;
+  gsize i;
+  guint j;
+
+  for (i = 0; i < len; i++)
+    {
+      crc ^= data[i];
+      for (j = 0; j < 8; j++)
+        crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+    }
+
+  return ~crc;
+}
+
+static void
+test_crc_check_values (void)
+{
+  /* The standard check values of the respective CRC catalogue entries */
+  g_assert_cmphex (fpi_crc32 (0, CHECK_INPUT, CHECK_LEN), ==, 0xcbf43926);
+  g_assert_cmphex (fpi_crc16_ccitt (0, CHECK_INPUT, CHECK_LEN), ==, 0x31c3);
+  g_assert_cmphex (fpi_crc8 (0, CHECK_INPUT, CHECK_LEN), ==, 0xf4);
+
+  g_assert_cmphex (fpi_crc32 (0, NULL, 0), ==, 0);
+  g_assert_cmphex (fpi_crc16_ccitt (0, NULL, 0), ==, 0);
+  g_assert_cmphex (fpi_crc8 (0, NULL, 0), ==, 0);
+}
+
+static void
+test_crc_upek_packet (void)
+{
+  /* An acknowledgement sent by upektc_img devices, the CRC covers
+   * everything after the "Ciao" prefix and is stored little endian */
+  const guint8 ack[] = {
+    'C', 'i', 'a', 'o',
+    0x00, 0x80, 0x08, 0x28, 0x05, 0x00, 0x00, 0x00, 0x00, 0x30, 0x01,
+    0x6a, 0xc4,
+  };
+  guint16 crc = fpi_crc16_ccitt (0, ack + 4, sizeof (ack) - 6);
+
+  g_assert_cmphex (crc, ==, ack[sizeof (ack) - 1] << 8 | ack[sizeof (ack) - 2]);
+}
+
+static void
+test_crc32_slicing (void)
+{
+  guint8 data[259];
+  gsize start, len;
+
+  for (start = 0; start < G_N_ELEMENTS (data); start++)
+    data[start] = (start * 149 + 31) & 0xff;
+
+  /* Cover all alignments and tail lengths of the 8 byte steps */
+  for (start = 0; start < 16; start++)
+    for (len = 0; start + len <= G_N_ELEMENTS (data); len += 7)
+      g_assert_cmphex (fpi_crc32 (0, data + start, len), ==,
+                       crc32_reference (data + start, len));
+}
+
+static void
+test_crc_chaining (void)
+{
+  guint i;
+
+  for (i = 0; i <= CHECK_LEN; i++)
+    {
+      g_assert_cmphex (fpi_crc32 (fpi_crc32 (0, CHECK_INPUT, i), CHECK_INPUT + i, CHECK_LEN - i), ==, 0xcbf43926);
+      g_assert_cmphex (fpi_crc16_ccitt (fpi_crc16_ccitt (0, CHECK_INPUT, i), CHECK_INPUT + i, CHECK_LEN - i), ==, 0x31c3);
+      g_assert_cmphex (fpi_crc8 (fpi_crc8 (0, CHECK_INPUT, i), CHECK_INPUT + i, CHECK_LEN - i), ==, 0xf4);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/crc/check_values", test_crc_check_values);
+  g_test_add_func ("/crc/upek_packet", test_crc_upek_packet);
+  g_test_add_func ("/crc/crc32_slicing", test_crc32_slicing);
+  g_test_add_func ("/crc/chaining", test_crc_chaining);
+
+  return g_test_run ();
+}
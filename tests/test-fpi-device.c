@@ -911,6 +911,35 @@ test_driver_open (void)
   g_assert_no_error (error);
 }
 
+static void
+test_driver_open_worker_thread (void)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(FpDevice) device = NULL;
+  FpDeviceClass *dev_class;
+  FpiDeviceFake *fake_dev;
+
+  g_setenv ("FP_DEVICE_WORKER_THREAD", "1", TRUE);
+  device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  g_unsetenv ("FP_DEVICE_WORKER_THREAD");
+
+  dev_class = FP_DEVICE_GET_CLASS (device);
+  fake_dev = FPI_DEVICE_FAKE (device);
+
+  g_assert_true (fp_device_open_sync (device, NULL, &error));
+  g_assert (fake_dev->last_called_function == dev_class->open);
+  g_assert_no_error (error);
+  g_assert_true (fp_device_is_open (device));
+
+  /* The driver ran on its own context and the result was passed back */
+  g_assert_nonnull (fake_dev->last_called_context);
+  g_assert_false (fake_dev->last_called_context == g_main_context_default ());
+
+  g_assert_true (fp_device_close_sync (FP_DEVICE (device), NULL, &error));
+  g_assert_no_error (error);
+  g_assert_false (fp_device_is_open (device));
+}
+
 static void
 test_driver_open_error (void)
 {
@@ -1384,6 +1413,53 @@ test_driver_verify (void)
   g_assert_true (match);
 }
 
+static void
+fake_device_verify_finger_once (FpDevice *device)
+{
+  FpiDeviceFake *fake_dev = FPI_DEVICE_FAKE (device);
+  FpPrint *print;
+
+  /* Only the first verify sees a finger being placed */
+  if (!fake_dev->user_data)
+    {
+      fpi_device_report_finger_status (device, FP_FINGER_STATUS_PRESENT);
+      fake_dev->user_data = GUINT_TO_POINTER (TRUE);
+    }
+
+  fpi_device_get_verify_data (device, &print);
+  fpi_device_verify_report (device, FPI_MATCH_SUCCESS, print, NULL);
+  fpi_device_verify_complete (device, NULL);
+}
+
+static void
+test_driver_verify_result_timing (void)
+{
+  g_autoptr(FpAutoResetClass) dev_class = auto_reset_device_class ();
+  g_autoptr(FpAutoCloseDevice) device = NULL;
+  g_autoptr(FpPrint) enrolled_print = NULL;
+  g_autoptr(GVariant) stats = NULL;
+  g_autoptr(GVariant) result_stats = NULL;
+  guint64 count;
+
+  dev_class->verify = fake_device_verify_finger_once;
+  device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  enrolled_print = make_fake_print_reffed (device, NULL);
+
+  g_assert_true (fp_device_open_sync (device, NULL, NULL));
+  g_assert_true (fp_device_verify_sync (device, enrolled_print, NULL,
+                                        NULL, NULL, NULL, NULL, NULL));
+  fpi_device_report_finger_status (device, FP_FINGER_STATUS_NONE);
+  g_assert_true (fp_device_verify_sync (device, enrolled_print, NULL,
+                                        NULL, NULL, NULL, NULL, NULL));
+
+  /* The finger of the first verify must not be used for the second one */
+  stats = fp_device_get_statistics (device);
+  result_stats = g_variant_lookup_value (stats, "result", G_VARIANT_TYPE_VARDICT);
+  g_assert_nonnull (result_stats);
+  g_assert_true (g_variant_lookup (result_stats, "count", "t", &count));
+  g_assert_cmpuint (count, ==, 1);
+}
+
 static void
 test_driver_verify_not_supported (void)
 {
@@ -2723,6 +2799,260 @@ test_driver_cancel (void)
   g_assert (fake_dev->last_called_function == fake_device_delete_wait_for_cancel_timeout);
 }
 
+static FpAutoCloseDevice *
+auto_close_worker_fake_device_new (void)
+{
+  FpAutoCloseDevice *device;
+
+  g_setenv ("FP_DEVICE_WORKER_THREAD", "1", TRUE);
+  device = auto_close_fake_device_new ();
+  g_unsetenv ("FP_DEVICE_WORKER_THREAD");
+
+  return device;
+}
+
+typedef struct
+{
+  GThread *driver_thread;
+  GThread *callback_thread;
+  GThread *notify_thread;
+} WorkerThreadData;
+
+static void
+fake_device_probe_record_thread (FpDevice *device)
+{
+  FpiDeviceFake *fake_dev = FPI_DEVICE_FAKE (device);
+
+  fake_dev->user_data = g_thread_self ();
+  default_fake_dev_class.probe (device);
+}
+
+static void
+on_driver_probe_worker_thread_async (GObject *initable, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr(GError) error = NULL;
+  FpDevice **out_device = user_data;
+
+  *out_device = FP_DEVICE (g_async_initable_new_finish (G_ASYNC_INITABLE (initable), res, &error));
+  g_assert_no_error (error);
+}
+
+static void
+test_driver_probe_worker_thread (void)
+{
+  g_autoptr(FpAutoResetClass) dev_class = auto_reset_device_class ();
+  g_autoptr(FpDevice) device = NULL;
+
+  dev_class->id = "Probed device ID";
+  dev_class->full_name = "Probed device name";
+  dev_class->probe = fake_device_probe_record_thread;
+
+  g_setenv ("FP_DEVICE_WORKER_THREAD", "1", TRUE);
+  g_async_initable_new_async (FPI_TYPE_DEVICE_FAKE, G_PRIORITY_DEFAULT, NULL,
+                              on_driver_probe_worker_thread_async, &device, NULL);
+  g_unsetenv ("FP_DEVICE_WORKER_THREAD");
+
+  while (!FP_IS_DEVICE (device))
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_nonnull (FPI_DEVICE_FAKE (device)->user_data);
+  g_assert_false (FPI_DEVICE_FAKE (device)->user_data == g_thread_self ());
+  g_assert_cmpstr (fp_device_get_device_id (device), ==, "Probed device ID");
+  g_assert_cmpstr (fp_device_get_name (device), ==, "Probed device name");
+}
+
+static void
+fake_device_enroll_worker_thread (FpDevice *device)
+{
+  FpiDeviceFake *fake_dev = FPI_DEVICE_FAKE (device);
+  WorkerThreadData *data = fake_dev->user_data;
+
+  data->driver_thread = g_thread_self ();
+
+  fpi_device_report_finger_status_changes (device,
+                                           FP_FINGER_STATUS_PRESENT,
+                                           FP_FINGER_STATUS_NONE);
+  fpi_device_enroll_progress (device, 1, NULL, NULL);
+
+  default_fake_dev_class.enroll (device);
+}
+
+static void
+on_worker_thread_enroll_progress (FpDevice *device,
+                                  gint      completed_stages,
+                                  FpPrint  *print,
+                                  gpointer  user_data,
+                                  GError   *error)
+{
+  WorkerThreadData *data = user_data;
+
+  g_assert_cmpint (completed_stages, ==, 1);
+  data->callback_thread = g_thread_self ();
+}
+
+static void
+on_worker_thread_notify (FpDevice *device, GParamSpec *spec, gpointer user_data)
+{
+  WorkerThreadData *data = user_data;
+
+  g_assert_true (data->notify_thread == NULL ||
+                 data->notify_thread == g_thread_self ());
+  data->notify_thread = g_thread_self ();
+}
+
+static void
+test_driver_enroll_worker_thread (void)
+{
+  g_autoptr(FpAutoResetClass) dev_class = auto_reset_device_class ();
+  g_autoptr(FpAutoCloseDevice) device = NULL;
+  g_autoptr(FpPrint) template_print = NULL;
+  g_autoptr(GError) error = NULL;
+  WorkerThreadData data = { 0, };
+  FpiDeviceFake *fake_dev;
+  FpPrint *out_print = NULL;
+
+  dev_class->enroll = fake_device_enroll_worker_thread;
+
+  device = auto_close_worker_fake_device_new ();
+  fake_dev = FPI_DEVICE_FAKE (device);
+  fake_dev->user_data = &data;
+  template_print = fp_print_new (device);
+
+  g_signal_connect (device, "notify::finger-status",
+                    G_CALLBACK (on_worker_thread_notify), &data);
+
+  out_print = fp_device_enroll_sync (device, template_print, NULL,
+                                     on_worker_thread_enroll_progress, &data,
+                                     &error);
+  g_assert_no_error (error);
+  g_assert (out_print == template_print);
+
+  while (g_main_context_iteration (NULL, FALSE))
+    continue;
+
+  g_signal_handlers_disconnect_by_data (device, &data);
+  fake_dev->user_data = NULL;
+
+  /* The driver ran on the worker, everything reported back on this thread */
+  g_assert_nonnull (data.driver_thread);
+  g_assert_false (data.driver_thread == g_thread_self ());
+  g_assert_true (data.callback_thread == g_thread_self ());
+  g_assert_true (data.notify_thread == g_thread_self ());
+}
+
+static void
+fake_device_verify_worker_thread (FpDevice *device)
+{
+  FpiDeviceFake *fake_dev = FPI_DEVICE_FAKE (device);
+  WorkerThreadData *data = fake_dev->user_data;
+
+  data->driver_thread = g_thread_self ();
+  default_fake_dev_class.verify (device);
+}
+
+static void
+on_worker_thread_match (FpDevice *device,
+                        FpPrint  *match,
+                        FpPrint  *print,
+                        gpointer  user_data,
+                        GError   *error)
+{
+  WorkerThreadData *data = user_data;
+
+  g_assert_nonnull (match);
+  g_assert_no_error (error);
+  data->callback_thread = g_thread_self ();
+}
+
+static void
+test_driver_verify_worker_thread (void)
+{
+  g_autoptr(FpAutoResetClass) dev_class = auto_reset_device_class ();
+  g_autoptr(FpAutoCloseDevice) device = NULL;
+  g_autoptr(FpPrint) enrolled_print = NULL;
+  g_autoptr(FpPrint) out_print = NULL;
+  g_autoptr(GError) error = NULL;
+  WorkerThreadData data = { 0, };
+  FpiDeviceFake *fake_dev;
+  gboolean match;
+
+  dev_class->verify = fake_device_verify_worker_thread;
+
+  device = auto_close_worker_fake_device_new ();
+  fake_dev = FPI_DEVICE_FAKE (device);
+  fake_dev->user_data = &data;
+  fake_dev->ret_result = FPI_MATCH_SUCCESS;
+  enrolled_print = make_fake_print_reffed (device, NULL);
+
+  g_assert_true (fp_device_verify_sync (device, enrolled_print, NULL,
+                                        on_worker_thread_match, &data,
+                                        &match, &out_print, &error));
+  g_assert_no_error (error);
+  g_assert_true (match);
+  g_assert (out_print == enrolled_print);
+  fake_dev->user_data = NULL;
+
+  g_assert_nonnull (data.driver_thread);
+  g_assert_false (data.driver_thread == g_thread_self ());
+  g_assert_true (data.callback_thread == g_thread_self ());
+}
+
+static void
+fake_device_delete_worker_cancel_timeout (FpDevice *device,
+                                          gpointer  user_data)
+{
+  FpiDeviceFake *fake_dev = FPI_DEVICE_FAKE (device);
+  FpDeviceClass *dev_class = FP_DEVICE_GET_CLASS (device);
+
+  g_assert (fake_dev->last_called_function == dev_class->cancel);
+  fake_dev->user_data = g_thread_self ();
+
+  default_fake_dev_class.delete (device);
+}
+
+static void
+fake_device_delete_worker_wait_for_cancel (FpDevice *device)
+{
+  FpiDeviceFake *fake_dev = FPI_DEVICE_FAKE (device);
+
+  fake_dev->last_called_function = fake_device_delete_worker_wait_for_cancel;
+
+  /* Runs on the worker context, not the default one */
+  fpi_device_add_timeout (device, 100,
+                          fake_device_delete_worker_cancel_timeout,
+                          NULL, NULL);
+}
+
+static void
+test_driver_cancel_worker_thread (void)
+{
+  g_autoptr(FpAutoResetClass) dev_class = auto_reset_device_class ();
+  g_autoptr(FpAutoCloseDevice) device = NULL;
+  g_autoptr(GCancellable) cancellable = NULL;
+  g_autoptr(FpPrint) enrolled_print = NULL;
+  gboolean completed = FALSE;
+  FpiDeviceFake *fake_dev;
+
+  dev_class->delete = fake_device_delete_worker_wait_for_cancel;
+
+  device = auto_close_worker_fake_device_new ();
+  fake_dev = FPI_DEVICE_FAKE (device);
+  cancellable = g_cancellable_new ();
+  enrolled_print = make_fake_print_reffed (device, NULL);
+
+  fp_device_delete_print (device, enrolled_print, cancellable,
+                          on_driver_cancel_delete, &completed);
+  g_cancellable_cancel (cancellable);
+
+  while (!completed)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert (fake_dev->last_called_function == default_fake_dev_class.delete);
+  g_assert_nonnull (fake_dev->user_data);
+  g_assert_false (fake_dev->user_data == g_thread_self ());
+  fake_dev->user_data = NULL;
+}
+
 static void
 test_driver_cancel_fail (void)
 {
@@ -3421,6 +3751,7 @@ main (int argc, char *argv[])
   g_test_add_func ("/driver/probe/action_error", test_driver_probe_action_error);
   g_test_add_func ("/driver/open", test_driver_open);
   g_test_add_func ("/driver/open/error", test_driver_open_error);
+  g_test_add_func ("/driver/open/worker_thread", test_driver_open_worker_thread);
   g_test_add_func ("/driver/close", test_driver_close);
   g_test_add_func ("/driver/close/error", test_driver_close_error);
   g_test_add_func ("/driver/enroll", test_driver_enroll);
@@ -3435,6 +3766,7 @@ main (int argc, char *argv[])
   g_test_add_func ("/driver/enroll/update_nbis_missing_feature",
                    test_driver_enroll_update_nbis_missing_feature);
   g_test_add_func ("/driver/verify", test_driver_verify);
+  g_test_add_func ("/driver/verify/result_timing", test_driver_verify_result_timing);
   g_test_add_func ("/driver/verify/fail", test_driver_verify_fail);
   g_test_add_func ("/driver/verify/retry", test_driver_verify_retry);
   g_test_add_func ("/driver/verify/error", test_driver_verify_error);
@@ -3468,6 +3800,10 @@ main (int argc, char *argv[])
   g_test_add_func ("/driver/clear_storage", test_driver_clear_storage);
   g_test_add_func ("/driver/clear_storage/error", test_driver_clear_storage_error);
   g_test_add_func ("/driver/cancel", test_driver_cancel);
+  g_test_add_func ("/driver/probe/worker_thread", test_driver_probe_worker_thread);
+  g_test_add_func ("/driver/enroll/worker_thread", test_driver_enroll_worker_thread);
+  g_test_add_func ("/driver/verify/worker_thread", test_driver_verify_worker_thread);
+  g_test_add_func ("/driver/cancel/worker_thread", test_driver_cancel_worker_thread);
   g_test_add_func ("/driver/cancel/fail", test_driver_cancel_fail);
 
   g_test_add_func ("/driver/critical", test_driver_critical);
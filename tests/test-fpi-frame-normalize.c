@@ -0,0 +1,150 @@
+/*
+ * Unit tests for the sensor frame normalization helpers
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fpi-frame-normalize.h"
+
+#define FRAME_SIZE (96 * 96)
+
+static int
+cmp_u16 (const void *a, const void *b)
+{
+  return (int) (*(guint16 *) a - *(guint16 *) b);
+}
+
+/* The qsort based implementation that drivers used to have */
+static void
+normalize_reference (const guint16 *frame, gsize len, guint8 *out)
+{
+  g_autofree guint16 *sorted = g_new (guint16, len);
+  guint16 lvl0, lvl1, lvl2, lvl3;
+  gsize i;
+
+  memcpy (sorted, frame, len * sizeof (guint16));
+  qsort (sorted, len, sizeof (guint16), cmp_u16);
+  lvl0 = sorted[0];
+  lvl1 = sorted[len * 3 / 10];
+  lvl2 = sorted[len * 65 / 100];
+  lvl3 = sorted[len - 1];
+
+  for (i = 0; i < len; i++)
+    {
+      guint px = frame[i];
+
+      if (lvl0 <= px && px < lvl1)
+        px = (px - lvl0) * 99 / (lvl1 - lvl0);
+      else if (lvl1 <= px && px < lvl2)
+        px = 99 + ((px - lvl1) * 56 / (lvl2 - lvl1));
+      else
+        px = 155 + ((px - lvl2) * 100 / (lvl3 - lvl2));
+      out[i] = px;
+    }
+}
+
+static void
+test_frame_normalize_reference (void)
+{
+  static const guint16 permille[] = { 0, 300, 650, 1000 };
+  static const guint8 values[] = { 0, 99, 155, 255 };
+  static const guint ranges[] = { 16, 1 << 14, 60000 };
+  g_autofree FpiFrameNormalizeScratch *scratch = g_new (FpiFrameNormalizeScratch, 1);
+  g_autofree guint16 *frame = g_new (guint16, FRAME_SIZE);
+  g_autofree guint8 *expected = g_new (guint8, FRAME_SIZE);
+  g_autofree guint8 *out = g_new (guint8, FRAME_SIZE);
+  g_autoptr(GRand) rand = g_rand_new_with_seed (0x5eed);
+  guint r, run;
+
+  for (r = 0; r < G_N_ELEMENTS (ranges); r++)
+    {
+      for (run = 0; run < 10; run++)
+        {
+          gsize len = g_rand_int_range (rand, 16, FRAME_SIZE + 1);
+          guint16 offset = g_rand_int_range (rand, 0, 100);
+          gsize i;
+
+          for (i = 0; i < len; i++)
+            frame[i] = offset + g_rand_int_range (rand, 0, ranges[r]);
+          /* Guarantee non-empty segments, the reference divides by zero otherwise */
+          frame[0] = offset;
+          frame[1] = offset + ranges[r];
+
+          normalize_reference (frame, len, expected);
+          fpi_frame_normalize (frame, len, permille, values,
+                               G_N_ELEMENTS (permille), out, scratch);
+
+          g_assert_cmpmem (out, len, expected, len);
+        }
+    }
+}
+
+static void
+test_frame_normalize_levels (void)
+{
+  static const guint16 permille[] = { 0, 500, 1000 };
+  g_autofree FpiFrameNormalizeScratch *scratch = g_new (FpiFrameNormalizeScratch, 1);
+  guint16 frame[] = { 0x1234, 7, 0xffff, 0x1200, 0x1235 };
+  guint16 levels[G_N_ELEMENTS (permille)];
+
+  fpi_frame_normalize_get_levels (frame, G_N_ELEMENTS (frame), permille,
+                                  G_N_ELEMENTS (permille), levels, scratch);
+
+  g_assert_cmpuint (levels[0], ==, 7);
+  g_assert_cmpuint (levels[1], ==, 0x1234);
+  g_assert_cmpuint (levels[2], ==, 0xffff);
+}
+
+static void
+test_frame_subtract_background (void)
+{
+  guint16 frame[] = { 10, 20, 30, 40 };
+  const guint16 background[] = { 5, 25, 30, 0 };
+  guint8 frame_u8[] = { 10, 20, 30, 40 };
+  const guint8 background_u8[] = { 5, 18, 30, 0 };
+  guint64 sum;
+
+  g_assert_cmpuint (fpi_frame_subtract_background (frame, background,
+                                                   G_N_ELEMENTS (frame), &sum), ==, 1);
+  g_assert_cmpuint (sum, ==, 45);
+  g_assert_cmpuint (frame[0], ==, 5);
+  g_assert_cmpuint (frame[1], ==, 0);
+  g_assert_cmpuint (frame[2], ==, 0);
+  g_assert_cmpuint (frame[3], ==, 40);
+
+  g_assert_cmpuint (fpi_frame_subtract_background_u8 (frame_u8, background_u8, 3,
+                                                      G_N_ELEMENTS (frame_u8), &sum), ==, 2);
+  g_assert_cmpuint (sum, ==, 45);
+  g_assert_cmpuint (frame_u8[0], ==, 5);
+  g_assert_cmpuint (frame_u8[1], ==, 0);
+  g_assert_cmpuint (frame_u8[2], ==, 0);
+  g_assert_cmpuint (frame_u8[3], ==, 40);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/frame-normalize/reference", test_frame_normalize_reference);
+  g_test_add_func ("/frame-normalize/levels", test_frame_normalize_levels);
+  g_test_add_func ("/frame-normalize/background", test_frame_subtract_background);
+
+  return g_test_run ();
+}
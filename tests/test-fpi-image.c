@@ -0,0 +1,126 @@
+/*
+ * Unit tests for the image helpers
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include "fpi-image.h"
+
+static void
+test_sum_abs_diff (void)
+{
+  guint8 buf1[61], buf2[61];
+  guint expected = 0;
+  gint i;
+
+  /* Not a multiple of the block size, so the tail is covered too */
+  for (i = 0; i < G_N_ELEMENTS (buf1); i++)
+    {
+      buf1[i] = (i * 37) & 0xff;
+      buf2[i] = (i * 91 + 13) & 0xff;
+      expected += ABS ((gint) buf1[i] - (gint) buf2[i]);
+    }
+
+  g_assert_cmpuint (fpi_sum_abs_diff (buf1, buf2, G_N_ELEMENTS (buf1)), ==, expected);
+  g_assert_cmpuint (fpi_sum_abs_diff (buf2, buf1, G_N_ELEMENTS (buf1)), ==, expected);
+  g_assert_cmpuint (fpi_sum_abs_diff (buf1, buf1, G_N_ELEMENTS (buf1)), ==, 0);
+}
+
+static void
+test_line_stats (void)
+{
+  guint8 line[37], prev[37];
+  FpiLineStats stats;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (line); i++)
+    {
+      line[i] = (i * 53) & 0xff;
+      prev[i] = (i * 29 + 7) & 0xff;
+    }
+
+  fpi_get_line_stats (line, prev, G_N_ELEMENTS (line), &stats);
+  g_assert_cmpint (stats.sq_dev, ==, fpi_std_sq_dev (line, G_N_ELEMENTS (line)));
+  g_assert_cmpint (stats.sq_diff, ==, fpi_mean_sq_diff_norm (prev, line, G_N_ELEMENTS (line)));
+
+  fpi_get_line_stats (line, NULL, G_N_ELEMENTS (line), &stats);
+  g_assert_cmpint (stats.sq_diff, ==, 0);
+}
+
+static void
+test_unpack_4bpp (void)
+{
+  guint8 input[13], output[2 * G_N_ELEMENTS (input)];
+  guint i;
+
+  /* Odd size, so that the tail is covered as well */
+  for (i = 0; i < G_N_ELEMENTS (input); i++)
+    input[i] = (i * 37 + 5) & 0xff;
+
+  fpi_unpack_4bpp (input, G_N_ELEMENTS (input), output, FPI_UNPACK_4BPP_NONE);
+  for (i = 0; i < G_N_ELEMENTS (input); i++)
+    {
+      g_assert_cmpuint (output[2 * i], ==, (input[i] & 0x0f) * 17);
+      g_assert_cmpuint (output[2 * i + 1], ==, (input[i] >> 4) * 17);
+    }
+
+  fpi_unpack_4bpp (input, G_N_ELEMENTS (input), output,
+                   FPI_UNPACK_4BPP_HIGH_NIBBLE_FIRST | FPI_UNPACK_4BPP_SHIFT);
+  for (i = 0; i < G_N_ELEMENTS (input); i++)
+    {
+      g_assert_cmpuint (output[2 * i], ==, input[i] & 0xf0);
+      g_assert_cmpuint (output[2 * i + 1], ==, (input[i] << 4) & 0xff);
+    }
+}
+
+#define UNPACK_WIDTH 11
+#define UNPACK_HEIGHT 6
+
+static void
+test_unpack_4bpp_transposed (void)
+{
+  guint8 input[UNPACK_WIDTH * UNPACK_HEIGHT / 2];
+  guint8 output[UNPACK_WIDTH * UNPACK_HEIGHT];
+  guint i, x, y;
+
+  for (i = 0; i < G_N_ELEMENTS (input); i++)
+    input[i] = (i * 37 + 5) & 0xff;
+
+  fpi_unpack_4bpp_transposed (input, UNPACK_WIDTH, UNPACK_HEIGHT, output,
+                              FPI_UNPACK_4BPP_NONE);
+  for (y = 0; y < UNPACK_HEIGHT; y++)
+    for (x = 0; x < UNPACK_WIDTH; x++)
+      {
+        guint8 packed = input[x * (UNPACK_HEIGHT / 2) + y / 2];
+        guint8 px = y % 2 ? packed >> 4 : packed & 0x0f;
+
+        g_assert_cmpuint (output[y * UNPACK_WIDTH + x], ==, px * 17);
+      }
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/image/sum_abs_diff", test_sum_abs_diff);
+  g_test_add_func ("/image/line_stats", test_line_stats);
+  g_test_add_func ("/image/unpack_4bpp", test_unpack_4bpp);
+  g_test_add_func ("/image/unpack_4bpp_transposed", test_unpack_4bpp_transposed);
+
+  return g_test_run ();
+}
@@ -0,0 +1,253 @@
+/*
+ * Unit tests for the SPI transfer helpers
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <linux/spi/spidev.h>
+#include <string.h>
+#include "fpi-spi-transfer.h"
+#include "test-device-fake.h"
+
+/* Fake SPI_IOC_MESSAGE ioctl, records every call and can be held up so that
+ * further transfers are queued to the worker in the meantime. */
+static GMutex ioctl_mutex;
+static GCond ioctl_cond;
+static GPtrArray *ioctl_calls;
+static gboolean ioctl_hold;
+static gboolean ioctl_held;
+
+static int
+fake_spi_ioctl (int fd, guint n_transfers, struct spi_ioc_transfer *xfer)
+{
+  GArray *call = g_array_new (FALSE, FALSE, sizeof (struct spi_ioc_transfer));
+  int length = 0;
+  guint i;
+
+  g_array_append_vals (call, xfer, n_transfers);
+
+  for (i = 0; i < n_transfers; i++)
+    {
+      if (xfer[i].rx_buf)
+        memset ((guint8 *) (gsize) xfer[i].rx_buf, 0xa5, xfer[i].len);
+      length += xfer[i].len;
+    }
+
+  g_mutex_lock (&ioctl_mutex);
+  g_ptr_array_add (ioctl_calls, call);
+  ioctl_held = ioctl_hold;
+  g_cond_broadcast (&ioctl_cond);
+  while (ioctl_hold)
+    g_cond_wait (&ioctl_cond, &ioctl_mutex);
+  g_mutex_unlock (&ioctl_mutex);
+
+  return length;
+}
+
+static void
+fake_spi_ioctl_release (void)
+{
+  g_mutex_lock (&ioctl_mutex);
+  ioctl_hold = FALSE;
+  g_cond_broadcast (&ioctl_cond);
+  g_mutex_unlock (&ioctl_mutex);
+}
+
+static void
+fake_spi_ioctl_wait_held (void)
+{
+  g_mutex_lock (&ioctl_mutex);
+  while (!ioctl_held)
+    g_cond_wait (&ioctl_cond, &ioctl_mutex);
+  g_mutex_unlock (&ioctl_mutex);
+}
+
+static void
+on_spi_transfer_done (FpiSpiTransfer *transfer,
+                      FpDevice       *dev,
+                      gpointer        user_data,
+                      GError         *error)
+{
+  GPtrArray *completed = user_data;
+
+  /* Cancelled transfers are recorded as NULL */
+  if (error)
+    g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_ptr_array_add (completed, error ? NULL : transfer);
+
+  g_clear_error (&error);
+}
+
+static void
+test_spi_worker_batch (void)
+{
+  g_autoptr(FpDevice) device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  g_autoptr(GPtrArray) completed = g_ptr_array_new ();
+  g_autoptr(GCancellable) cancelled = g_cancellable_new ();
+  FpiSpiTransfer *first, *second, *skipped, *third;
+  struct spi_ioc_transfer *xfer;
+  GArray *call;
+
+  ioctl_calls = g_ptr_array_new_with_free_func ((GDestroyNotify) g_array_unref);
+  fpi_spi_transfer_set_ioctl_func (fake_spi_ioctl);
+
+  first = fpi_spi_transfer_new (device, 42);
+  fpi_spi_transfer_write (first, 2);
+  fpi_spi_transfer_read (first, 4);
+
+  second = fpi_spi_transfer_new (device, 42);
+  fpi_spi_transfer_write (second, 2);
+
+  skipped = fpi_spi_transfer_new (device, 42);
+  fpi_spi_transfer_write (skipped, 2);
+  g_cancellable_cancel (cancelled);
+
+  third = fpi_spi_transfer_new (device, 42);
+  fpi_spi_transfer_write (third, 1);
+  fpi_spi_transfer_read (third, 8);
+
+  /* Hold up the first transfer in the worker while the others are queued */
+  ioctl_hold = TRUE;
+  fpi_spi_transfer_submit (first, NULL, on_spi_transfer_done, completed);
+  fake_spi_ioctl_wait_held ();
+
+  fpi_spi_transfer_submit (second, NULL, on_spi_transfer_done, completed);
+  fpi_spi_transfer_submit (skipped, cancelled, on_spi_transfer_done, completed);
+  fpi_spi_transfer_submit (third, NULL, on_spi_transfer_done, completed);
+  fake_spi_ioctl_release ();
+
+  while (completed->len < 4)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* Completion is reported in submission order */
+  g_assert_true (g_ptr_array_remove (completed, NULL));
+  g_assert_true (g_ptr_array_index (completed, 0) == first);
+  g_assert_true (g_ptr_array_index (completed, 1) == second);
+  g_assert_true (g_ptr_array_index (completed, 2) == third);
+
+  /* The transfers queued in the meantime were combined into one ioctl, the
+   * cancelled one was never started. */
+  g_assert_cmpuint (ioctl_calls->len, ==, 2);
+
+  call = g_ptr_array_index (ioctl_calls, 0);
+  g_assert_cmpuint (call->len, ==, 2);
+
+  call = g_ptr_array_index (ioctl_calls, 1);
+  xfer = (struct spi_ioc_transfer *) call->data;
+  g_assert_cmpuint (call->len, ==, 3);
+  g_assert_cmpuint (xfer[0].len, ==, 2);
+  g_assert_true (xfer[0].cs_change);
+  g_assert_cmpuint (xfer[1].len, ==, 1);
+  g_assert_false (xfer[1].cs_change);
+  g_assert_cmpuint (xfer[2].len, ==, 8);
+  g_assert_false (xfer[2].cs_change);
+
+  ioctl_held = FALSE;
+  fpi_spi_transfer_set_ioctl_func (NULL);
+  g_clear_pointer (&ioctl_calls, g_ptr_array_unref);
+}
+
+static void
+assert_plan (GArray *ends, const guint *expected, guint n_expected)
+{
+  g_assert_nonnull (ends);
+  g_assert_cmpmem (ends->data, ends->len * sizeof (guint),
+                   expected, n_expected * sizeof (guint));
+}
+
+static void
+test_spi_plan_segments (void)
+{
+  g_autoptr(FpDevice) device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  g_autoptr(FpiSpiTransfer) transfer = fpi_spi_transfer_new (device, -1);
+  g_autoptr(GArray) combined = NULL;
+  g_autoptr(GArray) by_length = NULL;
+  g_autoptr(GArray) by_segments = NULL;
+  g_autoptr(GArray) per_group = NULL;
+  const guint8 cmd[4] = { 0 };
+  const guint expected_combined[] = { 5 };
+  const guint expected_by_length[] = { 3, 5 };
+  const guint expected_by_segments[] = { 2, 3, 5 };
+  const guint expected_per_group[] = { 2, 3, 5 };
+
+  /* Groups of 2 + 4, 4 and 2 + 4 bytes, the last cs_change is implied */
+  fpi_spi_transfer_add_write (transfer, cmd, 2, FALSE);
+  fpi_spi_transfer_add_read (transfer, 4, TRUE);
+  fpi_spi_transfer_add_write (transfer, cmd, 4, TRUE);
+  fpi_spi_transfer_add_write (transfer, cmd, 2, FALSE);
+  fpi_spi_transfer_add_read (transfer, 4, FALSE);
+
+  combined = fpi_spi_transfer_plan_segments (transfer, 4096, 256, FALSE, NULL);
+  assert_plan (combined, expected_combined, G_N_ELEMENTS (expected_combined));
+
+  /* Groups are combined while they fit, but never split */
+  by_length = fpi_spi_transfer_plan_segments (transfer, 10, 256, FALSE, NULL);
+  assert_plan (by_length, expected_by_length, G_N_ELEMENTS (expected_by_length));
+
+  by_segments = fpi_spi_transfer_plan_segments (transfer, 4096, 2, FALSE, NULL);
+  assert_plan (by_segments, expected_by_segments, G_N_ELEMENTS (expected_by_segments));
+
+  per_group = fpi_spi_transfer_plan_segments (transfer, 4096, 256, TRUE, NULL);
+  assert_plan (per_group, expected_per_group, G_N_ELEMENTS (expected_per_group));
+}
+
+static void
+test_spi_plan_segments_too_large (void)
+{
+  g_autoptr(FpDevice) device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  g_autoptr(FpiSpiTransfer) transfer = fpi_spi_transfer_new (device, -1);
+  g_autoptr(FpiSpiTransfer) many = fpi_spi_transfer_new (device, -1);
+  g_autoptr(GArray) ends = NULL;
+  g_autoptr(GArray) ends_many = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GError) error_many = NULL;
+  const guint8 cmd[2] = { 0 };
+  guint i;
+
+  /* A single group larger than one block */
+  fpi_spi_transfer_add_write (transfer, cmd, 2, TRUE);
+  fpi_spi_transfer_add_write (transfer, cmd, 2, FALSE);
+  fpi_spi_transfer_add_read (transfer, 4096, TRUE);
+
+  ends = fpi_spi_transfer_plan_segments (transfer, 4096, 256, FALSE, &error);
+  g_assert_null (ends);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE);
+
+  /* A single group with more segments than one ioctl may carry */
+  for (i = 0; i < 512; i++)
+    fpi_spi_transfer_add_write (many, cmd, 1, FALSE);
+
+  ends_many = fpi_spi_transfer_plan_segments (many, 4096, 256, FALSE, &error_many);
+  g_assert_null (ends_many);
+  g_assert_error (error_many, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  /* Transfers are not combined under emulation */
+  g_unsetenv ("FP_DEVICE_EMULATION");
+
+  g_test_add_func ("/spi-transfer/segments/plan", test_spi_plan_segments);
+  g_test_add_func ("/spi-transfer/segments/too-large", test_spi_plan_segments_too_large);
+  g_test_add_func ("/spi-transfer/worker/batch", test_spi_worker_batch);
+
+  return g_test_run ();
+}
@@ -1311,6 +1311,150 @@ test_ssm_cleanup_fail (void)
   g_assert_true (data->ssm_destroyed);
 }
 
+static void
+test_ssm_pool_reuse (void)
+{
+  FpiSsm *ssm;
+  FpiSsm *reused;
+
+  ssm = fpi_ssm_new (fake_device, test_ssm_handler, FPI_TEST_SSM_STATE_NUM);
+  fpi_ssm_set_data (ssm, fpi_ssm_test_data_new (), (GDestroyNotify) fpi_ssm_test_data_unref);
+  fpi_ssm_free (ssm);
+
+  /* The freed machine is taken from the free-list and fully reset */
+  reused = fpi_ssm_new_full (fake_device, test_ssm_handler,
+                             FPI_TEST_SSM_STATE_NUM, FPI_TEST_SSM_STATE_2,
+                             "FPI_TEST_SSM_REUSED");
+  g_assert_true (reused == ssm);
+  g_assert_null (fpi_ssm_get_data (reused));
+  g_assert_no_error (fpi_ssm_get_error (reused));
+  g_assert_cmpint (fpi_ssm_get_cur_state (reused), ==, FPI_TEST_SSM_STATE_0);
+
+  fpi_ssm_free (reused);
+}
+
+static void
+test_ssm_delayed_source_reuse (void)
+{
+  FpiSsm *ssm = ssm_test_new ();
+  g_autoptr(FpiSsmTestData) data = fpi_ssm_test_data_ref (fpi_ssm_get_data (ssm));
+  GSource *source;
+
+  fpi_ssm_start (ssm, test_ssm_completed_callback);
+
+  fpi_ssm_next_state_delayed (ssm, 1);
+  source = g_main_context_find_source_by_user_data (NULL, ssm);
+  g_assert_nonnull (source);
+
+  while (data->handler_state != FPI_TEST_SSM_STATE_1)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* All delayed transitions of a machine share one timeout source */
+  fpi_ssm_jump_to_state_delayed (ssm, FPI_TEST_SSM_STATE_3, 1);
+  g_assert_true (g_main_context_find_source_by_user_data (NULL, ssm) == source);
+
+  while (data->handler_state != FPI_TEST_SSM_STATE_3)
+    g_main_context_iteration (NULL, TRUE);
+
+  data->expected_last_state = FPI_TEST_SSM_STATE_3;
+  fpi_ssm_mark_completed_delayed (ssm, 1);
+  g_assert_true (g_main_context_find_source_by_user_data (NULL, ssm) == source);
+
+  while (!data->completed)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_true (data->ssm_destroyed);
+  g_assert_no_error (data->error);
+  g_assert_cmpuint (g_slist_length (data->handlers_chain), ==, 4);
+
+  /* The disarmed source is kept by the machine on the free-list */
+  g_assert_true (g_main_context_find_source_by_user_data (NULL, ssm) == source);
+  g_assert_cmpint (g_source_get_ready_time (source), ==, -1);
+
+  ssm = fpi_ssm_new (fake_device, test_ssm_handler, FPI_TEST_SSM_STATE_NUM);
+  fpi_ssm_set_data (ssm, fpi_ssm_test_data_ref (data),
+                    (GDestroyNotify) fpi_ssm_test_data_unref_by_ssm);
+  data->completed = FALSE;
+  data->ssm_destroyed = FALSE;
+  data->expected_last_state = FPI_TEST_SSM_STATE_0;
+  fpi_ssm_start (ssm, test_ssm_completed_callback);
+
+  fpi_ssm_mark_completed_delayed (ssm, 1);
+  g_assert_true (g_main_context_find_source_by_user_data (NULL, ssm) == source);
+
+  while (!data->completed)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+test_ssm_perf_handler (FpiSsm   *ssm,
+                       FpDevice *dev)
+{
+  /* Every other transition is a delayed one */
+  if (fpi_ssm_get_cur_state (ssm) % 2 == 0)
+    fpi_ssm_next_state_delayed (ssm, 0);
+  else
+    fpi_ssm_next_state (ssm);
+}
+
+static void
+test_ssm_perf_completed (FpiSsm   *ssm,
+                         FpDevice *dev,
+                         GError   *error)
+{
+  gboolean *completed = fpi_ssm_get_data (ssm);
+
+  g_assert_no_error (error);
+  *completed = TRUE;
+}
+
+static void
+test_ssm_perf_transitions (void)
+{
+  const guint iterations = 100000;
+  g_autoptr(GTimer) timer = NULL;
+  FpiSsm *first = NULL;
+  GSource *source = NULL;
+  gdouble per_transition;
+  guint i;
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("Only run in performance mode");
+      return;
+    }
+
+  timer = g_timer_new ();
+  for (i = 0; i < iterations; i++)
+    {
+      FpiSsm *ssm = fpi_ssm_new (fake_device, test_ssm_perf_handler,
+                                 FPI_TEST_SSM_STATE_NUM);
+      gboolean completed = FALSE;
+
+      /* After the first iteration neither a new machine nor a new timeout
+       * source is allocated */
+      if (!first)
+        first = ssm;
+      g_assert_true (ssm == first);
+
+      fpi_ssm_set_data (ssm, &completed, NULL);
+      fpi_ssm_silence_debug (ssm);
+      fpi_ssm_start (ssm, test_ssm_perf_completed);
+
+      if (!source)
+        source = g_main_context_find_source_by_user_data (NULL, ssm);
+      g_assert_true (g_main_context_find_source_by_user_data (NULL, ssm) == source);
+
+      while (!completed)
+        g_main_context_iteration (NULL, TRUE);
+    }
+  g_timer_stop (timer);
+
+  per_transition = g_timer_elapsed (timer, NULL) * G_USEC_PER_SEC /
+                   (iterations * FPI_TEST_SSM_STATE_NUM);
+  g_test_minimized_result (per_transition, "%.3f µs per state transition", per_transition);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -1364,6 +1508,9 @@ main (int argc, char *argv[])
   g_test_add_func ("/ssm/subssm/mark_failed", test_ssm_subssm_mark_failed);
   g_test_add_func ("/ssm/cleanup/complete", test_ssm_cleanup_complete);
   g_test_add_func ("/ssm/cleanup/fail", test_ssm_cleanup_fail);
+  g_test_add_func ("/ssm/pool/reuse", test_ssm_pool_reuse);
+  g_test_add_func ("/ssm/delayed/source_reuse", test_ssm_delayed_source_reuse);
+  g_test_add_func ("/ssm/perf/transitions", test_ssm_perf_transitions);
 
   return g_test_run ();
 }
@@ -0,0 +1,358 @@
+/*
+ * Unit tests for the USB transfer helpers
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <string.h>
+#include "fpi-usb-transfer.h"
+#include "test-device-fake.h"
+
+#define STREAM_ENDPOINT (0x01 | FPI_USB_ENDPOINT_IN)
+#define STREAM_LENGTH 16
+
+/* Transfers that the stream submitted, completed by the tests in any order */
+typedef struct
+{
+  FpiUsbTransfer        *transfer;
+  GCancellable          *cancellable;
+  FpiUsbTransferCallback callback;
+  gpointer               user_data;
+} FakeSubmission;
+
+static GPtrArray *submissions = NULL;
+
+static void
+fake_submit (FpiUsbTransfer        *transfer,
+             guint                  timeout_ms,
+             GCancellable          *cancellable,
+             FpiUsbTransferCallback callback,
+             gpointer               user_data)
+{
+  FakeSubmission *submission = g_new0 (FakeSubmission, 1);
+
+  submission->transfer = transfer;
+  submission->cancellable = cancellable;
+  submission->callback = callback;
+  submission->user_data = user_data;
+
+  g_ptr_array_add (submissions, submission);
+}
+
+static void
+fake_complete (guint index, guint8 data, GError *error)
+{
+  FakeSubmission *submission;
+  FpiUsbTransfer *transfer;
+
+  g_assert_cmpuint (index, <, submissions->len);
+  submission = g_ptr_array_remove_index (submissions, index);
+  transfer = submission->transfer;
+
+  if (error)
+    {
+      transfer->actual_length = -1;
+    }
+  else
+    {
+      memset (transfer->buffer, data, transfer->length);
+      transfer->actual_length = transfer->length;
+    }
+
+  submission->callback (transfer, transfer->device, submission->user_data, error);
+  fpi_usb_transfer_unref (transfer);
+  g_free (submission);
+}
+
+static void
+fake_complete_cancelled (guint index)
+{
+  FakeSubmission *submission = g_ptr_array_index (submissions, index);
+
+  g_assert_true (g_cancellable_is_cancelled (submission->cancellable));
+  fake_complete (index, 0,
+                 g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED, "Cancelled"));
+}
+
+typedef struct
+{
+  GByteArray *received;
+  gboolean    done;
+  GError     *error;
+} StreamData;
+
+static void
+stream_data_clear (StreamData *data)
+{
+  g_clear_pointer (&data->received, g_byte_array_unref);
+  g_clear_error (&data->error);
+}
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (StreamData, stream_data_clear)
+
+static void
+on_stream_data (FpiUsbStream   *stream,
+                FpiUsbTransfer *transfer,
+                FpDevice       *dev,
+                gpointer        user_data)
+{
+  StreamData *data = user_data;
+
+  g_assert_cmpint (transfer->actual_length, ==, STREAM_LENGTH);
+  g_byte_array_append (data->received, transfer->buffer, 1);
+}
+
+static void
+on_stream_done (FpiUsbStream *stream,
+                FpDevice     *dev,
+                gpointer      user_data,
+                GError       *error)
+{
+  StreamData *data = user_data;
+
+  g_assert_false (data->done);
+  data->done = TRUE;
+  data->error = error;
+}
+
+static FpiUsbStream *
+fake_stream_new (FpDevice *device, guint n_transfers)
+{
+  FpiUsbStream *stream;
+
+  stream = fpi_usb_stream_new (device, STREAM_ENDPOINT, STREAM_LENGTH, n_transfers);
+  fpi_usb_stream_set_submit_func (stream, fake_submit);
+
+  return stream;
+}
+
+static void
+test_usb_stream_order (void)
+{
+  g_autoptr(FpDevice) device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  g_autoptr(FpiUsbStream) stream = fake_stream_new (device, 3);
+  g_auto(StreamData) data = { g_byte_array_new (), };
+
+  fpi_usb_stream_start (stream, 0, NULL, on_stream_data, on_stream_done, &data);
+  g_assert_true (fpi_usb_stream_is_active (stream));
+  g_assert_cmpuint (submissions->len, ==, 3);
+
+  /* Nothing is delivered until the first submitted transfer is done */
+  fake_complete (2, 3, NULL);
+  fake_complete (1, 2, NULL);
+  g_assert_cmpuint (data.received->len, ==, 0);
+
+  fake_complete (0, 1, NULL);
+  g_assert_cmpuint (data.received->len, ==, 3);
+  g_assert_cmpuint (data.received->data[0], ==, 1);
+  g_assert_cmpuint (data.received->data[1], ==, 2);
+  g_assert_cmpuint (data.received->data[2], ==, 3);
+
+  /* All transfers were resubmitted */
+  g_assert_cmpuint (submissions->len, ==, 3);
+
+  fpi_usb_stream_stop (stream, NULL);
+  g_assert_true (fpi_usb_stream_is_active (stream));
+
+  fake_complete_cancelled (0);
+  fake_complete_cancelled (0);
+  g_assert_false (data.done);
+  fake_complete_cancelled (0);
+
+  g_assert_true (data.done);
+  g_assert_no_error (data.error);
+  g_assert_false (fpi_usb_stream_is_active (stream));
+  g_assert_cmpuint (data.received->len, ==, 3);
+}
+
+static void
+test_usb_stream_cancel (void)
+{
+  g_autoptr(FpDevice) device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  g_autoptr(FpiUsbStream) stream = fake_stream_new (device, 4);
+  g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+  g_auto(StreamData) data = { g_byte_array_new (), };
+  guint i;
+
+  fpi_usb_stream_start (stream, 0, cancellable, on_stream_data, on_stream_done, &data);
+  fake_complete (0, 1, NULL);
+  g_assert_cmpuint (data.received->len, ==, 1);
+  g_assert_cmpuint (submissions->len, ==, 4);
+
+  g_cancellable_cancel (cancellable);
+  for (i = 0; i < submissions->len; i++)
+    {
+      FakeSubmission *submission = g_ptr_array_index (submissions, i);
+
+      g_assert_true (g_cancellable_is_cancelled (submission->cancellable));
+    }
+
+  /* Return in reverse order, the stream only finishes with the last one */
+  while (submissions->len > 1)
+    {
+      fake_complete_cancelled (submissions->len - 1);
+      g_assert_false (data.done);
+    }
+  fake_complete_cancelled (0);
+
+  g_assert_true (data.done);
+  g_assert_error (data.error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_false (fpi_usb_stream_is_active (stream));
+  g_assert_cmpuint (data.received->len, ==, 1);
+}
+
+static void
+test_usb_stream_error (void)
+{
+  g_autoptr(FpDevice) device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  g_autoptr(FpiUsbStream) stream = fake_stream_new (device, 3);
+  g_auto(StreamData) data = { g_byte_array_new (), };
+
+  fpi_usb_stream_start (stream, 0, NULL, on_stream_data, on_stream_done, &data);
+
+  /* The second transfer fails before the first one is done */
+  fake_complete (1, 0, g_error_new_literal (G_IO_ERROR, G_IO_ERROR_FAILED, "Failed"));
+  g_assert_cmpuint (data.received->len, ==, 0);
+  g_assert_false (data.done);
+
+  /* The first one is still delivered, the error then stops the stream */
+  fake_complete (0, 1, NULL);
+  g_assert_cmpuint (data.received->len, ==, 1);
+  g_assert_cmpuint (data.received->data[0], ==, 1);
+  g_assert_cmpuint (submissions->len, ==, 2);
+  g_assert_false (data.done);
+
+  fake_complete_cancelled (0);
+  fake_complete_cancelled (0);
+
+  g_assert_true (data.done);
+  g_assert_error (data.error, G_IO_ERROR, G_IO_ERROR_FAILED);
+  g_assert_false (fpi_usb_stream_is_active (stream));
+  g_assert_cmpuint (data.received->len, ==, 1);
+}
+
+static FpiUsbTransfer *
+pooled_transfer_new (FpDevice *device, guint8 endpoint, gsize length)
+{
+  FpiUsbTransfer *transfer = fpi_usb_transfer_new (device);
+
+  fpi_usb_transfer_fill_bulk_pooled (transfer, endpoint, length);
+  g_assert_nonnull (transfer->buffer);
+  g_assert_cmpint (transfer->length, ==, length);
+
+  return transfer;
+}
+
+static void
+test_usb_pool_reuse (void)
+{
+  g_autoptr(FpDevice) device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  FpiUsbTransfer *transfer;
+  FpiUsbTransfer *other;
+  guint8 *buffer;
+  guint8 *other_buffer;
+  gsize i;
+
+  transfer = pooled_transfer_new (device, STREAM_ENDPOINT, 64);
+  buffer = transfer->buffer;
+  memset (buffer, 0xff, 64);
+  fpi_usb_transfer_unref (transfer);
+
+  /* The buffer is handed out again, IN buffers are not cleared */
+  transfer = pooled_transfer_new (device, STREAM_ENDPOINT, 64);
+  g_assert_true (transfer->buffer == buffer);
+  g_assert_cmpuint (transfer->buffer[63], ==, 0xff);
+
+  /* Only one transfer can use a buffer at a time */
+  other = pooled_transfer_new (device, STREAM_ENDPOINT, 64);
+  other_buffer = other->buffer;
+  g_assert_false (other_buffer == buffer);
+  fpi_usb_transfer_unref (other);
+  fpi_usb_transfer_unref (transfer);
+
+  /* OUT buffers are zeroed */
+  transfer = pooled_transfer_new (device, 0x01, 64);
+  g_assert_true (transfer->buffer == buffer || transfer->buffer == other_buffer);
+  for (i = 0; i < 64; i++)
+    g_assert_cmpuint (transfer->buffer[i], ==, 0);
+  fpi_usb_transfer_unref (transfer);
+}
+
+static void
+test_usb_pool_size_mismatch (void)
+{
+  g_autoptr(FpDevice) device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  FpiUsbTransfer *transfer;
+  guint8 *buffer;
+
+  transfer = pooled_transfer_new (device, STREAM_ENDPOINT, 64);
+  buffer = transfer->buffer;
+  fpi_usb_transfer_unref (transfer);
+
+  /* A pooled buffer is only reused for the exact same length */
+  transfer = pooled_transfer_new (device, STREAM_ENDPOINT, 32);
+  g_assert_false (transfer->buffer == buffer);
+  memset (transfer->buffer, 0, 32);
+  fpi_usb_transfer_unref (transfer);
+
+  transfer = pooled_transfer_new (device, STREAM_ENDPOINT, 128);
+  g_assert_false (transfer->buffer == buffer);
+  memset (transfer->buffer, 0, 128);
+  fpi_usb_transfer_unref (transfer);
+
+  /* And the buffer of the first size class was kept */
+  transfer = pooled_transfer_new (device, STREAM_ENDPOINT, 64);
+  g_assert_true (transfer->buffer == buffer);
+  fpi_usb_transfer_unref (transfer);
+}
+
+static void
+test_usb_pool_device_gone (void)
+{
+  FpDevice *device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  FpiUsbTransfer *transfer;
+  FpiUsbTransfer *released;
+
+  released = pooled_transfer_new (device, STREAM_ENDPOINT, 64);
+  fpi_usb_transfer_unref (released);
+  transfer = pooled_transfer_new (device, STREAM_ENDPOINT, 64);
+  memset (transfer->buffer, 0, 64);
+
+  /* The pool goes away with the device, the buffer that is still in use is
+   * freed when it is released (checked by running under valgrind). */
+  g_object_unref (device);
+  fpi_usb_transfer_unref (transfer);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  /* Streams only use one transfer under emulation */
+  g_unsetenv ("FP_DEVICE_EMULATION");
+  submissions = g_ptr_array_new ();
+
+  g_test_add_func ("/usb-transfer/stream/order", test_usb_stream_order);
+  g_test_add_func ("/usb-transfer/stream/cancel", test_usb_stream_cancel);
+  g_test_add_func ("/usb-transfer/stream/error", test_usb_stream_error);
+  g_test_add_func ("/usb-transfer/pool/reuse", test_usb_pool_reuse);
+  g_test_add_func ("/usb-transfer/pool/size-mismatch", test_usb_pool_size_mismatch);
+  g_test_add_func ("/usb-transfer/pool/device-gone", test_usb_pool_device_gone);
+
+  return g_test_run ();
+}
@@ -239,6 +239,53 @@ class VirtualImage(unittest.TestCase):
 
         return self._enrolled
 
+    def test_enroll_pipelined(self):
+        self._steps = []
+        self._needed = 0
+        self._was_needed = False
+        self._enrolled = None
+
+        def finger_status_cb(dev, pspec):
+            needed = bool(dev.get_finger_status() & FPrint.FingerStatusFlags.NEEDED)
+            if needed and not self._was_needed:
+                self._needed += 1
+            self._was_needed = needed
+
+        def progress_cb(dev, step, fp, user_data):
+            self._steps.append(step)
+
+        def done_cb(dev, res):
+            self._enrolled = dev.enroll_finish(res)
+
+        handler = self.dev.connect('notify::finger-status', finger_status_cb)
+        template = FPrint.Print.new(self.dev)
+        self.dev.enroll(template, None, progress_cb, tuple(), done_cb)
+
+        # Send the next image as soon as the device asks for the finger,
+        # the minutiae scan of the previous one may still be running.
+        # Note: Assumes 5 enroll steps for this device!
+        for i in range(5):
+            while self._needed <= i:
+                ctx.iteration(True)
+            self.send_image('whorl')
+
+        while self._enrolled is None:
+            ctx.iteration(True)
+        self.dev.disconnect(handler)
+
+        self.assertEqual(self._steps, [1, 2, 3, 4, 5])
+        self.assertEqual(self.dev.get_finger_status(), FPrint.FingerStatusFlags.NONE)
+
+        self._verify_match = None
+        def verify_cb(dev, res):
+            self._verify_match, fp = dev.verify_finish(res)
+
+        self.dev.verify(self._enrolled, callback=verify_cb)
+        self.send_image('whorl')
+        while self._verify_match is None:
+            ctx.iteration(True)
+        assert(self._verify_match)
+
     def test_enroll_verify(self):
         done = False
 